@@ -134,6 +134,34 @@ asm_x64_emit_inturbo_check_interrupt(struct util_buffer* p_buf) {
                      asm_x64_inturbo_call_interp);
 }
 
+void
+asm_x64_emit_inturbo_tier_check(struct util_buffer* p_buf) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf,
+               asm_x64_inturbo_tier_check,
+               asm_x64_inturbo_tier_check_END);
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_inturbo_tier_check,
+                     asm_x64_inturbo_tier_check_jb_patch,
+                     asm_x64_inturbo_tier_exit);
+}
+
+void
+asm_x64_emit_inturbo_tier_invalidate(struct util_buffer* p_buf,
+                                     int is_based) {
+  if (is_based) {
+    asm_x64_copy(p_buf,
+                 asm_x64_inturbo_tier_invalidate_based,
+                 asm_x64_inturbo_tier_invalidate_based_END);
+  } else {
+    asm_x64_copy(p_buf,
+                 asm_x64_inturbo_tier_invalidate,
+                 asm_x64_inturbo_tier_invalidate_END);
+  }
+}
+
 void
 asm_x64_emit_inturbo_advance_pc_and_next(struct util_buffer* p_buf,
                                          uint8_t advance) {
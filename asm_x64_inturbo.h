@@ -13,6 +13,9 @@ void asm_x64_emit_inturbo_check_countdown_with_page_crossing(
     struct util_buffer* p_buf, uint8_t opcycles);
 void asm_x64_emit_inturbo_check_decimal(struct util_buffer* p_buf);
 void asm_x64_emit_inturbo_check_interrupt(struct util_buffer* p_buf);
+void asm_x64_emit_inturbo_tier_check(struct util_buffer* p_buf);
+void asm_x64_emit_inturbo_tier_invalidate(struct util_buffer* p_buf,
+                                          int is_based);
 void asm_x64_emit_inturbo_advance_pc_and_next(struct util_buffer* p_buf,
                                               uint8_t advance);
 void asm_x64_emit_inturbo_enter_debug(struct util_buffer* p_buf);
@@ -160,6 +163,14 @@ void asm_x64_inturbo_call_interp();
 void asm_x64_inturbo_call_interp_countdown();
 void asm_x64_inturbo_enter_debug();
 void asm_x64_inturbo_enter_debug_END();
+void asm_x64_inturbo_tier_check();
+void asm_x64_inturbo_tier_check_END();
+void asm_x64_inturbo_tier_check_jb_patch();
+void asm_x64_inturbo_tier_invalidate();
+void asm_x64_inturbo_tier_invalidate_END();
+void asm_x64_inturbo_tier_invalidate_based();
+void asm_x64_inturbo_tier_invalidate_based_END();
+void asm_x64_inturbo_tier_exit();
 void asm_x64_inturbo_check_interrupt();
 void asm_x64_inturbo_check_interrupt_END();
 void asm_x64_inturbo_check_interrupt_jae_patch();
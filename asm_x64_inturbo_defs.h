@@ -0,0 +1,15 @@
+#ifndef BEEBJIT_ASM_X64_INTURBO_DEFS_H
+#define BEEBJIT_ASM_X64_INTURBO_DEFS_H
+
+#include "asm_x64_defs.h"
+
+/* Per 6502 address execution counts, only mapped when inturbo is the cold
+ * tier beneath the JIT.
+ */
+#define K_INTURBO_TIER_COUNTS_ADDR         0x41000000
+#define K_INTURBO_CONTEXT_OFFSET_TIER_COUNTDOWN \
+                                           (K_CONTEXT_OFFSET_DRIVER_END + 0)
+#define K_INTURBO_CONTEXT_OFFSET_TIER_JIT_PTRS \
+                                           (K_CONTEXT_OFFSET_DRIVER_END + 8)
+
+#endif /* BEEBJIT_ASM_X64_INTURBO_DEFS_H */
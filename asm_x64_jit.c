@@ -104,6 +104,70 @@ asm_x64_emit_jit_check_countdown(struct util_buffer* p_buf,
   }
 }
 
+void
+asm_x64_emit_jit_check_countdown_ahead(struct util_buffer* p_buf,
+                                       uint32_t count,
+                                       uint32_t count_ahead,
+                                       void* p_trampoline) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  if ((count <= 128) && (count_ahead <= 128)) {
+    asm_x64_copy(p_buf,
+                 asm_x64_jit_check_countdown_ahead_8bit,
+                 asm_x64_jit_check_countdown_ahead_8bit_END);
+    asm_x64_patch_byte(p_buf,
+                       offset,
+                       asm_x64_jit_check_countdown_ahead_8bit,
+                       asm_x64_jit_check_countdown_ahead_8bit_count_patch,
+                       -count);
+    asm_x64_patch_byte(p_buf,
+                       offset,
+                       asm_x64_jit_check_countdown_ahead_8bit,
+                       asm_x64_jit_check_countdown_ahead_8bit_ahead_patch,
+                       -count_ahead);
+    asm_x64_patch_jump(p_buf,
+                       offset,
+                       asm_x64_jit_check_countdown_ahead_8bit,
+                       asm_x64_jit_check_countdown_ahead_8bit_jump_patch,
+                       p_trampoline);
+  } else {
+    asm_x64_copy(p_buf,
+                 asm_x64_jit_check_countdown_ahead,
+                 asm_x64_jit_check_countdown_ahead_END);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_check_countdown_ahead,
+                      asm_x64_jit_check_countdown_ahead_count_patch,
+                      -count);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_check_countdown_ahead,
+                      asm_x64_jit_check_countdown_ahead_ahead_patch,
+                      -count_ahead);
+    asm_x64_patch_jump(p_buf,
+                       offset,
+                       asm_x64_jit_check_countdown_ahead,
+                       asm_x64_jit_check_countdown_ahead_jump_patch,
+                       p_trampoline);
+  }
+}
+
+void
+asm_x64_emit_jit_countdown_no_check(struct util_buffer* p_buf, int32_t count) {
+  /* count may be negative after folding in a not-taken branch refund. */
+  if ((count >= -127) && (count <= 128)) {
+    asm_x64_copy_patch_byte(p_buf,
+                            asm_x64_jit_countdown_no_check_8bit,
+                            asm_x64_jit_countdown_no_check_8bit_END,
+                            -count);
+  } else {
+    asm_x64_copy_patch_u32(p_buf,
+                           asm_x64_jit_countdown_no_check,
+                           asm_x64_jit_countdown_no_check_END,
+                           -count);
+  }
+}
+
 void
 asm_x64_emit_jit_call_debug(struct util_buffer* p_buf, uint16_t addr) {
   size_t offset = util_buffer_get_pos(p_buf);
@@ -144,11 +208,148 @@ asm_x64_emit_jit_jump_interp(struct util_buffer* p_buf, uint16_t addr) {
                      asm_x64_jit_interp);
 }
 
+void
+asm_x64_emit_jit_jump_hw_read(struct util_buffer* p_buf, uint16_t addr) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  /* Same sequence as a jump to the interpreter, but it lands at the hardware
+   * register read handler instead.
+   */
+  asm_x64_copy(p_buf, asm_x64_jit_jump_interp, asm_x64_jit_jump_interp_END);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_jump_interp,
+                    asm_x64_jit_jump_interp_pc_patch,
+                    (addr + K_BBC_MEM_READ_FULL_ADDR));
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_jit_jump_interp,
+                     asm_x64_jit_jump_interp_jump_patch,
+                     asm_x64_jit_hw_read);
+}
+
+void
+asm_x64_emit_jit_jump_tier(struct util_buffer* p_buf, uint16_t addr) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  /* Same sequence again, landing at the cold tier entry. */
+  asm_x64_copy(p_buf, asm_x64_jit_jump_interp, asm_x64_jit_jump_interp_END);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_jump_interp,
+                    asm_x64_jit_jump_interp_pc_patch,
+                    (addr + K_BBC_MEM_READ_FULL_ADDR));
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_jit_jump_interp,
+                     asm_x64_jit_jump_interp_jump_patch,
+                     asm_x64_jit_tier);
+}
+
 void
 asm_x64_emit_jit_for_testing(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_for_testing, asm_x64_jit_for_testing_END);
 }
 
+void
+asm_x64_emit_jit_profile(struct util_buffer* p_buf,
+                         uint16_t block_addr,
+                         int is_block_entry,
+                         uint32_t cycles) {
+  size_t offset = util_buffer_get_pos(p_buf);
+  uint32_t entries_addr = (K_BBC_JIT_PROFILE_ADDR +
+                           (block_addr * sizeof(uint64_t)));
+  uint32_t cycles_addr = (entries_addr + K_BBC_JIT_PROFILE_CYCLES_OFFSET);
+
+  /* The cycles add has both a 32-bit address and a 32-bit immediate; the
+   * address patch sits just before the immediate.
+   */
+  if (is_block_entry) {
+    asm_x64_copy(p_buf,
+                 asm_x64_jit_profile_block,
+                 asm_x64_jit_profile_block_END);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_profile_block,
+                      asm_x64_jit_profile_block_entries_patch,
+                      entries_addr);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_profile_block,
+                      ((void*) asm_x64_jit_profile_block_cycles_patch - 4),
+                      cycles_addr);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_profile_block,
+                      asm_x64_jit_profile_block_cycles_patch,
+                      cycles);
+  } else {
+    asm_x64_copy(p_buf,
+                 asm_x64_jit_profile_cycles,
+                 asm_x64_jit_profile_cycles_END);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_profile_cycles,
+                      ((void*) asm_x64_jit_profile_cycles_cycles_patch - 4),
+                      cycles_addr);
+    asm_x64_patch_int(p_buf,
+                      offset,
+                      asm_x64_jit_profile_cycles,
+                      asm_x64_jit_profile_cycles_cycles_patch,
+                      cycles);
+  }
+}
+
+void
+asm_x64_emit_jit_ADC_ZPG_16(struct util_buffer* p_buf,
+                            uint8_t addr1,
+                            uint8_t addr2,
+                            uint8_t addr_dest) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf, asm_x64_jit_ADC_ZPG_16, asm_x64_jit_ADC_ZPG_16_END);
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_ADC_ZPG_16,
+                     asm_x64_jit_ADC_ZPG_16_mov1_patch,
+                     (addr1 - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_ADC_ZPG_16,
+                     asm_x64_jit_ADC_ZPG_16_adc_patch,
+                     (addr2 - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_ADC_ZPG_16,
+                     asm_x64_jit_ADC_ZPG_16_mov2_patch,
+                     (addr_dest - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ADC_ZPG_32(struct util_buffer* p_buf,
+                            uint8_t addr1,
+                            uint8_t addr2,
+                            uint8_t addr_dest) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf, asm_x64_jit_ADC_ZPG_32, asm_x64_jit_ADC_ZPG_32_END);
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_ADC_ZPG_32,
+                     asm_x64_jit_ADC_ZPG_32_mov1_patch,
+                     (addr1 - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_ADC_ZPG_32,
+                     asm_x64_jit_ADC_ZPG_32_adc_patch,
+                     (addr2 - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_ADC_ZPG_32,
+                     asm_x64_jit_ADC_ZPG_32_mov2_patch,
+                     (addr_dest - REG_MEM_OFFSET));
+}
+
 void
 asm_x64_emit_jit_ADD_CYCLES(struct util_buffer* p_buf, uint8_t value) {
   asm_x64_copy_patch_byte(p_buf,
@@ -209,11 +410,96 @@ asm_x64_emit_jit_ADD_SCRATCH_Y(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_ADD_SCRATCH_Y, asm_x64_jit_ADD_SCRATCH_Y_END);
 }
 
+void
+asm_x64_emit_jit_ASL_ZPG_16(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ASL_ZPG_16,
+                          asm_x64_jit_ASL_ZPG_16_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ASL_ZPG_32(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ASL_ZPG_32,
+                          asm_x64_jit_ASL_ZPG_32_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_BCD(struct util_buffer* p_buf, int is_sbc, int check_d) {
+  void* p_start;
+  void* p_end;
+  void* p_call_patch;
+  void* p_worker;
+
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  if (check_d) {
+    p_start = asm_x64_jit_BCD_CHECK_D;
+    p_end = asm_x64_jit_BCD_CHECK_D_END;
+    p_call_patch = asm_x64_jit_BCD_CHECK_D_call_patch;
+  } else {
+    p_start = asm_x64_jit_BCD_CALL;
+    p_end = asm_x64_jit_BCD_CALL_END;
+    p_call_patch = asm_x64_jit_BCD_CALL_call_patch;
+  }
+  if (is_sbc) {
+    p_worker = asm_x64_jit_do_BCD_SBC;
+  } else {
+    p_worker = asm_x64_jit_do_BCD_ADC;
+  }
+
+  asm_x64_copy(p_buf, p_start, p_end);
+  asm_x64_patch_jump(p_buf, offset, p_start, p_call_patch, p_worker);
+}
+
+void
+asm_x64_emit_jit_BCD_SAVE_A(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_BCD_SAVE_A, asm_x64_jit_BCD_SAVE_A_END);
+}
+
 void
 asm_x64_emit_jit_CHECK_BCD(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_CHECK_BCD, asm_x64_jit_CHECK_BCD_END);
 }
 
+void
+asm_x64_emit_jit_CHECK_OPCODE(struct util_buffer* p_buf,
+                              uint16_t addr,
+                              uint8_t opcode) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  /* The miss jump is patched later, by CHECK_OPCODE_MISS. */
+  asm_x64_copy(p_buf, asm_x64_jit_CHECK_OPCODE, asm_x64_jit_CHECK_OPCODE_END);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_CHECK_OPCODE,
+                    asm_x64_jit_CHECK_OPCODE_addr_patch,
+                    (addr - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_CHECK_OPCODE,
+                     asm_x64_jit_CHECK_OPCODE_opcode_patch,
+                     opcode);
+}
+
+void
+asm_x64_emit_jit_CHECK_OPCODE_MISS(struct util_buffer* p_buf,
+                                   uint32_t check_offset) {
+  void* p_miss = (util_buffer_get_base_address(p_buf) +
+                  util_buffer_get_pos(p_buf));
+
+  asm_x64_patch_jump(p_buf,
+                     check_offset,
+                     asm_x64_jit_CHECK_OPCODE,
+                     asm_x64_jit_CHECK_OPCODE_jump_patch,
+                     p_miss);
+  asm_x64_copy(p_buf,
+               asm_x64_jit_CHECK_OPCODE_MISS,
+               asm_x64_jit_CHECK_OPCODE_MISS_END);
+}
+
 void
 asm_x64_emit_jit_CHECK_PAGE_CROSSING_SCRATCH_n(struct util_buffer* p_buf,
                                                uint8_t n) {
@@ -287,6 +573,48 @@ asm_x64_emit_jit_CHECK_PAGE_CROSSING_Y_n(struct util_buffer* p_buf,
                     value);
 }
 
+void
+asm_x64_emit_jit_CHECK_IND_SCRATCH(struct util_buffer* p_buf,
+                                   void* p_trampoline,
+                                   uint32_t limit) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf,
+               asm_x64_jit_CHECK_IND_SCRATCH,
+               asm_x64_jit_CHECK_IND_SCRATCH_END);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_CHECK_IND_SCRATCH,
+                    asm_x64_jit_CHECK_IND_SCRATCH_limit_patch,
+                    limit);
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_jit_CHECK_IND_SCRATCH,
+                     asm_x64_jit_CHECK_IND_SCRATCH_jump_patch,
+                     p_trampoline);
+}
+
+void
+asm_x64_emit_jit_CHECK_IND_SCRATCH_Y(struct util_buffer* p_buf,
+                                     void* p_trampoline,
+                                     uint32_t limit) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf,
+               asm_x64_jit_CHECK_IND_SCRATCH_Y,
+               asm_x64_jit_CHECK_IND_SCRATCH_Y_END);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_CHECK_IND_SCRATCH_Y,
+                    asm_x64_jit_CHECK_IND_SCRATCH_Y_limit_patch,
+                    limit);
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_jit_CHECK_IND_SCRATCH_Y,
+                     asm_x64_jit_CHECK_IND_SCRATCH_Y_jump_patch,
+                     p_trampoline);
+}
+
 void
 asm_x64_emit_jit_CHECK_PENDING_IRQ(struct util_buffer* p_buf,
                                    void* p_trampoline) {
@@ -307,6 +635,114 @@ asm_x64_emit_jit_CLEAR_CARRY(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_CLEAR_CARRY, asm_x64_jit_CLEAR_CARRY_END);
 }
 
+void
+asm_x64_emit_jit_COPY_ZPG_16(struct util_buffer* p_buf,
+                             uint8_t addr_src,
+                             uint8_t addr_dest) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf, asm_x64_jit_COPY_ZPG_16, asm_x64_jit_COPY_ZPG_16_END);
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_COPY_ZPG_16,
+                     asm_x64_jit_COPY_ZPG_16_mov1_patch,
+                     (addr_src - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_COPY_ZPG_16,
+                     asm_x64_jit_COPY_ZPG_16_mov2_patch,
+                     (addr_dest - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_COPY_ZPG_32(struct util_buffer* p_buf,
+                             uint8_t addr_src,
+                             uint8_t addr_dest) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf, asm_x64_jit_COPY_ZPG_32, asm_x64_jit_COPY_ZPG_32_END);
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_COPY_ZPG_32,
+                     asm_x64_jit_COPY_ZPG_32_mov1_patch,
+                     (addr_src - REG_MEM_OFFSET));
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_COPY_ZPG_32,
+                     asm_x64_jit_COPY_ZPG_32_mov2_patch,
+                     (addr_dest - REG_MEM_OFFSET));
+}
+
+static void
+asm_x64_emit_jit_entry_guard(struct util_buffer* p_buf,
+                             void* p_start,
+                             void* p_value_patch,
+                             void* p_end,
+                             uint8_t value,
+                             void* p_trampoline) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf, p_start, p_end);
+  asm_x64_patch_int(p_buf, offset, p_start, p_value_patch, -(int) value);
+  offset = util_buffer_get_pos(p_buf);
+  asm_x64_copy(p_buf,
+               asm_x64_jit_ENTRY_GUARD_check,
+               asm_x64_jit_ENTRY_GUARD_check_END);
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_jit_ENTRY_GUARD_check,
+                     asm_x64_jit_ENTRY_GUARD_check_jump_patch,
+                     p_trampoline);
+}
+
+void
+asm_x64_emit_jit_ENTRY_GUARD_A(struct util_buffer* p_buf,
+                               uint8_t value,
+                               void* p_trampoline) {
+  asm_x64_emit_jit_entry_guard(p_buf,
+                               asm_x64_jit_ENTRY_GUARD_A,
+                               asm_x64_jit_ENTRY_GUARD_A_value_patch,
+                               asm_x64_jit_ENTRY_GUARD_A_END,
+                               value,
+                               p_trampoline);
+}
+
+void
+asm_x64_emit_jit_ENTRY_GUARD_C(struct util_buffer* p_buf,
+                               uint8_t value,
+                               void* p_trampoline) {
+  asm_x64_emit_jit_entry_guard(p_buf,
+                               asm_x64_jit_ENTRY_GUARD_C,
+                               asm_x64_jit_ENTRY_GUARD_C_value_patch,
+                               asm_x64_jit_ENTRY_GUARD_C_END,
+                               value,
+                               p_trampoline);
+}
+
+void
+asm_x64_emit_jit_ENTRY_GUARD_X(struct util_buffer* p_buf,
+                               uint8_t value,
+                               void* p_trampoline) {
+  asm_x64_emit_jit_entry_guard(p_buf,
+                               asm_x64_jit_ENTRY_GUARD_X,
+                               asm_x64_jit_ENTRY_GUARD_X_value_patch,
+                               asm_x64_jit_ENTRY_GUARD_X_END,
+                               value,
+                               p_trampoline);
+}
+
+void
+asm_x64_emit_jit_ENTRY_GUARD_Y(struct util_buffer* p_buf,
+                               uint8_t value,
+                               void* p_trampoline) {
+  asm_x64_emit_jit_entry_guard(p_buf,
+                               asm_x64_jit_ENTRY_GUARD_Y,
+                               asm_x64_jit_ENTRY_GUARD_Y_value_patch,
+                               asm_x64_jit_ENTRY_GUARD_Y_END,
+                               value,
+                               p_trampoline);
+}
+
 void
 asm_x64_emit_jit_FLAGA(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_FLAGA, asm_x64_jit_FLAGA_END);
@@ -334,6 +770,84 @@ asm_x64_emit_jit_FLAG_MEM(struct util_buffer* p_buf, uint16_t addr) {
                     (addr - REG_MEM_OFFSET));
 }
 
+void
+asm_x64_emit_jit_IDLE_LOOP(struct util_buffer* p_buf,
+                           uint8_t opcode_6502,
+                           uint32_t cycles,
+                           uint32_t lookahead) {
+  size_t offset;
+  void* p_skip;
+  void* p_skip_end;
+
+  size_t len_x64 = (asm_x64_jit_IDLE_LOOP_END - asm_x64_jit_IDLE_LOOP);
+
+  /* Jump over the fast forward if the loop branch isn't going to be taken,
+   * i.e. use the 6502 branch with the opposite condition.
+   */
+  switch (opcode_6502) {
+  case 0x10: /* BPL */
+    p_skip = asm_x64_jit_BMI_8bit;
+    p_skip_end = asm_x64_jit_BMI_8bit_END;
+    break;
+  case 0x30: /* BMI */
+    p_skip = asm_x64_jit_BPL_8bit;
+    p_skip_end = asm_x64_jit_BPL_8bit_END;
+    break;
+  case 0x50: /* BVC */
+    p_skip = asm_x64_jit_BVS_8bit;
+    p_skip_end = asm_x64_jit_BVS_8bit_END;
+    break;
+  case 0x70: /* BVS */
+    p_skip = asm_x64_jit_BVC_8bit;
+    p_skip_end = asm_x64_jit_BVC_8bit_END;
+    break;
+  case 0x90: /* BCC */
+    p_skip = asm_x64_jit_BCS_8bit;
+    p_skip_end = asm_x64_jit_BCS_8bit_END;
+    break;
+  case 0xB0: /* BCS */
+    p_skip = asm_x64_jit_BCC_8bit;
+    p_skip_end = asm_x64_jit_BCC_8bit_END;
+    break;
+  case 0xD0: /* BNE */
+    p_skip = asm_x64_jit_BEQ_8bit;
+    p_skip_end = asm_x64_jit_BEQ_8bit_END;
+    break;
+  case 0xF0: /* BEQ */
+    p_skip = asm_x64_jit_BNE_8bit;
+    p_skip_end = asm_x64_jit_BNE_8bit_END;
+    break;
+  default:
+    assert(0);
+    p_skip = NULL;
+    p_skip_end = NULL;
+    break;
+  }
+
+  offset = util_buffer_get_pos(p_buf);
+  asm_x64_copy(p_buf, p_skip, p_skip_end);
+  assert(len_x64 <= INT8_MAX);
+  asm_x64_patch_byte(p_buf, offset, p_skip, p_skip_end, (uint8_t) len_x64);
+
+  offset = util_buffer_get_pos(p_buf);
+  asm_x64_copy(p_buf, asm_x64_jit_IDLE_LOOP, asm_x64_jit_IDLE_LOOP_END);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_IDLE_LOOP,
+                    asm_x64_jit_IDLE_LOOP_cycles_patch,
+                    cycles);
+  asm_x64_patch_int(p_buf,
+                    offset,
+                    asm_x64_jit_IDLE_LOOP,
+                    asm_x64_jit_IDLE_LOOP_lookahead_patch,
+                    lookahead);
+  asm_x64_patch_jump(p_buf,
+                     offset,
+                     asm_x64_jit_IDLE_LOOP,
+                     asm_x64_jit_IDLE_LOOP_call_patch,
+                     asm_x64_jit_do_idle_loop);
+}
+
 void
 asm_x64_emit_jit_INC_SCRATCH(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_INC_SCRATCH, asm_x64_jit_INC_SCRATCH_END);
@@ -345,8 +859,17 @@ asm_x64_emit_jit_INVERT_CARRY(struct util_buffer* p_buf) {
 }
 
 void
-asm_x64_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf) {
+asm_x64_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf,
+                             uint8_t block_shift) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
   asm_x64_copy(p_buf, asm_x64_jit_JMP_SCRATCH, asm_x64_jit_JMP_SCRATCH_END);
+  /* A rotate of the 16-bit address is a shift left. */
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_JMP_SCRATCH,
+                     asm_x64_jit_JMP_SCRATCH_shift_patch,
+                     (32 - block_shift));
 }
 
 void
@@ -415,6 +938,22 @@ asm_x64_emit_jit_LOAD_SCRATCH_16(struct util_buffer* p_buf, uint16_t addr) {
                     ((addr + 1) - REG_MEM_OFFSET));
 }
 
+void
+asm_x64_emit_jit_LSR_ZPG_16(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_LSR_ZPG_16,
+                          asm_x64_jit_LSR_ZPG_16_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_LSR_ZPG_32(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_LSR_ZPG_32,
+                          asm_x64_jit_LSR_ZPG_32_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
 void
 asm_x64_emit_jit_MODE_ABX(struct util_buffer* p_buf, uint16_t value) {
   size_t offset = util_buffer_get_pos(p_buf);
@@ -570,6 +1109,38 @@ asm_x64_emit_jit_PUSH_16(struct util_buffer* p_buf, uint16_t value) {
                     value);
 }
 
+void
+asm_x64_emit_jit_ROL_ZPG_16(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ROL_ZPG_16,
+                          asm_x64_jit_ROL_ZPG_16_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ROL_ZPG_32(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ROL_ZPG_32,
+                          asm_x64_jit_ROL_ZPG_32_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ROR_ZPG_16(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ROR_ZPG_16,
+                          asm_x64_jit_ROR_ZPG_16_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ROR_ZPG_32(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ROR_ZPG_32,
+                          asm_x64_jit_ROR_ZPG_32_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
 void
 asm_x64_emit_jit_SAVE_CARRY(struct util_buffer* p_buf) {
   asm_x64_copy(p_buf, asm_x64_jit_SAVE_CARRY, asm_x64_jit_SAVE_CARRY_END);
@@ -675,6 +1246,154 @@ asm_x64_emit_jit_WRITE_INV_SCRATCH_Y(struct util_buffer* p_buf) {
                asm_x64_jit_WRITE_INV_SCRATCH_Y_END);
 }
 
+void
+asm_x64_emit_jit_WRITE_INV_STACK_n(struct util_buffer* p_buf, uint8_t value) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_x64_copy(p_buf,
+               asm_x64_jit_WRITE_INV_STACK_n,
+               asm_x64_jit_WRITE_INV_STACK_n_END);
+  /* Negative displacement: the n'th byte down from S. */
+  asm_x64_patch_byte(p_buf,
+                     offset,
+                     asm_x64_jit_WRITE_INV_STACK_n,
+                     asm_x64_jit_WRITE_INV_STACK_n_lea_patch,
+                     (uint8_t) -value);
+}
+
+void
+asm_x64_emit_jit_WRITE_SINK(struct util_buffer* p_buf) {
+  /* Never executed: just a landing spot for self-modify invalidation writes
+   * that we want to ignore.
+   */
+  asm_x64_emit_instruction_TRAP(p_buf);
+  asm_x64_emit_instruction_TRAP(p_buf);
+}
+
+void
+asm_x64_emit_jit_ZPC_ADC(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_ADC, asm_x64_jit_ZPC_ADC_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_ADD(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_ADD, asm_x64_jit_ZPC_ADD_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_AND(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_AND, asm_x64_jit_ZPC_AND_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_ASL(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_ASL, asm_x64_jit_ZPC_ASL_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_CMP(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_CMP, asm_x64_jit_ZPC_CMP_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_CPX(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_CPX, asm_x64_jit_ZPC_CPX_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_CPY(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_CPY, asm_x64_jit_ZPC_CPY_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_DEC(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_DEC, asm_x64_jit_ZPC_DEC_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_EOR(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_EOR, asm_x64_jit_ZPC_EOR_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_INC(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_INC, asm_x64_jit_ZPC_INC_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_LDA(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_LDA, asm_x64_jit_ZPC_LDA_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_LDX(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_LDX, asm_x64_jit_ZPC_LDX_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_LDY(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_LDY, asm_x64_jit_ZPC_LDY_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_LOAD(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ZPC_LOAD,
+                          asm_x64_jit_ZPC_LOAD_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ZPC_LSR(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_LSR, asm_x64_jit_ZPC_LSR_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_ORA(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_ORA, asm_x64_jit_ZPC_ORA_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_SBC(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_SBC, asm_x64_jit_ZPC_SBC_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_STA(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_STA, asm_x64_jit_ZPC_STA_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_STOA(struct util_buffer* p_buf, uint8_t value) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ZPC_STOA,
+                          asm_x64_jit_ZPC_STOA_END,
+                          value);
+}
+
+void
+asm_x64_emit_jit_ZPC_STORE(struct util_buffer* p_buf, uint8_t addr) {
+  asm_x64_copy_patch_byte(p_buf,
+                          asm_x64_jit_ZPC_STORE,
+                          asm_x64_jit_ZPC_STORE_END,
+                          (addr - REG_MEM_OFFSET));
+}
+
+void
+asm_x64_emit_jit_ZPC_STX(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_STX, asm_x64_jit_ZPC_STX_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_STY(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_STY, asm_x64_jit_ZPC_STY_END);
+}
+
+void
+asm_x64_emit_jit_ZPC_SUB(struct util_buffer* p_buf) {
+  asm_x64_copy(p_buf, asm_x64_jit_ZPC_SUB, asm_x64_jit_ZPC_SUB_END);
+}
+
 void
 asm_x64_emit_jit_ADC_ABS(struct util_buffer* p_buf, uint16_t addr) {
   if (addr < 0x100) {
@@ -11,10 +11,30 @@ void asm_x64_emit_jit_jump_interp_trampoline(struct util_buffer* p_buf,
 void asm_x64_emit_jit_check_countdown(struct util_buffer* p_buf,
                                       uint32_t count,
                                       void* p_trampoline);
+void asm_x64_emit_jit_check_countdown_ahead(struct util_buffer* p_buf,
+                                            uint32_t count,
+                                            uint32_t count_ahead,
+                                            void* p_trampoline);
+void asm_x64_emit_jit_countdown_no_check(struct util_buffer* p_buf,
+                                         int32_t count);
 void asm_x64_emit_jit_call_debug(struct util_buffer* p_buf, uint16_t addr);
 void asm_x64_emit_jit_jump_interp(struct util_buffer* p_buf, uint16_t addr);
+void asm_x64_emit_jit_jump_hw_read(struct util_buffer* p_buf, uint16_t addr);
+void asm_x64_emit_jit_jump_tier(struct util_buffer* p_buf, uint16_t addr);
 void asm_x64_emit_jit_for_testing(struct util_buffer* p_buf);
+void asm_x64_emit_jit_profile(struct util_buffer* p_buf,
+                              uint16_t block_addr,
+                              int is_block_entry,
+                              uint32_t cycles);
 
+void asm_x64_emit_jit_ADC_ZPG_16(struct util_buffer* p_buf,
+                                 uint8_t addr1,
+                                 uint8_t addr2,
+                                 uint8_t addr_dest);
+void asm_x64_emit_jit_ADC_ZPG_32(struct util_buffer* p_buf,
+                                 uint8_t addr1,
+                                 uint8_t addr2,
+                                 uint8_t addr_dest);
 void asm_x64_emit_jit_ADD_CYCLES(struct util_buffer* p_buf, uint8_t value);
 void asm_x64_emit_jit_ADD_ABS(struct util_buffer* p_buf, uint16_t value);
 void asm_x64_emit_jit_ADD_ABX(struct util_buffer* p_buf, uint16_t value);
@@ -22,7 +42,16 @@ void asm_x64_emit_jit_ADD_ABY(struct util_buffer* p_buf, uint16_t value);
 void asm_x64_emit_jit_ADD_IMM(struct util_buffer* p_buf, uint8_t value);
 void asm_x64_emit_jit_ADD_SCRATCH(struct util_buffer* p_buf, uint8_t offset);
 void asm_x64_emit_jit_ADD_SCRATCH_Y(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ASL_ZPG_16(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_ASL_ZPG_32(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_BCD(struct util_buffer* p_buf, int is_sbc, int check_d);
+void asm_x64_emit_jit_BCD_SAVE_A(struct util_buffer* p_buf);
 void asm_x64_emit_jit_CHECK_BCD(struct util_buffer* p_buf);
+void asm_x64_emit_jit_CHECK_OPCODE(struct util_buffer* p_buf,
+                                   uint16_t addr,
+                                   uint8_t opcode);
+void asm_x64_emit_jit_CHECK_OPCODE_MISS(struct util_buffer* p_buf,
+                                        uint32_t check_offset);
 void asm_x64_emit_jit_CHECK_PAGE_CROSSING_SCRATCH_n(struct util_buffer* p_buf,
                                                     uint8_t offset);
 void asm_x64_emit_jit_CHECK_PAGE_CROSSING_SCRATCH_X(struct util_buffer* p_buf);
@@ -31,16 +60,45 @@ void asm_x64_emit_jit_CHECK_PAGE_CROSSING_X_n(struct util_buffer* p_buf,
                                               uint16_t addr);
 void asm_x64_emit_jit_CHECK_PAGE_CROSSING_Y_n(struct util_buffer* p_buf,
                                               uint16_t addr);
+void asm_x64_emit_jit_CHECK_IND_SCRATCH(struct util_buffer* p_buf,
+                                        void* p_trampoline,
+                                        uint32_t limit);
+void asm_x64_emit_jit_CHECK_IND_SCRATCH_Y(struct util_buffer* p_buf,
+                                          void* p_trampoline,
+                                          uint32_t limit);
 void asm_x64_emit_jit_CHECK_PENDING_IRQ(struct util_buffer* p_buf,
                                         void* p_trampoline);
 void asm_x64_emit_jit_CLEAR_CARRY(struct util_buffer* p_buf);
+void asm_x64_emit_jit_COPY_ZPG_16(struct util_buffer* p_buf,
+                                  uint8_t addr_src,
+                                  uint8_t addr_dest);
+void asm_x64_emit_jit_COPY_ZPG_32(struct util_buffer* p_buf,
+                                  uint8_t addr_src,
+                                  uint8_t addr_dest);
+void asm_x64_emit_jit_ENTRY_GUARD_A(struct util_buffer* p_buf,
+                                    uint8_t value,
+                                    void* p_trampoline);
+void asm_x64_emit_jit_ENTRY_GUARD_C(struct util_buffer* p_buf,
+                                    uint8_t value,
+                                    void* p_trampoline);
+void asm_x64_emit_jit_ENTRY_GUARD_X(struct util_buffer* p_buf,
+                                    uint8_t value,
+                                    void* p_trampoline);
+void asm_x64_emit_jit_ENTRY_GUARD_Y(struct util_buffer* p_buf,
+                                    uint8_t value,
+                                    void* p_trampoline);
 void asm_x64_emit_jit_FLAGA(struct util_buffer* p_buf);
 void asm_x64_emit_jit_FLAGX(struct util_buffer* p_buf);
 void asm_x64_emit_jit_FLAGY(struct util_buffer* p_buf);
 void asm_x64_emit_jit_FLAG_MEM(struct util_buffer* p_buf, uint16_t addr);
+void asm_x64_emit_jit_IDLE_LOOP(struct util_buffer* p_buf,
+                                uint8_t opcode_6502,
+                                uint32_t cycles,
+                                uint32_t lookahead);
 void asm_x64_emit_jit_INC_SCRATCH(struct util_buffer* p_buf);
 void asm_x64_emit_jit_INVERT_CARRY(struct util_buffer* p_buf);
-void asm_x64_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf);
+void asm_x64_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf,
+                                  uint8_t block_shift);
 void asm_x64_emit_jit_LDA_Z(struct util_buffer* p_buf);
 void asm_x64_emit_jit_LDX_Z(struct util_buffer* p_buf);
 void asm_x64_emit_jit_LDY_Z(struct util_buffer* p_buf);
@@ -50,6 +108,8 @@ void asm_x64_emit_jit_LOAD_CARRY_INV_FOR_CALC(struct util_buffer* p_buf);
 void asm_x64_emit_jit_LOAD_OVERFLOW(struct util_buffer* p_buf);
 void asm_x64_emit_jit_LOAD_SCRATCH_8(struct util_buffer* p_buf, uint16_t addr);
 void asm_x64_emit_jit_LOAD_SCRATCH_16(struct util_buffer* p_buf, uint16_t addr);
+void asm_x64_emit_jit_LSR_ZPG_16(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_LSR_ZPG_32(struct util_buffer* p_buf, uint8_t addr);
 void asm_x64_emit_jit_MODE_ABX(struct util_buffer* p_buf, uint16_t value);
 void asm_x64_emit_jit_MODE_ABY(struct util_buffer* p_buf, uint16_t value);
 void asm_x64_emit_jit_MODE_IND_8(struct util_buffer* p_buf, uint8_t addr);
@@ -62,6 +122,10 @@ void asm_x64_emit_jit_MODE_ZPX(struct util_buffer* p_buf, uint8_t value);
 void asm_x64_emit_jit_MODE_ZPY(struct util_buffer* p_buf, uint8_t value);
 void asm_x64_emit_jit_PULL_16(struct util_buffer* p_buf);
 void asm_x64_emit_jit_PUSH_16(struct util_buffer* p_buf, uint16_t value);
+void asm_x64_emit_jit_ROL_ZPG_16(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_ROL_ZPG_32(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_ROR_ZPG_16(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_ROR_ZPG_32(struct util_buffer* p_buf, uint8_t addr);
 void asm_x64_emit_jit_SAVE_CARRY(struct util_buffer* p_buf);
 void asm_x64_emit_jit_SAVE_CARRY_INV(struct util_buffer* p_buf);
 void asm_x64_emit_jit_SAVE_OVERFLOW(struct util_buffer* p_buf);
@@ -76,6 +140,32 @@ void asm_x64_emit_jit_WRITE_INV_SCRATCH(struct util_buffer* p_buf);
 void asm_x64_emit_jit_WRITE_INV_SCRATCH_n(struct util_buffer* p_buf,
                                           uint8_t value);
 void asm_x64_emit_jit_WRITE_INV_SCRATCH_Y(struct util_buffer* p_buf);
+void asm_x64_emit_jit_WRITE_INV_STACK_n(struct util_buffer* p_buf,
+                                        uint8_t value);
+void asm_x64_emit_jit_WRITE_SINK(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_ADC(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_ADD(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_AND(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_ASL(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_CMP(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_CPX(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_CPY(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_DEC(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_EOR(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_INC(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_LDA(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_LDX(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_LDY(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_LOAD(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_ZPC_LSR(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_ORA(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_SBC(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_STA(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_STOA(struct util_buffer* p_buf, uint8_t value);
+void asm_x64_emit_jit_ZPC_STORE(struct util_buffer* p_buf, uint8_t addr);
+void asm_x64_emit_jit_ZPC_STX(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_STY(struct util_buffer* p_buf);
+void asm_x64_emit_jit_ZPC_SUB(struct util_buffer* p_buf);
 
 void asm_x64_emit_jit_ADC_ABS(struct util_buffer* p_buf, uint16_t addr);
 void asm_x64_emit_jit_ADC_ABX(struct util_buffer* p_buf, uint16_t addr);
@@ -195,6 +285,11 @@ void asm_x64_emit_jit_STY_scratch(struct util_buffer* p_buf);
 /* Symbols pointing directly to ASM bytes. */
 void asm_x64_jit_compile_trampoline();
 void asm_x64_jit_interp();
+void asm_x64_jit_hw_read();
+void asm_x64_jit_tier();
+void asm_x64_jit_do_BCD_ADC();
+void asm_x64_jit_do_BCD_SBC();
+void asm_x64_jit_do_idle_loop();
 
 void asm_x64_jit_call_compile_trampoline();
 void asm_x64_jit_call_compile_trampoline_END();
@@ -210,6 +305,20 @@ void asm_x64_jit_check_countdown_8bit();
 void asm_x64_jit_check_countdown_8bit_count_patch();
 void asm_x64_jit_check_countdown_8bit_jump_patch();
 void asm_x64_jit_check_countdown_8bit_END();
+void asm_x64_jit_check_countdown_ahead();
+void asm_x64_jit_check_countdown_ahead_count_patch();
+void asm_x64_jit_check_countdown_ahead_ahead_patch();
+void asm_x64_jit_check_countdown_ahead_jump_patch();
+void asm_x64_jit_check_countdown_ahead_END();
+void asm_x64_jit_check_countdown_ahead_8bit();
+void asm_x64_jit_check_countdown_ahead_8bit_count_patch();
+void asm_x64_jit_check_countdown_ahead_8bit_ahead_patch();
+void asm_x64_jit_check_countdown_ahead_8bit_jump_patch();
+void asm_x64_jit_check_countdown_ahead_8bit_END();
+void asm_x64_jit_countdown_no_check();
+void asm_x64_jit_countdown_no_check_END();
+void asm_x64_jit_countdown_no_check_8bit();
+void asm_x64_jit_countdown_no_check_8bit_END();
 void asm_x64_jit_call_debug();
 void asm_x64_jit_call_debug_pc_patch();
 void asm_x64_jit_call_debug_call_patch();
@@ -220,7 +329,24 @@ void asm_x64_jit_jump_interp_jump_patch();
 void asm_x64_jit_jump_interp_END();
 void asm_x64_jit_for_testing();
 void asm_x64_jit_for_testing_END();
+void asm_x64_jit_profile_block();
+void asm_x64_jit_profile_block_entries_patch();
+void asm_x64_jit_profile_block_cycles_patch();
+void asm_x64_jit_profile_block_END();
+void asm_x64_jit_profile_cycles();
+void asm_x64_jit_profile_cycles_cycles_patch();
+void asm_x64_jit_profile_cycles_END();
 
+void asm_x64_jit_ADC_ZPG_16();
+void asm_x64_jit_ADC_ZPG_16_mov1_patch();
+void asm_x64_jit_ADC_ZPG_16_adc_patch();
+void asm_x64_jit_ADC_ZPG_16_mov2_patch();
+void asm_x64_jit_ADC_ZPG_16_END();
+void asm_x64_jit_ADC_ZPG_32();
+void asm_x64_jit_ADC_ZPG_32_mov1_patch();
+void asm_x64_jit_ADC_ZPG_32_adc_patch();
+void asm_x64_jit_ADC_ZPG_32_mov2_patch();
+void asm_x64_jit_ADC_ZPG_32_END();
 void asm_x64_jit_ADD_ABS();
 void asm_x64_jit_ADD_ABS_END();
 void asm_x64_jit_ADD_ABX();
@@ -237,8 +363,27 @@ void asm_x64_jit_ADD_SCRATCH_Y();
 void asm_x64_jit_ADD_SCRATCH_Y_END();
 void asm_x64_jit_ADD_ZPG();
 void asm_x64_jit_ADD_ZPG_END();
+void asm_x64_jit_ASL_ZPG_16();
+void asm_x64_jit_ASL_ZPG_16_END();
+void asm_x64_jit_ASL_ZPG_32();
+void asm_x64_jit_ASL_ZPG_32_END();
+void asm_x64_jit_BCD_CALL();
+void asm_x64_jit_BCD_CALL_call_patch();
+void asm_x64_jit_BCD_CALL_END();
+void asm_x64_jit_BCD_CHECK_D();
+void asm_x64_jit_BCD_CHECK_D_call_patch();
+void asm_x64_jit_BCD_CHECK_D_END();
+void asm_x64_jit_BCD_SAVE_A();
+void asm_x64_jit_BCD_SAVE_A_END();
 void asm_x64_jit_CHECK_BCD();
 void asm_x64_jit_CHECK_BCD_END();
+void asm_x64_jit_CHECK_OPCODE();
+void asm_x64_jit_CHECK_OPCODE_addr_patch();
+void asm_x64_jit_CHECK_OPCODE_opcode_patch();
+void asm_x64_jit_CHECK_OPCODE_jump_patch();
+void asm_x64_jit_CHECK_OPCODE_END();
+void asm_x64_jit_CHECK_OPCODE_MISS();
+void asm_x64_jit_CHECK_OPCODE_MISS_END();
 void asm_x64_jit_CHECK_PAGE_CROSSING_SCRATCH_n();
 void asm_x64_jit_CHECK_PAGE_CROSSING_SCRATCH_n_lea_patch();
 void asm_x64_jit_CHECK_PAGE_CROSSING_SCRATCH_n_END();
@@ -252,11 +397,42 @@ void asm_x64_jit_CHECK_PAGE_CROSSING_X_n_END();
 void asm_x64_jit_CHECK_PAGE_CROSSING_Y_n();
 void asm_x64_jit_CHECK_PAGE_CROSSING_Y_n_lea_patch();
 void asm_x64_jit_CHECK_PAGE_CROSSING_Y_n_END();
+void asm_x64_jit_CHECK_IND_SCRATCH();
+void asm_x64_jit_CHECK_IND_SCRATCH_limit_patch();
+void asm_x64_jit_CHECK_IND_SCRATCH_jump_patch();
+void asm_x64_jit_CHECK_IND_SCRATCH_END();
+void asm_x64_jit_CHECK_IND_SCRATCH_Y();
+void asm_x64_jit_CHECK_IND_SCRATCH_Y_limit_patch();
+void asm_x64_jit_CHECK_IND_SCRATCH_Y_jump_patch();
+void asm_x64_jit_CHECK_IND_SCRATCH_Y_END();
 void asm_x64_jit_CHECK_PENDING_IRQ();
 void asm_x64_jit_CHECK_PENDING_IRQ_jump_patch();
 void asm_x64_jit_CHECK_PENDING_IRQ_END();
 void asm_x64_jit_CLEAR_CARRY();
 void asm_x64_jit_CLEAR_CARRY_END();
+void asm_x64_jit_COPY_ZPG_16();
+void asm_x64_jit_COPY_ZPG_16_mov1_patch();
+void asm_x64_jit_COPY_ZPG_16_mov2_patch();
+void asm_x64_jit_COPY_ZPG_16_END();
+void asm_x64_jit_COPY_ZPG_32();
+void asm_x64_jit_COPY_ZPG_32_mov1_patch();
+void asm_x64_jit_COPY_ZPG_32_mov2_patch();
+void asm_x64_jit_COPY_ZPG_32_END();
+void asm_x64_jit_ENTRY_GUARD_A();
+void asm_x64_jit_ENTRY_GUARD_A_value_patch();
+void asm_x64_jit_ENTRY_GUARD_A_END();
+void asm_x64_jit_ENTRY_GUARD_C();
+void asm_x64_jit_ENTRY_GUARD_C_value_patch();
+void asm_x64_jit_ENTRY_GUARD_C_END();
+void asm_x64_jit_ENTRY_GUARD_X();
+void asm_x64_jit_ENTRY_GUARD_X_value_patch();
+void asm_x64_jit_ENTRY_GUARD_X_END();
+void asm_x64_jit_ENTRY_GUARD_Y();
+void asm_x64_jit_ENTRY_GUARD_Y_value_patch();
+void asm_x64_jit_ENTRY_GUARD_Y_END();
+void asm_x64_jit_ENTRY_GUARD_check();
+void asm_x64_jit_ENTRY_GUARD_check_jump_patch();
+void asm_x64_jit_ENTRY_GUARD_check_END();
 void asm_x64_jit_FLAGA();
 void asm_x64_jit_FLAGA_END();
 void asm_x64_jit_FLAGX();
@@ -265,11 +441,17 @@ void asm_x64_jit_FLAGY();
 void asm_x64_jit_FLAGY_END();
 void asm_x64_jit_FLAG_MEM();
 void asm_x64_jit_FLAG_MEM_END();
+void asm_x64_jit_IDLE_LOOP();
+void asm_x64_jit_IDLE_LOOP_cycles_patch();
+void asm_x64_jit_IDLE_LOOP_lookahead_patch();
+void asm_x64_jit_IDLE_LOOP_call_patch();
+void asm_x64_jit_IDLE_LOOP_END();
 void asm_x64_jit_INC_SCRATCH();
 void asm_x64_jit_INC_SCRATCH_END();
 void asm_x64_jit_INVERT_CARRY();
 void asm_x64_jit_INVERT_CARRY_END();
 void asm_x64_jit_JMP_SCRATCH();
+void asm_x64_jit_JMP_SCRATCH_shift_patch();
 void asm_x64_jit_JMP_SCRATCH_END();
 void asm_x64_jit_LDA_Z();
 void asm_x64_jit_LDA_Z_END();
@@ -287,6 +469,10 @@ void asm_x64_jit_LOAD_OVERFLOW();
 void asm_x64_jit_LOAD_OVERFLOW_END();
 void asm_x64_jit_LOAD_SCRATCH_8();
 void asm_x64_jit_LOAD_SCRATCH_8_END();
+void asm_x64_jit_LSR_ZPG_16();
+void asm_x64_jit_LSR_ZPG_16_END();
+void asm_x64_jit_LSR_ZPG_32();
+void asm_x64_jit_LSR_ZPG_32_END();
 void asm_x64_jit_MODE_ABX();
 void asm_x64_jit_MODE_ABX_lea_patch();
 void asm_x64_jit_MODE_ABX_END();
@@ -323,6 +509,14 @@ void asm_x64_jit_PULL_16_END();
 void asm_x64_jit_PUSH_16();
 void asm_x64_jit_PUSH_16_word_patch();
 void asm_x64_jit_PUSH_16_END();
+void asm_x64_jit_ROL_ZPG_16();
+void asm_x64_jit_ROL_ZPG_16_END();
+void asm_x64_jit_ROL_ZPG_32();
+void asm_x64_jit_ROL_ZPG_32_END();
+void asm_x64_jit_ROR_ZPG_16();
+void asm_x64_jit_ROR_ZPG_16_END();
+void asm_x64_jit_ROR_ZPG_32();
+void asm_x64_jit_ROR_ZPG_32_END();
 void asm_x64_jit_SAVE_CARRY();
 void asm_x64_jit_SAVE_CARRY_END();
 void asm_x64_jit_SAVE_CARRY_INV();
@@ -349,6 +543,55 @@ void asm_x64_jit_WRITE_INV_SCRATCH_n_lea_patch();
 void asm_x64_jit_WRITE_INV_SCRATCH_n_END();
 void asm_x64_jit_WRITE_INV_SCRATCH_Y();
 void asm_x64_jit_WRITE_INV_SCRATCH_Y_END();
+void asm_x64_jit_WRITE_INV_STACK_n();
+void asm_x64_jit_WRITE_INV_STACK_n_lea_patch();
+void asm_x64_jit_WRITE_INV_STACK_n_END();
+void asm_x64_jit_ZPC_ADC();
+void asm_x64_jit_ZPC_ADC_END();
+void asm_x64_jit_ZPC_ADD();
+void asm_x64_jit_ZPC_ADD_END();
+void asm_x64_jit_ZPC_AND();
+void asm_x64_jit_ZPC_AND_END();
+void asm_x64_jit_ZPC_ASL();
+void asm_x64_jit_ZPC_ASL_END();
+void asm_x64_jit_ZPC_CMP();
+void asm_x64_jit_ZPC_CMP_END();
+void asm_x64_jit_ZPC_CPX();
+void asm_x64_jit_ZPC_CPX_END();
+void asm_x64_jit_ZPC_CPY();
+void asm_x64_jit_ZPC_CPY_END();
+void asm_x64_jit_ZPC_DEC();
+void asm_x64_jit_ZPC_DEC_END();
+void asm_x64_jit_ZPC_EOR();
+void asm_x64_jit_ZPC_EOR_END();
+void asm_x64_jit_ZPC_INC();
+void asm_x64_jit_ZPC_INC_END();
+void asm_x64_jit_ZPC_LDA();
+void asm_x64_jit_ZPC_LDA_END();
+void asm_x64_jit_ZPC_LDX();
+void asm_x64_jit_ZPC_LDX_END();
+void asm_x64_jit_ZPC_LDY();
+void asm_x64_jit_ZPC_LDY_END();
+void asm_x64_jit_ZPC_LOAD();
+void asm_x64_jit_ZPC_LOAD_END();
+void asm_x64_jit_ZPC_LSR();
+void asm_x64_jit_ZPC_LSR_END();
+void asm_x64_jit_ZPC_ORA();
+void asm_x64_jit_ZPC_ORA_END();
+void asm_x64_jit_ZPC_SBC();
+void asm_x64_jit_ZPC_SBC_END();
+void asm_x64_jit_ZPC_STA();
+void asm_x64_jit_ZPC_STA_END();
+void asm_x64_jit_ZPC_STOA();
+void asm_x64_jit_ZPC_STOA_END();
+void asm_x64_jit_ZPC_STORE();
+void asm_x64_jit_ZPC_STORE_END();
+void asm_x64_jit_ZPC_STX();
+void asm_x64_jit_ZPC_STX_END();
+void asm_x64_jit_ZPC_STY();
+void asm_x64_jit_ZPC_STY_END();
+void asm_x64_jit_ZPC_SUB();
+void asm_x64_jit_ZPC_SUB_END();
 
 void asm_x64_jit_ADC_ABS();
 void asm_x64_jit_ADC_ABS_END();
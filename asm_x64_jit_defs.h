@@ -6,14 +6,35 @@
 /* NOTE: this affects performance significantly.
  * 9 == -8% and 10 == -23%.
  * 7 may be a tiny shade faster (<1%), needs more tests. <= 6 is not viable.
+ * It's also the most host code a single block can have. In the code arena
+ * layout, each 6502 address only has a small entry slot that jumps to the
+ * block, which lives in an arena further up the same mapping.
  */
 #define K_BBC_JIT_BYTES_SHIFT              8
 #define K_BBC_JIT_BYTES_PER_BYTE           (1 << K_BBC_JIT_BYTES_SHIFT)
 #define K_BBC_JIT_ADDR                     0x20000000
+#define K_BBC_JIT_ARENA_SLOT_SHIFT         4
 #define K_BBC_JIT_TRAMPOLINE_BYTES         16
 #define K_BBC_JIT_TRAMPOLINES_ADDR         0x31000000
+/* Per-block entry and cycle counters, only mapped when profiling. */
+#define K_BBC_JIT_PROFILE_ADDR             0x32000000
+#define K_BBC_JIT_PROFILE_CYCLES_OFFSET    0x80000
 #define K_JIT_CONTEXT_OFFSET_JIT_CALLBACK  (K_CONTEXT_OFFSET_DRIVER_END + 0)
-#define K_JIT_CONTEXT_OFFSET_JIT_PTRS      (K_CONTEXT_OFFSET_DRIVER_END + 8)
+#define K_JIT_CONTEXT_OFFSET_HW_READ_CALLBACK \
+                                           (K_CONTEXT_OFFSET_DRIVER_END + 8)
+#define K_JIT_CONTEXT_OFFSET_JIT_PTRS      (K_CONTEXT_OFFSET_DRIVER_END + 16)
+#define K_JIT_CONTEXT_OFFSET_ZPC_SAVE      (K_JIT_CONTEXT_OFFSET_JIT_PTRS + \
+                                            (0x10000 * 4))
+#define K_JIT_CONTEXT_OFFSET_BLOCK_SHIFT   (K_JIT_CONTEXT_OFFSET_ZPC_SAVE + 8)
+#define K_JIT_CONTEXT_OFFSET_TIER_CALLBACK \
+                                           (K_JIT_CONTEXT_OFFSET_BLOCK_SHIFT + 8)
+
+/* A hot zero page byte that a block keeps in a host register. Only the BCD
+ * helpers and the callouts to C otherwise use this register.
+ */
+#define REG_JIT_ZPC                        REG_SCRATCH4
+#define REG_JIT_ZPC_8                      REG_SCRATCH4_8
+#define REG_JIT_ZPC_32                     REG_SCRATCH4_32
 
 #endif /* BEEBJIT_ASM_X64_JIT_DEFS_H */
 
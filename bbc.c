@@ -27,6 +27,7 @@
 #include "video.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 
 static const size_t k_bbc_os_rom_offset = 0xC000;
@@ -67,6 +68,10 @@ enum {
   k_addr_tube = 0xFEE0,
 };
 
+enum {
+  k_bbc_num_top_hw_regs = 4,
+};
+
 struct bbc_struct {
   /* Internal system mechanics. */
   struct os_thread_struct* p_thread_cpu;
@@ -89,6 +94,7 @@ struct bbc_struct {
   int fast_flag;
   int test_map_flag;
   int vsync_wait_for_render;
+  int is_render_thread;
   struct bbc_options options;
 
   /* Machine state. */
@@ -142,10 +148,12 @@ struct bbc_struct {
   uint64_t last_frames;
   uint64_t last_crtc_advances;
   uint64_t last_hw_reg_hits;
-  uint64_t last_c1;
-  uint64_t last_c2;
+  uint64_t last_custom_counters[k_cpu_driver_max_custom_counters];
 
   uint64_t num_hw_reg_hits;
+  /* Per-register breakdown of num_hw_reg_hits, for &FC00 - &FEFF. */
+  uint64_t hw_reg_hits[k_bbc_registers_len];
+  uint64_t last_hw_reg_hits_per_reg[k_bbc_registers_len];
   int log_speed;
 };
 
@@ -192,6 +200,23 @@ bbc_write_needs_callback(void* p, uint16_t addr) {
   return (addr >= k_bbc_os_rom_offset);
 }
 
+static int
+bbc_read_is_timer_driven(void* p, uint16_t addr) {
+  (void) p;
+
+  /* The VIA interrupt flags and enables. Flags are raised by the VIA timers,
+   * and by the port inputs, which change on timers too: vsync and the
+   * keyboard scan.
+   */
+  switch (addr & ~0x1F) {
+  case k_addr_sysvia:
+  case k_addr_uservia:
+    return (((addr & 0xF) == 0xD) || ((addr & 0xF) == 0xE));
+  default:
+    return 0;
+  }
+}
+
 static inline int
 bbc_is_1MHz_address(uint16_t addr) {
   if ((addr & 0xFF00) == k_addr_shiela) {
@@ -268,12 +293,23 @@ bbc_do_read_write_tick_handling(struct bbc_struct* p_bbc,
   }
 }
 
+static inline void
+bbc_count_hw_reg_hit(struct bbc_struct* p_bbc, uint16_t addr) {
+  uint16_t index = (addr - k_bbc_registers_start);
+
+  p_bbc->num_hw_reg_hits++;
+  /* Also hit for $FBxx and $FFxx, which are not registers. */
+  if (index < k_bbc_registers_len) {
+    p_bbc->hw_reg_hits[index]++;
+  }
+}
+
 uint8_t
 bbc_read_callback(void* p, uint16_t addr, int do_last_tick_callback) {
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
   uint8_t ret = 0xFE;
 
-  p_bbc->num_hw_reg_hits++;
+  bbc_count_hw_reg_hit(p_bbc, addr);
 
   bbc_do_read_write_tick_handling(p_bbc, addr, do_last_tick_callback);
 
@@ -474,6 +510,8 @@ bbc_sideways_select(struct bbc_struct* p_bbc, uint8_t index) {
   uint8_t effective_new_bank;
   int curr_is_ram;
   int new_is_ram;
+  int is_romsel_invalidated;
+  uint8_t* p_sideways_curr;
 
   struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
   uint8_t* p_sideways_src = p_bbc->p_mem_sideways;
@@ -491,25 +529,40 @@ bbc_sideways_select(struct bbc_struct* p_bbc, uint8_t index) {
     return;
   }
 
+  is_romsel_invalidated = p_bbc->is_romsel_invalidated;
   p_bbc->is_romsel_invalidated = 0;
 
   curr_is_ram = p_bbc->is_sideways_ram_bank[effective_curr_bank];
   new_is_ram = p_bbc->is_sideways_ram_bank[effective_new_bank];
 
+  p_sideways_curr = p_bbc->p_mem_sideways;
+  p_sideways_curr += (effective_curr_bank * k_bbc_rom_size);
   p_sideways_src += (effective_new_bank * k_bbc_rom_size);
 
   /* If current bank is RAM, save it. */
   if (curr_is_ram) {
-    uint8_t* p_sideways_dest = p_bbc->p_mem_sideways;
-    p_sideways_dest += (effective_curr_bank * k_bbc_rom_size);
-    (void) memcpy(p_sideways_dest, p_mem_sideways, k_bbc_rom_size);
+    (void) memcpy(p_sideways_curr, p_mem_sideways, k_bbc_rom_size);
   }
 
   (void) memcpy(p_mem_sideways, p_sideways_src, k_bbc_rom_size);
 
-  p_cpu_driver->p_funcs->memory_range_invalidate(p_cpu_driver,
-                                                 k_bbc_sideways_offset,
-                                                 k_bbc_rom_size);
+  /* A plain switch lets the CPU driver put aside anything it has for the
+   * outgoing bank. If the bank contents were changed behind its back, e.g. a
+   * ROM load, everything in the window goes.
+   */
+  if (is_romsel_invalidated ||
+      (effective_new_bank == effective_curr_bank)) {
+    p_cpu_driver->p_funcs->memory_range_invalidate(p_cpu_driver,
+                                                   k_bbc_sideways_offset,
+                                                   k_bbc_rom_size);
+  } else {
+    p_cpu_driver->p_funcs->memory_range_bank_switch(p_cpu_driver,
+                                                    k_bbc_sideways_offset,
+                                                    k_bbc_rom_size,
+                                                    p_sideways_curr,
+                                                    effective_curr_bank,
+                                                    effective_new_bank);
+  }
 
   /* If we flipped from ROM to RAM or visa versa, we need to update the write
    * mapping with either a dummy area (ROM) or the real sideways area (RAM).
@@ -562,7 +615,7 @@ bbc_write_callback(void* p,
                    int do_last_tick_callback) {
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
 
-  p_bbc->num_hw_reg_hits++;
+  bbc_count_hw_reg_hit(p_bbc, addr);
 
   bbc_do_read_write_tick_handling(p_bbc, addr, do_last_tick_callback);
 
@@ -997,6 +1050,7 @@ bbc_create(int mode,
       bbc_write_needs_callback_from;
   p_bbc->memory_access.memory_read_needs_callback = bbc_read_needs_callback;
   p_bbc->memory_access.memory_write_needs_callback = bbc_write_needs_callback;
+  p_bbc->memory_access.memory_read_is_timer_driven = bbc_read_is_timer_driven;
   p_bbc->memory_access.memory_read_callback = bbc_read_callback;
   p_bbc->memory_access.memory_write_callback = bbc_write_callback;
 
@@ -1018,6 +1072,12 @@ bbc_create(int mode,
     synchronous_sound = 1;
   }
 
+  /* Rendering on its own thread needs video to drive the beam. */
+  if (!externally_clocked_crtc) {
+    p_bbc->is_render_thread = util_has_option(p_opt_flags,
+                                              "video:render-thread");
+  }
+
   p_timing = timing_create(cpu_scale_factor);
   if (p_timing == NULL) {
     util_bail("timing_create failed");
@@ -1500,27 +1560,82 @@ bbc_do_sleep(struct bbc_struct* p_bbc,
   }
 }
 
+static void
+bbc_log_hw_reg_hits(struct bbc_struct* p_bbc, double delta_s) {
+  uint32_t i;
+  uint32_t j;
+  uint16_t top_regs[k_bbc_num_top_hw_regs];
+  uint64_t top_deltas[k_bbc_num_top_hw_regs];
+  char regs_buf[256];
+  size_t regs_pos;
+
+  (void) memset(top_deltas, '\0', sizeof(top_deltas));
+  (void) memset(top_regs, '\0', sizeof(top_regs));
+
+  /* Keep the busiest few registers, in descending order. */
+  for (i = 0; i < k_bbc_registers_len; ++i) {
+    uint64_t delta = (p_bbc->hw_reg_hits[i] -
+                      p_bbc->last_hw_reg_hits_per_reg[i]);
+    p_bbc->last_hw_reg_hits_per_reg[i] = p_bbc->hw_reg_hits[i];
+    if (delta <= top_deltas[k_bbc_num_top_hw_regs - 1]) {
+      continue;
+    }
+    j = (k_bbc_num_top_hw_regs - 1);
+    while ((j > 0) && (delta > top_deltas[j - 1])) {
+      top_deltas[j] = top_deltas[j - 1];
+      top_regs[j] = top_regs[j - 1];
+      j--;
+    }
+    top_deltas[j] = delta;
+    top_regs[j] = (k_bbc_registers_start + i);
+  }
+
+  if (top_deltas[0] == 0) {
+    return;
+  }
+
+  regs_buf[0] = '\0';
+  regs_pos = 0;
+  for (i = 0; i < k_bbc_num_top_hw_regs; ++i) {
+    int ret;
+    if (top_deltas[i] == 0) {
+      break;
+    }
+    ret = snprintf(&regs_buf[regs_pos],
+                   (sizeof(regs_buf) - regs_pos),
+                   " $%.4X %.1f/s",
+                   top_regs[i],
+                   (top_deltas[i] / delta_s));
+    if ((ret < 0) || ((size_t) ret >= (sizeof(regs_buf) - regs_pos))) {
+      break;
+    }
+    regs_pos += ret;
+  }
+
+  log_do_log(k_log_perf, k_log_info, " hw regs:%s", regs_buf);
+}
+
 static void
 bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
   uint64_t curr_cycles;
   uint64_t curr_frames;
   uint64_t curr_crtc_advances;
   uint64_t curr_hw_reg_hits;
-  uint64_t curr_c1;
-  uint64_t curr_c2;
   uint64_t delta_cycles;
   uint64_t delta_frames;
   uint64_t delta_crtc_advances;
   uint64_t delta_hw_reg_hits;
-  uint64_t delta_c1;
-  uint64_t delta_c2;
   double delta_s;
   double fps;
   double mhz;
   double crtc_ps;
   double hw_reg_ps;
-  double c1_ps;
-  double c2_ps;
+  uint32_t num_counters;
+  uint32_t i;
+  const char* counter_names[k_cpu_driver_max_custom_counters];
+  uint64_t curr_counters[k_cpu_driver_max_custom_counters];
+  char counters_buf[512];
+  size_t counters_pos;
 
   struct video_struct* p_video = p_bbc->p_video;
   struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
@@ -1537,40 +1652,53 @@ bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
   curr_frames = video_get_num_vsyncs(p_video);
   curr_crtc_advances = video_get_num_crtc_advances(p_video);
   curr_hw_reg_hits = p_bbc->num_hw_reg_hits;
-  p_cpu_driver->p_funcs->get_custom_counters(p_cpu_driver, &curr_c1, &curr_c2);
+  num_counters = p_cpu_driver->p_funcs->get_custom_counters(p_cpu_driver,
+                                                            &counter_names[0],
+                                                            &curr_counters[0]);
+  assert(num_counters <= k_cpu_driver_max_custom_counters);
 
   delta_cycles = (curr_cycles - p_bbc->last_cycles);
   delta_frames = (curr_frames - p_bbc->last_frames);
   delta_crtc_advances = (curr_crtc_advances - p_bbc->last_crtc_advances);
   delta_hw_reg_hits = (curr_hw_reg_hits - p_bbc->last_hw_reg_hits);
   delta_s = ((curr_time_us - p_bbc->last_time_us_perf) / 1000000.0);
-  delta_c1 = (curr_c1 - p_bbc->last_c1);
-  delta_c2 = (curr_c2 - p_bbc->last_c2);
 
   fps = (delta_frames / delta_s);
   mhz = ((delta_cycles / delta_s) / 1000000.0);
   crtc_ps = (delta_crtc_advances / delta_s);
   hw_reg_ps = (delta_hw_reg_hits / delta_s);
-  c1_ps = (delta_c1 / delta_s);
-  c2_ps = (delta_c2 / delta_s);
+
+  counters_buf[0] = '\0';
+  counters_pos = 0;
+  for (i = 0; i < num_counters; ++i) {
+    uint64_t delta = (curr_counters[i] - p_bbc->last_custom_counters[i]);
+    int ret = snprintf(&counters_buf[counters_pos],
+                       (sizeof(counters_buf) - counters_pos),
+                       " %.1f %s/s",
+                       (delta / delta_s),
+                       counter_names[i]);
+    if ((ret < 0) || ((size_t) ret >= (sizeof(counters_buf) - counters_pos))) {
+      break;
+    }
+    counters_pos += ret;
+    p_bbc->last_custom_counters[i] = curr_counters[i];
+  }
 
   log_do_log(k_log_perf,
              k_log_info,
-             " %.1f fps, %.1f Mhz, %.1f crtc/s %.1f hw/s %.1f c1/s %.1f c2/s",
+             " %.1f fps, %.1f Mhz, %.1f crtc/s %.1f hw/s%s",
              fps,
              mhz,
              crtc_ps,
              hw_reg_ps,
-             c1_ps,
-             c2_ps);
+             counters_buf);
+  bbc_log_hw_reg_hits(p_bbc, delta_s);
 
   p_bbc->last_cycles = curr_cycles;
   p_bbc->last_frames = curr_frames;
   p_bbc->last_crtc_advances = curr_crtc_advances;
   p_bbc->last_hw_reg_hits = curr_hw_reg_hits;
   p_bbc->last_time_us_perf = curr_time_us;
-  p_bbc->last_c1 = curr_c1;
-  p_bbc->last_c2 = curr_c2;
 }
 
 static int
@@ -1765,11 +1893,18 @@ bbc_cpu_thread(void* p) {
   /* Set up initial fast mode correctly. */
   bbc_set_fast_mode(p_bbc, p_bbc->fast_flag);
 
+  if (p_bbc->is_render_thread) {
+    render_start_thread(p_bbc->p_render);
+  }
+
   exited = p_cpu_driver->p_funcs->enter(p_cpu_driver);
   (void) exited;
   assert(exited == 1);
   assert(p_cpu_driver->p_funcs->get_flags(p_cpu_driver) & k_cpu_flag_exited);
 
+  /* The render buffer may go away once the exit message is out. */
+  render_stop_thread(p_bbc->p_render);
+
   p_bbc->running = 0;
   p_bbc->exit_value = p_cpu_driver->p_funcs->get_exit_value(p_cpu_driver);
 
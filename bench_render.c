@@ -0,0 +1,133 @@
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bbc_options.h"
+#include "os_time.h"
+#include "render.h"
+#include "teletext.h"
+#include "util.h"
+
+/* Microbenchmark for the character renderers in render.c. Whole frames of
+ * screen bytes are fed straight to the renderer, a scanline at a time as the
+ * video code does, for each graphics mode and each flavor of character copy.
+ */
+
+static const char* s_p_flavors[] = { "video:no-simd", "video:no-avx2", "" };
+static const char* s_p_flavor_names[] = { "scalar", "sse2", "default" };
+static const int s_modes[] = { k_render_mode0, k_render_mode1,
+                               k_render_mode2, k_render_mode4,
+                               k_render_mode5, k_render_mode8,
+                               k_render_mode7 };
+static const char* s_p_mode_names[] = { "0", "1", "2", "4", "5", "8", "7" };
+
+static uint64_t
+bench_render_frames(struct render_struct* p_render,
+                    int mode,
+                    uint32_t num_frames) {
+  uint32_t i_frames;
+  uint32_t i_lines;
+  uint32_t i;
+  uint8_t line_data[80];
+
+  uint32_t num_cols = 80;
+  uint32_t pixels_size = 8;
+
+  if (mode >= k_render_mode4) {
+    num_cols = 40;
+    pixels_size = 16;
+  }
+
+  for (i_frames = 0; i_frames < num_frames; ++i_frames) {
+    render_vsync(p_render, 0);
+    for (i_lines = 0; i_lines < 312; ++i_lines) {
+      void (*func_render_blank)(struct render_struct*, uint8_t) =
+          render_get_render_blank_function(p_render);
+      for (i = 0; i < (176 / pixels_size); ++i) {
+        func_render_blank(p_render, 0);
+      }
+      for (i = 0; i < num_cols; ++i) {
+        line_data[i] = ((i_lines * 3) + (i * 7) + i_frames);
+      }
+      if (i_lines == 100) {
+        render_cursor(p_render);
+      }
+      render_data_span(p_render, line_data, num_cols);
+      render_hsync(p_render, 0);
+    }
+  }
+
+  return ((uint64_t) num_frames * 312 * num_cols * pixels_size);
+}
+
+int
+main(int argc, const char* argv[]) {
+  int arg;
+  uint32_t i_flavors;
+  uint32_t i_modes;
+  uint32_t i;
+  uint32_t size;
+  uint32_t* p_buffer;
+  struct bbc_options options;
+  struct teletext_struct* p_teletext;
+
+  uint32_t num_frames = 500;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if (!strcmp(argv[arg], "-f") && ((arg + 1) < argc)) {
+      num_frames = strtoul(argv[++arg], NULL, 10);
+    } else {
+      errx(1, "usage: bench_render [-f frames]");
+    }
+  }
+
+  (void) memset(&options, '\0', sizeof(options));
+  options.p_log_flags = "";
+  p_teletext = teletext_create();
+  p_buffer = NULL;
+  size = 0;
+
+  for (i_flavors = 0; i_flavors < 3; ++i_flavors) {
+    options.p_opt_flags = s_p_flavors[i_flavors];
+    for (i_modes = 0; i_modes < 7; ++i_modes) {
+      uint64_t num_pixels;
+      uint64_t start_ns;
+      uint64_t elapsed_ns;
+      struct render_struct* p_render = render_create(p_teletext, &options);
+
+      if (p_buffer == NULL) {
+        size = (render_get_width(p_render) * render_get_height(p_render));
+        p_buffer = util_mallocz(size * 4);
+      }
+      render_set_buffer(p_render, p_buffer);
+      render_set_mode(p_render, s_modes[i_modes]);
+      render_set_cursor_segments(p_render, 0, 1, 1, 0);
+      for (i = 0; i < 16; ++i) {
+        render_set_palette(p_render, i, (0xff000000 | (i * 0x00102030)));
+      }
+
+      start_ns = os_time_get_ns();
+      num_pixels = bench_render_frames(p_render,
+                                       s_modes[i_modes],
+                                       num_frames);
+      elapsed_ns = (os_time_get_ns() - start_ns);
+      if (elapsed_ns == 0) {
+        elapsed_ns = 1;
+      }
+
+      (void) printf("MODE %s %-8s %8.1f Mpixels/s\n",
+                    s_p_mode_names[i_modes],
+                    s_p_flavor_names[i_flavors],
+                    ((double) num_pixels * 1000.0 / elapsed_ns));
+
+      render_destroy(p_render);
+    }
+  }
+
+  util_free(p_buffer);
+  teletext_destroy(p_teletext);
+
+  return 0;
+}
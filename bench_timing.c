@@ -0,0 +1,100 @@
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os_time.h"
+#include "timing.h"
+#include "util.h"
+
+/* Microbenchmark for the timer scheduler in timing.c. A number of timers each
+ * re-arm themselves with a pseudo random period when they fire, while time is
+ * advanced a couple of ticks at a time, like the CPU does. Half the timers
+ * tick without firing, as VIA timers often do.
+ */
+
+static struct timing_struct* s_p_timing;
+static uint32_t s_rand = 1;
+static uint64_t s_num_expiries;
+
+/* timing.c carries its unit tests, which report through this. */
+void
+test_expect_u32(uint32_t expectation, uint32_t actual) {
+  if (actual != expectation) {
+    errx(1, "FAIL: %u, expected %u", actual, expectation);
+  }
+}
+
+static int64_t
+bench_timing_period() {
+  s_rand = ((s_rand * 1103515245) + 12345);
+  return (1 + ((s_rand >> 16) % 1000));
+}
+
+static void
+bench_timing_fired(void* p) {
+  uint32_t id = (uint32_t) (uintptr_t) p;
+
+  s_num_expiries++;
+  (void) timing_set_timer_value(s_p_timing, id, bench_timing_period());
+}
+
+int
+main(int argc, const char* argv[]) {
+  int arg;
+  uint32_t i;
+  uint64_t num_advances;
+  uint64_t start_ns;
+  uint64_t elapsed_ns;
+
+  uint32_t num_timers = 64;
+  uint64_t max_expiries = 10000000;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if (!strcmp(argv[arg], "-n") && ((arg + 1) < argc)) {
+      num_timers = strtoul(argv[++arg], NULL, 10);
+    } else if (!strcmp(argv[arg], "-i") && ((arg + 1) < argc)) {
+      max_expiries = strtoull(argv[++arg], NULL, 10);
+    } else {
+      errx(1, "usage: bench_timing [-n timers] [-i expiries]");
+    }
+  }
+  if (num_timers < 2) {
+    errx(1, "need at least 2 timers");
+  }
+
+  s_p_timing = timing_create(2);
+  for (i = 0; i < num_timers; ++i) {
+    uint32_t id = timing_register_timer(s_p_timing,
+                                        bench_timing_fired,
+                                        (void*) (uintptr_t) i);
+    if (i & 1) {
+      (void) timing_set_firing(s_p_timing, id, 0);
+    }
+    (void) timing_start_timer_with_value(s_p_timing,
+                                         id,
+                                         bench_timing_period());
+  }
+
+  num_advances = 0;
+  start_ns = os_time_get_ns();
+  while (s_num_expiries < max_expiries) {
+    (void) timing_advance_time_delta(s_p_timing, 2);
+    num_advances++;
+  }
+  elapsed_ns = (os_time_get_ns() - start_ns);
+
+  (void) printf("%u timers, %llu advances, %llu expiries, %.3f ms\n",
+                num_timers,
+                (unsigned long long) num_advances,
+                (unsigned long long) s_num_expiries,
+                (elapsed_ns / 1000000.0));
+  (void) printf("%.2f ns per advance, %.2f ns per expiry\n",
+                ((double) elapsed_ns / num_advances),
+                ((double) elapsed_ns / s_num_expiries));
+
+  timing_destroy(s_p_timing);
+
+  return 0;
+}
@@ -10,15 +10,27 @@ gcc -Wall -W -Werror -g -o make_timing_rom make_timing_rom.c \
     util.c defs_6502.c emit_6502.c test_helper.c
 gcc -Wall -W -Werror -g -o make_perf_rom make_perf_rom.c \
     util.c defs_6502.c emit_6502.c test_helper.c
+gcc -Wall -W -Werror -O3 -DNDEBUG -o bench_timing bench_timing.c \
+    timing.c util.c os_time_posix.c
+gcc -Wall -W -Werror -O3 -DNDEBUG -o bench_render bench_render.c \
+    render.c teletext.c util.c os_thread_linux.c os_time_posix.c -lpthread
 ./make_test_rom
 ./make_timing_rom
 
 echo 'Running built-in unit tests.'
 ./beebjit -test
+echo 'Running built-in unit tests, code arena.'
+./beebjit -test -opt jit:arena,jit:code-arena-size=65536
 echo 'Running test.rom, JIT, fast.'
 ./beebjit -os test.rom -expect 434241 -mode jit -fast
 echo 'Running test.rom, JIT, fast, debug.'
 ./beebjit -os test.rom -expect 434241 -mode jit -fast -debug -run
+echo 'Running test.rom, JIT, fast, code arena.'
+./beebjit -os test.rom -expect 434241 -mode jit -fast -opt jit:arena,jit:code-arena-size=65536
+echo 'Running test.rom, JIT, fast, background compile.'
+./beebjit -os test.rom -expect 434241 -mode jit -fast -opt jit:background
+echo 'Running test.rom, JIT, fast, tiered.'
+./beebjit -os test.rom -expect 434241 -mode jit -fast -opt jit:tiered
 echo 'Running test.rom, JIT, fast, accurate.'
 ./beebjit -os test.rom -expect 434241 -mode jit -fast -accurate
 echo 'Running test.rom, interpreter, fast.'
@@ -10,9 +10,9 @@ gcc -Wall -W -Werror \
     jit_compiler.c cpu_driver.c asm_x64_abi.c asm_tables.c \
     asm_x64_common.c asm_x64_inturbo.c asm_x64_jit.c \
     asm_x64_common.S asm_x64_inturbo.S asm_x64_jit.S \
-    jit_optimizer.c jit_opcode.c keyboard.c \
+    jit_cache.c jit_optimizer.c jit_opcode.c jit_scanner.c keyboard.c \
     teletext.c render.c serial.c log.c test.c tape.c \
     disc_drive.c disc.c disc_fsd.c disc_hfe.c disc_ssd.c ibm_disc_format.c \
     debug.c jit.c util.c \
     os.c \
-    -lm -lX11 -lXext -lpthread -lasound
+    -lm -lX11 -lXext -lpthread -lrt -lasound
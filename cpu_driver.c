@@ -3,6 +3,7 @@
 #include "interp.h"
 #include "inturbo.h"
 #include "jit.h"
+#include "log.h"
 #include "util.h"
 
 #include <assert.h>
@@ -17,6 +18,20 @@ cpu_driver_memory_range_invalidate_dummy(struct cpu_driver* p_cpu_driver,
   (void) len;
 }
 
+static void
+cpu_driver_memory_range_bank_switch_default(struct cpu_driver* p_cpu_driver,
+                                            uint16_t addr,
+                                            uint32_t len,
+                                            uint8_t* p_old_mem,
+                                            uint32_t old_bank,
+                                            uint32_t new_bank) {
+  (void) p_old_mem;
+  (void) old_bank;
+  (void) new_bank;
+
+  p_cpu_driver->p_funcs->memory_range_invalidate(p_cpu_driver, addr, len);
+}
+
 static char*
 cpu_driver_get_address_info_dummy(struct cpu_driver* p_cpu_driver,
                                   uint16_t addr) {
@@ -26,14 +41,22 @@ cpu_driver_get_address_info_dummy(struct cpu_driver* p_cpu_driver,
   return "    ";
 }
 
-static void
+static uint32_t
 cpu_driver_get_custom_counters_dummy(struct cpu_driver* p_cpu_driver,
-                                     uint64_t* p_c1,
-                                     uint64_t* p_c2) {
+                                     const char** p_names,
+                                     uint64_t* p_values) {
+  (void) p_cpu_driver;
+  (void) p_names;
+  (void) p_values;
+
+  return 0;
+}
+
+static void
+cpu_driver_dump_profile_dummy(struct cpu_driver* p_cpu_driver) {
   (void) p_cpu_driver;
 
-  *p_c1 = 0;
-  *p_c2 = 0;
+  log_do_log(k_log_perf, k_log_info, "no profile for this CPU mode");
 }
 
 static void
@@ -119,8 +142,11 @@ cpu_driver_alloc(int mode,
   p_funcs->get_exit_value = cpu_driver_get_exit_value_default;
   p_funcs->set_exit_value = cpu_driver_set_exit_value_default;
   p_funcs->memory_range_invalidate = cpu_driver_memory_range_invalidate_dummy;
+  p_funcs->memory_range_bank_switch =
+      cpu_driver_memory_range_bank_switch_default;
   p_funcs->get_address_info = cpu_driver_get_address_info_dummy;
   p_funcs->get_custom_counters = cpu_driver_get_custom_counters_dummy;
+  p_funcs->dump_profile = cpu_driver_dump_profile_dummy;
 
   p_funcs->init(p_cpu_driver);
 
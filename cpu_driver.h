@@ -17,6 +17,10 @@ enum {
   k_cpu_mode_jit = 3,
 };
 
+enum {
+  k_cpu_driver_max_custom_counters = 24,
+};
+
 enum {
   k_cpu_flag_exited = 1,
   k_cpu_flag_soft_reset = 2,
@@ -41,10 +45,24 @@ struct cpu_driver_funcs {
   void (*memory_range_invalidate)(struct cpu_driver* p_cpu_driver,
                                   uint16_t addr,
                                   uint32_t len);
+  /* The memory range has been switched from one bank of paged memory to
+   * another, and already holds the new bank's contents. p_old_mem holds the
+   * outgoing bank's contents.
+   */
+  void (*memory_range_bank_switch)(struct cpu_driver* p_cpu_driver,
+                                   uint16_t addr,
+                                   uint32_t len,
+                                   uint8_t* p_old_mem,
+                                   uint32_t old_bank,
+                                   uint32_t new_bank);
   char* (*get_address_info)(struct cpu_driver* p_cpu_driver, uint16_t addr);
-  void (*get_custom_counters)(struct cpu_driver* p_cpu_driver,
-                              uint64_t* p_c1,
-                              uint64_t* p_c2);
+  /* Fills in up to k_cpu_driver_max_custom_counters named counters and
+   * returns how many there are.
+   */
+  uint32_t (*get_custom_counters)(struct cpu_driver* p_cpu_driver,
+                                  const char** p_names,
+                                  uint64_t* p_values);
+  void (*dump_profile)(struct cpu_driver* p_cpu_driver);
 };
 
 struct cpu_driver {
@@ -1158,6 +1158,9 @@ debug_callback(struct cpu_driver* p_cpu_driver, int do_irq) {
       debug_dump_stats(p_debug);
     } else if (!strcmp(input_buf, "cs")) {
       debug_clear_stats(p_debug);
+    } else if (!strcmp(input_buf, "prof")) {
+      struct cpu_driver* p_bbc_cpu_driver = bbc_get_cpu_driver(p_bbc);
+      p_bbc_cpu_driver->p_funcs->dump_profile(p_bbc_cpu_driver);
     } else if (!strcmp(input_buf, "s")) {
       break;
     } else if (!strcmp(input_buf, "t")) {
@@ -1369,6 +1372,7 @@ debug_callback(struct cpu_driver* p_cpu_driver, int do_irq) {
   "stats             : toggle stats collection (default: off)\n"
   "ds                : dump stats collected\n"
   "cs                : clear stats collected\n"
+  "prof              : dump CPU driver profile (e.g. -opt jit:profile)\n"
   );
     } else {
       (void) printf("???\n");
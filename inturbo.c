@@ -4,6 +4,7 @@
 #include "asm_x64_common.h"
 #include "asm_x64_defs.h"
 #include "asm_x64_inturbo.h"
+#include "asm_x64_inturbo_defs.h"
 #include "bbc_options.h"
 #include "cpu_driver.h"
 #include "defs_6502.h"
@@ -20,14 +21,25 @@
 
 static const size_t k_inturbo_bytes_per_opcode = 256;
 static void* k_inturbo_opcodes_addr = (void*) 0x40000000;
+static void* k_inturbo_tier_counts_addr = (void*) K_INTURBO_TIER_COUNTS_ADDR;
 
 struct inturbo_struct {
   struct cpu_driver driver;
 
+  /* Fields referenced by the tier checks. */
+  int64_t tier_countdown;
+  uint32_t* p_tier_jit_ptrs;
+
   struct interp_struct* p_interp;
   int debug_subsystem_active;
   struct os_alloc_mapping* p_mapping_base;
   uint8_t* p_inturbo_base;
+
+  /* Only when running as the cold tier beneath the JIT. */
+  struct os_alloc_mapping* p_mapping_tier_counts;
+  uint8_t* p_tier_counts;
+  void (*p_tier_write_callback)(void* p, uint16_t addr_6502);
+  void* p_tier_write_callback_object;
 };
 
 static void
@@ -43,6 +55,7 @@ inturbo_fill_tables(struct inturbo_struct* p_inturbo) {
   struct bbc_options* p_options = p_inturbo->driver.p_options;
   int accurate = p_options->accurate;
   int debug = p_inturbo->debug_subsystem_active;
+  int is_tier = (p_inturbo->p_tier_counts != NULL);
   struct memory_access* p_memory_access = p_inturbo->driver.p_memory_access;
   void* p_memory_object = p_memory_access->p_callback_obj;
 
@@ -69,6 +82,9 @@ inturbo_fill_tables(struct inturbo_struct* p_inturbo) {
     if (debug) {
       asm_x64_emit_inturbo_enter_debug(p_buf);
     }
+    if (is_tier) {
+      asm_x64_emit_inturbo_tier_check(p_buf);
+    }
 
     /* Preflight checks. Some opcodes or situations are tricky enough we want
      * to go straight to the interpreter.
@@ -496,6 +512,19 @@ inturbo_fill_tables(struct inturbo_struct* p_inturbo) {
       break;
     }
 
+    /* As the cold tier, a write must invalidate any JIT code for the address
+     * written, the same as a write from JIT code would. The stack page is
+     * never compiled in that mode, so pushes can be left alone.
+     */
+    if (is_tier &&
+        ((opmem == k_write) || (opmem == k_rw)) &&
+        (opmode != k_acc)) {
+      asm_x64_emit_inturbo_tier_invalidate(p_buf,
+                                           ((opmode == k_abx) ||
+                                            (opmode == k_aby) ||
+                                            (opmode == k_idy)));
+    }
+
     switch (opreg) {
     case k_a:
       asm_x64_emit_instruction_A_NZ_flags(p_buf);
@@ -553,10 +582,19 @@ inturbo_interp_instruction_callback(void* p,
                                     uint16_t done_addr,
                                     int next_is_irq,
                                     int irq_pending) {
-  (void) p;
+  struct inturbo_struct* p_inturbo = (struct inturbo_struct*) p;
+
   (void) next_pc;
-  (void) done_opcode;
-  (void) done_addr;
+
+  if (p_inturbo->p_tier_write_callback != NULL) {
+    uint8_t optype = g_optypes[done_opcode];
+    uint8_t opmem = g_opmem[optype];
+    if (((opmem == k_write) || (opmem == k_rw)) &&
+        (g_opmodes[done_opcode] != k_acc)) {
+      p_inturbo->p_tier_write_callback(p_inturbo->p_tier_write_callback_object,
+                                       done_addr);
+    }
+  }
 
   if (next_is_irq || irq_pending) {
     /* Keep interpreting to handle the IRQ. */
@@ -584,7 +622,7 @@ inturbo_enter_interp(struct inturbo_struct* p_inturbo,
   countdown = interp_enter_with_details(p_interp,
                                         countdown,
                                         inturbo_interp_instruction_callback,
-                                        NULL);
+                                        p_inturbo);
 
   cpu_driver_flags =
       p_inturbo_cpu_driver->p_funcs->get_flags(p_inturbo_cpu_driver);
@@ -601,25 +639,25 @@ inturbo_destroy(struct cpu_driver* p_cpu_driver) {
   p_interp_cpu_driver->p_funcs->destroy(p_interp_cpu_driver);
 
   os_alloc_free_mapping(p_inturbo->p_mapping_base);
+  if (p_inturbo->p_mapping_tier_counts != NULL) {
+    os_alloc_free_mapping(p_inturbo->p_mapping_tier_counts);
+  }
   util_free(p_inturbo);
 }
 
 static int
-inturbo_enter(struct cpu_driver* p_cpu_driver) {
-  int64_t countdown;
+inturbo_enter_with_countdown(struct cpu_driver* p_cpu_driver,
+                             int64_t countdown) {
   int exited;
 
   struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
   uint16_t addr_6502 = state_6502_get_pc(p_state_6502);
   uint8_t* p_mem_read = p_cpu_driver->p_memory_access->p_mem_read;
-  struct timing_struct* p_timing = p_cpu_driver->p_timing;
   uint8_t opcode = p_mem_read[addr_6502];
   uint32_t p_start_address =
       (uint32_t) (size_t) (k_inturbo_opcodes_addr +
                            (opcode * k_inturbo_bytes_per_opcode));
 
-  countdown = timing_get_countdown(p_timing);
-
   /* The memory must be aligned to at least 0x10000 so that our register access
    * tricks work.
    */
@@ -636,11 +674,61 @@ inturbo_enter(struct cpu_driver* p_cpu_driver) {
                              p_start_address,
                              countdown,
                              (p_mem_read + REG_MEM_OFFSET));
+
+  return exited;
+}
+
+static int
+inturbo_enter(struct cpu_driver* p_cpu_driver) {
+  int exited;
+
+  int64_t countdown = timing_get_countdown(p_cpu_driver->p_timing);
+
+  exited = inturbo_enter_with_countdown(p_cpu_driver, countdown);
   assert(exited == 1);
 
   return exited;
 }
 
+uint8_t*
+inturbo_set_tier(struct cpu_driver* p_cpu_driver,
+                 uint32_t* p_jit_ptrs,
+                 void (*p_write_callback)(void* p, uint16_t addr_6502),
+                 void* p_write_callback_object) {
+  struct inturbo_struct* p_inturbo = (struct inturbo_struct*) p_cpu_driver;
+
+  assert(p_inturbo->p_tier_counts == NULL);
+  assert(!p_inturbo->debug_subsystem_active);
+
+  p_inturbo->p_mapping_tier_counts =
+      os_alloc_get_mapping(k_inturbo_tier_counts_addr, k_6502_addr_space_size);
+  p_inturbo->p_tier_counts =
+      os_alloc_get_mapping_addr(p_inturbo->p_mapping_tier_counts);
+  os_alloc_make_mapping_read_write(p_inturbo->p_tier_counts,
+                                   k_6502_addr_space_size);
+  p_inturbo->p_tier_jit_ptrs = p_jit_ptrs;
+  p_inturbo->p_tier_write_callback = p_write_callback;
+  p_inturbo->p_tier_write_callback_object = p_write_callback_object;
+
+  inturbo_fill_tables(p_inturbo);
+
+  return p_inturbo->p_tier_counts;
+}
+
+int
+inturbo_enter_tier(struct cpu_driver* p_cpu_driver, int64_t* p_countdown) {
+  int exited;
+
+  struct inturbo_struct* p_inturbo = (struct inturbo_struct*) p_cpu_driver;
+
+  exited = inturbo_enter_with_countdown(p_cpu_driver, *p_countdown);
+  if (!exited) {
+    *p_countdown = p_inturbo->tier_countdown;
+  }
+
+  return exited;
+}
+
 static void
 inturbo_set_reset_callback(struct cpu_driver* p_cpu_driver,
                            void (*do_reset_callback)(void* p, uint32_t flags),
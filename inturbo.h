@@ -1,9 +1,24 @@
 #ifndef BEEBJIT_INTURBO_H
 #define BEEBJIT_INTURBO_H
 
+#include <stdint.h>
+
 struct cpu_driver;
 struct cpu_driver_funcs;
 
 struct cpu_driver* inturbo_create(struct cpu_driver_funcs* p_funcs);
 
+/* Sets up an inturbo to run as the cold tier beneath the JIT. Each opcode
+ * first counts down a byte per 6502 address, in the returned table, and one
+ * whose count is already zero doesn't run: inturbo_enter_tier() returns
+ * instead, with the PC there. Writes also invalidate any JIT code at the
+ * address written, via p_jit_ptrs or the callback.
+ */
+uint8_t* inturbo_set_tier(struct cpu_driver* p_cpu_driver,
+                          uint32_t* p_jit_ptrs,
+                          void (*p_write_callback)(void* p, uint16_t addr_6502),
+                          void* p_write_callback_object);
+/* Returns whether the CPU exited. */
+int inturbo_enter_tier(struct cpu_driver* p_cpu_driver, int64_t* p_countdown);
+
 #endif /* BEEBJIT_INTURBO_H */
@@ -7,9 +7,13 @@
 #include "cpu_driver.h"
 #include "defs_6502.h"
 #include "interp.h"
+#include "inturbo.h"
+#include "jit_cache.h"
+#include "jit_scanner.h"
 #include "memory_access.h"
 #include "os_alloc.h"
 #include "os_fault.h"
+#include "os_time.h"
 #include "jit_compiler.h"
 #include "log.h"
 #include "state_6502.h"
@@ -17,6 +21,7 @@
 #include "util.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,16 +32,104 @@ static void* k_jit_addr = (void*) K_BBC_JIT_ADDR;
 static const int k_jit_bytes_per_byte = K_BBC_JIT_BYTES_PER_BYTE;
 static void* k_jit_trampolines_addr = (void*) K_BBC_JIT_TRAMPOLINES_ADDR;
 static const int k_jit_trampoline_bytes_per_byte = K_BBC_JIT_TRAMPOLINE_BYTES;
+static void* k_jit_profile_addr = (void*) K_BBC_JIT_PROFILE_ADDR;
+
+enum {
+  k_jit_profile_sample_us = 1000,
+  k_jit_profile_max_report_blocks = 40,
+  /* Longest an absolute mode register read can take, including the 1MHz
+   * stretch.
+   */
+  k_jit_hw_read_max_cycles = 6,
+  /* Faults at one opcode before it is recompiled not to fault. */
+  k_jit_default_faults = 16,
+  /* The paged ROM window, for which compiled code is kept per bank. */
+  k_jit_bank_addr = 0x8000,
+  k_jit_bank_len = 0x4000,
+  k_jit_bank_num_pages = (k_jit_bank_len / 0x100),
+  k_jit_num_banks = 16,
+  /* Blocks in the code arena start on a granule boundary. Each granule
+   * records the 6502 block it belongs to, and whether the block starts there.
+   */
+  k_jit_arena_granule_shift = 5,
+  k_jit_arena_granule_block_start = 0x10000,
+  /* Most speculative compiles done on any one way back from the
+   * interpreter.
+   */
+  k_jit_spec_max_compiles = 8,
+  /* Decoded blocks held back until execution reaches them, hashed by
+   * address.
+   */
+  k_jit_spec_num_held = 32,
+  /* Compile latency buckets: under 1us, then powers of two up to 1ms+. */
+  k_jit_latency_buckets = 12,
+  /* Tiered execution: times an address runs in the cold tier before it is
+   * compiled, and self-modify invalidations of a block before its code goes
+   * back to the cold tier for good.
+   */
+  k_jit_tier_default_threshold = 32,
+  k_jit_tier_demote_invalidations = 4,
+};
+
+enum {
+  k_jit_tier_cold = 0,
+  k_jit_tier_hot = 1,
+  k_jit_tier_demoted = 2,
+};
+
+/* Everything compiled for one bank of the paged ROM window, put aside while
+ * another bank is paged in. The 6502 bytes are those the code was compiled
+ * from, and are checked when the bank comes back: any change, i.e. a sideways
+ * RAM write, means the code is stale.
+ */
+struct jit_bank {
+  int is_valid;
+  /* Bitmap of the window's 6502 pages with anything compiled. */
+  uint64_t pages;
+  uint32_t num_blocks;
+  uint8_t* p_mem;
+  uint32_t* p_jit_ptrs;
+  uint8_t* p_compiler_state;
+  uint8_t* p_host_code;
+};
+
+/* Profile counters maintained by C code. The entry and cycle counts are
+ * maintained by the JIT code itself, in a separate fixed mapping.
+ */
+struct jit_profile_block {
+  uint64_t samples;
+  uint64_t compiles;
+  uint64_t invalidations;
+  uint64_t faults;
+};
+
+struct jit_profile_report_line {
+  uint16_t addr_6502;
+  uint64_t samples;
+  uint64_t cycles;
+  uint64_t entries;
+  uint64_t compiles;
+  uint64_t invalidations;
+  uint64_t faults;
+};
 
 struct jit_struct {
   struct cpu_driver driver;
 
   /* C callbacks called by JIT code. */
   void* p_compile_callback;
+  void* p_hw_read_callback;
 
   /* 6502 address -> JIT code pointers. */
   uint32_t jit_ptrs[k_6502_addr_space_size];
 
+  /* Host register holding any cached zero page byte, saved on the way out. */
+  uint64_t host_zpc_value;
+  /* log2 of the host bytes per 6502 address in the block entry layout. */
+  uint64_t block_shift;
+  /* C callback called by the stubs for cold addresses. */
+  void* p_tier_callback;
+
   /* Fields not referenced by JIT'ed code. */
   struct os_alloc_mapping* p_mapping_jit;
   struct os_alloc_mapping* p_mapping_trampolines;
@@ -46,22 +139,101 @@ struct jit_struct {
   struct util_buffer* p_temp_buf;
   struct util_buffer* p_compile_buf;
   struct interp_struct* p_interp;
+  /* Address of the opcode the interpreter is about to run. */
+  uint16_t interp_pc;
   uint32_t jit_ptr_no_code;
   uint32_t jit_ptr_dynamic_operand;
   uint8_t jit_invalidation_sequence[2];
 
   int log_compile;
+  int log_fusions;
 
   uint64_t counter_num_compiles;
   uint64_t counter_num_interps;
+  uint64_t counter_num_hw_reads;
+  uint64_t counter_num_hw_idle_loops;
   uint64_t counter_num_faults;
   int do_fault_log;
+  /* Block that faulted on decimal mode ADC / SBC, to recompile, or -1. */
+  int32_t bcd_fault_block_addr_6502;
+  /* Per 6502 opcode address fault counts, and an opcode that faulted too
+   * often and is waiting to be recompiled, or -1.
+   */
+  uint8_t* p_fault_counts;
+  int32_t default_addr_6502;
+  uint64_t counter_num_defaults;
+  /* Arrivals at a block compiled for other register values on entry. */
+  uint64_t counter_entry_misses;
+
+  struct jit_cache* p_cache;
+  char* p_cache_file_name;
+  /* Scratch for preloading a page of cached blocks. */
+  struct jit_cache_block cache_preload_blocks[256];
+  uint64_t counter_cache_hits;
+  uint64_t counter_cache_misses;
+  uint64_t counter_cache_stale;
+
+  /* Per 6502 page, the code pages that blocks starting in it write to without
+   * self-modify invalidation.
+   */
+  uint8_t unguarded_pages[k_6502_addr_space_size / 256];
+
+  struct jit_bank* p_banks;
+  uint64_t bank_live_pages;
+  uint64_t counter_bank_switches;
+  uint64_t counter_bank_blocks_kept;
+
+  /* The optional code arena, which blocks are packed into rather than each
+   * having a full 256 bytes at a fixed spot.
+   */
+  uint8_t* p_arena;
+  uint8_t* p_arena_pos;
+  uint8_t* p_arena_end;
+  uint32_t* p_arena_granules;
+  /* Scratch list of the blocks to keep when the arena fills. */
+  uint16_t* p_arena_live_blocks;
+  uint64_t counter_arena_flushes;
+  uint64_t counter_arena_compactions;
+
+  /* Compiling ahead of execution, guided by the scanner's helper thread. */
+  struct jit_scanner* p_scanner;
+  uint64_t counter_spec_compiles;
+  /* Scanner slots of provisional blocks, or -1. */
+  int32_t spec_held_slots[k_jit_spec_num_held];
+  uint64_t counter_spec_held_hits;
+  /* Time spent stalled compiling, on demand and speculatively. */
+  int log_compile_latency;
+  uint64_t demand_latency[k_jit_latency_buckets];
+  uint64_t spec_latency[k_jit_latency_buckets];
+
+  /* Tiered execution. Code runs in an inturbo, which counts down a byte per
+   * address as it goes, and is only compiled once it gets hot. Until then, the
+   * address's slot holds a stub that jumps into the inturbo.
+   */
+  struct cpu_driver* p_tier;
+  uint8_t* p_tier_counts;
+  uint8_t* p_tier_states;
+  uint8_t* p_tier_invalidations;
+  uint8_t tier_threshold;
+  int log_tier;
+  uint64_t counter_tier_promotes;
+  uint64_t counter_tier_demotes;
+  uint64_t tier_cold_ns;
+  uint64_t tier_total_ns;
+
+  struct os_alloc_mapping* p_mapping_profile;
+  uint64_t* p_profile_entries;
+  uint64_t* p_profile_cycles;
+  struct jit_profile_block* p_profile_blocks;
+  uint64_t profile_samples_total;
+  uint64_t profile_samples_other;
+  int is_profile_sampling;
 };
 
 static inline uint8_t*
 jit_get_jit_block_host_address(struct jit_struct* p_jit, uint16_t addr_6502) {
   uint8_t* p_jit_ptr = (p_jit->p_jit_base +
-                        (addr_6502 * k_jit_bytes_per_byte));
+                        ((size_t) addr_6502 << p_jit->block_shift));
   return p_jit_ptr;
 }
 
@@ -113,14 +285,38 @@ jit_6502_block_addr_from_host(struct jit_struct* p_jit, uint8_t* p_intel_rip) {
 
   uint8_t* p_jit_base = p_jit->p_jit_base;
 
+  if ((p_jit->p_arena != NULL) && (p_intel_rip >= p_jit->p_arena)) {
+    size_t granule = ((p_intel_rip - p_jit->p_arena) >>
+                      k_jit_arena_granule_shift);
+    return (uint16_t) p_jit->p_arena_granules[granule];
+  }
+
   block_addr_6502 = (p_intel_rip - p_jit_base);
-  block_addr_6502 /= k_jit_bytes_per_byte;
+  block_addr_6502 >>= p_jit->block_shift;
 
   assert(block_addr_6502 < k_6502_addr_space_size);
 
   return (uint16_t) block_addr_6502;
 }
 
+static int
+jit_is_block_entry_host_address(struct jit_struct* p_jit,
+                                uint8_t* p_intel_rip) {
+  size_t offset;
+
+  if ((p_jit->p_arena != NULL) && (p_intel_rip >= p_jit->p_arena)) {
+    offset = (p_intel_rip - p_jit->p_arena);
+    if (offset & ((1 << k_jit_arena_granule_shift) - 1)) {
+      return 0;
+    }
+    return !!(p_jit->p_arena_granules[offset >> k_jit_arena_granule_shift] &
+              k_jit_arena_granule_block_start);
+  }
+
+  offset = (p_intel_rip - p_jit->p_jit_base);
+  return !(offset & ((1 << p_jit->block_shift) - 1));
+}
+
 static uint16_t
 jit_6502_block_addr_from_6502(struct jit_struct* p_jit, uint16_t addr) {
   void* p_jit_ptr;
@@ -157,18 +353,39 @@ jit_interp_instruction_callback(void* p,
                                 int irq_pending) {
   uint16_t next_block;
   uint16_t next_block_prev;
+  uint16_t done_pc;
 
   struct jit_struct* p_jit = (struct jit_struct*) p;
   uint8_t opmode = g_opmodes[done_opcode];
   uint8_t optype = g_optypes[done_opcode];
   uint8_t opmem = g_opmem[optype];
 
+  /* done_addr is the opcode's memory operand, so track the opcode's own
+   * address separately.
+   */
+  done_pc = p_jit->interp_pc;
+  p_jit->interp_pc = next_pc;
+
   if ((opmem == k_write || opmem == k_rw) && (opmode != k_acc)) {
     /* Any memory writes executed by the interpreter need to invalidate
      * compiled JIT code if they're self-modifying writes.
      */
     jit_invalidate_code_at_address(p_jit, done_addr);
   }
+  if ((optype == k_pha) || (optype == k_php) || (optype == k_jsr) ||
+      (optype == k_brk)) {
+    /* S isn't available here, so a push (including an IRQ's) invalidates any
+     * code in the stack page. This is only the interpreter path and only once
+     * there is stack page code.
+     */
+    if (jit_compiler_get_code_pages(p_jit->p_compiler) &
+        k_jit_compiler_code_page_stack) {
+      uint32_t i;
+      for (i = 0x100; i < 0x200; ++i) {
+        jit_invalidate_code_at_address(p_jit, i);
+      }
+    }
+  }
 
   if (next_is_irq || irq_pending) {
     /* Keep interpreting to handle the IRQ. */
@@ -192,6 +409,14 @@ jit_interp_instruction_callback(void* p,
     return 1;
   }
 
+  if ((g_opbranch[optype] == k_bra_m) && (next_pc <= done_pc)) {
+    /* A taken backward branch into the middle of a block would split the
+     * block if the JIT ran it. Let it, rather than interpreting the whole
+     * loop because its head isn't a block start yet.
+     */
+    return 1;
+  }
+
   /* Keep interpreting. */
   return 0;
 }
@@ -201,25 +426,78 @@ struct jit_enter_interp_ret {
   int64_t exited;
 };
 
+static void jit_spec_compile(struct jit_struct* p_jit);
+
+static void
+jit_run_interp(struct jit_struct* p_jit,
+               struct jit_enter_interp_ret* p_ret,
+               int64_t countdown) {
+  uint32_t cpu_driver_flags;
+
+  struct cpu_driver* p_jit_cpu_driver = &p_jit->driver;
+  struct interp_struct* p_interp = p_jit->p_interp;
+
+  p_jit->counter_num_interps++;
+  p_jit->interp_pc = p_jit_cpu_driver->abi.p_state_6502->reg_pc;
+
+  countdown = interp_enter_with_details(p_interp,
+                                        countdown,
+                                        jit_interp_instruction_callback,
+                                        p_jit);
+
+  cpu_driver_flags = p_jit_cpu_driver->p_funcs->get_flags(p_jit_cpu_driver);
+  p_ret->countdown = countdown;
+  p_ret->exited = !!(cpu_driver_flags & k_cpu_flag_exited);
+
+  if ((p_jit->p_scanner != NULL) && !p_ret->exited) {
+    jit_spec_compile(p_jit);
+  }
+}
+
 static void
 jit_enter_interp(struct jit_struct* p_jit,
                  struct jit_enter_interp_ret* p_ret,
                  int64_t countdown,
                  uint64_t intel_rflags) {
-  uint32_t cpu_driver_flags;
-
   struct cpu_driver* p_jit_cpu_driver = &p_jit->driver;
   struct jit_compiler* p_compiler = p_jit->p_compiler;
-  struct interp_struct* p_interp = p_jit->p_interp;
   struct state_6502* p_state_6502 = p_jit_cpu_driver->abi.p_state_6502;
 
-  p_jit->counter_num_interps++;
-
   /* Take care of any deferred fault logging. */
   if (p_jit->do_fault_log) {
     p_jit->do_fault_log = 0;
     log_do_log(k_log_jit, k_log_info, "JIT handled fault (log every 1k)");
   }
+  /* A block that runs in decimal mode gets recompiled to handle it natively,
+   * so it only comes through here the once.
+   */
+  if (p_jit->bcd_fault_block_addr_6502 != -1) {
+    uint16_t block_addr_6502 = p_jit->bcd_fault_block_addr_6502;
+    p_jit->bcd_fault_block_addr_6502 = -1;
+    jit_compiler_set_decimal_block(p_compiler, block_addr_6502);
+    jit_invalidate_block_address(p_jit, block_addr_6502);
+    jit_compiler_unchain_block(p_compiler, block_addr_6502);
+  }
+  /* Likewise, an opcode that keeps faulting gets recompiled to check and
+   * branch instead, which saves a signal round trip every time.
+   */
+  if (p_jit->default_addr_6502 != -1) {
+    uint16_t addr_6502 = p_jit->default_addr_6502;
+    uint16_t block_addr_6502 = jit_6502_block_addr_from_6502(p_jit,
+                                                             addr_6502);
+    int level = jit_compiler_default_opcode(p_compiler, addr_6502);
+    p_jit->default_addr_6502 = -1;
+    p_jit->counter_num_defaults++;
+    if (p_jit->log_compile) {
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "default @$%.4X, level %d",
+                 addr_6502,
+                 level);
+    }
+    jit_invalidate_block_address(p_jit, block_addr_6502);
+    jit_compiler_unchain_block(p_compiler, block_addr_6502);
+  }
 
   /* Bouncing out of the JIT is quite jarring. We need to fixup up any state
    * that was temporarily stale due to optimizations.
@@ -227,174 +505,1713 @@ jit_enter_interp(struct jit_struct* p_jit,
   countdown = jit_compiler_fixup_state(p_compiler,
                                        p_state_6502,
                                        countdown,
-                                       intel_rflags);
+                                       intel_rflags,
+                                       (uint8_t) p_jit->host_zpc_value);
 
-  countdown = interp_enter_with_details(p_interp,
-                                        countdown,
-                                        jit_interp_instruction_callback,
-                                        p_jit);
+  /* A block that assumed register values on entry, arrived at with others,
+   * gets recompiled without the assumption.
+   */
+  if (jit_compiler_check_entry_state(p_compiler, p_state_6502)) {
+    uint16_t block_addr_6502 = p_state_6502->reg_pc;
+    p_jit->counter_entry_misses++;
+    if (p_jit->log_compile) {
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "entry state miss @$%.4X",
+                 block_addr_6502);
+    }
+    jit_invalidate_block_address(p_jit, block_addr_6502);
+    jit_compiler_unchain_block(p_compiler, block_addr_6502);
+  }
+
+  jit_run_interp(p_jit, p_ret, countdown);
+}
+
+static void
+jit_tier_reset(struct jit_struct* p_jit, uint16_t addr_6502, uint32_t len) {
+  /* Zero page and stack page code stays in the cold tier. That way, cold
+   * tier pushes never need to invalidate anything, and the compiler never
+   * needs its zero page code handling.
+   */
+  (void) memset(&p_jit->p_tier_counts[addr_6502], p_jit->tier_threshold, len);
+  (void) memset(&p_jit->p_tier_states[addr_6502], k_jit_tier_cold, len);
+  (void) memset(&p_jit->p_tier_invalidations[addr_6502], '\0', len);
+  if (addr_6502 < 0x200) {
+    uint32_t low_len = (0x200 - addr_6502);
+    if (low_len > len) {
+      low_len = len;
+    }
+    (void) memset(&p_jit->p_tier_states[addr_6502],
+                  k_jit_tier_demoted,
+                  low_len);
+  }
+}
+
+static void
+jit_tier_write_callback(void* p, uint16_t addr_6502) {
+  struct jit_struct* p_jit = (struct jit_struct*) p;
+
+  jit_invalidate_code_at_address(p_jit, addr_6502);
+}
+
+static void
+jit_tier_stub(struct jit_struct* p_jit, uint16_t addr_6502) {
+  /* Any JIT pointers left over from a block that started here go. In the
+   * standard layout they point into this slot, and a self-modify
+   * invalidation through one would land in the middle of the stub.
+   */
+  uint16_t i = addr_6502;
+  struct util_buffer* p_temp_buf = p_jit->p_temp_buf;
+
+  while (jit_6502_block_addr_from_6502(p_jit, i) == addr_6502) {
+    p_jit->jit_ptrs[i] = p_jit->jit_ptr_no_code;
+    i++;
+  }
+
+  util_buffer_setup(p_temp_buf,
+                    jit_get_jit_block_host_address(p_jit, addr_6502),
+                    ((size_t) 1 << p_jit->block_shift));
+  asm_x64_emit_jit_jump_tier(p_temp_buf, addr_6502);
+}
+
+static void
+jit_tier_promote(struct jit_struct* p_jit, uint16_t addr_6502) {
+  if (p_jit->p_tier_states[addr_6502] == k_jit_tier_cold) {
+    p_jit->p_tier_states[addr_6502] = k_jit_tier_hot;
+    p_jit->counter_tier_promotes++;
+    if (p_jit->log_tier) {
+      log_do_log(k_log_jit, k_log_info, "tier promote @$%.4X", addr_6502);
+    }
+    /* Replace the stub, so the next entry compiles. */
+    jit_invalidate_block_address(p_jit, addr_6502);
+  }
+  /* The cold tier stops here from now on, to hand over to the JIT. */
+  p_jit->p_tier_counts[addr_6502] = 0;
+}
+
+static int
+jit_tier_note_invalidation(struct jit_struct* p_jit,
+                           uint16_t block_addr_6502,
+                           uint16_t addr_6502) {
+  uint8_t count = p_jit->p_tier_invalidations[block_addr_6502];
+
+  if (count < k_jit_tier_demote_invalidations) {
+    p_jit->p_tier_invalidations[block_addr_6502] = (count + 1);
+    return 0;
+  }
+
+  /* Code that keeps rewriting itself is better off not being compiled at
+   * all. The block's next entry gets a stub, and so does the rewritten
+   * opcode, where execution picks up now.
+   */
+  p_jit->p_tier_states[block_addr_6502] = k_jit_tier_demoted;
+  p_jit->p_tier_states[addr_6502] = k_jit_tier_demoted;
+  p_jit->p_tier_counts[block_addr_6502] = p_jit->tier_threshold;
+  p_jit->p_tier_counts[addr_6502] = p_jit->tier_threshold;
+  p_jit->counter_tier_demotes++;
+  if (p_jit->log_tier) {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "tier demote @$%.4X",
+               block_addr_6502);
+  }
+
+  return 1;
+}
+
+static void
+jit_run_tier(struct jit_struct* p_jit,
+             struct jit_enter_interp_ret* p_ret,
+             int64_t countdown) {
+  int exited;
+  uint16_t addr_6502;
+
+  struct state_6502* p_state_6502 = p_jit->driver.abi.p_state_6502;
+  struct cpu_driver* p_tier = p_jit->p_tier;
+  uint64_t start_ns = os_time_get_ns();
+
+  while (1) {
+    exited = inturbo_enter_tier(p_tier, &countdown);
+    if (exited) {
+      break;
+    }
+    addr_6502 = state_6502_get_pc(p_state_6502);
+    if (p_jit->p_tier_states[addr_6502] != k_jit_tier_demoted) {
+      break;
+    }
+    /* Demoted code never leaves, it just gets a fresh count. */
+    p_jit->p_tier_counts[addr_6502] = 0xFF;
+  }
+
+  p_jit->tier_cold_ns += (os_time_get_ns() - start_ns);
 
-  cpu_driver_flags = p_jit_cpu_driver->p_funcs->get_flags(p_jit_cpu_driver);
   p_ret->countdown = countdown;
-  p_ret->exited = !!(cpu_driver_flags & k_cpu_flag_exited);
+  p_ret->exited = exited;
+  if (exited) {
+    /* The inturbo has its own interpreter, which may be what exited. */
+    struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+    p_interp_driver->p_funcs->apply_flags(p_interp_driver,
+                                          k_cpu_flag_exited,
+                                          0);
+    p_interp_driver->p_funcs->set_exit_value(
+        p_interp_driver, p_tier->p_funcs->get_exit_value(p_tier));
+    return;
+  }
+
+  jit_tier_promote(p_jit, addr_6502);
+
+  /* The inturbo bases X, Y and S on a different view of memory. */
+  p_state_6502->reg_x = ((p_state_6502->reg_x & 0xFF) |
+                         K_BBC_MEM_READ_IND_ADDR);
+  p_state_6502->reg_y = ((p_state_6502->reg_y & 0xFF) |
+                         K_BBC_MEM_READ_IND_ADDR);
+  p_state_6502->reg_s = ((p_state_6502->reg_s & 0x1FF) |
+                         K_BBC_MEM_READ_IND_ADDR);
 }
 
 static void
-jit_destroy(struct cpu_driver* p_cpu_driver) {
+jit_enter_tier(struct jit_struct* p_jit,
+               struct jit_enter_interp_ret* p_ret,
+               int64_t countdown,
+               uint64_t intel_rflags) {
+  /* Only ever entered at a block boundary, where the state is all exact. */
+  (void) intel_rflags;
+
+  jit_run_tier(p_jit, p_ret, countdown);
+}
+
+static void
+jit_tier_setup(struct jit_struct* p_jit, uint8_t threshold) {
+  struct cpu_driver* p_cpu_driver = &p_jit->driver;
+
+  p_jit->p_tier = cpu_driver_alloc(k_cpu_mode_inturbo,
+                                   p_cpu_driver->abi.p_state_6502,
+                                   p_cpu_driver->p_memory_access,
+                                   p_cpu_driver->p_timing,
+                                   p_cpu_driver->p_options);
+  if (p_jit->p_tier == NULL) {
+    util_bail("couldn't allocate inturbo tier");
+  }
+  p_jit->p_tier_counts = inturbo_set_tier(p_jit->p_tier,
+                                          &p_jit->jit_ptrs[0],
+                                          jit_tier_write_callback,
+                                          p_jit);
+  p_jit->p_tier_states = util_malloc(k_6502_addr_space_size);
+  p_jit->p_tier_invalidations = util_malloc(k_6502_addr_space_size);
+  p_jit->tier_threshold = threshold;
+  jit_tier_reset(p_jit, 0, k_6502_addr_space_size);
+  p_jit->p_tier_callback = jit_enter_tier;
+}
+
+static void
+jit_tier_destroy(struct jit_struct* p_jit) {
+  struct cpu_driver* p_tier = p_jit->p_tier;
+
+  /* Its interpreter may not have seen the exit. */
+  p_tier->p_funcs->apply_flags(p_tier, k_cpu_flag_exited, 0);
+  p_tier->p_funcs->destroy(p_tier);
+  util_free(p_jit->p_tier_states);
+  util_free(p_jit->p_tier_invalidations);
+  p_jit->p_tier = NULL;
+  p_jit->p_tier_counts = NULL;
+  p_jit->p_tier_states = NULL;
+  p_jit->p_tier_invalidations = NULL;
+  p_jit->p_tier_callback = NULL;
+}
+
+static void
+jit_do_hw_read_idle_loop(struct jit_struct* p_jit,
+                         uint16_t pc,
+                         uint8_t flags,
+                         int64_t* p_countdown) {
+  int32_t cycles;
+  int64_t iterations;
+  int is_taken;
+
+  struct cpu_driver* p_jit_cpu_driver = &p_jit->driver;
+  struct state_6502* p_state_6502 = p_jit_cpu_driver->abi.p_state_6502;
+  uint8_t* p_mem_read = p_jit_cpu_driver->p_memory_access->p_mem_read;
+  uint8_t opcode = p_mem_read[(uint16_t) (pc + 3)];
+
+  /* A polling loop on a VIA interrupt register. If the loop goes round again,
+   * every read up to the next timer gets the same value, so whole iterations
+   * can be skipped, as the compiled fast forward does for loops on RAM.
+   */
+  cycles = jit_compiler_get_idle_loop_cycles(p_jit->p_compiler, pc);
+  if (cycles == -1) {
+    return;
+  }
+  switch (g_optypes[opcode]) {
+  case k_bpl:
+    is_taken = !(flags & (1 << k_flag_negative));
+    break;
+  case k_bmi:
+    is_taken = !!(flags & (1 << k_flag_negative));
+    break;
+  case k_bvc:
+    is_taken = !(flags & (1 << k_flag_overflow));
+    break;
+  case k_bvs:
+    is_taken = !!(flags & (1 << k_flag_overflow));
+    break;
+  case k_bcc:
+    is_taken = !(flags & (1 << k_flag_carry));
+    break;
+  case k_bcs:
+    is_taken = !!(flags & (1 << k_flag_carry));
+    break;
+  case k_bne:
+    is_taken = !(flags & (1 << k_flag_zero));
+    break;
+  case k_beq:
+    is_taken = !!(flags & (1 << k_flag_zero));
+    break;
+  default:
+    is_taken = 0;
+    break;
+  }
+  if (!is_taken) {
+    return;
+  }
+
+  /* The read is on an iteration's last cycle, and the 1MHz stretch holds it
+   * for 1 more cycle, or 2 if it starts out of phase with the 1MHz clock.
+   * The stretch leaves the read ending in phase, so with an even iteration
+   * length, every iteration is stretched the same.
+   */
+  cycles += (1 + ((state_6502_get_cycles(p_state_6502) + cycles - 1) & 1));
+  if (cycles & 1) {
+    return;
+  }
+  /* Leave the last iteration before the timer to run for real, and the last
+   * read with it.
+   */
+  iterations = (((*p_countdown - k_jit_hw_read_max_cycles) / cycles) - 1);
+  if (iterations <= 0) {
+    return;
+  }
+  *p_countdown -= (iterations * cycles);
+  p_jit->counter_num_hw_idle_loops++;
+}
+
+static int
+jit_do_hw_read(struct jit_struct* p_jit, int64_t* p_countdown) {
+  uint8_t a;
+  uint8_t x;
+  uint8_t y;
+  uint8_t s;
+  uint8_t flags;
+  uint16_t pc;
+  uint16_t addr;
+  uint8_t opcode;
+  uint8_t v;
+  uint8_t reg;
+  int64_t countdown;
+
+  struct cpu_driver* p_jit_cpu_driver = &p_jit->driver;
+  struct state_6502* p_state_6502 = p_jit_cpu_driver->abi.p_state_6502;
+  struct timing_struct* p_timing = p_jit_cpu_driver->p_timing;
+  struct memory_access* p_memory_access = p_jit_cpu_driver->p_memory_access;
+  void* p_memory_obj = p_memory_access->p_callback_obj;
+  uint8_t* p_mem_read = p_memory_access->p_mem_read;
+
+  /* The interpreter is needed if an IRQ is asserted, because the read is also
+   * an IRQ poll point. It is also needed if a timer could fire during the
+   * read, because that is a cycle accurate affair.
+   * The read itself can lower IRQs (e.g. reading T1CL) but never raise one.
+   */
+  if (p_state_6502->irq_fire) {
+    return 0;
+  }
+  if (*p_countdown <= k_jit_hw_read_max_cycles) {
+    return 0;
+  }
+
+  state_6502_get_registers(p_state_6502, &a, &x, &y, &s, &flags, &pc);
+  /* Re-check the instruction in case it was modified since compilation. */
+  opcode = p_mem_read[pc];
+  if (g_opmodes[opcode] != k_abs) {
+    return 0;
+  }
+  addr = (p_mem_read[(uint16_t) (pc + 1)] |
+          (p_mem_read[(uint16_t) (pc + 2)] << 8));
+  if (!p_memory_access->memory_read_needs_callback(p_memory_obj, addr)) {
+    return 0;
+  }
+
+  switch (g_optypes[opcode]) {
+  case k_lda:
+  case k_and:
+  case k_ora:
+  case k_eor:
+  case k_cmp:
+  case k_bit:
+    reg = a;
+    break;
+  case k_ldx:
+  case k_cpx:
+    reg = x;
+    break;
+  case k_ldy:
+  case k_cpy:
+    reg = y;
+    break;
+  default:
+    return 0;
+  }
+
+  /* Same timing as the interpreter: the register access is on the last of
+   * the 4 cycles, and the read callback ticks that one, stretched or not.
+   */
+  (void) timing_advance_time(p_timing, (*p_countdown - 3));
+
+  v = p_memory_access->memory_read_callback(p_memory_obj, addr, 0);
+  countdown = timing_get_countdown(p_timing);
+
+  switch (g_optypes[opcode]) {
+  case k_lda:
+  case k_ldx:
+  case k_ldy:
+    reg = v;
+    break;
+  case k_and:
+    reg &= v;
+    break;
+  case k_ora:
+    reg |= v;
+    break;
+  case k_eor:
+    reg ^= v;
+    break;
+  case k_bit:
+    flags &= ~((1 << k_flag_overflow) | (1 << k_flag_negative));
+    flags |= (v & ((1 << k_flag_overflow) | (1 << k_flag_negative)));
+    v &= reg;
+    break;
+  case k_cmp:
+  case k_cpx:
+  case k_cpy:
+    flags &= ~(1 << k_flag_carry);
+    flags |= ((reg >= v) << k_flag_carry);
+    v = (reg - v);
+    break;
+  default:
+    assert(0);
+    break;
+  }
+
+  switch (g_optypes[opcode]) {
+  case k_lda:
+  case k_and:
+  case k_ora:
+  case k_eor:
+    a = reg;
+    v = reg;
+    break;
+  case k_ldx:
+    x = reg;
+    v = reg;
+    break;
+  case k_ldy:
+    y = reg;
+    v = reg;
+    break;
+  default:
+    break;
+  }
+  flags &= ~(1 << k_flag_zero);
+  flags |= ((v == 0) << k_flag_zero);
+  if (g_optypes[opcode] != k_bit) {
+    flags &= ~(1 << k_flag_negative);
+    flags |= (v & (1 << k_flag_negative));
+  }
+
+  state_6502_set_registers(p_state_6502, a, x, y, s, flags, (pc + 3));
+  *p_countdown = countdown;
+
+  jit_do_hw_read_idle_loop(p_jit, pc, flags, p_countdown);
+
+  return 1;
+}
+
+static void
+jit_enter_hw_read(struct jit_struct* p_jit,
+                  struct jit_enter_interp_ret* p_ret,
+                  int64_t countdown,
+                  uint64_t intel_rflags) {
+  struct cpu_driver* p_jit_cpu_driver = &p_jit->driver;
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+  struct state_6502* p_state_6502 = p_jit_cpu_driver->abi.p_state_6502;
+
+  countdown = jit_compiler_fixup_state(p_compiler,
+                                       p_state_6502,
+                                       countdown,
+                                       intel_rflags,
+                                       (uint8_t) p_jit->host_zpc_value);
+
+  if (jit_do_hw_read(p_jit, &countdown)) {
+    /* The compiler ends the block after the register read, so the JIT code
+     * resumes at a block start with a fresh countdown check.
+     */
+    p_jit->counter_num_hw_reads++;
+    p_ret->countdown = countdown;
+    p_ret->exited = 0;
+    return;
+  }
+
+  jit_run_interp(p_jit, p_ret, countdown);
+}
+
+static int
+jit_profile_compare(const void* p1, const void* p2) {
+  const struct jit_profile_report_line* p_line1 = p1;
+  const struct jit_profile_report_line* p_line2 = p2;
+
+  if (p_line1->samples != p_line2->samples) {
+    return (p_line1->samples < p_line2->samples) ? 1 : -1;
+  }
+  if (p_line1->cycles != p_line2->cycles) {
+    return (p_line1->cycles < p_line2->cycles) ? 1 : -1;
+  }
+  return (p_line1->addr_6502 - p_line2->addr_6502);
+}
+
+static void
+jit_dump_profile(struct cpu_driver* p_cpu_driver) {
+  struct jit_profile_report_line* p_lines;
+  uint32_t num_lines;
+  uint32_t i;
+  uint64_t total_samples;
+  uint64_t total_cycles;
+
   struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct cpu_driver* p_interp_cpu_driver = (struct cpu_driver*) p_jit->p_interp;
 
-  p_interp_cpu_driver->p_funcs->destroy(p_interp_cpu_driver);
+  if (p_jit->p_profile_blocks == NULL) {
+    log_do_log(k_log_perf,
+               k_log_info,
+               "JIT profile not enabled, use -opt jit:profile");
+    return;
+  }
 
-  util_buffer_destroy(p_jit->p_compile_buf);
-  util_buffer_destroy(p_jit->p_temp_buf);
+  p_lines = util_malloc(k_6502_addr_space_size * sizeof(*p_lines));
+  num_lines = 0;
+  total_cycles = 0;
+  for (i = 0; i < k_6502_addr_space_size; ++i) {
+    struct jit_profile_block* p_block = &p_jit->p_profile_blocks[i];
+    struct jit_profile_report_line* p_line = &p_lines[num_lines];
+
+    p_line->addr_6502 = i;
+    p_line->samples = p_block->samples;
+    p_line->cycles = p_jit->p_profile_cycles[i];
+    p_line->entries = p_jit->p_profile_entries[i];
+    p_line->compiles = p_block->compiles;
+    p_line->invalidations = p_block->invalidations;
+    p_line->faults = p_block->faults;
+    total_cycles += p_line->cycles;
+    if (p_line->samples || p_line->cycles || p_line->compiles) {
+      num_lines++;
+    }
+  }
 
-  jit_compiler_destroy(p_jit->p_compiler);
+  qsort(p_lines, num_lines, sizeof(*p_lines), jit_profile_compare);
+
+  total_samples = p_jit->profile_samples_total;
+  log_do_log(k_log_perf,
+             k_log_info,
+             "JIT profile: %"PRIu64" samples (%"PRIu64" outside JIT code), "
+             "%"PRIu64" JIT cycles, %u blocks",
+             total_samples,
+             p_jit->profile_samples_other,
+             total_cycles,
+             num_lines);
+  log_do_log(k_log_perf,
+             k_log_info,
+             "block  samples     %%       cycles      entries compiles "
+             "invals   faults");
+  for (i = 0; (i < num_lines) && (i < k_jit_profile_max_report_blocks); ++i) {
+    struct jit_profile_report_line* p_line = &p_lines[i];
+    double percent = 0.0;
+    if (total_samples) {
+      percent = ((p_line->samples * 100.0) / total_samples);
+    }
+    log_do_log(k_log_perf,
+               k_log_info,
+               "$%.4X %8"PRIu64" %5.1f %12"PRIu64" %12"PRIu64" %8"PRIu64
+               " %8"PRIu64" %8"PRIu64,
+               p_line->addr_6502,
+               p_line->samples,
+               percent,
+               p_line->cycles,
+               p_line->entries,
+               p_line->compiles,
+               p_line->invalidations,
+               p_line->faults);
+  }
+
+  util_free(p_lines);
+}
+
+static void
+jit_profile_sample_callback(void* p, uintptr_t host_rip) {
+  /* NOTE: called in signal context, and only ever on one thread. */
+  struct jit_struct* p_jit = (struct jit_struct*) p;
+  uint8_t* p_rip = (uint8_t*) host_rip;
+  uint8_t* p_jit_base = p_jit->p_jit_base;
+  uint8_t* p_jit_end = (p_jit_base +
+                        (k_6502_addr_space_size * k_jit_bytes_per_byte));
+
+  p_jit->profile_samples_total++;
+  if ((p_rip >= p_jit_base) && (p_rip < p_jit_end)) {
+    uint16_t block_addr_6502 = jit_6502_block_addr_from_host(p_jit, p_rip);
+    p_jit->p_profile_blocks[block_addr_6502].samples++;
+  } else {
+    p_jit->profile_samples_other++;
+  }
+}
+
+static uint64_t
+jit_get_num_fusions(struct jit_struct* p_jit) {
+  uint64_t num_fusions = 0;
+  int i;
+
+  for (i = 0; i < k_jit_fusion_num_kinds; ++i) {
+    num_fusions += jit_compiler_get_fusion_count(p_jit->p_compiler, i);
+  }
+
+  return num_fusions;
+}
+
+static void
+jit_log_fusions(struct jit_struct* p_jit) {
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+
+  if (!p_jit->log_fusions) {
+    return;
+  }
+  log_do_log(k_log_jit,
+             k_log_info,
+             "fused multi-byte ops: %"PRIu64" shift, %"PRIu64" copy, "
+             "%"PRIu64" add",
+             jit_compiler_get_fusion_count(p_compiler, k_jit_fusion_shift),
+             jit_compiler_get_fusion_count(p_compiler, k_jit_fusion_copy),
+             jit_compiler_get_fusion_count(p_compiler, k_jit_fusion_add));
+}
+
+static void
+jit_latency_record(uint64_t* p_buckets, uint64_t start_ns) {
+  uint64_t us = ((os_time_get_ns() - start_ns) / 1000);
+  uint32_t bucket = 0;
+
+  while ((us > 0) && (bucket < (k_jit_latency_buckets - 1))) {
+    us >>= 1;
+    bucket++;
+  }
+  p_buckets[bucket]++;
+}
+
+static void
+jit_latency_log(uint64_t* p_buckets, const char* p_name) {
+  char buf[512];
+  uint32_t i;
+
+  size_t pos = 0;
+
+  for (i = 0; i < k_jit_latency_buckets; ++i) {
+    if (p_buckets[i] == 0) {
+      continue;
+    }
+    if (i == 0) {
+      pos += snprintf(&buf[pos], (sizeof(buf) - pos), " <1us %"PRIu64",",
+                      p_buckets[i]);
+    } else if (i == (k_jit_latency_buckets - 1)) {
+      pos += snprintf(&buf[pos], (sizeof(buf) - pos), " 1ms+ %"PRIu64",",
+                      p_buckets[i]);
+    } else {
+      pos += snprintf(&buf[pos], (sizeof(buf) - pos), " %uus+ %"PRIu64",",
+                      (1u << (i - 1)), p_buckets[i]);
+    }
+  }
+  if (pos == 0) {
+    return;
+  }
+  buf[pos - 1] = '\0';
+  log_do_log(k_log_jit, k_log_info, "%s compile latency:%s", p_name, buf);
+}
+
+static void
+jit_destroy(struct cpu_driver* p_cpu_driver) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct cpu_driver* p_interp_cpu_driver = (struct cpu_driver*) p_jit->p_interp;
+
+  p_interp_cpu_driver->p_funcs->destroy(p_interp_cpu_driver);
+
+  if (p_jit->p_profile_blocks != NULL) {
+    if (p_jit->is_profile_sampling) {
+      os_fault_stop_sampling();
+    }
+    jit_dump_profile(p_cpu_driver);
+    util_free(p_jit->p_profile_blocks);
+    os_alloc_free_mapping(p_jit->p_mapping_profile);
+  }
+
+  if (p_jit->p_cache != NULL) {
+    if (p_jit->p_cache_file_name != NULL) {
+      jit_cache_save(p_jit->p_cache, p_jit->p_cache_file_name);
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "saved %u JIT cache entries to %s",
+                 jit_cache_get_num_entries(p_jit->p_cache),
+                 p_jit->p_cache_file_name);
+      util_free(p_jit->p_cache_file_name);
+    }
+    jit_cache_destroy(p_jit->p_cache);
+  }
+
+  if (p_jit->p_fault_counts != NULL) {
+    util_free(p_jit->p_fault_counts);
+  }
+  if (p_jit->p_arena_granules != NULL) {
+    util_free(p_jit->p_arena_granules);
+  }
+  if (p_jit->p_arena_live_blocks != NULL) {
+    util_free(p_jit->p_arena_live_blocks);
+  }
+  if (p_jit->p_scanner != NULL) {
+    jit_scanner_destroy(p_jit->p_scanner);
+  }
+  if (p_jit->log_compile_latency) {
+    jit_latency_log(&p_jit->demand_latency[0], "demand");
+    jit_latency_log(&p_jit->spec_latency[0], "speculative");
+  }
+  if (p_jit->p_tier != NULL) {
+    if (p_jit->log_tier) {
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "tiers: %"PRIu64" promoted, %"PRIu64" demoted, "
+                 "%"PRIu64"ms cold of %"PRIu64"ms",
+                 p_jit->counter_tier_promotes,
+                 p_jit->counter_tier_demotes,
+                 (p_jit->tier_cold_ns / 1000000),
+                 (p_jit->tier_total_ns / 1000000));
+    }
+    jit_tier_destroy(p_jit);
+  }
+
+  if (p_jit->p_banks != NULL) {
+    uint32_t i;
+    for (i = 0; i < k_jit_num_banks; ++i) {
+      struct jit_bank* p_bank = &p_jit->p_banks[i];
+      if (p_bank->p_mem == NULL) {
+        continue;
+      }
+      util_free(p_bank->p_mem);
+      util_free(p_bank->p_jit_ptrs);
+      util_free(p_bank->p_compiler_state);
+      util_free(p_bank->p_host_code);
+    }
+    util_free(p_jit->p_banks);
+  }
+
+  util_buffer_destroy(p_jit->p_compile_buf);
+  util_buffer_destroy(p_jit->p_temp_buf);
+
+  jit_log_fusions(p_jit);
+  jit_compiler_destroy(p_jit->p_compiler);
+
+  os_alloc_free_mapping(p_jit->p_mapping_jit);
+  os_alloc_free_mapping(p_jit->p_mapping_trampolines);
+
+  os_alloc_free_aligned(p_cpu_driver);
+}
+
+static int
+jit_enter(struct cpu_driver* p_cpu_driver) {
+  int exited;
+  uint32_t uint_start_addr;
+  int64_t countdown;
+
+  uint64_t start_ns = 0;
+
+  struct timing_struct* p_timing = p_cpu_driver->p_timing;
+  struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
+  uint16_t addr_6502 = state_6502_get_pc(p_state_6502);
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  uint8_t* p_start_addr = jit_get_jit_block_host_address(p_jit, addr_6502);
+  void* p_mem_base = ((void*) K_BBC_MEM_READ_IND_ADDR + REG_MEM_OFFSET);
+
+  uint_start_addr = (uint32_t) (size_t) p_start_addr;
+
+  countdown = timing_get_countdown(p_timing);
+
+  /* The memory must be aligned to at least 0x100 so that our register access
+   * tricks work.
+   */
+  assert((K_BBC_MEM_READ_IND_ADDR & 0xff) == 0);
+
+  p_state_6502->reg_x = ((p_state_6502->reg_x & 0xFF) |
+                         K_BBC_MEM_READ_IND_ADDR);
+  p_state_6502->reg_y = ((p_state_6502->reg_y & 0xFF) |
+                         K_BBC_MEM_READ_IND_ADDR);
+  p_state_6502->reg_s = ((p_state_6502->reg_s & 0x1FF) |
+                         K_BBC_MEM_READ_IND_ADDR);
+
+  if (p_jit->p_tier != NULL) {
+    start_ns = os_time_get_ns();
+  }
+
+  /* Sampling follows the thread that enters, which is the CPU thread. */
+  if ((p_jit->p_profile_blocks != NULL) && !p_jit->is_profile_sampling) {
+    os_fault_start_sampling(jit_profile_sample_callback,
+                            p_jit,
+                            k_jit_profile_sample_us);
+    p_jit->is_profile_sampling = 1;
+  }
+
+  exited = asm_x64_asm_enter(p_jit, uint_start_addr, countdown, p_mem_base);
+  assert(exited == 1);
+
+  if (p_jit->p_tier != NULL) {
+    p_jit->tier_total_ns += (os_time_get_ns() - start_ns);
+  }
+
+  return exited;
+}
+
+static void
+jit_set_reset_callback(struct cpu_driver* p_cpu_driver,
+                       void (*do_reset_callback)(void* p, uint32_t flags),
+                       void* p_do_reset_callback_object) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+
+  p_interp_driver->p_funcs->set_reset_callback(p_interp_driver,
+                                               do_reset_callback,
+                                               p_do_reset_callback_object);
+  /* The cold tier's interpreter gets the same flags and callbacks. */
+  if (p_jit->p_tier != NULL) {
+    p_jit->p_tier->p_funcs->set_reset_callback(p_jit->p_tier,
+                                               do_reset_callback,
+                                               p_do_reset_callback_object);
+  }
+}
+
+static void
+jit_apply_flags(struct cpu_driver* p_cpu_driver,
+                uint32_t flags_set,
+                uint32_t flags_clear) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+
+  p_interp_driver->p_funcs->apply_flags(p_interp_driver,
+                                        flags_set,
+                                        flags_clear);
+  if (p_jit->p_tier != NULL) {
+    p_jit->p_tier->p_funcs->apply_flags(p_jit->p_tier, flags_set, flags_clear);
+  }
+}
+
+static uint32_t
+jit_get_flags(struct cpu_driver* p_cpu_driver) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+
+  return p_interp_driver->p_funcs->get_flags(p_interp_driver);
+}
+
+
+static uint32_t
+jit_get_exit_value(struct cpu_driver* p_cpu_driver) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+
+  return p_interp_driver->p_funcs->get_exit_value(p_interp_driver);
+}
+
+static void
+jit_set_exit_value(struct cpu_driver* p_cpu_driver, uint32_t exit_value) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+
+  p_interp_driver->p_funcs->set_exit_value(p_interp_driver, exit_value);
+  if (p_jit->p_tier != NULL) {
+    p_jit->p_tier->p_funcs->set_exit_value(p_jit->p_tier, exit_value);
+  }
+}
+
+static void
+jit_memory_range_invalidate(struct cpu_driver* p_cpu_driver,
+                            uint16_t addr,
+                            uint32_t len) {
+  uint32_t i;
+
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  uint32_t addr_end = (addr + len);
+
+  assert(len <= k_6502_addr_space_size);
+  assert(addr_end <= k_6502_addr_space_size);
+
+  if (p_jit->log_compile) {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "invalidate range $%.4X-$%.4X",
+               addr,
+               (addr_end - 1));
+  }
+
+  assert(addr_end >= addr);
+
+  for (i = addr; i < addr_end; ++i) {
+    /* Pages the compiler never touched since they were last wiped are
+     * already in the invalidated state.
+     */
+    if (!jit_compiler_is_page_live(p_jit->p_compiler, i)) {
+      i |= 0xFF;
+      continue;
+    }
+    jit_invalidate_code_at_address(p_jit, i);
+    jit_invalidate_block_address(p_jit, i);
+    p_jit->jit_ptrs[i] = p_jit->jit_ptr_no_code;
+  }
+
+  jit_compiler_memory_range_invalidate(p_jit->p_compiler, addr, len);
+
+  /* Anything in the range is new code, cold until it runs enough. */
+  if (p_jit->p_tier != NULL) {
+    jit_tier_reset(p_jit, addr, len);
+  }
+
+  if ((p_jit->p_banks == NULL) ||
+      (addr > k_jit_bank_addr) ||
+      (addr_end < (k_jit_bank_addr + k_jit_bank_len))) {
+    return;
+  }
+  p_jit->bank_live_pages = 0;
+  /* A wholesale invalidation, e.g. power on or a switch to compiling for code
+   * in zero page, applies to the banks put aside too.
+   */
+  if ((addr < k_jit_bank_addr) ||
+      (addr_end > (k_jit_bank_addr + k_jit_bank_len))) {
+    for (i = 0; i < k_jit_num_banks; ++i) {
+      p_jit->p_banks[i].is_valid = 0;
+    }
+  }
+}
+
+static int
+jit_is_bank_window_straddled(struct jit_struct* p_jit) {
+  /* A block that runs over either edge of the window can't be put aside with
+   * the window.
+   */
+  uint16_t bank_end = (k_jit_bank_addr + k_jit_bank_len);
+  uint16_t block_addr_6502;
+
+  if (jit_has_6502_code(p_jit, k_jit_bank_addr)) {
+    block_addr_6502 = jit_6502_block_addr_from_6502(p_jit, k_jit_bank_addr);
+    if (block_addr_6502 != k_jit_bank_addr) {
+      return 1;
+    }
+  }
+  if (jit_has_6502_code(p_jit, bank_end)) {
+    block_addr_6502 = jit_6502_block_addr_from_6502(p_jit, bank_end);
+    if ((block_addr_6502 >= k_jit_bank_addr) && (block_addr_6502 < bank_end)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static inline int
+jit_is_block_start(struct jit_struct* p_jit, uint16_t addr_6502) {
+  if (!jit_has_6502_code(p_jit, addr_6502)) {
+    return 0;
+  }
+  return (jit_6502_block_addr_from_6502(p_jit, addr_6502) == addr_6502);
+}
+
+static void
+jit_bank_note_compile(struct jit_struct* p_jit,
+                      uint16_t addr_6502,
+                      uint32_t len) {
+  /* Notes the window pages that now have compiled code or compiler state, so
+   * that bank switches only look at those. The address just past the block
+   * may pick up a block start.
+   */
+  uint32_t addr;
+  uint32_t addr_last = (addr_6502 + len);
+
+  if (p_jit->p_banks == NULL) {
+    return;
+  }
+  for (addr = (addr_6502 & 0xFF00); addr <= addr_last; addr += 0x100) {
+    if ((addr < k_jit_bank_addr) ||
+        (addr >= (k_jit_bank_addr + k_jit_bank_len))) {
+      continue;
+    }
+    p_jit->bank_live_pages |= ((uint64_t) 1 << ((addr - k_jit_bank_addr) >> 8));
+  }
+}
+
+static void
+jit_bank_reset_pages(struct jit_struct* p_jit, uint64_t pages) {
+  uint32_t i;
+
+  for (i = 0; i < k_jit_bank_num_pages; ++i) {
+    if (!(pages & ((uint64_t) 1 << i))) {
+      continue;
+    }
+    jit_memory_range_invalidate(&p_jit->driver,
+                                (k_jit_bank_addr + (i * 0x100)),
+                                0x100);
+  }
+  p_jit->bank_live_pages &= ~pages;
+}
+
+static void
+jit_bank_save(struct jit_struct* p_jit,
+              struct jit_bank* p_bank,
+              uint8_t* p_old_mem) {
+  uint32_t i;
+  uint32_t j;
+
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+  uint32_t page_state_size = jit_compiler_get_range_state_size(p_compiler,
+                                                               0x100);
+  /* In the code arena layout, this is just the jump to the block, which
+   * stays put in the arena.
+   */
+  uint32_t slot_size = (1 << p_jit->block_shift);
+
+  if (p_bank->p_mem == NULL) {
+    p_bank->p_mem = util_malloc(k_jit_bank_len);
+    p_bank->p_jit_ptrs = util_malloc(k_jit_bank_len * sizeof(uint32_t));
+    p_bank->p_compiler_state =
+        util_malloc(k_jit_bank_num_pages * page_state_size);
+    p_bank->p_host_code = util_malloc(k_jit_bank_len * slot_size);
+  }
+
+  (void) memcpy(p_bank->p_mem, p_old_mem, k_jit_bank_len);
+  p_bank->pages = p_jit->bank_live_pages;
+  p_bank->num_blocks = 0;
+
+  /* Pages without compiled code are in the invalidated state, so there's
+   * nothing to keep for them.
+   */
+  for (i = 0; i < k_jit_bank_num_pages; ++i) {
+    uint32_t offset = (i * 0x100);
+    uint16_t page_addr_6502 = (k_jit_bank_addr + offset);
+
+    if (!(p_bank->pages & ((uint64_t) 1 << i))) {
+      continue;
+    }
+    (void) memcpy((p_bank->p_jit_ptrs + offset),
+                  &p_jit->jit_ptrs[page_addr_6502],
+                  (0x100 * sizeof(uint32_t)));
+    jit_compiler_save_range_state(
+        p_compiler,
+        (p_bank->p_compiler_state + (i * page_state_size)),
+        page_addr_6502,
+        0x100);
+
+    /* Only block starts are entered, so only their host code is kept. */
+    for (j = 0; j < 0x100; ++j) {
+      uint16_t addr_6502 = (page_addr_6502 + j);
+      if (!jit_is_block_start(p_jit, addr_6502)) {
+        continue;
+      }
+      (void) memcpy(
+          (p_bank->p_host_code + ((offset + j) * slot_size)),
+          jit_get_jit_block_host_address(p_jit, addr_6502),
+          slot_size);
+      p_bank->num_blocks++;
+    }
+  }
+
+  p_bank->is_valid = 1;
+}
+
+static void
+jit_bank_restore(struct jit_struct* p_jit, struct jit_bank* p_bank) {
+  uint32_t i;
+  uint32_t j;
+
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+  uint32_t page_state_size = jit_compiler_get_range_state_size(p_compiler,
+                                                               0x100);
+  /* In the code arena layout, this is just the jump to the block, which
+   * stays put in the arena.
+   */
+  uint32_t slot_size = (1 << p_jit->block_shift);
+
+  /* Pages only the outgoing bank has code in go back to the invalidated
+   * state. This unchains using the outgoing bank's state, which only touches
+   * the window.
+   */
+  jit_bank_reset_pages(p_jit, (p_jit->bank_live_pages & ~p_bank->pages));
+
+  for (i = 0; i < k_jit_bank_num_pages; ++i) {
+    uint32_t offset = (i * 0x100);
+    uint16_t page_addr_6502 = (k_jit_bank_addr + offset);
+
+    if (!(p_bank->pages & ((uint64_t) 1 << i))) {
+      continue;
+    }
+    (void) memcpy(&p_jit->jit_ptrs[page_addr_6502],
+                  (p_bank->p_jit_ptrs + offset),
+                  (0x100 * sizeof(uint32_t)));
+    jit_compiler_load_range_state(
+        p_compiler,
+        (p_bank->p_compiler_state + (i * page_state_size)),
+        page_addr_6502,
+        0x100);
+
+    for (j = 0; j < 0x100; ++j) {
+      uint16_t addr_6502 = (page_addr_6502 + j);
+      uint8_t* p_jit_ptr = jit_get_jit_block_host_address(p_jit, addr_6502);
+      if (jit_is_block_start(p_jit, addr_6502)) {
+        (void) memcpy(
+            p_jit_ptr,
+            (p_bank->p_host_code + ((offset + j) * slot_size)),
+            slot_size);
+      } else {
+        jit_invalidate_host_address(p_jit, p_jit_ptr);
+      }
+    }
+  }
+
+  p_jit->bank_live_pages = p_bank->pages;
+}
+
+static void
+jit_memory_range_bank_switch(struct cpu_driver* p_cpu_driver,
+                             uint16_t addr,
+                             uint32_t len,
+                             uint8_t* p_old_mem,
+                             uint32_t old_bank,
+                             uint32_t new_bank) {
+  struct jit_bank* p_bank;
+
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  uint8_t* p_mem_read = p_cpu_driver->p_memory_access->p_mem_read;
+
+  if ((p_jit->p_banks == NULL) ||
+      (addr != k_jit_bank_addr) ||
+      (len != k_jit_bank_len) ||
+      (old_bank >= k_jit_num_banks) ||
+      (new_bank >= k_jit_num_banks)) {
+    jit_memory_range_invalidate(p_cpu_driver, addr, len);
+    return;
+  }
+
+  p_jit->counter_bank_switches++;
+
+  p_bank = &p_jit->p_banks[new_bank];
+  if (jit_is_bank_window_straddled(p_jit)) {
+    p_jit->p_banks[old_bank].is_valid = 0;
+    p_bank->is_valid = 0;
+  } else {
+    jit_bank_save(p_jit, &p_jit->p_banks[old_bank], p_old_mem);
+  }
+
+  if (p_bank->is_valid &&
+      (memcmp(p_bank->p_mem, (p_mem_read + addr), len) == 0)) {
+    jit_bank_restore(p_jit, p_bank);
+    p_jit->counter_bank_blocks_kept += p_bank->num_blocks;
+    if (p_jit->log_compile) {
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "bank %u -> %u, kept %u blocks",
+                 old_bank,
+                 new_bank,
+                 p_bank->num_blocks);
+    }
+  } else {
+    jit_bank_reset_pages(p_jit, p_jit->bank_live_pages);
+  }
+  /* The live state will move on from the copy. */
+  p_bank->is_valid = 0;
+}
+
+static char*
+jit_get_address_info(struct cpu_driver* p_cpu_driver, uint16_t addr) {
+  static char block_addr_buf[64];
+  struct jit_smc_info smc_info;
+
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  uint16_t block_addr_6502 = jit_6502_block_addr_from_6502(p_jit, addr);
+
+  jit_compiler_get_smc_info(p_jit->p_compiler, &smc_info, addr);
+
+  switch (smc_info.smc_class) {
+  case k_jit_smc_none:
+    (void) snprintf(block_addr_buf,
+                    sizeof(block_addr_buf),
+                    "%.4X",
+                    block_addr_6502);
+    break;
+  case k_jit_smc_operand:
+    (void) snprintf(block_addr_buf,
+                    sizeof(block_addr_buf),
+                    "%.4X smc %s x%u $%.4X-$%.4X %s",
+                    block_addr_6502,
+                    jit_compiler_get_smc_class_name(smc_info.smc_class),
+                    smc_info.num_operand_writes,
+                    smc_info.operand_min,
+                    smc_info.operand_max,
+                    jit_compiler_get_smc_strategy_name(smc_info.strategy));
+    break;
+  default:
+    (void) snprintf(block_addr_buf,
+                    sizeof(block_addr_buf),
+                    "%.4X smc %s x%u %.2X/%.2X%s %s",
+                    block_addr_6502,
+                    jit_compiler_get_smc_class_name(smc_info.smc_class),
+                    smc_info.num_opcode_writes,
+                    smc_info.opcodes[0],
+                    smc_info.opcodes[1],
+                    ((smc_info.num_opcodes > k_jit_smc_max_variants) ?
+                        "/.." : ""),
+                    jit_compiler_get_smc_strategy_name(smc_info.strategy));
+    break;
+  }
+
+  return block_addr_buf;
+}
+
+static uint32_t
+jit_get_custom_counters(struct cpu_driver* p_cpu_driver,
+                        const char** p_names,
+                        uint64_t* p_values) {
+  uint32_t num_counters = 0;
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+
+  p_names[num_counters] = "compile";
+  p_values[num_counters++] = p_jit->counter_num_compiles;
+  p_names[num_counters] = "interp";
+  p_values[num_counters++] = p_jit->counter_num_interps;
+  p_names[num_counters] = "hwread";
+  p_values[num_counters++] = p_jit->counter_num_hw_reads;
+  p_names[num_counters] = "hwread-idle";
+  p_values[num_counters++] = p_jit->counter_num_hw_idle_loops;
+  p_names[num_counters] = "fuse";
+  p_values[num_counters++] = jit_get_num_fusions(p_jit);
+  p_names[num_counters] = "fault";
+  p_values[num_counters++] = p_jit->counter_num_faults;
+  p_names[num_counters] = "entry-miss";
+  p_values[num_counters++] = p_jit->counter_entry_misses;
+  p_names[num_counters] = "idle-loop";
+  p_values[num_counters++] =
+      jit_compiler_get_num_idle_loops(p_jit->p_compiler);
+  if (p_jit->p_fault_counts != NULL) {
+    p_names[num_counters] = "default";
+    p_values[num_counters++] = p_jit->counter_num_defaults;
+  }
+
+  if (p_jit->p_cache != NULL) {
+    p_names[num_counters] = "cache-hit";
+    p_values[num_counters++] = p_jit->counter_cache_hits;
+    p_names[num_counters] = "cache-miss";
+    p_values[num_counters++] = p_jit->counter_cache_misses;
+    p_names[num_counters] = "cache-stale";
+    p_values[num_counters++] = p_jit->counter_cache_stale;
+  }
+  if (p_jit->p_banks != NULL) {
+    p_names[num_counters] = "bank-switch";
+    p_values[num_counters++] = p_jit->counter_bank_switches;
+    p_names[num_counters] = "bank-keep";
+    p_values[num_counters++] = p_jit->counter_bank_blocks_kept;
+  }
+  if (p_jit->p_arena != NULL) {
+    p_names[num_counters] = "arena-flush";
+    p_values[num_counters++] = p_jit->counter_arena_flushes;
+    p_names[num_counters] = "arena-compact";
+    p_values[num_counters++] = p_jit->counter_arena_compactions;
+  }
+  if (p_jit->p_scanner != NULL) {
+    p_names[num_counters] = "spec-compile";
+    p_values[num_counters++] = p_jit->counter_spec_compiles;
+    p_names[num_counters] = "spec-held-hit";
+    p_values[num_counters++] = p_jit->counter_spec_held_hits;
+    p_names[num_counters] = "prep-opcode";
+    p_values[num_counters++] =
+        jit_compiler_get_num_prep_opcodes(p_jit->p_compiler);
+  }
+  if (p_jit->p_tier != NULL) {
+    p_names[num_counters] = "tier-promote";
+    p_values[num_counters++] = p_jit->counter_tier_promotes;
+    p_names[num_counters] = "tier-demote";
+    p_values[num_counters++] = p_jit->counter_tier_demotes;
+    p_names[num_counters] = "tier-cold-ms";
+    p_values[num_counters++] = (p_jit->tier_cold_ns / 1000000);
+  }
+
+  assert(num_counters <= k_cpu_driver_max_custom_counters);
+
+  return num_counters;
+}
 
-  os_alloc_free_mapping(p_jit->p_mapping_jit);
-  os_alloc_free_mapping(p_jit->p_mapping_trampolines);
+static void
+jit_setup_compile_buf(struct jit_struct* p_jit, uint16_t addr_6502) {
+  uint8_t* p_code = jit_get_jit_block_host_address(p_jit, addr_6502);
 
-  os_alloc_free_aligned(p_cpu_driver);
+  if (p_jit->p_arena != NULL) {
+    assert((p_jit->p_arena_end - p_jit->p_arena_pos) >= k_jit_bytes_per_byte);
+    p_code = p_jit->p_arena_pos;
+  }
+  util_buffer_setup(p_jit->p_compile_buf, p_code, k_jit_bytes_per_byte);
 }
 
-static int
-jit_enter(struct cpu_driver* p_cpu_driver) {
-  int exited;
-  uint32_t uint_start_addr;
-  int64_t countdown;
+static void
+jit_arena_commit(struct jit_struct* p_jit, uint16_t addr_6502) {
+  /* Claim the arena space the block used and point its entry slot at it. */
+  uint32_t i;
+  uint32_t len;
+  size_t granule;
+  struct util_buffer* p_buf;
 
-  struct timing_struct* p_timing = p_cpu_driver->p_timing;
-  struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
-  uint16_t addr_6502 = state_6502_get_pc(p_state_6502);
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  uint8_t* p_start_addr = jit_get_jit_block_host_address(p_jit, addr_6502);
-  void* p_mem_base = ((void*) K_BBC_MEM_READ_IND_ADDR + REG_MEM_OFFSET);
+  if (p_jit->p_arena == NULL) {
+    return;
+  }
 
-  uint_start_addr = (uint32_t) (size_t) p_start_addr;
+  len = jit_compiler_get_compile_code_len(p_jit->p_compiler);
+  len = ((len + (1 << k_jit_arena_granule_shift) - 1) >>
+         k_jit_arena_granule_shift);
+  granule = ((p_jit->p_arena_pos - p_jit->p_arena) >>
+             k_jit_arena_granule_shift);
+  for (i = 0; i < len; ++i) {
+    p_jit->p_arena_granules[granule + i] = addr_6502;
+  }
+  p_jit->p_arena_granules[granule] |= k_jit_arena_granule_block_start;
 
-  countdown = timing_get_countdown(p_timing);
+  p_buf = p_jit->p_temp_buf;
+  util_buffer_setup(p_buf,
+                    jit_get_jit_block_host_address(p_jit, addr_6502),
+                    (1 << p_jit->block_shift));
+  asm_x64_emit_jit_JMP(p_buf, p_jit->p_arena_pos);
 
-  /* The memory must be aligned to at least 0x100 so that our register access
-   * tricks work.
+  p_jit->p_arena_pos += (len << k_jit_arena_granule_shift);
+}
+
+static void
+jit_note_code_pages(struct jit_struct* p_jit,
+                    uint16_t addr_6502,
+                    uint32_t len) {
+  /* Zero page and stack page writes only carry self-modify invalidation once
+   * code has been seen in those pages. When code first turns up there, only
+   * the blocks that wrote to the page without invalidation are thrown away.
    */
-  assert((K_BBC_MEM_READ_IND_ADDR & 0xff) == 0);
+  uint32_t i;
+  int new_pages = 0;
+  uint32_t addr_end = (addr_6502 + len - 1);
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
 
-  p_state_6502->reg_x = ((p_state_6502->reg_x & 0xFF) |
-                         K_BBC_MEM_READ_IND_ADDR);
-  p_state_6502->reg_y = ((p_state_6502->reg_y & 0xFF) |
-                         K_BBC_MEM_READ_IND_ADDR);
-  p_state_6502->reg_s = ((p_state_6502->reg_s & 0x1FF) |
-                         K_BBC_MEM_READ_IND_ADDR);
+  if (addr_6502 <= 0xFF) {
+    new_pages |= k_jit_compiler_code_page_zero;
+  }
+  if ((addr_6502 <= 0x1FF) && (addr_end >= 0x100)) {
+    new_pages |= k_jit_compiler_code_page_stack;
+  }
+  new_pages &= ~jit_compiler_get_code_pages(p_compiler);
+  if (!new_pages) {
+    return;
+  }
 
-  exited = asm_x64_asm_enter(p_jit, uint_start_addr, countdown, p_mem_base);
-  assert(exited == 1);
+  log_do_log(k_log_jit,
+             k_log_unusual,
+             "compiling %s page code @$%.4X",
+             ((new_pages & k_jit_compiler_code_page_zero) ? "zero" : "stack"),
+             addr_6502);
 
-  return exited;
+  jit_compiler_add_code_pages(p_compiler, new_pages);
+  for (i = 0; i < (k_6502_addr_space_size / 256); ++i) {
+    if (!(p_jit->unguarded_pages[i] & new_pages)) {
+      continue;
+    }
+    jit_memory_range_invalidate(&p_jit->driver, (i * 256), 256);
+    p_jit->unguarded_pages[i] &= ~new_pages;
+  }
+  /* Code put aside for other sideways banks doesn't get a second chance. */
+  if (p_jit->p_banks != NULL) {
+    for (i = 0; i < k_jit_num_banks; ++i) {
+      p_jit->p_banks[i].is_valid = 0;
+    }
+  }
 }
 
 static void
-jit_set_reset_callback(struct cpu_driver* p_cpu_driver,
-                       void (*do_reset_callback)(void* p, uint32_t flags),
-                       void* p_do_reset_callback_object) {
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+jit_cache_apply_block(struct jit_struct* p_jit,
+                      struct jit_cache_block* p_block) {
+  uint32_t i;
 
-  p_interp_driver->p_funcs->set_reset_callback(p_interp_driver,
-                                               do_reset_callback,
-                                               p_do_reset_callback_object);
-}
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+  uint8_t* p_mem_read = p_jit->driver.p_memory_access->p_mem_read;
+  int32_t max_revalidate_count =
+      jit_compiler_get_max_revalidate_count(p_compiler);
 
-static void
-jit_apply_flags(struct cpu_driver* p_cpu_driver,
-                uint32_t flags_set,
-                uint32_t flags_clear) {
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+  jit_bank_note_compile(p_jit, p_block->addr_6502, p_block->len_6502);
 
-  p_interp_driver->p_funcs->apply_flags(p_interp_driver,
-                                        flags_set,
-                                        flags_clear);
+  /* Restore the block boundary so that the block doesn't need to be split
+   * again, and restore the dynamic operands so that they don't need to go
+   * through the revalidation dance again.
+   */
+  if (p_block->ends_at_block_start) {
+    jit_compiler_set_block_start(
+        p_compiler, (uint16_t) (p_block->addr_6502 + p_block->len_6502));
+  }
+  for (i = 0; i < p_block->num_dynamic_operands; ++i) {
+    uint16_t addr_6502 = p_block->dynamic_operands[i];
+    if ((i > 0) &&
+        (p_block->dynamic_operands[i - 1] == (uint16_t) (addr_6502 - 1))) {
+      continue;
+    }
+    addr_6502--;
+    jit_compiler_set_revalidation_details(p_compiler,
+                                          p_mem_read[addr_6502],
+                                          max_revalidate_count,
+                                          addr_6502);
+  }
 }
 
-static uint32_t
-jit_get_flags(struct cpu_driver* p_cpu_driver) {
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+static int
+jit_cache_lookup(struct jit_struct* p_jit, uint16_t addr_6502) {
+  struct jit_cache_block block;
+  int ret;
 
-  return p_interp_driver->p_funcs->get_flags(p_interp_driver);
+  if (addr_6502 < 0x200) {
+    return 0;
+  }
+
+  ret = jit_cache_find(p_jit->p_cache, &block, addr_6502);
+  switch (ret) {
+  case k_jit_cache_hit:
+    p_jit->counter_cache_hits++;
+    jit_cache_apply_block(p_jit, &block);
+    return 1;
+  case k_jit_cache_miss:
+    p_jit->counter_cache_misses++;
+    break;
+  case k_jit_cache_stale:
+    p_jit->counter_cache_stale++;
+    break;
+  default:
+    assert(0);
+    break;
+  }
+
+  return 0;
 }
 
+static void
+jit_compile_ahead(struct jit_struct* p_jit,
+                  uint16_t addr_6502,
+                  const char* p_reason) {
+  /* Compiles a block that hasn't been jumped to yet. Only for use when no
+   * block is part way through executing, and with arena space reserved.
+   */
+  uint32_t bytes_6502_compiled;
 
-static uint32_t
-jit_get_exit_value(struct cpu_driver* p_cpu_driver) {
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
 
-  return p_interp_driver->p_funcs->get_exit_value(p_interp_driver);
+  p_jit->counter_num_compiles++;
+  if (p_jit->p_profile_blocks != NULL) {
+    p_jit->p_profile_blocks[addr_6502].compiles++;
+  }
+  jit_setup_compile_buf(p_jit, addr_6502);
+  bytes_6502_compiled = jit_compiler_compile_block(p_compiler,
+                                                   p_jit->p_compile_buf,
+                                                   0,
+                                                   addr_6502);
+  jit_arena_commit(p_jit, addr_6502);
+  p_jit->unguarded_pages[addr_6502 >> 8] |=
+      jit_compiler_get_unguarded_pages(p_compiler);
+  if (p_jit->p_tier != NULL) {
+    p_jit->p_tier_states[addr_6502] = k_jit_tier_hot;
+    p_jit->p_tier_counts[addr_6502] = 0;
+  }
+  jit_bank_note_compile(p_jit, addr_6502, bytes_6502_compiled);
+
+  if (p_jit->log_compile) {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "compile @$%.4X-$%.4X, %s",
+               addr_6502,
+               (addr_6502 + bytes_6502_compiled - 1),
+               p_reason);
+  }
 }
 
-static void
-jit_set_exit_value(struct cpu_driver* p_cpu_driver, uint32_t exit_value) {
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
+static uint32_t
+jit_arena_get_live_blocks(struct jit_struct* p_jit, uint32_t* p_live_granules) {
+  /* Lists the blocks in the arena that are still current, in arena order,
+   * and how much space they take.
+   */
+  uint32_t granule;
+  uint32_t num_granules = ((p_jit->p_arena_pos - p_jit->p_arena) >>
+                           k_jit_arena_granule_shift);
+  uint32_t num_blocks = 0;
+  uint32_t* p_granules = p_jit->p_arena_granules;
+  int is_live = 0;
+
+  *p_live_granules = 0;
+  for (granule = 0; granule < num_granules; ++granule) {
+    uint16_t addr_6502 = (uint16_t) p_granules[granule];
+    uint8_t* p_host;
+    uint32_t block_granule;
+
+    if (!(p_granules[granule] & k_jit_arena_granule_block_start)) {
+      *p_live_granules += is_live;
+      continue;
+    }
+    /* An older copy of a block that was since compiled again elsewhere is
+     * dead, so check the block's JIT pointer leads back here.
+     */
+    is_live = 0;
+    if (!jit_is_block_start(p_jit, addr_6502)) {
+      continue;
+    }
+    p_host = (uint8_t*) (uintptr_t) p_jit->jit_ptrs[addr_6502];
+    if (p_host < p_jit->p_arena) {
+      continue;
+    }
+    block_granule = ((p_host - p_jit->p_arena) >> k_jit_arena_granule_shift);
+    while (!(p_granules[block_granule] & k_jit_arena_granule_block_start)) {
+      block_granule--;
+    }
+    if (block_granule != granule) {
+      continue;
+    }
+    is_live = 1;
+    *p_live_granules += 1;
+    p_jit->p_arena_live_blocks[num_blocks++] = addr_6502;
+  }
 
-  p_interp_driver->p_funcs->set_exit_value(p_interp_driver, exit_value);
+  return num_blocks;
 }
 
 static void
-jit_memory_range_invalidate(struct cpu_driver* p_cpu_driver,
-                            uint16_t addr,
-                            uint32_t len) {
+jit_arena_reserve(struct jit_struct* p_jit) {
+  /* Compiled code can't be reused piecemeal: stale JIT pointers into dead
+   * blocks may still take self-modify invalidation writes. Nor can it be
+   * copied elsewhere, because the compiler doesn't record its relative jumps
+   * and calls. So a full arena starts over, and the blocks that were still
+   * live are compiled again, packed at the bottom. That writes their JIT
+   * pointers and chains as any compile does, and reclaims the space of the
+   * blocks that self-modifying code threw away. If the live blocks fill most
+   * of the arena, they are left to recompile as they are next run.
+   */
   uint32_t i;
+  uint32_t num_blocks;
+  uint32_t live_granules;
+  uint32_t arena_granules;
 
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  uint32_t addr_end = (addr + len);
+  if (p_jit->p_arena == NULL) {
+    return;
+  }
+  if ((p_jit->p_arena_end - p_jit->p_arena_pos) >= k_jit_bytes_per_byte) {
+    return;
+  }
 
-  assert(len <= k_6502_addr_space_size);
-  assert(addr_end <= k_6502_addr_space_size);
+  num_blocks = jit_arena_get_live_blocks(p_jit, &live_granules);
+  arena_granules = ((p_jit->p_arena_end - p_jit->p_arena) >>
+                    k_jit_arena_granule_shift);
+  jit_memory_range_invalidate(&p_jit->driver, 0, k_6502_addr_space_size);
+  p_jit->p_arena_pos = p_jit->p_arena;
+
+  if (live_granules > (arena_granules / 2)) {
+    if (p_jit->log_compile) {
+      log_do_log(k_log_jit, k_log_info, "code arena full, flushing");
+    }
+    p_jit->counter_arena_flushes++;
+    return;
+  }
 
   if (p_jit->log_compile) {
     log_do_log(k_log_jit,
                k_log_info,
-               "invalidate range $%.4X-$%.4X",
-               addr,
-               (addr_end - 1));
+               "code arena full, compacting %u live blocks",
+               num_blocks);
+  }
+  for (i = 0; i < num_blocks; ++i) {
+    uint16_t addr_6502 = p_jit->p_arena_live_blocks[i];
+    if (jit_has_6502_code(p_jit, addr_6502)) {
+      continue;
+    }
+    /* A recompile can come out larger than before. */
+    if ((p_jit->p_arena_end - p_jit->p_arena_pos) < k_jit_bytes_per_byte) {
+      break;
+    }
+    jit_compile_ahead(p_jit, addr_6502, "compact");
   }
+  p_jit->counter_arena_compactions++;
+}
 
-  assert(addr_end >= addr);
+static void
+jit_cache_preload(struct jit_struct* p_jit, uint16_t addr_6502) {
+  /* A cache hit suggests the surrounding code is the same as when it was
+   * recorded. Compile the remembered blocks in the same page up front, which
+   * avoids compile-on-first-execution, and block splits if the first
+   * execution enters mid-block.
+   */
+  uint32_t num_blocks;
+  uint32_t i;
 
-  for (i = addr; i < addr_end; ++i) {
-    jit_invalidate_code_at_address(p_jit, i);
-    jit_invalidate_block_address(p_jit, i);
-    p_jit->jit_ptrs[i] = p_jit->jit_ptr_no_code;
+  struct jit_cache_block* blocks = &p_jit->cache_preload_blocks[0];
+
+  uint32_t page_addr_6502 = (addr_6502 & 0xFF00);
+
+  /* First apply all the boundaries, so that each block compiles to the
+   * remembered length.
+   */
+  num_blocks = 0;
+  for (i = page_addr_6502; i < (page_addr_6502 + 0x100); ++i) {
+    struct jit_cache_block* p_block = &blocks[num_blocks];
+    uint32_t j;
+
+    if (jit_has_6502_code(p_jit, i)) {
+      continue;
+    }
+    if (jit_cache_find(p_jit->p_cache, p_block, i) != k_jit_cache_hit) {
+      continue;
+    }
+    for (j = 0; j < p_block->len_6502; ++j) {
+      if (jit_has_6502_code(p_jit, (uint16_t) (i + j))) {
+        break;
+      }
+    }
+    if (j != p_block->len_6502) {
+      continue;
+    }
+    jit_cache_apply_block(p_jit, p_block);
+    num_blocks++;
   }
 
-  jit_compiler_memory_range_invalidate(p_jit->p_compiler, addr, len);
+  for (i = 0; i < num_blocks; ++i) {
+    uint16_t block_addr_6502 = blocks[i].addr_6502;
+    if (jit_has_6502_code(p_jit, block_addr_6502)) {
+      continue;
+    }
+    jit_arena_reserve(p_jit);
+    if (jit_has_6502_code(p_jit, block_addr_6502)) {
+      continue;
+    }
+    jit_compile_ahead(p_jit, block_addr_6502, "preload");
+  }
 }
 
-static char*
-jit_get_address_info(struct cpu_driver* p_cpu_driver, uint16_t addr) {
-  static char block_addr_buf[5];
+static int32_t
+jit_spec_take_held(struct jit_struct* p_jit, uint16_t addr_6502) {
+  uint32_t index = (addr_6502 % k_jit_spec_num_held);
+  int32_t slot = p_jit->spec_held_slots[index];
 
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  uint16_t block_addr_6502 = jit_6502_block_addr_from_6502(p_jit, addr);
+  if (slot == -1) {
+    return -1;
+  }
+  if (jit_compiler_prep_get_addr(jit_scanner_get_prep(p_jit->p_scanner,
+                                                      slot)) != addr_6502) {
+    return -1;
+  }
+  p_jit->spec_held_slots[index] = -1;
+  return slot;
+}
 
-  (void) snprintf(block_addr_buf,
-                  sizeof(block_addr_buf),
-                  "%.4X",
-                  block_addr_6502);
+static void
+jit_spec_hold(struct jit_struct* p_jit, uint16_t addr_6502, uint32_t slot) {
+  uint32_t index = (addr_6502 % k_jit_spec_num_held);
+  int32_t old_slot = p_jit->spec_held_slots[index];
 
-  return block_addr_buf;
+  if (old_slot != -1) {
+    jit_scanner_free_slot(p_jit->p_scanner, old_slot);
+  }
+  p_jit->spec_held_slots[index] = slot;
 }
 
 static void
-jit_get_custom_counters(struct cpu_driver* p_cpu_driver,
-                        uint64_t* p_c1,
-                        uint64_t* p_c2) {
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+jit_spec_compile(struct jit_struct* p_jit) {
+  /* Compile some of the blocks the scanner expects to run soon. This happens
+   * on the way back from the interpreter, when no block is part way through,
+   * the same as for a cache preload. The scanner already decoded each block
+   * on its helper thread, a little while ago, so each address is checked
+   * again here, and the compiler checks each decoded opcode against the
+   * current 6502 bytes before it takes it.
+   * A provisional block, such as the bytes after a JSR, may be inline data, so
+   * compiling it could leave block starts and self-modify history in the
+   * wrong places. It's held, decoded but not compiled, until the JIT first
+   * jumps there.
+   */
+  uint32_t i;
+  uint16_t addr_6502;
+
+  struct jit_scanner* p_scanner = p_jit->p_scanner;
+  uint64_t start_ns = 0;
+  uint32_t num_compiles = 0;
+
+  if (p_jit->log_compile_latency) {
+    start_ns = os_time_get_ns();
+  }
+  for (i = 0; i < k_jit_spec_max_compiles; ++i) {
+    uint32_t slot;
+    struct jit_compiler_prep* p_prep;
+
+    if (!jit_scanner_get_candidate(p_scanner, &slot)) {
+      break;
+    }
+    p_prep = jit_scanner_get_prep(p_scanner, slot);
+    addr_6502 = jit_compiler_prep_get_addr(p_prep);
+    if (jit_has_6502_code(p_jit, addr_6502)) {
+      jit_scanner_free_slot(p_scanner, slot);
+      continue;
+    }
+    if (jit_scanner_is_provisional(p_scanner, slot)) {
+      jit_spec_hold(p_jit, addr_6502, slot);
+      continue;
+    }
+    /* A guess isn't worth an arena flush. */
+    if ((p_jit->p_arena != NULL) &&
+        ((p_jit->p_arena_end - p_jit->p_arena_pos) < k_jit_bytes_per_byte)) {
+      jit_scanner_free_slot(p_scanner, slot);
+      break;
+    }
+    jit_compiler_set_prep(p_jit->p_compiler, p_prep);
+    jit_compile_ahead(p_jit, addr_6502, "speculative");
+    jit_scanner_free_slot(p_scanner, slot);
+    p_jit->counter_spec_compiles++;
+    num_compiles++;
+  }
+  if (p_jit->log_compile_latency && (num_compiles > 0)) {
+    jit_latency_record(&p_jit->spec_latency[0], start_ns);
+  }
+}
+
+static void
+jit_cache_record_block(struct jit_struct* p_jit,
+                       uint16_t addr_6502,
+                       uint32_t len_6502) {
+  struct jit_cache_block block;
+  uint32_t i;
+
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+
+  if ((addr_6502 < 0x200) ||
+      !jit_compiler_is_block_start(p_compiler, addr_6502)) {
+    return;
+  }
+
+  block.addr_6502 = addr_6502;
+  block.len_6502 = len_6502;
+  block.ends_at_block_start =
+      jit_compiler_is_block_start(p_compiler, (uint16_t) (addr_6502 + len_6502));
+  block.num_dynamic_operands = 0;
+  for (i = 0; i < len_6502; ++i) {
+    uint16_t operand_addr_6502 = (addr_6502 + i);
+    if (p_jit->jit_ptrs[operand_addr_6502] != p_jit->jit_ptr_dynamic_operand) {
+      continue;
+    }
+    if (block.num_dynamic_operands == k_jit_cache_max_dynamic_operands) {
+      break;
+    }
+    block.dynamic_operands[block.num_dynamic_operands++] = operand_addr_6502;
+  }
 
-  *p_c1 = p_jit->counter_num_compiles;
-  *p_c2 = p_jit->counter_num_interps;
+  jit_cache_record(p_jit->p_cache, &block);
 }
 
 static int64_t
@@ -404,8 +2221,6 @@ jit_compile(struct jit_struct* p_jit,
             uint64_t intel_rflags) {
   uint32_t jit_ptr;
   uint8_t* p_tmp_jit_ptr;
-  uint8_t* p_host_block_ptr;
-  uint8_t* p_new_block_ptr;
   uint8_t* p_old_block_ptr;
   uint32_t bytes_6502_compiled;
   int has_6502_code;
@@ -417,15 +2232,31 @@ jit_compile(struct jit_struct* p_jit,
   uint16_t clear_ptrs_block_addr_6502;
 
   int is_invalidation = 0;
+  int is_cache_hit = 0;
+  int32_t held_slot = -1;
+  uint64_t start_ns = 0;
   struct state_6502* p_state_6502 = p_jit->driver.abi.p_state_6502;
   struct jit_compiler* p_compiler = p_jit->p_compiler;
   struct util_buffer* p_compile_buf = p_jit->p_compile_buf;
 
+  /* An entry to cold code just gets a stub into the cold tier. */
+  if (p_jit->p_tier != NULL) {
+    addr_6502 = jit_6502_block_addr_from_host(p_jit, p_intel_rip);
+    if ((p_intel_rip == jit_get_jit_block_host_address(p_jit, addr_6502)) &&
+        (p_jit->p_tier_states[addr_6502] != k_jit_tier_hot)) {
+      jit_tier_stub(p_jit, addr_6502);
+      p_state_6502->reg_pc = addr_6502;
+      return countdown;
+    }
+  }
+
+  if (p_jit->log_compile_latency) {
+    start_ns = os_time_get_ns();
+  }
+
   p_jit->counter_num_compiles++;
 
   host_block_addr_6502 = jit_6502_block_addr_from_host(p_jit, p_intel_rip);
-  p_host_block_ptr = jit_get_jit_block_host_address(p_jit,
-                                                    host_block_addr_6502);
 
   /* Whatever happens, the existing block will either be recompiled or split.
    * Either way, it is now invalid.
@@ -434,9 +2265,10 @@ jit_compile(struct jit_struct* p_jit,
                                                       host_block_addr_6502);
   p_old_block_ptr = jit_get_jit_block_host_address(p_jit, old_block_addr_6502);
   jit_invalidate_host_address(p_jit, p_old_block_ptr);
+  jit_compiler_unchain_block(p_compiler, old_block_addr_6502);
 
   addr_6502 = host_block_addr_6502;
-  if (p_host_block_ptr != p_intel_rip) {
+  if (!jit_is_block_entry_host_address(p_jit, p_intel_rip)) {
     is_invalidation = 1;
     /* Host IP is inside a code block; find the corresponding 6502 address. */
     while (1) {
@@ -455,49 +2287,60 @@ jit_compile(struct jit_struct* p_jit,
   /* Bouncing out of the JIT is quite jarring. We need to fixup up any state
    * that was temporarily stale due to optimizations.
    */
-  p_new_block_ptr = jit_get_jit_block_host_address(p_jit, addr_6502);
   p_state_6502->reg_pc = addr_6502;
   if (is_invalidation) {
     countdown = jit_compiler_fixup_state(p_compiler,
                                          p_state_6502,
                                          countdown,
-                                         intel_rflags);
+                                         intel_rflags,
+                                         (uint8_t) p_jit->host_zpc_value);
+    if ((p_jit->p_tier != NULL) &&
+        jit_tier_note_invalidation(p_jit, old_block_addr_6502, addr_6502)) {
+      jit_tier_stub(p_jit, addr_6502);
+      return countdown;
+    }
   }
 
-  util_buffer_setup(p_compile_buf, p_new_block_ptr, k_jit_bytes_per_byte);
-
-  if ((addr_6502 < 0xFF) &&
-      !jit_compiler_is_compiling_for_code_in_zero_page(p_compiler)) {
-    log_do_log(k_log_jit,
-               k_log_unusual,
-               "compiling zero page code @$%.2X",
-               addr_6502);
+  /* Any arena flush happens before the compile related state below is set
+   * up.
+   */
+  jit_arena_reserve(p_jit);
+  jit_setup_compile_buf(p_jit, addr_6502);
 
-    /* Invalidate all existing compiled code because if it writes to the zero
-     * page, it isn't doing self-modified code correctly.
-     */
-    jit_memory_range_invalidate(&p_jit->driver,
-                                0,
-                                (k_6502_addr_space_size - 1));
+  jit_note_code_pages(p_jit, addr_6502, 1);
 
-    jit_compiler_set_compiling_for_code_in_zero_page(p_compiler, 1);
-  } else if ((addr_6502 >= 0x100) && (addr_6502 <= 0x1FF)) {
-    /* TODO: doesn't handle case where zero page code spills into stack page
-     * code.
-     */
-    log_do_log(k_log_jit,
-               k_log_unimplemented,
-               "compiling stack page code @$%.4X; self-modify not handled",
-               addr_6502);
+  if (p_jit->p_profile_blocks != NULL) {
+    p_jit->p_profile_blocks[addr_6502].compiles++;
+    if (is_invalidation) {
+      p_jit->p_profile_blocks[old_block_addr_6502].invalidations++;
+    }
   }
 
   has_6502_code = jit_has_6502_code(p_jit, addr_6502);
   is_block_continuation = jit_compiler_is_block_continuation(p_compiler,
                                                              addr_6502);
+  if ((p_jit->p_cache != NULL) && !is_invalidation) {
+    is_cache_hit = jit_cache_lookup(p_jit, addr_6502);
+  }
+  if (p_jit->p_scanner != NULL) {
+    held_slot = jit_spec_take_held(p_jit, addr_6502);
+    if (held_slot != -1) {
+      jit_compiler_set_prep(p_compiler,
+                            jit_scanner_get_prep(p_jit->p_scanner, held_slot));
+      p_jit->counter_spec_held_hits++;
+    }
+  }
   bytes_6502_compiled = jit_compiler_compile_block(p_compiler,
                                                    p_compile_buf,
                                                    is_invalidation,
                                                    addr_6502);
+  if (held_slot != -1) {
+    jit_scanner_free_slot(p_jit->p_scanner, held_slot);
+  }
+  jit_arena_commit(p_jit, addr_6502);
+  p_jit->unguarded_pages[addr_6502 >> 8] |=
+      jit_compiler_get_unguarded_pages(p_compiler);
+  jit_bank_note_compile(p_jit, addr_6502, bytes_6502_compiled);
 
   /* Clear any leftover JIT pointers from a previous block at the same
    * location.
@@ -513,6 +2356,10 @@ jit_compile(struct jit_struct* p_jit,
     clear_ptrs_addr_6502++;
   }
 
+  if (p_jit->p_cache != NULL) {
+    jit_cache_record_block(p_jit, addr_6502, bytes_6502_compiled);
+  }
+
   if (p_jit->log_compile) {
     const char* p_text;
     uint16_t addr_6502_end = (addr_6502 + bytes_6502_compiled - 1);
@@ -522,6 +2369,8 @@ jit_compile(struct jit_struct* p_jit,
       p_text = "cont";
     } else if (has_6502_code) {
       p_text = "split";
+    } else if (is_cache_hit) {
+      p_text = "new, cached";
     } else {
       p_text = "new";
     }
@@ -534,6 +2383,25 @@ jit_compile(struct jit_struct* p_jit,
                p_text);
   }
 
+  /* Catches zero page code that spills into the stack page. */
+  jit_note_code_pages(p_jit, addr_6502, bytes_6502_compiled);
+
+  if (is_cache_hit) {
+    jit_cache_preload(p_jit, addr_6502);
+  }
+
+  if (p_jit->log_compile_latency) {
+    jit_latency_record(&p_jit->demand_latency[0], start_ns);
+  }
+  /* Just executed, or just rewritten: either way, worth looking ahead of.
+   * Compile bursts are when look ahead pays off, so this is also a good time
+   * to pick up what was found from earlier seeds.
+   */
+  if (p_jit->p_scanner != NULL) {
+    jit_spec_compile(p_jit);
+    jit_scanner_add_seed(p_jit->p_scanner, addr_6502);
+  }
+
   return countdown;
 }
 
@@ -715,6 +2583,12 @@ jit_handle_fault(uintptr_t* p_host_rip,
    * raw asm, shouldn't be a disaster.
    */
   block_addr_6502 = jit_6502_block_addr_from_host(p_jit, p_fault_rip);
+  if (p_jit->p_profile_blocks != NULL) {
+    p_jit->p_profile_blocks[block_addr_6502].faults++;
+  }
+  if (bcd_fault_fixup) {
+    p_jit->bcd_fault_block_addr_6502 = block_addr_6502;
+  }
 
   /* Walk the code pointers in the block and do a non-exact match because the
    * faulting instruction won't be the start of the 6502 opcode. (That may
@@ -745,6 +2619,16 @@ jit_handle_fault(uintptr_t* p_host_rip,
     i_addr_6502++;
   }
 
+  if ((p_jit->p_fault_counts != NULL) && !bcd_fault_fixup) {
+    uint8_t count = p_jit->p_fault_counts[addr_6502];
+    if (count < k_jit_default_faults) {
+      p_jit->p_fault_counts[addr_6502] = (count + 1);
+    } else if (p_jit->default_addr_6502 == -1) {
+      p_jit->p_fault_counts[addr_6502] = 0;
+      p_jit->default_addr_6502 = addr_6502;
+    }
+  }
+
   /* Bounce into the interpreter via the trampolines. */
   *p_host_rip =
       (K_BBC_JIT_TRAMPOLINES_ADDR + (addr_6502 * K_BBC_JIT_TRAMPOLINE_BYTES));
@@ -769,6 +2653,10 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   struct cpu_driver_funcs* p_funcs = p_cpu_driver->p_funcs;
 
   p_jit->log_compile = util_has_option(p_options->p_log_flags, "jit:compile");
+  p_jit->log_compile_latency = util_has_option(p_options->p_log_flags,
+                                               "jit:latency");
+  p_jit->log_tier = util_has_option(p_options->p_log_flags, "jit:tier");
+  p_jit->log_fusions = util_has_option(p_options->p_log_flags, "jit:fusions");
 
   p_funcs->destroy = jit_destroy;
   p_funcs->enter = jit_enter;
@@ -778,11 +2666,14 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   p_funcs->get_exit_value = jit_get_exit_value;
   p_funcs->set_exit_value = jit_set_exit_value;
   p_funcs->memory_range_invalidate = jit_memory_range_invalidate;
+  p_funcs->memory_range_bank_switch = jit_memory_range_bank_switch;
   p_funcs->get_address_info = jit_get_address_info;
   p_funcs->get_custom_counters = jit_get_custom_counters;
+  p_funcs->dump_profile = jit_dump_profile;
 
   p_cpu_driver->abi.p_util_private = asm_x64_jit_compile_trampoline;
   p_jit->p_compile_callback = jit_compile;
+  p_jit->p_hw_read_callback = jit_enter_hw_read;
 
   /* The JIT mode uses an interpreter to handle complicated situations,
    * such as IRQs, hardware accesses, etc.
@@ -808,6 +2699,37 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   /* Fill with int3. */
   (void) memset(p_jit_base, '\xcc', mapping_size);
 
+  /* The optional code arena layout: each 6502 address just has a small entry
+   * slot at the bottom of the mapping, and blocks are packed in above that.
+   * Hot code then covers far fewer host pages.
+   */
+  p_jit->block_shift = K_BBC_JIT_BYTES_SHIFT;
+  if (util_has_option(p_options->p_opt_flags, "jit:arena")) {
+    size_t slots_size = (k_6502_addr_space_size << K_BBC_JIT_ARENA_SLOT_SHIFT);
+    uint32_t arena_size = (mapping_size - slots_size);
+    /* NOTE: options are matched as substrings, so this one must not start
+     * with "jit:arena".
+     */
+    (void) util_get_u32_option(&arena_size,
+                               p_options->p_opt_flags,
+                               "jit:code-arena-size=");
+    if (arena_size > (mapping_size - slots_size)) {
+      arena_size = (mapping_size - slots_size);
+    }
+    if (arena_size < (uint32_t) k_jit_bytes_per_byte) {
+      arena_size = k_jit_bytes_per_byte;
+    }
+    p_jit->block_shift = K_BBC_JIT_ARENA_SLOT_SHIFT;
+    p_jit->p_arena = (p_jit_base + slots_size);
+    p_jit->p_arena_pos = p_jit->p_arena;
+    p_jit->p_arena_end = (p_jit->p_arena + arena_size);
+    p_jit->p_arena_granules =
+        util_mallocz(((arena_size >> k_jit_arena_granule_shift) + 1) *
+                     sizeof(uint32_t));
+    p_jit->p_arena_live_blocks =
+        util_malloc(k_6502_addr_space_size * sizeof(uint16_t));
+  }
+
   /* This is the mapping that holds trampolines to jump out of JIT. These
    * one-per-6502-address trampolines enable the core JIT code to be simpler
    * and smaller, at the expense of more complicated bridging between JIT and
@@ -821,6 +2743,25 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   /* Fill with int3. */
   (void) memset(p_jit_trampolines, '\xcc', mapping_size);
 
+  /* The optional profiler. The JIT code counts block entries and cycles into
+   * a fixed mapping, and the host time is sampled.
+   */
+  if (util_has_option(p_options->p_opt_flags, "jit:profile")) {
+    mapping_size = (k_6502_addr_space_size * sizeof(uint64_t) * 2);
+    assert(K_BBC_JIT_PROFILE_CYCLES_OFFSET ==
+           (k_6502_addr_space_size * sizeof(uint64_t)));
+    p_jit->p_mapping_profile = os_alloc_get_mapping(k_jit_profile_addr,
+                                                    mapping_size);
+    p_jit->p_profile_entries =
+        os_alloc_get_mapping_addr(p_jit->p_mapping_profile);
+    os_alloc_make_mapping_read_write(p_jit->p_profile_entries, mapping_size);
+    (void) memset(p_jit->p_profile_entries, '\0', mapping_size);
+    p_jit->p_profile_cycles = (p_jit->p_profile_entries +
+                               k_6502_addr_space_size);
+    p_jit->p_profile_blocks =
+        util_mallocz(k_6502_addr_space_size * sizeof(struct jit_profile_block));
+  }
+
   p_jit->p_jit_base = p_jit_base;
   p_jit->p_jit_trampolines = p_jit_trampolines;
   p_jit->p_compiler = jit_compiler_create(
@@ -831,6 +2772,47 @@ jit_init(struct cpu_driver* p_cpu_driver) {
       &p_jit->jit_ptrs[0],
       p_options,
       debug);
+  jit_compiler_set_block_shift(p_jit->p_compiler, (uint8_t) p_jit->block_shift);
+  p_jit->bcd_fault_block_addr_6502 = -1;
+  p_jit->default_addr_6502 = -1;
+  /* Compiled code for the paged ROM window is kept per bank, which saves
+   * recompiling on every ROMSEL write. Not with the debugger, which
+   * invalidates for its own reasons.
+   */
+  /* Opcodes that fault over and over get recompiled not to. */
+  if (!util_has_option(p_options->p_opt_flags, "jit:no-default")) {
+    p_jit->p_fault_counts = util_mallocz(k_6502_addr_space_size);
+  }
+  if (!util_has_option(p_options->p_opt_flags, "jit:no-bank-keep") && !debug) {
+    p_jit->p_banks = util_mallocz(k_jit_num_banks * sizeof(struct jit_bank));
+    jit_compiler_set_banked_range(p_jit->p_compiler,
+                                  k_jit_bank_addr,
+                                  k_jit_bank_len);
+  }
+  /* The optional cache of compile decisions, which may persist to disc.
+   * Debug mode compiles very different code so it doesn't participate.
+   */
+  if (util_has_option(p_options->p_opt_flags, "jit:cache") && !debug) {
+    p_jit->p_cache = jit_cache_create(p_memory_access->p_mem_read,
+                                      jit_compiler_get_cache_key(
+                                          p_jit->p_compiler));
+    if (util_get_str_option(&p_jit->p_cache_file_name,
+                            p_options->p_opt_flags,
+                            "jit:cache-file=")) {
+      jit_cache_load(p_jit->p_cache, p_jit->p_cache_file_name);
+    }
+  }
+  /* Optionally, a helper thread looks ahead of what has been compiled so far,
+   * and decodes blocks so that they can be compiled sooner and faster.
+   */
+  if (util_has_option(p_options->p_opt_flags, "jit:background") && !debug) {
+    p_jit->p_scanner = jit_scanner_create(p_memory_access->p_mem_read,
+                                          p_jit->p_compiler);
+    jit_scanner_start_thread(p_jit->p_scanner);
+  }
+  for (i = 0; i < k_jit_spec_num_held; ++i) {
+    p_jit->spec_held_slots[i] = -1;
+  }
   p_temp_buf = util_buffer_create();
   p_jit->p_temp_buf = p_temp_buf;
   p_jit->p_compile_buf = util_buffer_create();
@@ -840,6 +2822,19 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   p_jit->jit_ptr_dynamic_operand =
       (uint32_t) (size_t) jit_get_jit_block_host_address(
           p_jit, (k_6502_addr_space_size - 2));
+  /* Optionally, code runs in an inturbo first and is only compiled once it
+   * gets hot. Not with the debugger, which the cold tier doesn't support.
+   */
+  if (util_has_option(p_options->p_opt_flags, "jit:tiered") && !debug) {
+    uint32_t threshold = k_jit_tier_default_threshold;
+    (void) util_get_u32_option(&threshold,
+                               p_options->p_opt_flags,
+                               "jit:tier-threshold=");
+    if (threshold > 0xFF) {
+      threshold = 0xFF;
+    }
+    jit_tier_setup(p_jit, (uint8_t) threshold);
+  }
 
   util_buffer_setup(p_temp_buf, &p_jit->jit_invalidation_sequence[0], 2);
   asm_x64_emit_jit_call_compile_trampoline(p_temp_buf);
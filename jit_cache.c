@@ -0,0 +1,361 @@
+#include "jit_cache.h"
+
+#include "defs_6502.h"
+#include "log.h"
+#include "util.h"
+
+#include <assert.h>
+#include <string.h>
+
+enum {
+  k_jit_cache_max_entries = 65536,
+  /* Keep a few variants per address, for code that is overlaid (e.g. loaded
+   * from disc into the same location) during a run.
+   */
+  k_jit_cache_max_variants = 4,
+  /* A compile covers at most 256 opcodes of up to 3 bytes each. */
+  k_jit_cache_max_len_6502 = (256 * 3),
+  k_jit_cache_version = 1,
+};
+
+static const char* k_jit_cache_signature = "BEEBJITC";
+
+struct jit_cache_entry {
+  uint64_t hash;
+  struct jit_cache_block block;
+  /* Index + 1 of the next entry for the same address, or 0. */
+  uint32_t next;
+};
+
+struct jit_cache {
+  uint8_t* p_mem_read;
+  uint32_t codegen_key;
+  uint32_t num_entries;
+  uint32_t num_used;
+  uint32_t free_head;
+  int logged_full;
+  uint32_t addr_heads[k_6502_addr_space_size];
+  struct jit_cache_entry entries[k_jit_cache_max_entries];
+};
+
+struct jit_cache_file_header {
+  uint8_t signature[8];
+  uint32_t version;
+  uint32_t codegen_key;
+  uint32_t num_entries;
+} __attribute__((packed));
+
+struct jit_cache_file_entry {
+  uint64_t hash;
+  uint16_t addr_6502;
+  uint16_t len_6502;
+  uint8_t ends_at_block_start;
+  uint8_t num_dynamic_operands;
+  uint16_t dynamic_operands[k_jit_cache_max_dynamic_operands];
+} __attribute__((packed));
+
+struct jit_cache*
+jit_cache_create(uint8_t* p_mem_read, uint32_t codegen_key) {
+  struct jit_cache* p_cache = util_mallocz(sizeof(struct jit_cache));
+
+  p_cache->p_mem_read = p_mem_read;
+  p_cache->codegen_key = codegen_key;
+
+  return p_cache;
+}
+
+void
+jit_cache_destroy(struct jit_cache* p_cache) {
+  util_free(p_cache);
+}
+
+static uint64_t
+jit_cache_hash_block(struct jit_cache* p_cache,
+                     struct jit_cache_block* p_block) {
+  uint32_t i;
+  uint32_t i_dynamic;
+
+  uint8_t* p_mem_read = p_cache->p_mem_read;
+  uint16_t addr_6502 = p_block->addr_6502;
+  /* FNV-1a. */
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  hash ^= p_block->len_6502;
+  hash *= 0x100000001b3ull;
+
+  i_dynamic = 0;
+  for (i = 0; i < p_block->len_6502; ++i) {
+    uint8_t val = p_mem_read[addr_6502];
+    /* Dynamic operands are recorded in address order. */
+    if ((i_dynamic < p_block->num_dynamic_operands) &&
+        (p_block->dynamic_operands[i_dynamic] == addr_6502)) {
+      val = 0;
+      i_dynamic++;
+    }
+    hash ^= val;
+    hash *= 0x100000001b3ull;
+    addr_6502++;
+  }
+
+  return hash;
+}
+
+static void
+jit_cache_unlink(struct jit_cache* p_cache,
+                 uint32_t* p_link,
+                 struct jit_cache_entry* p_entry) {
+  *p_link = p_entry->next;
+  p_entry->next = p_cache->free_head;
+  p_cache->free_head = ((p_entry - &p_cache->entries[0]) + 1);
+  assert(p_cache->num_entries > 0);
+  p_cache->num_entries--;
+}
+
+static void
+jit_cache_insert(struct jit_cache* p_cache,
+                 struct jit_cache_block* p_block,
+                 uint64_t hash) {
+  uint32_t index;
+  struct jit_cache_entry* p_entry;
+
+  uint16_t addr_6502 = p_block->addr_6502;
+
+  if (p_cache->free_head) {
+    index = p_cache->free_head;
+    p_entry = &p_cache->entries[index - 1];
+    p_cache->free_head = p_entry->next;
+  } else if (p_cache->num_used < k_jit_cache_max_entries) {
+    p_cache->num_used++;
+    index = p_cache->num_used;
+    p_entry = &p_cache->entries[index - 1];
+  } else {
+    if (!p_cache->logged_full) {
+      log_do_log(k_log_jit, k_log_unusual, "JIT cache full");
+      p_cache->logged_full = 1;
+    }
+    return;
+  }
+
+  p_entry->hash = hash;
+  p_entry->block = *p_block;
+  p_entry->next = p_cache->addr_heads[addr_6502];
+  p_cache->addr_heads[addr_6502] = index;
+  p_cache->num_entries++;
+}
+
+void
+jit_cache_record(struct jit_cache* p_cache, struct jit_cache_block* p_block) {
+  uint32_t* p_link;
+  uint32_t num_variants;
+
+  uint16_t addr_6502 = p_block->addr_6502;
+  uint64_t hash = jit_cache_hash_block(p_cache, p_block);
+
+  assert(p_block->len_6502 > 0);
+  assert(p_block->num_dynamic_operands <= k_jit_cache_max_dynamic_operands);
+
+  /* Any existing entry that describes the current memory contents is
+   * superseded by this newer compile decision. Also cap the variants.
+   */
+  num_variants = 0;
+  p_link = &p_cache->addr_heads[addr_6502];
+  while (*p_link) {
+    struct jit_cache_entry* p_entry = &p_cache->entries[*p_link - 1];
+    uint64_t entry_hash = jit_cache_hash_block(p_cache, &p_entry->block);
+    if ((entry_hash == p_entry->hash) ||
+        (num_variants == (k_jit_cache_max_variants - 1))) {
+      jit_cache_unlink(p_cache, p_link, p_entry);
+      continue;
+    }
+    num_variants++;
+    p_link = &p_entry->next;
+  }
+
+  jit_cache_insert(p_cache, p_block, hash);
+}
+
+int
+jit_cache_find(struct jit_cache* p_cache,
+               struct jit_cache_block* p_block,
+               uint16_t addr_6502) {
+  uint32_t index = p_cache->addr_heads[addr_6502];
+
+  if (!index) {
+    return k_jit_cache_miss;
+  }
+
+  while (index) {
+    struct jit_cache_entry* p_entry = &p_cache->entries[index - 1];
+    if (jit_cache_hash_block(p_cache, &p_entry->block) == p_entry->hash) {
+      *p_block = p_entry->block;
+      return k_jit_cache_hit;
+    }
+    index = p_entry->next;
+  }
+
+  return k_jit_cache_stale;
+}
+
+uint32_t
+jit_cache_get_num_entries(struct jit_cache* p_cache) {
+  return p_cache->num_entries;
+}
+
+static uint32_t
+jit_cache_get_variants(struct jit_cache* p_cache,
+                       uint32_t* p_variants,
+                       uint16_t addr_6502) {
+  /* Newest first. jit_cache_record() caps the variants, so any more would be a
+   * bug, but never write past the caller's array.
+   */
+  uint32_t num_variants = 0;
+  uint32_t index = p_cache->addr_heads[addr_6502];
+
+  while (index && (num_variants < k_jit_cache_max_variants)) {
+    p_variants[num_variants++] = index;
+    index = p_cache->entries[index - 1].next;
+  }
+
+  return num_variants;
+}
+
+static void
+jit_cache_clear(struct jit_cache* p_cache) {
+  (void) memset(p_cache->addr_heads, '\0', sizeof(p_cache->addr_heads));
+  p_cache->num_entries = 0;
+  p_cache->num_used = 0;
+  p_cache->free_head = 0;
+}
+
+void
+jit_cache_load(struct jit_cache* p_cache, const char* p_file_name) {
+  struct jit_cache_file_header header;
+  uint64_t ret;
+  uint32_t i;
+  struct util_file* p_file;
+
+  if (!util_file_exists(p_file_name)) {
+    return;
+  }
+
+  p_file = util_file_open(p_file_name, 0, 0);
+  ret = util_file_read(p_file, &header, sizeof(header));
+  if ((ret != sizeof(header)) ||
+      memcmp(header.signature, k_jit_cache_signature, sizeof(header.signature))
+      || (header.version != k_jit_cache_version)) {
+    log_do_log(k_log_jit,
+               k_log_warning,
+               "ignoring bad JIT cache file %s",
+               p_file_name);
+    util_file_close(p_file);
+    return;
+  }
+  if (header.codegen_key != p_cache->codegen_key) {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "ignoring JIT cache file %s with different options",
+               p_file_name);
+    util_file_close(p_file);
+    return;
+  }
+
+  for (i = 0; i < header.num_entries; ++i) {
+    struct jit_cache_file_entry file_entry;
+    struct jit_cache_block block;
+    uint32_t variants[k_jit_cache_max_variants];
+    uint32_t i_dynamic;
+
+    ret = util_file_read(p_file, &file_entry, sizeof(file_entry));
+    if (ret != sizeof(file_entry)) {
+      log_do_log(k_log_jit,
+                 k_log_warning,
+                 "truncated JIT cache file %s",
+                 p_file_name);
+      break;
+    }
+    /* A file that this code could not have written is not trusted at all. */
+    if ((file_entry.len_6502 == 0) ||
+        (file_entry.len_6502 > k_jit_cache_max_len_6502) ||
+        (file_entry.num_dynamic_operands > k_jit_cache_max_dynamic_operands) ||
+        (jit_cache_get_variants(p_cache, variants, file_entry.addr_6502) ==
+             k_jit_cache_max_variants)) {
+      log_do_log(k_log_jit,
+                 k_log_warning,
+                 "ignoring corrupt JIT cache file %s",
+                 p_file_name);
+      jit_cache_clear(p_cache);
+      util_file_close(p_file);
+      return;
+    }
+    (void) memset(&block, '\0', sizeof(block));
+    block.addr_6502 = file_entry.addr_6502;
+    block.len_6502 = file_entry.len_6502;
+    block.ends_at_block_start = file_entry.ends_at_block_start;
+    block.num_dynamic_operands = file_entry.num_dynamic_operands;
+    for (i_dynamic = 0;
+         i_dynamic < block.num_dynamic_operands;
+         ++i_dynamic) {
+      block.dynamic_operands[i_dynamic] =
+          file_entry.dynamic_operands[i_dynamic];
+    }
+    /* Entries are stored oldest first so this restores the variant order. */
+    jit_cache_insert(p_cache, &block, file_entry.hash);
+  }
+
+  util_file_close(p_file);
+
+  log_do_log(k_log_jit,
+             k_log_info,
+             "loaded %u JIT cache entries from %s",
+             p_cache->num_entries,
+             p_file_name);
+}
+
+void
+jit_cache_save(struct jit_cache* p_cache, const char* p_file_name) {
+  struct jit_cache_file_header header;
+  uint32_t variants[k_jit_cache_max_variants];
+  uint32_t num_entries;
+  uint32_t i;
+  struct util_file* p_file = util_file_open(p_file_name, 1, 1);
+
+  num_entries = 0;
+  for (i = 0; i < k_6502_addr_space_size; ++i) {
+    num_entries += jit_cache_get_variants(p_cache, variants, i);
+  }
+
+  (void) memcpy(header.signature,
+                k_jit_cache_signature,
+                sizeof(header.signature));
+  header.version = k_jit_cache_version;
+  header.codegen_key = p_cache->codegen_key;
+  header.num_entries = num_entries;
+  util_file_write(p_file, &header, sizeof(header));
+
+  for (i = 0; i < k_6502_addr_space_size; ++i) {
+    uint32_t num_variants = jit_cache_get_variants(p_cache, variants, i);
+    while (num_variants > 0) {
+      struct jit_cache_file_entry file_entry;
+      struct jit_cache_entry* p_entry;
+      uint32_t i_dynamic;
+
+      num_variants--;
+      p_entry = &p_cache->entries[variants[num_variants] - 1];
+      (void) memset(&file_entry, '\0', sizeof(file_entry));
+      file_entry.hash = p_entry->hash;
+      file_entry.addr_6502 = p_entry->block.addr_6502;
+      file_entry.len_6502 = p_entry->block.len_6502;
+      file_entry.ends_at_block_start = p_entry->block.ends_at_block_start;
+      file_entry.num_dynamic_operands = p_entry->block.num_dynamic_operands;
+      for (i_dynamic = 0;
+           i_dynamic < p_entry->block.num_dynamic_operands;
+           ++i_dynamic) {
+        file_entry.dynamic_operands[i_dynamic] =
+            p_entry->block.dynamic_operands[i_dynamic];
+      }
+      util_file_write(p_file, &file_entry, sizeof(file_entry));
+    }
+  }
+
+  util_file_close(p_file);
+}
@@ -0,0 +1,45 @@
+#ifndef BEEBJIT_JIT_CACHE_H
+#define BEEBJIT_JIT_CACHE_H
+
+#include <stdint.h>
+
+struct jit_cache;
+
+enum {
+  k_jit_cache_max_dynamic_operands = 8,
+};
+
+enum {
+  k_jit_cache_miss = 0,
+  k_jit_cache_hit = 1,
+  k_jit_cache_stale = 2,
+};
+
+/* A remembered compile decision for the block starting at addr_6502. The
+ * dynamic operand addresses are the operand bytes that the optimizer had
+ * converted to dynamic operands. They are excluded from the content hash
+ * because by definition they are expected to change.
+ */
+struct jit_cache_block {
+  uint16_t addr_6502;
+  uint16_t len_6502;
+  int ends_at_block_start;
+  uint32_t num_dynamic_operands;
+  uint16_t dynamic_operands[k_jit_cache_max_dynamic_operands];
+};
+
+struct jit_cache* jit_cache_create(uint8_t* p_mem_read, uint32_t codegen_key);
+void jit_cache_destroy(struct jit_cache* p_cache);
+
+void jit_cache_load(struct jit_cache* p_cache, const char* p_file_name);
+void jit_cache_save(struct jit_cache* p_cache, const char* p_file_name);
+
+void jit_cache_record(struct jit_cache* p_cache,
+                      struct jit_cache_block* p_block);
+int jit_cache_find(struct jit_cache* p_cache,
+                   struct jit_cache_block* p_block,
+                   uint16_t addr_6502);
+
+uint32_t jit_cache_get_num_entries(struct jit_cache* p_cache);
+
+#endif /* BEEBJIT_JIT_CACHE_H */
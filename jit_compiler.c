@@ -15,6 +15,105 @@
 #include <assert.h>
 #include <string.h>
 
+struct jit_compiler_smc {
+  uint32_t num_operand_writes;
+  uint32_t num_opcode_writes;
+  uint16_t operand_min;
+  uint16_t operand_max;
+  /* Saturates at k_jit_smc_max_variants + 1, meaning "too many". */
+  uint8_t num_opcodes;
+  uint8_t opcodes[k_jit_smc_max_variants];
+  uint8_t strategy;
+};
+
+/* A block can be entered directly past its countdown check by a block that
+ * jumps to it, if that block pays for the target's first countdown run in its
+ * own countdown check. Sources are on a doubly linked list per target so that
+ * they can be invalidated when the target goes away.
+ */
+struct jit_compiler_chain {
+  /* Cycles charged by the block's first countdown check, or -1 if the block
+   * can't be chained into. check_cycles also includes the later runs that the
+   * check covers.
+   */
+  int32_t cycles;
+  int32_t check_cycles;
+  uint32_t entry_jit_ptr;
+  /* Past any entry guard, for blocks that jump in with the values assumed. */
+  uint32_t unguarded_jit_ptr;
+  int32_t target;
+  int32_t sources_head;
+  int32_t sources_next;
+  int32_t sources_prev;
+};
+
+/* Register values on arrival at a block start, from the static jumps into it
+ * seen when compiling the blocks they're in. A block can be compiled to
+ * assume the values that all of those agree on, behind a guard that bounces
+ * any other arrival to the interpreter.
+ */
+struct jit_compiler_entry {
+  /* -1 where the recorded jumps disagree or don't know. */
+  int16_t values[k_jit_entry_num_values];
+  /* What the block here was compiled to assume, or -1. */
+  int16_t guards[k_jit_entry_num_values];
+  uint8_t is_recorded;
+  /* Arrived at with other values than assumed, so no longer specialized. */
+  uint8_t is_dropped;
+};
+
+/* What the interpreter needs to know to take over at the start of a compiled
+ * opcode. These are only held for addresses that start an opcode, in a pool,
+ * rather than in a full size array per item.
+ */
+struct jit_compiler_opcode_meta {
+  int32_t revalidate_count;
+  /* Cycles to give back to the countdown, or -1 if not compiled yet. */
+  int32_t cycles_fixup;
+  uint16_t nz_mem_fixup;
+  uint8_t opcode;
+  uint8_t fixups;
+  uint8_t nz_fixup;
+  uint8_t c_fixup;
+  uint8_t a_fixup;
+  uint8_t x_fixup;
+  uint8_t y_fixup;
+  uint8_t zpc_fixup;
+};
+
+enum {
+  k_jit_compiler_max_prep_opcodes = 32,
+};
+
+/* An opcode decoded ahead of compilation, with the inputs it was decoded
+ * from, so that it can be checked against the current state before use.
+ */
+struct jit_compiler_prep_opcode {
+  uint8_t bytes[3];
+  uint8_t defaulted;
+  uint8_t bcd_check;
+  uint8_t unguarded_pages;
+  struct jit_opcode_details details;
+};
+
+/* The opcodes from a block start up to the first that ends a block. */
+struct jit_compiler_prep {
+  uint16_t addr_6502;
+  uint32_t num_opcodes;
+  int code_pages;
+  int hw_read;
+  struct jit_compiler_prep_opcode opcodes[k_jit_compiler_max_prep_opcodes];
+};
+
+enum {
+  k_jit_compiler_fixup_nz_mem = 1,
+  k_jit_compiler_fixup_o = 2,
+  k_jit_compiler_fixup_a = 4,
+  k_jit_compiler_fixup_x = 8,
+  k_jit_compiler_fixup_y = 16,
+  k_jit_compiler_fixup_zpc = 32,
+};
+
 struct jit_compiler {
   struct memory_access* p_memory_access;
   uint8_t* p_mem_read;
@@ -27,6 +126,16 @@ struct jit_compiler {
 
   int option_accurate_timings;
   int option_no_optimize;
+  int option_no_fuse;
+  int option_idle_loops;
+  int option_hw_read;
+  int option_zp_cache;
+  int option_profile;
+  int option_chain;
+  int option_entry_state;
+  uint16_t banked_addr;
+  uint32_t banked_len;
+  uint8_t block_shift;
   uint32_t max_6502_opcodes_per_block;
   uint32_t max_revalidate_count;
 
@@ -37,6 +146,7 @@ struct jit_compiler {
 
   uint32_t len_x64_jmp;
   uint32_t len_x64_countdown;
+  uint32_t len_x64_ADD_CYCLES;
   uint32_t len_x64_FLAGA;
   uint32_t len_x64_FLAGX;
   uint32_t len_x64_FLAGY;
@@ -49,28 +159,118 @@ struct jit_compiler {
   uint32_t len_x64_SAVE_CARRY_INV;
   uint32_t len_x64_CLC;
   uint32_t len_x64_SEC;
+  uint32_t len_x64_ZPC_STORE;
 
-  int compile_for_code_in_zero_page;
+  int code_pages;
+  int unguarded_pages;
+  uint16_t compile_start_addr_6502;
+  uint32_t compile_code_len;
+  uint32_t check_opcode_offset;
+  uint64_t fusion_counts[k_jit_fusion_num_kinds];
+  uint64_t num_idle_loops;
+  /* Opcodes decoded ahead on the helper thread, for the next compile. */
+  struct jit_compiler_prep* p_prep;
+  uint32_t prep_index;
+  uint64_t num_prep_opcodes;
+
+  /* Index into p_metas for addresses that start an opcode, or 0. */
+  uint32_t addr_meta[k_6502_addr_space_size];
+  struct jit_compiler_opcode_meta* p_metas;
+  uint32_t* p_free_metas;
+  uint32_t num_free_metas;
+  /* Pages that may have compiled state in them. Range invalidation skips the
+   * others.
+   */
+  uint8_t page_is_live[k_6502_addr_space_size / 256];
 
-  int32_t addr_opcode[k_6502_addr_space_size];
-  int32_t addr_revalidate_count[k_6502_addr_space_size];
   uint8_t addr_is_block_start[k_6502_addr_space_size];
   uint8_t addr_is_block_continuation[k_6502_addr_space_size];
+  /* ADC / SBC here, or in the block starting here, have run in decimal
+   * mode.
+   */
+  uint8_t addr_decimal[k_6502_addr_space_size];
+  /* Opcodes here that kept faulting: 1 to check and branch to the
+   * interpreter instead of faulting, 2 to always use the interpreter.
+   */
+  uint8_t addr_defaulted[k_6502_addr_space_size];
 
-  int32_t addr_cycles_fixup[k_6502_addr_space_size];
-  uint8_t addr_nz_fixup[k_6502_addr_space_size];
-  int32_t addr_nz_mem_fixup[k_6502_addr_space_size];
-  uint8_t addr_o_fixup[k_6502_addr_space_size];
-  uint8_t addr_c_fixup[k_6502_addr_space_size];
-  int32_t addr_a_fixup[k_6502_addr_space_size];
-  int32_t addr_x_fixup[k_6502_addr_space_size];
-  int32_t addr_y_fixup[k_6502_addr_space_size];
+  struct jit_compiler_smc addr_smc[k_6502_addr_space_size];
+  struct jit_compiler_chain addr_chain[k_6502_addr_space_size];
+  struct jit_compiler_entry addr_entry[k_6502_addr_space_size];
 };
 
 enum {
   k_max_opcodes_per_compile = 256,
+  /* Limit on the cycles covered by one countdown check, including the cycles
+   * of chained blocks. Covering more is never incorrect, but it bounces to the
+   * interpreter earlier and more often ahead of a timer firing.
+   */
+  k_max_cycles_per_check = 128,
 };
 
+static void jit_invalidate_jump_target(struct jit_compiler* p_compiler,
+                                       uint16_t addr);
+
+static void
+jit_compiler_chain_unlink(struct jit_compiler* p_compiler, uint16_t addr) {
+  struct jit_compiler_chain* p_chain = &p_compiler->addr_chain[addr];
+  int32_t target = p_chain->target;
+
+  if (target == -1) {
+    return;
+  }
+  if (p_chain->sources_prev == -1) {
+    p_compiler->addr_chain[target].sources_head = p_chain->sources_next;
+  } else {
+    p_compiler->addr_chain[p_chain->sources_prev].sources_next =
+        p_chain->sources_next;
+  }
+  if (p_chain->sources_next != -1) {
+    p_compiler->addr_chain[p_chain->sources_next].sources_prev =
+        p_chain->sources_prev;
+  }
+  p_chain->target = -1;
+  p_chain->sources_next = -1;
+  p_chain->sources_prev = -1;
+}
+
+static void
+jit_compiler_chain_link(struct jit_compiler* p_compiler,
+                        uint16_t addr,
+                        uint16_t target) {
+  struct jit_compiler_chain* p_chain = &p_compiler->addr_chain[addr];
+  struct jit_compiler_chain* p_target_chain = &p_compiler->addr_chain[target];
+
+  assert(p_chain->target == -1);
+  assert(p_target_chain->cycles != -1);
+
+  p_chain->target = target;
+  p_chain->sources_prev = -1;
+  p_chain->sources_next = p_target_chain->sources_head;
+  if (p_target_chain->sources_head != -1) {
+    p_compiler->addr_chain[p_target_chain->sources_head].sources_prev = addr;
+  }
+  p_target_chain->sources_head = addr;
+}
+
+static void
+jit_compiler_unchain(struct jit_compiler* p_compiler, uint16_t addr) {
+  struct jit_compiler_chain* p_chain = &p_compiler->addr_chain[addr];
+
+  /* Blocks that jump past the countdown check at this address are relying on
+   * code that is going away, so they're invalidated too. Chains only ever
+   * point at older blocks so this terminates.
+   */
+  p_chain->cycles = -1;
+  jit_compiler_chain_unlink(p_compiler, addr);
+  while (p_chain->sources_head != -1) {
+    uint16_t source = (uint16_t) p_chain->sources_head;
+    jit_compiler_chain_unlink(p_compiler, source);
+    jit_invalidate_jump_target(p_compiler, source);
+    jit_compiler_unchain(p_compiler, source);
+  }
+}
+
 static void
 jit_invalidate_jump_target(struct jit_compiler* p_compiler, uint16_t addr) {
   void* p_host_ptr =
@@ -78,6 +278,78 @@ jit_invalidate_jump_target(struct jit_compiler* p_compiler, uint16_t addr) {
                                          addr);
   util_buffer_setup(p_compiler->p_tmp_buf, p_host_ptr, 2);
   asm_x64_emit_jit_call_compile_trampoline(p_compiler->p_tmp_buf);
+  jit_compiler_unchain(p_compiler, addr);
+}
+
+static inline void
+jit_compiler_touch_page(struct jit_compiler* p_compiler, uint16_t addr_6502) {
+  p_compiler->page_is_live[addr_6502 >> 8] = 1;
+}
+
+static void
+jit_compiler_clear_entry_guards(struct jit_compiler_entry* p_entry) {
+  uint32_t i;
+
+  for (i = 0; i < k_jit_entry_num_values; ++i) {
+    p_entry->guards[i] = -1;
+  }
+}
+
+static void
+jit_compiler_reset_entry(struct jit_compiler_entry* p_entry) {
+  uint32_t i;
+
+  for (i = 0; i < k_jit_entry_num_values; ++i) {
+    p_entry->values[i] = -1;
+  }
+  jit_compiler_clear_entry_guards(p_entry);
+  p_entry->is_recorded = 0;
+  p_entry->is_dropped = 0;
+}
+
+static inline struct jit_compiler_opcode_meta*
+jit_compiler_get_meta(struct jit_compiler* p_compiler, uint16_t addr_6502) {
+  uint32_t index = p_compiler->addr_meta[addr_6502];
+
+  if (index == 0) {
+    return NULL;
+  }
+  return &p_compiler->p_metas[index];
+}
+
+static void
+jit_compiler_free_meta(struct jit_compiler* p_compiler, uint16_t addr_6502) {
+  uint32_t index = p_compiler->addr_meta[addr_6502];
+
+  if (index == 0) {
+    return;
+  }
+  assert(p_compiler->num_free_metas < k_6502_addr_space_size);
+  p_compiler->p_free_metas[p_compiler->num_free_metas++] = index;
+  p_compiler->addr_meta[addr_6502] = 0;
+}
+
+static struct jit_compiler_opcode_meta*
+jit_compiler_new_meta(struct jit_compiler* p_compiler,
+                      uint16_t addr_6502,
+                      uint8_t opcode) {
+  struct jit_compiler_opcode_meta* p_meta;
+  uint32_t index = p_compiler->addr_meta[addr_6502];
+
+  if (index == 0) {
+    /* There's at most one per address so the pool can't run dry. */
+    assert(p_compiler->num_free_metas > 0);
+    index = p_compiler->p_free_metas[--p_compiler->num_free_metas];
+    p_compiler->addr_meta[addr_6502] = index;
+    jit_compiler_touch_page(p_compiler, addr_6502);
+  }
+  p_meta = &p_compiler->p_metas[index];
+  (void) memset(p_meta, '\0', sizeof(struct jit_compiler_opcode_meta));
+  p_meta->opcode = opcode;
+  p_meta->revalidate_count = -1;
+  p_meta->cycles_fixup = -1;
+
+  return p_meta;
 }
 
 static int
@@ -94,7 +366,7 @@ jit_has_invalidated_code(struct jit_compiler* p_compiler, uint16_t addr_6502) {
   /* TODO: this shouldn't be necessary. Is invalidating a range not clearing
    * JIT pointers properly?
    */
-  if (p_compiler->addr_opcode[addr_6502] == -1) {
+  if (jit_compiler_get_meta(p_compiler, addr_6502) == NULL) {
     return 0;
   }
 
@@ -144,6 +416,29 @@ jit_compiler_create(struct memory_access* p_memory_access,
   }
   p_compiler->option_no_optimize = util_has_option(p_options->p_opt_flags,
                                                    "jit:no-optimize");
+  p_compiler->option_no_fuse = util_has_option(p_options->p_opt_flags,
+                                               "jit:no-fuse");
+  p_compiler->option_idle_loops = !util_has_option(p_options->p_opt_flags,
+                                                   "jit:no-idle");
+  p_compiler->option_hw_read = !util_has_option(p_options->p_opt_flags,
+                                                "jit:no-hw-read");
+  p_compiler->option_zp_cache = !util_has_option(p_options->p_opt_flags,
+                                                 "jit:no-zp-cache");
+  p_compiler->option_profile = util_has_option(p_options->p_opt_flags,
+                                               "jit:profile");
+  /* Chained entry skips the countdown check, which is where the debugger and
+   * the profiler hook in.
+   */
+  p_compiler->option_chain = util_has_option(p_options->p_opt_flags,
+                                             "jit:chain");
+  if (debug || p_compiler->option_profile) {
+    p_compiler->option_chain = 0;
+  }
+  /* Compile blocks to assume register values that every static jump in
+   * agrees on.
+   */
+  p_compiler->option_entry_state = !util_has_option(p_options->p_opt_flags,
+                                                    "jit:no-entry-state");
   p_compiler->log_revalidate = util_has_option(p_options->p_log_flags,
                                                "jit:revalidate");
 
@@ -162,7 +457,9 @@ jit_compiler_create(struct memory_access* p_memory_access,
   }
   p_compiler->max_revalidate_count = max_revalidate_count;
 
-  p_compiler->compile_for_code_in_zero_page = 0;
+  p_compiler->code_pages = 0;
+  p_compiler->unguarded_pages = 0;
+  p_compiler->block_shift = K_BBC_JIT_BYTES_SHIFT;
 
   p_compiler->p_single_opcode_buf = util_buffer_create();
   p_tmp_buf = util_buffer_create();
@@ -175,14 +472,38 @@ jit_compiler_create(struct memory_access* p_memory_access,
       (uint32_t) (size_t) get_block_host_address(p_host_address_object,
                                                  (k_6502_addr_space_size - 2));
 
+  /* Index 0 means "none", so the pool has one spare entry. Hand out the low
+   * indexes first.
+   */
+  p_compiler->p_metas = util_malloc((k_6502_addr_space_size + 1) *
+                                    sizeof(struct jit_compiler_opcode_meta));
+  p_compiler->p_free_metas = util_malloc(k_6502_addr_space_size *
+                                         sizeof(uint32_t));
+  for (i = 0; i < k_6502_addr_space_size; ++i) {
+    p_compiler->p_free_metas[i] = (k_6502_addr_space_size - i);
+  }
+  p_compiler->num_free_metas = k_6502_addr_space_size;
+  /* Nothing is known about the JIT code space until the first invalidation. */
+  (void) memset(&p_compiler->page_is_live[0],
+                '\1',
+                sizeof(p_compiler->page_is_live));
+
   for (i = 0; i < k_6502_addr_space_size; ++i) {
     p_compiler->p_jit_ptrs[i] = p_compiler->jit_ptr_no_code;
+    p_compiler->addr_chain[i].cycles = -1;
+    p_compiler->addr_chain[i].target = -1;
+    p_compiler->addr_chain[i].sources_head = -1;
+    p_compiler->addr_chain[i].sources_next = -1;
+    p_compiler->addr_chain[i].sources_prev = -1;
+    jit_compiler_reset_entry(&p_compiler->addr_entry[i]);
   }
 
   /* Calculate lengths of sequences we need to know. */
   p_compiler->len_x64_jmp = (asm_x64_jit_JMP_END - asm_x64_jit_JMP);
   p_compiler->len_x64_countdown = (asm_x64_jit_check_countdown_END -
                                    asm_x64_jit_check_countdown);
+  p_compiler->len_x64_ADD_CYCLES = (asm_x64_jit_ADD_CYCLES_END -
+                                    asm_x64_jit_ADD_CYCLES);
   p_compiler->len_x64_FLAGA = (asm_x64_jit_FLAGA_END - asm_x64_jit_FLAGA);
   p_compiler->len_x64_FLAGX = (asm_x64_jit_FLAGX_END - asm_x64_jit_FLAGX);
   p_compiler->len_x64_FLAGY = (asm_x64_jit_FLAGY_END - asm_x64_jit_FLAGY);
@@ -201,6 +522,8 @@ jit_compiler_create(struct memory_access* p_memory_access,
                              asm_x64_instruction_CLC);
   p_compiler->len_x64_SEC = (asm_x64_instruction_SEC_END -
                              asm_x64_instruction_SEC);
+  p_compiler->len_x64_ZPC_STORE = (asm_x64_jit_ZPC_STORE_END -
+                                   asm_x64_jit_ZPC_STORE);
 
   return p_compiler;
 }
@@ -209,14 +532,76 @@ void
 jit_compiler_destroy(struct jit_compiler* p_compiler) {
   util_buffer_destroy(p_compiler->p_single_opcode_buf);
   util_buffer_destroy(p_compiler->p_tmp_buf);
+  util_free(p_compiler->p_metas);
+  util_free(p_compiler->p_free_metas);
   util_free(p_compiler);
 }
 
+static int
+jit_compiler_needs_bcd_check(struct jit_compiler* p_compiler,
+                             uint16_t addr_6502) {
+  /* The faulting BCD check is the cheapest option for ADC / SBC that never
+   * see decimal mode. Once a block has seen decimal mode, its ADC / SBC
+   * instead check the D flag inline and run native BCD code if it is set.
+   */
+  if (p_compiler->addr_decimal[p_compiler->compile_start_addr_6502]) {
+    p_compiler->addr_decimal[addr_6502] = 1;
+  }
+  return !p_compiler->addr_decimal[addr_6502];
+}
+
+static int
+jit_compiler_is_hw_read(struct jit_compiler* p_compiler,
+                        uint8_t opcode_6502,
+                        uint16_t addr) {
+  struct memory_access* p_memory_access = p_compiler->p_memory_access;
+  void* p_memory_callback = p_memory_access->p_callback_obj;
+  uint8_t optype = g_optypes[opcode_6502];
+
+  /* Plain absolute mode register reads, as used by polling loops and keyboard
+   * scans, can be handled by a direct call to the read callback rather than a
+   * trip through the interpreter. In debug mode, everything goes via the
+   * interpreter as before.
+   */
+  if (!p_compiler->option_hw_read || p_compiler->debug) {
+    return 0;
+  }
+  if (g_opmodes[opcode_6502] != k_abs) {
+    return 0;
+  }
+  if (!p_memory_access->memory_read_needs_callback(p_memory_callback, addr)) {
+    return 0;
+  }
+  switch (optype) {
+  case k_lda:
+  case k_ldx:
+  case k_ldy:
+  case k_bit:
+  case k_and:
+  case k_ora:
+  case k_eor:
+  case k_cmp:
+  case k_cpx:
+  case k_cpy:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 static void
-jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
-                                struct jit_opcode_details* p_details,
-                                uint16_t addr_6502) {
-  uint8_t opcode_6502;
+jit_compiler_decode_opcode(struct jit_compiler* p_compiler,
+                           struct jit_opcode_details* p_details,
+                           int* p_unguarded_pages,
+                           uint16_t addr_6502,
+                           const uint8_t* p_bytes,
+                           uint8_t defaulted,
+                           int bcd_check,
+                           int code_pages) {
+  /* Breaks the opcode in p_bytes into uops. All per-address compiler state
+   * comes in as arguments and nothing in the compiler is written, so this is
+   * safe to call from the scanner's helper thread.
+   */
   uint16_t operand_6502;
   uint8_t optype;
   uint8_t opmode;
@@ -226,10 +611,8 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   int main_written;
 
   struct memory_access* p_memory_access = p_compiler->p_memory_access;
-  uint8_t* p_mem_read = p_compiler->p_mem_read;
   void* p_memory_callback = p_memory_access->p_callback_obj;
-  uint16_t addr_plus_1 = (addr_6502 + 1);
-  uint16_t addr_plus_2 = (addr_6502 + 2);
+  uint8_t opcode_6502 = p_bytes[0];
   struct jit_uop* p_uop = &p_details->uops[0];
   struct jit_uop* p_first_post_debug_uop = p_uop;
   int use_interp = 0;
@@ -240,7 +623,6 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   p_details->addr_6502 = addr_6502;
   p_details->num_uops = 0;
 
-  opcode_6502 = p_mem_read[addr_6502];
   optype = g_optypes[opcode_6502];
   opmode = g_opmodes[opcode_6502];
   opmem = g_opmem[optype];
@@ -274,26 +656,26 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     break;
   case k_imm:
   case k_zpg:
-    operand_6502 = p_mem_read[addr_plus_1];
+    operand_6502 = p_bytes[1];
     break;
   case k_zpx:
-    operand_6502 = p_mem_read[addr_plus_1];
+    operand_6502 = p_bytes[1];
     jit_opcode_make_uop1(p_uop, k_opcode_MODE_ZPX, operand_6502);
     p_uop++;
     break;
   case k_zpy:
-    operand_6502 = p_mem_read[addr_plus_1];
+    operand_6502 = p_bytes[1];
     jit_opcode_make_uop1(p_uop, k_opcode_MODE_ZPY, operand_6502);
     p_uop++;
     break;
   case k_rel:
-    operand_6502 = p_mem_read[addr_plus_1];
+    operand_6502 = p_bytes[1];
     rel_target_6502 = ((int) addr_6502 + 2 + (int8_t) operand_6502);
     break;
   case k_abs:
   case k_abx:
   case k_aby:
-    operand_6502 = ((p_mem_read[addr_plus_2] << 8) | p_mem_read[addr_plus_1]);
+    operand_6502 = ((p_bytes[2] << 8) | p_bytes[1]);
     if ((operand_6502 & 0xFF) == 0x00) {
       could_page_cross = 0;
     }
@@ -332,21 +714,35 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     }
     break;
   case k_ind:
-    operand_6502 = ((p_mem_read[addr_plus_2] << 8) | p_mem_read[addr_plus_1]);
+    operand_6502 = ((p_bytes[2] << 8) | p_bytes[1]);
     jit_opcode_make_uop1(p_uop, k_opcode_MODE_IND_16, operand_6502);
     p_uop++;
     break;
   case k_idx:
-    operand_6502 = p_mem_read[addr_plus_1];
+    operand_6502 = p_bytes[1];
     jit_opcode_make_uop1(p_uop, k_opcode_MODE_ZPX, operand_6502);
     p_uop++;
     jit_opcode_make_uop1(p_uop, k_opcode_MODE_IND_SCRATCH_8, addr_6502);
     p_uop++;
+    if (defaulted == 1) {
+      jit_opcode_make_uop1(p_uop, k_opcode_CHECK_IND_SCRATCH, addr_6502);
+      /* Lowest address that faults. */
+      p_uop->value2 = ((opmem == k_read) ? K_BBC_MEM_INACCESSIBLE_OFFSET :
+                                           K_BBC_MEM_OS_ROM_OFFSET);
+      p_uop++;
+    }
     break;
   case k_idy:
-    operand_6502 = p_mem_read[addr_plus_1];
+    operand_6502 = p_bytes[1];
     jit_opcode_make_uop1(p_uop, k_opcode_MODE_IND_8, operand_6502);
     p_uop++;
+    if (defaulted == 1) {
+      jit_opcode_make_uop1(p_uop, k_opcode_CHECK_IND_SCRATCH_Y, addr_6502);
+      /* Lowest address that faults. */
+      p_uop->value2 = ((opmem == k_read) ? K_BBC_MEM_INACCESSIBLE_OFFSET :
+                                           K_BBC_MEM_OS_ROM_OFFSET);
+      p_uop++;
+    }
     break;
   default:
     assert(0);
@@ -375,6 +771,14 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   }
   p_details->max_cycles_merged = p_details->max_cycles_orig;
 
+  /* A defaulted opcode without an explicit check goes to the interpreter,
+   * which is still far cheaper than a fault.
+   */
+  if ((defaulted > 1) ||
+      ((defaulted == 1) && (opmode != k_idx) && (opmode != k_idy))) {
+    use_interp = 1;
+  }
+
   if (optype == k_rti) {
     /* Bounce to the interpreter for RTI. The problem with RTI is that it
      * might jump all over the place without any particular pattern, because
@@ -386,9 +790,14 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   }
 
   if (use_interp) {
+    int uopcode = k_opcode_interp;
+    if (jit_compiler_is_hw_read(p_compiler, opcode_6502, operand_6502)) {
+      uopcode = k_opcode_hw_read;
+    }
+
     p_uop = p_first_post_debug_uop;
 
-    jit_opcode_make_uop1(p_uop, k_opcode_interp, addr_6502);
+    jit_opcode_make_uop1(p_uop, uopcode, addr_6502);
     p_uop++;
     p_details->ends_block = 1;
 
@@ -397,13 +806,45 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     return;
   }
 
+  /* Stack pushes invalidate ahead of the write, while S still points at the
+   * first byte pushed.
+   */
+  switch (optype) {
+  case k_brk:
+  case k_jsr:
+  case k_pha:
+  case k_php:
+    if (code_pages & k_jit_compiler_code_page_stack) {
+      uint32_t i;
+      uint32_t num_pushed = 1;
+      if (optype == k_brk) {
+        num_pushed = 3;
+      } else if (optype == k_jsr) {
+        num_pushed = 2;
+      }
+      for (i = 0; i < num_pushed; ++i) {
+        jit_opcode_make_uop1(p_uop, k_opcode_WRITE_INV_STACK_n, i);
+        p_uop++;
+      }
+    } else {
+      *p_unguarded_pages |= k_jit_compiler_code_page_stack;
+    }
+    break;
+  default:
+    break;
+  }
+
   /* Pre-main uops. */
   switch (optype) {
   case k_adc:
-    jit_opcode_make_uop1(p_uop, k_opcode_CHECK_BCD, 0);
-    p_uop++;
+    if (bcd_check) {
+      jit_opcode_make_uop1(p_uop, k_opcode_CHECK_BCD, 0);
+      p_uop++;
+    }
     jit_opcode_make_uop1(p_uop, k_opcode_LOAD_CARRY_FOR_CALC, 0);
     p_uop++;
+    jit_opcode_make_uop1(p_uop, k_opcode_BCD_SAVE_A, 0);
+    p_uop++;
     break;
   case k_bcc:
   case k_bcs:
@@ -447,10 +888,14 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     p_uop++;
     break;
   case k_sbc:
-    jit_opcode_make_uop1(p_uop, k_opcode_CHECK_BCD, 0);
-    p_uop++;
+    if (bcd_check) {
+      jit_opcode_make_uop1(p_uop, k_opcode_CHECK_BCD, 0);
+      p_uop++;
+    }
     jit_opcode_make_uop1(p_uop, k_opcode_LOAD_CARRY_INV_FOR_CALC, 0);
     p_uop++;
+    jit_opcode_make_uop1(p_uop, k_opcode_BCD_SAVE_A, 0);
+    p_uop++;
     break;
   default:
     break;
@@ -525,6 +970,8 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   /* Post-main uops. */
   switch (optype) {
   case k_adc:
+    jit_opcode_make_uop1(p_uop, k_opcode_BCD_ADC_CHECK_D, 0);
+    p_uop++;
     jit_opcode_make_uop1(p_uop, k_opcode_SAVE_CARRY, 0);
     p_uop++;
     jit_opcode_make_uop1(p_uop, k_opcode_SAVE_OVERFLOW, 0);
@@ -595,6 +1042,8 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     }
     break;
   case k_sbc:
+    jit_opcode_make_uop1(p_uop, k_opcode_BCD_SBC_CHECK_D, 0);
+    p_uop++;
     jit_opcode_make_uop1(p_uop, k_opcode_SAVE_CARRY_INV, 0);
     p_uop++;
     jit_opcode_make_uop1(p_uop, k_opcode_SAVE_OVERFLOW, 0);
@@ -606,7 +1055,6 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
 
   /* Post-main per-mode uops. */
   /* Code invalidation for writes, aka. self-modifying code. */
-  /* TODO: stack page invalidations. */
   if (opmem == k_write || opmem == k_rw) {
     switch (opmode) {
     case k_abs:
@@ -634,16 +1082,20 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
       p_uop++;
       break;
     case k_zpg:
-      if (p_compiler->compile_for_code_in_zero_page) {
+      if (code_pages & k_jit_compiler_code_page_zero) {
         jit_opcode_make_uop1(p_uop, k_opcode_WRITE_INV_ABS, operand_6502);
         p_uop++;
+      } else {
+        *p_unguarded_pages |= k_jit_compiler_code_page_zero;
       }
       break;
     case k_zpx:
     case k_zpy:
-      if (p_compiler->compile_for_code_in_zero_page) {
+      if (code_pages & k_jit_compiler_code_page_zero) {
         jit_opcode_make_uop1(p_uop, k_opcode_WRITE_INV_SCRATCH, 0);
         p_uop++;
+      } else {
+        *p_unguarded_pages |= k_jit_compiler_code_page_zero;
       }
       break;
     default:
@@ -685,95 +1137,1151 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
 }
 
 static void
-jit_compiler_emit_uop(struct jit_compiler* p_compiler,
-                      struct util_buffer* p_dest_buf,
-                      struct jit_uop* p_uop) {
-  int uopcode = p_uop->uopcode;
-  int32_t value1 = p_uop->value1;
-  int32_t value2 = p_uop->value2;
-  struct memory_access* p_memory_access = p_compiler->p_memory_access;
-  void* p_memory_object = p_memory_access->p_callback_obj;
-  void* p_host_address_object = p_compiler->p_host_address_object;
+jit_compiler_get_opcode_details_for(struct jit_compiler* p_compiler,
+                                    struct jit_opcode_details* p_details,
+                                    uint16_t addr_6502,
+                                    uint8_t opcode_6502) {
+  uint8_t bytes[3];
 
-  uint32_t segment;
+  uint8_t* p_mem_read = p_compiler->p_mem_read;
+  uint8_t optype = g_optypes[opcode_6502];
+  int bcd_check = 0;
 
-  /* Resolve any addresses to real pointers. */
-  switch (uopcode) {
-  case k_opcode_countdown:
-  case k_opcode_CHECK_PENDING_IRQ:
-    value1 = (uint32_t) (size_t) p_compiler->get_trampoline_host_address(
-        p_host_address_object, (uint16_t) value1);
-    break;
-  case 0x4C: /* JMP abs */
-  case 0x10: /* All of the conditional branches. */
-  case 0x30:
-  case 0x50:
-  case 0x70:
-  case 0x90:
-  case 0xB0:
-  case 0xD0:
-  case 0xF0:
-    value1 = (uint32_t) (size_t) p_compiler->get_block_host_address(
-        p_host_address_object, (uint16_t) value1);
-    break;
-  default:
-    break;
+  bytes[0] = opcode_6502;
+  bytes[1] = p_mem_read[(uint16_t) (addr_6502 + 1)];
+  bytes[2] = p_mem_read[(uint16_t) (addr_6502 + 2)];
+  if ((optype == k_adc) || (optype == k_sbc)) {
+    bcd_check = jit_compiler_needs_bcd_check(p_compiler, addr_6502);
   }
 
-  /* Resolve which segment we need to hit for memory accesses. */
-  segment = K_BBC_MEM_READ_IND_ADDR;
-  switch (uopcode) {
-  case k_opcode_MODE_IND_16:
-    /* TODO: this is not correct for hardware register hits. */
-    segment = K_BBC_MEM_READ_FULL_ADDR;
-    break;
-  default:
-    break;
+  jit_compiler_decode_opcode(p_compiler,
+                             p_details,
+                             &p_compiler->unguarded_pages,
+                             addr_6502,
+                             &bytes[0],
+                             p_compiler->addr_defaulted[addr_6502],
+                             bcd_check,
+                             p_compiler->code_pages);
+}
+
+static void
+jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
+                                struct jit_opcode_details* p_details,
+                                uint16_t addr_6502) {
+  uint8_t opcode_6502 = p_compiler->p_mem_read[addr_6502];
+  jit_compiler_get_opcode_details_for(p_compiler,
+                                      p_details,
+                                      addr_6502,
+                                      opcode_6502);
+}
+
+static int
+jit_compiler_get_prep_opcode_details(struct jit_compiler* p_compiler,
+                                     struct jit_opcode_details* p_details,
+                                     uint16_t addr_6502) {
+  /* Takes the next opcode decoded ahead, if it was decoded from what is here
+   * now. Once one doesn't match, the rest of the block is decoded as usual.
+   */
+  struct jit_compiler_prep_opcode* p_prep_opcode;
+  uint32_t i;
+  uint8_t optype;
+
+  struct jit_compiler_prep* p_prep = p_compiler->p_prep;
+  uint8_t* p_mem_read = p_compiler->p_mem_read;
+
+  if (p_prep == NULL) {
+    return 0;
+  }
+  p_compiler->p_prep = NULL;
+  if (p_compiler->prep_index == p_prep->num_opcodes) {
+    return 0;
+  }
+  p_prep_opcode = &p_prep->opcodes[p_compiler->prep_index];
+  if (p_prep_opcode->details.addr_6502 != addr_6502) {
+    return 0;
+  }
+  for (i = 0; i < p_prep_opcode->details.len_bytes_6502_orig; ++i) {
+    if (p_mem_read[(uint16_t) (addr_6502 + i)] != p_prep_opcode->bytes[i]) {
+      return 0;
+    }
+  }
+  if (p_compiler->addr_defaulted[addr_6502] != p_prep_opcode->defaulted) {
+    return 0;
+  }
+  optype = g_optypes[p_prep_opcode->bytes[0]];
+  if (((optype == k_adc) || (optype == k_sbc)) &&
+      (jit_compiler_needs_bcd_check(p_compiler, addr_6502) !=
+       p_prep_opcode->bcd_check)) {
+    return 0;
   }
 
-  /* Emit the opcode. */
-  switch (uopcode) {
-  case k_opcode_countdown:
-    asm_x64_emit_jit_check_countdown(p_dest_buf,
-                                     (uint32_t) value2,
-                                     (void*) (size_t) value1);
-    break;
-  case k_opcode_debug:
-    asm_x64_emit_jit_call_debug(p_dest_buf, (uint16_t) value1);
-    break;
-  case k_opcode_interp:
-    asm_x64_emit_jit_jump_interp(p_dest_buf, (uint16_t) value1);
-    break;
-  case k_opcode_for_testing:
-    asm_x64_emit_jit_for_testing(p_dest_buf);
-    break;
-  case k_opcode_ADD_CYCLES:
-    asm_x64_emit_jit_ADD_CYCLES(p_dest_buf, (uint8_t) value1);
-    break;
-  case k_opcode_ADD_ABS:
-    asm_x64_emit_jit_ADD_ABS(p_dest_buf, (uint16_t) value1);
-    break;
-  case k_opcode_ADD_ABX:
-    asm_x64_emit_jit_ADD_ABX(p_dest_buf, (uint16_t) value1);
-    break;
-  case k_opcode_ADD_ABY:
-    asm_x64_emit_jit_ADD_ABY(p_dest_buf, (uint16_t) value1);
-    break;
-  case k_opcode_ADD_IMM:
-    asm_x64_emit_jit_ADD_IMM(p_dest_buf, (uint8_t) value1);
-    break;
-  case k_opcode_ADD_SCRATCH:
-    asm_x64_emit_jit_ADD_SCRATCH(p_dest_buf, 0);
-    break;
-  case k_opcode_ADD_SCRATCH_Y:
-    asm_x64_emit_jit_ADD_SCRATCH_Y(p_dest_buf);
-    break;
-  case k_opcode_ASL_ACC_n:
-    asm_x64_emit_jit_ASL_ACC_n(p_dest_buf, (uint8_t) value1);
+  (void) memcpy(p_details,
+                &p_prep_opcode->details,
+                sizeof(struct jit_opcode_details));
+  p_compiler->unguarded_pages |= p_prep_opcode->unguarded_pages;
+  p_compiler->p_prep = p_prep;
+  p_compiler->prep_index++;
+  p_compiler->num_prep_opcodes++;
+
+  return 1;
+}
+
+static int
+jit_compiler_smc_needs_own_block(struct jit_compiler* p_compiler,
+                                 uint16_t addr_6502) {
+  struct jit_compiler_smc* p_smc = &p_compiler->addr_smc[addr_6502];
+  return (p_smc->num_opcode_writes >= p_compiler->max_revalidate_count);
+}
+
+static void
+jit_compiler_smc_add_opcode(struct jit_compiler_smc* p_smc, uint8_t opcode) {
+  uint32_t i;
+
+  for (i = 0; i < p_smc->num_opcodes; ++i) {
+    if (i == k_jit_smc_max_variants) {
+      return;
+    }
+    if (p_smc->opcodes[i] == opcode) {
+      return;
+    }
+  }
+  if (p_smc->num_opcodes < k_jit_smc_max_variants) {
+    p_smc->opcodes[p_smc->num_opcodes] = opcode;
+  }
+  p_smc->num_opcodes++;
+}
+
+static void
+jit_compiler_smc_record_write(struct jit_compiler* p_compiler,
+                              struct jit_opcode_details* p_details) {
+  uint16_t addr_6502 = p_details->addr_6502;
+  struct jit_compiler_smc* p_smc = &p_compiler->addr_smc[addr_6502];
+  struct jit_compiler_opcode_meta* p_meta =
+      jit_compiler_get_meta(p_compiler, addr_6502);
+  uint8_t new_opcode = p_details->opcode_6502;
+  uint16_t operand_6502 = p_details->operand_6502;
+  uint8_t old_opcode;
+
+  assert(p_meta != NULL);
+  old_opcode = p_meta->opcode;
+
+  if (old_opcode != new_opcode) {
+    jit_compiler_smc_add_opcode(p_smc, old_opcode);
+    jit_compiler_smc_add_opcode(p_smc, new_opcode);
+    p_smc->num_opcode_writes++;
+    if (p_compiler->log_revalidate) {
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "opcode flip at $%.4X, opcode %.2X -> %.2X count %u",
+                 addr_6502,
+                 old_opcode,
+                 new_opcode,
+                 p_smc->num_opcode_writes);
+    }
+    return;
+  }
+
+  if (p_details->len_bytes_6502_orig == 1) {
+    return;
+  }
+  if ((p_smc->num_operand_writes == 0) || (operand_6502 < p_smc->operand_min)) {
+    p_smc->operand_min = operand_6502;
+  }
+  if ((p_smc->num_operand_writes == 0) || (operand_6502 > p_smc->operand_max)) {
+    p_smc->operand_max = operand_6502;
+  }
+  p_smc->num_operand_writes++;
+}
+
+static int
+jit_compiler_get_smc_opcode_details(struct jit_compiler* p_compiler,
+                                    struct jit_opcode_details* p_details,
+                                    uint16_t addr_6502) {
+  /* Code where the opcode itself keeps being rewritten gets a block of its
+   * own, headed by a check of the current opcode byte. If the opcode has only
+   * flipped between a couple of values, each is compiled inline behind its
+   * own check, i.e. a small polymorphic inline cache. Otherwise, or if the
+   * variants don't fit, it's just a bounce into the interpreter. Either way,
+   * opcode writes stop costing a recompile.
+   */
+  struct jit_opcode_details variants[k_jit_smc_max_variants];
+  uint32_t num_variants;
+  uint32_t num_uops;
+  uint32_t i;
+  uint8_t opcode_6502;
+  uint8_t len_6502;
+  uint8_t max_cycles;
+  struct jit_uop* p_uop;
+
+  struct jit_compiler_smc* p_smc = &p_compiler->addr_smc[addr_6502];
+  int use_inline_cache = 1;
+
+  if (!jit_compiler_smc_needs_own_block(p_compiler, addr_6502)) {
+    return 0;
+  }
+
+  opcode_6502 = p_compiler->p_mem_read[addr_6502];
+  len_6502 = g_opmodelens[g_opmodes[opcode_6502]];
+  max_cycles = g_opcycles[opcode_6502];
+
+  /* Debug mode uses larger code per opcode, so keep it simple. */
+  if (p_compiler->debug || (p_smc->num_opcodes > k_jit_smc_max_variants)) {
+    use_inline_cache = 0;
+  }
+
+  /* A new opcode will get recorded, and is likely chaotic. */
+  for (i = 0; use_inline_cache && (i < p_smc->num_opcodes); ++i) {
+    if (p_smc->opcodes[i] == opcode_6502) {
+      break;
+    }
+  }
+  if (i == p_smc->num_opcodes) {
+    use_inline_cache = 0;
+  }
+
+  /* Always check the current opcode first. */
+  num_variants = 0;
+  if (use_inline_cache) {
+    jit_compiler_get_opcode_details_for(p_compiler,
+                                        &variants[num_variants++],
+                                        addr_6502,
+                                        opcode_6502);
+    for (i = 0; i < p_smc->num_opcodes; ++i) {
+      if (p_smc->opcodes[i] != opcode_6502) {
+        jit_compiler_get_opcode_details_for(p_compiler,
+                                            &variants[num_variants++],
+                                            addr_6502,
+                                            p_smc->opcodes[i]);
+      }
+    }
+  }
+
+  /* Budget: per variant, the check, the miss, a cycles refund and a jump out,
+   * plus the final interpreter bounce and the write sink.
+   */
+  num_uops = 2;
+  for (i = 0; use_inline_cache && (i < num_variants); ++i) {
+    struct jit_opcode_details* p_variant = &variants[i];
+    if (p_variant->len_bytes_6502_orig != len_6502) {
+      use_inline_cache = 0;
+    }
+    if (p_variant->max_cycles_orig > max_cycles) {
+      max_cycles = p_variant->max_cycles_orig;
+    }
+    num_uops += (p_variant->num_uops + 4);
+  }
+  if (num_uops > k_max_uops_per_opcode) {
+    use_inline_cache = 0;
+  }
+
+  (void) memset(p_details, '\0', sizeof(struct jit_opcode_details));
+  p_details->addr_6502 = addr_6502;
+  p_details->opcode_6502 = opcode_6502;
+  p_details->len_bytes_6502_orig = len_6502;
+  p_details->len_bytes_6502_merged = len_6502;
+  p_details->branches = k_bra_y;
+  p_details->ends_block = 1;
+  p_details->cycles_run_start = -1;
+  p_details->opcode_write_sink = 1;
+  if (use_inline_cache) {
+    p_details->operand_6502 = variants[0].operand_6502;
+  } else {
+    max_cycles = g_opcycles[opcode_6502];
+  }
+  p_details->max_cycles_orig = max_cycles;
+  p_details->max_cycles_merged = max_cycles;
+
+  p_uop = &p_details->uops[0];
+  if (p_compiler->debug) {
+    jit_opcode_make_uop1(p_uop, k_opcode_debug, addr_6502);
+    p_uop++;
+  }
+  for (i = 0; use_inline_cache && (i < num_variants); ++i) {
+    struct jit_opcode_details* p_variant = &variants[i];
+    uint8_t refund = (max_cycles - p_variant->max_cycles_orig);
+    uint32_t refund_pos = p_variant->num_uops;
+    uint32_t i_uops;
+    int32_t uopcode_last;
+
+    /* Refund the cycles the countdown over-charged for this variant. Do it
+     * after anything that could fault and bounce to the interpreter, which
+     * does its own full refund, but before any jump out.
+     */
+    uopcode_last = p_variant->uops[p_variant->num_uops - 1].uopcode;
+    if ((uopcode_last == k_opcode_interp) ||
+        (uopcode_last == k_opcode_hw_read)) {
+      refund = 0;
+    } else if (p_variant->branches == k_bra_m) {
+      refund_pos = 0;
+    } else if (p_variant->branches == k_bra_y) {
+      refund_pos = (p_variant->num_uops - 1);
+    }
+
+    jit_opcode_make_uop1(p_uop, k_opcode_CHECK_OPCODE, addr_6502);
+    p_uop->value2 = p_variant->opcode_6502;
+    p_uop++;
+    for (i_uops = 0; i_uops <= p_variant->num_uops; ++i_uops) {
+      if ((i_uops == refund_pos) && (refund > 0)) {
+        jit_opcode_make_uop1(p_uop, k_opcode_ADD_CYCLES, refund);
+        p_uop++;
+      }
+      if (i_uops < p_variant->num_uops) {
+        *p_uop = p_variant->uops[i_uops];
+        p_uop++;
+      }
+    }
+    if (!p_variant->ends_block) {
+      /* JMP abs */
+      jit_opcode_make_uop1(p_uop, 0x4C, (uint16_t) (addr_6502 + len_6502));
+      p_uop->uoptype = k_jmp;
+      p_uop++;
+    }
+    jit_opcode_make_uop1(p_uop, k_opcode_CHECK_OPCODE_MISS, 0);
+    p_uop++;
+  }
+  jit_opcode_make_uop1(p_uop, k_opcode_interp, addr_6502);
+  p_uop++;
+  /* Must be last: its position is needed when setting up the JIT pointers. */
+  jit_opcode_make_uop1(p_uop, k_opcode_WRITE_SINK, 0);
+  p_uop++;
+
+  p_details->num_uops = (p_uop - &p_details->uops[0]);
+  assert(p_details->num_uops <= k_max_uops_per_opcode);
+
+  if (use_inline_cache) {
+    p_smc->strategy = k_jit_smc_strategy_inline_cache;
+  } else {
+    p_smc->strategy = k_jit_smc_strategy_interp;
+  }
+
+  return 1;
+}
+
+static void
+jit_compiler_calculate_lookahead(struct jit_opcode_details* p_opcodes,
+                                 uint32_t num_opcodes,
+                                 int32_t last_check_extra) {
+  uint32_t i_opcodes;
+
+  struct jit_uop* p_check_uop = NULL;
+
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    struct jit_opcode_details* p_details = &p_opcodes[i_opcodes];
+    struct jit_uop* p_uop = &p_details->uops[0];
+    if (p_details->eliminated || (p_details->cycles_run_start == -1)) {
+      continue;
+    }
+    if (p_uop->uopcode == k_opcode_countdown) {
+      p_check_uop = p_uop;
+      p_check_uop->value3 = 0;
+    } else {
+      assert(p_uop->uopcode == k_opcode_countdown_no_check);
+      assert(p_check_uop != NULL);
+      p_check_uop->value3 += p_uop->value2;
+    }
+  }
+
+  assert(p_check_uop != NULL);
+  p_check_uop->value3 += last_check_extra;
+}
+
+static void
+jit_compiler_group_countdowns(struct jit_opcode_details* p_opcodes,
+                              uint32_t num_opcodes) {
+  uint32_t i_opcodes;
+
+  struct jit_opcode_details* p_prev_details = NULL;
+  int32_t check_cycles = 0;
+
+  /* Only the first run in a block needs a countdown check, as long as that
+   * check covers the cycles of all the runs up to the next check. Runs that
+   * follow a not-taken branch then only need to charge their cycles, which
+   * doesn't touch the host flags.
+   */
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    struct jit_opcode_details* p_details = &p_opcodes[i_opcodes];
+    struct jit_uop* p_uop = &p_details->uops[0];
+    if (p_details->eliminated) {
+      continue;
+    }
+    if (p_details->cycles_run_start == -1) {
+      p_prev_details = p_details;
+      continue;
+    }
+    assert(p_uop->uopcode == k_opcode_countdown);
+    if ((p_prev_details == NULL) ||
+        ((check_cycles + p_uop->value2) > k_max_cycles_per_check)) {
+      check_cycles = p_uop->value2;
+      p_prev_details = p_details;
+      continue;
+    }
+    check_cycles += p_uop->value2;
+    p_uop->uopcode = k_opcode_countdown_no_check;
+    p_uop->value3 = 0;
+    /* Fold the refund for a not-taken branch into the charge for this run. */
+    if ((p_prev_details->branches == k_bra_m) &&
+        (p_prev_details->num_uops > 0)) {
+      struct jit_uop* p_refund_uop =
+          &p_prev_details->uops[p_prev_details->num_uops - 1];
+      if ((p_refund_uop->uopcode == k_opcode_ADD_CYCLES) &&
+          !p_refund_uop->eliminated) {
+        p_refund_uop->eliminated = 1;
+        p_uop->value3 = p_refund_uop->value1;
+      }
+    }
+    p_prev_details = p_details;
+  }
+
+  jit_compiler_calculate_lookahead(p_opcodes, num_opcodes, 0);
+}
+
+static int32_t
+jit_compiler_get_idle_loop_branch(struct jit_compiler* p_compiler,
+                                  uint16_t start_addr_6502) {
+  uint32_t i;
+  uint32_t pass;
+
+  struct memory_access* p_memory_access = p_compiler->p_memory_access;
+  void* p_memory_callback = p_memory_access->p_callback_obj;
+  uint8_t* p_mem_read = p_compiler->p_mem_read;
+
+  /* An idle loop is a polling loop: reads of RAM or of registers that only
+   * change on timers, compares and a branch back to the block start. Nothing
+   * it reads changes until a timer fires, and each iteration computes the
+   * same registers and flags as the last, as long as every register it writes
+   * is written before it is read. Then whole iterations can be skipped
+   * without running them. A register read ends the block, so loops with one
+   * are fast forwarded from the read instead, by the JIT.
+   */
+  enum {
+    k_max_idle_loop_opcodes = 8,
+    k_reg_a = 1,
+    k_reg_x = 2,
+    k_reg_y = 4,
+  };
+  uint32_t loop_writes = 0;
+
+  if (!p_compiler->option_idle_loops || p_compiler->debug) {
+    return -1;
+  }
+
+  for (pass = 0; pass < 2; ++pass) {
+    uint32_t writes = 0;
+    uint16_t addr_6502 = start_addr_6502;
+    for (i = 0; i < k_max_idle_loop_opcodes; ++i) {
+      uint16_t operand_6502;
+      uint8_t opcode_6502 = p_mem_read[addr_6502];
+      uint8_t optype = g_optypes[opcode_6502];
+      uint8_t opmode = g_opmodes[opcode_6502];
+      uint32_t reads = 0;
+      uint32_t op_writes = 0;
+
+      if (g_opbranch[optype] == k_bra_m) {
+        operand_6502 = p_mem_read[(uint16_t) (addr_6502 + 1)];
+        if ((opmode != k_rel) ||
+            ((uint16_t) (addr_6502 + 2 + (int8_t) operand_6502) !=
+                 start_addr_6502)) {
+          return -1;
+        }
+        if (pass == 1) {
+          return addr_6502;
+        }
+        loop_writes = writes;
+        break;
+      }
+
+      switch (opmode) {
+      case k_nil:
+      case k_imm:
+      case k_zpg:
+        break;
+      case k_abs:
+        operand_6502 = ((p_mem_read[(uint16_t) (addr_6502 + 2)] << 8) |
+                        p_mem_read[(uint16_t) (addr_6502 + 1)]);
+        if (p_memory_access->memory_read_needs_callback(p_memory_callback,
+                                                        operand_6502) &&
+            !p_memory_access->memory_read_is_timer_driven(p_memory_callback,
+                                                          operand_6502)) {
+          return -1;
+        }
+        break;
+      case k_zpx:
+        reads |= k_reg_x;
+        break;
+      case k_zpy:
+        reads |= k_reg_y;
+        break;
+      default:
+        return -1;
+      }
+      switch (optype) {
+      case k_lda:
+        op_writes = k_reg_a;
+        break;
+      case k_ldx:
+        op_writes = k_reg_x;
+        break;
+      case k_ldy:
+        op_writes = k_reg_y;
+        break;
+      case k_and:
+      case k_eor:
+      case k_ora:
+        reads |= k_reg_a;
+        op_writes = k_reg_a;
+        break;
+      case k_bit:
+      case k_cmp:
+        reads |= k_reg_a;
+        break;
+      case k_cpx:
+        reads |= k_reg_x;
+        break;
+      case k_cpy:
+        reads |= k_reg_y;
+        break;
+      case k_tax:
+        reads |= k_reg_a;
+        op_writes = k_reg_x;
+        break;
+      case k_tay:
+        reads |= k_reg_a;
+        op_writes = k_reg_y;
+        break;
+      case k_txa:
+        reads |= k_reg_x;
+        op_writes = k_reg_a;
+        break;
+      case k_tya:
+        reads |= k_reg_y;
+        op_writes = k_reg_a;
+        break;
+      case k_nop:
+        if (opcode_6502 != 0xEA) {
+          return -1;
+        }
+        break;
+      default:
+        return -1;
+      }
+      /* A register read before the loop writes it would carry a value from one
+       * iteration to the next.
+       */
+      if (reads & loop_writes & ~writes) {
+        return -1;
+      }
+      writes |= op_writes;
+      addr_6502 += g_opmodelens[opmode];
+    }
+    if (i == k_max_idle_loop_opcodes) {
+      return -1;
+    }
+  }
+
+  assert(0);
+  return -1;
+}
+
+int32_t
+jit_compiler_get_idle_loop_cycles(struct jit_compiler* p_compiler,
+                                  uint16_t addr_6502) {
+  uint16_t loop_addr_6502;
+  uint32_t num_reads;
+  int32_t cycles;
+
+  struct memory_access* p_memory_access = p_compiler->p_memory_access;
+  void* p_memory_callback = p_memory_access->p_callback_obj;
+  uint8_t* p_mem_read = p_compiler->p_mem_read;
+  uint16_t branch_addr_6502 = (uint16_t) (addr_6502 + 3);
+  uint8_t branch_opcode_6502 = p_mem_read[branch_addr_6502];
+  int8_t branch_offset = (int8_t) p_mem_read[(uint16_t) (branch_addr_6502 + 1)];
+  uint16_t start_addr_6502 = (uint16_t) (branch_addr_6502 + 2 + branch_offset);
+
+  /* The register read at addr_6502 must be directly followed by the branch
+   * back, so that the read's flags say whether the loop goes round again.
+   */
+  if (g_opmodes[branch_opcode_6502] != k_rel) {
+    return -1;
+  }
+  if (jit_compiler_get_idle_loop_branch(p_compiler, start_addr_6502) !=
+          branch_addr_6502) {
+    return -1;
+  }
+
+  num_reads = 0;
+  cycles = 0;
+  loop_addr_6502 = start_addr_6502;
+  while (loop_addr_6502 != branch_addr_6502) {
+    uint8_t opcode_6502 = p_mem_read[loop_addr_6502];
+    uint8_t opmode = g_opmodes[opcode_6502];
+    if (opmode == k_abs) {
+      uint16_t operand_6502 =
+          ((p_mem_read[(uint16_t) (loop_addr_6502 + 2)] << 8) |
+           p_mem_read[(uint16_t) (loop_addr_6502 + 1)]);
+      if (p_memory_access->memory_read_needs_callback(p_memory_callback,
+                                                      operand_6502)) {
+        if (loop_addr_6502 != addr_6502) {
+          return -1;
+        }
+        num_reads++;
+      }
+    }
+    cycles += g_opcycles[opcode_6502];
+    loop_addr_6502 += g_opmodelens[opmode];
+  }
+  /* The opcodes an idle loop allows have no page crossing penalty, and the
+   * branch is taken.
+   */
+  if (num_reads != 1) {
+    return -1;
+  }
+  cycles += (g_opcycles[branch_opcode_6502] + 1);
+  if ((start_addr_6502 & 0xFF00) != ((branch_addr_6502 + 2) & 0xFF00)) {
+    cycles++;
+  }
+
+  return cycles;
+}
+
+static int
+jit_compiler_add_idle_loop(struct jit_opcode_details* p_opcodes,
+                           uint32_t num_opcodes,
+                           uint16_t branch_addr_6502,
+                           int32_t cycles) {
+  uint32_t i_opcodes;
+  uint32_t i_uop;
+  struct jit_uop* p_uop;
+
+  struct jit_uop* p_check_uop = &p_opcodes[0].uops[0];
+  struct jit_opcode_details* p_details = NULL;
+
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    if ((p_opcodes[i_opcodes].addr_6502 == branch_addr_6502) &&
+        (p_opcodes[i_opcodes].len_bytes_6502_orig > 0)) {
+      p_details = &p_opcodes[i_opcodes];
+      break;
+    }
+  }
+  /* The block may have been cut short before the branch. */
+  if ((p_details == NULL) || p_details->eliminated) {
+    return 0;
+  }
+  /* The fast forward relies on an iteration costing exactly what the loop's
+   * countdown check charges, which chaining can change.
+   */
+  assert(p_check_uop->uopcode == k_opcode_countdown);
+  if (p_check_uop->value2 != cycles) {
+    return 0;
+  }
+  p_uop = jit_opcode_find_uop(p_details, p_details->opcode_6502);
+  if ((p_uop == NULL) ||
+      p_uop->eliminated ||
+      (p_details->num_uops == k_max_uops_per_opcode)) {
+    return 0;
+  }
+
+  i_uop = (p_uop - &p_details->uops[0]);
+  (void) memmove((p_uop + 1),
+                 p_uop,
+                 ((p_details->num_uops - i_uop) * sizeof(struct jit_uop)));
+  p_details->num_uops++;
+  jit_opcode_make_uop1(p_uop, k_opcode_IDLE_LOOP, cycles);
+  p_uop->value2 = p_check_uop->value3;
+  p_uop->value3 = p_details->opcode_6502;
+
+  return 1;
+}
+
+static int
+jit_compiler_is_banked(struct jit_compiler* p_compiler, uint16_t addr) {
+  return ((uint32_t) (uint16_t) (addr - p_compiler->banked_addr) <
+          p_compiler->banked_len);
+}
+
+static int32_t
+jit_compiler_get_jump_target(struct jit_opcode_details* p_details) {
+  /* Static jumps only: branches, JMP abs and the jump to the next block. */
+  uint8_t opcode_6502 = p_details->opcode_6502;
+  uint8_t opmode = g_opmodes[opcode_6502];
+  uint16_t addr_6502 = p_details->addr_6502;
+
+  if (p_details->len_bytes_6502_orig == 0) {
+    if (p_details->uops[0].uopcode == 0x4C) {
+      return p_details->uops[0].value1;
+    }
+    return -1;
+  }
+  if (p_details->dynamic_operand) {
+    return -1;
+  }
+  if (opmode == k_rel) {
+    return (uint16_t) (addr_6502 + 2 + (int8_t) p_details->operand_6502);
+  }
+  if ((g_optypes[opcode_6502] == k_jmp) && (opmode == k_abs)) {
+    return p_details->operand_6502;
+  }
+  return -1;
+}
+
+static void
+jit_compiler_get_exit_values(int32_t* p_values,
+                             struct jit_opcode_details* p_details) {
+  /* The optimizer's known values are as of the start of the opcode, which
+   * for a jump is also as of the jump, except that a taken BCC / BCS knows
+   * the carry.
+   */
+  p_values[k_jit_entry_a] = p_details->reg_a;
+  p_values[k_jit_entry_x] = p_details->reg_x;
+  p_values[k_jit_entry_y] = p_details->reg_y;
+  p_values[k_jit_entry_carry] = p_details->flag_carry;
+  if (p_details->len_bytes_6502_orig == 0) {
+    return;
+  }
+  switch (p_details->opcode_6502) {
+  case 0x90: /* BCC */
+    p_values[k_jit_entry_carry] = 0;
+    break;
+  case 0xB0: /* BCS */
+    p_values[k_jit_entry_carry] = 1;
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+jit_compiler_record_exits(struct jit_compiler* p_compiler,
+                          struct jit_opcode_details* p_opcodes,
+                          uint32_t num_opcodes) {
+  uint32_t i_opcodes;
+  uint32_t i;
+
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    int32_t values[k_jit_entry_num_values];
+    struct jit_compiler_entry* p_entry;
+    struct jit_opcode_details* p_details = &p_opcodes[i_opcodes];
+    int32_t target = jit_compiler_get_jump_target(p_details);
+
+    if (target == -1) {
+      continue;
+    }
+    p_entry = &p_compiler->addr_entry[target];
+    if (p_entry->is_dropped) {
+      continue;
+    }
+    jit_compiler_get_exit_values(&values[0], p_details);
+    for (i = 0; i < k_jit_entry_num_values; ++i) {
+      if (!p_entry->is_recorded) {
+        p_entry->values[i] = (int16_t) values[i];
+      } else if (p_entry->values[i] != values[i]) {
+        p_entry->values[i] = -1;
+      }
+    }
+    p_entry->is_recorded = 1;
+    jit_compiler_touch_page(p_compiler, target);
+  }
+}
+
+static void
+jit_compiler_setup_entry_guard(struct jit_compiler* p_compiler,
+                               struct jit_opcode_details* p_opcodes,
+                               uint32_t num_opcodes,
+                               uint16_t start_addr_6502) {
+  static const int32_t k_guard_uopcodes[k_jit_entry_num_values] = {
+    k_opcode_ENTRY_GUARD_A,
+    k_opcode_ENTRY_GUARD_X,
+    k_opcode_ENTRY_GUARD_Y,
+    k_opcode_ENTRY_GUARD_C,
+  };
+  uint32_t i;
+  uint8_t num_uops;
+
+  struct jit_compiler_entry* p_entry =
+      &p_compiler->addr_entry[start_addr_6502];
+  struct jit_opcode_details* p_guard_opcode = &p_opcodes[1];
+
+  assert(p_guard_opcode->eliminated);
+  jit_compiler_clear_entry_guards(p_entry);
+  if (!p_entry->is_recorded || p_entry->is_dropped) {
+    return;
+  }
+  /* A loop back to the start would most likely arrive with other values. */
+  for (i = 0; i < num_opcodes; ++i) {
+    if (jit_compiler_get_jump_target(&p_opcodes[i]) == start_addr_6502) {
+      return;
+    }
+  }
+
+  num_uops = 0;
+  for (i = 0; i < k_jit_entry_num_values; ++i) {
+    struct jit_uop* p_uop;
+    int32_t value = p_entry->values[i];
+    if (value == -1) {
+      continue;
+    }
+    p_entry->guards[i] = (int16_t) value;
+    p_uop = &p_guard_opcode->uops[num_uops++];
+    jit_opcode_make_uop1(p_uop, k_guard_uopcodes[i], start_addr_6502);
+    p_uop->value2 = value;
+  }
+  if (num_uops > 0) {
+    p_guard_opcode->num_uops = num_uops;
+    p_guard_opcode->eliminated = 0;
+  }
+}
+
+static int
+jit_compiler_is_entry_guard_met(struct jit_compiler* p_compiler,
+                                uint16_t target,
+                                struct jit_opcode_details* p_details) {
+  int32_t values[k_jit_entry_num_values];
+  uint32_t i;
+
+  struct jit_compiler_entry* p_entry = &p_compiler->addr_entry[target];
+
+  jit_compiler_get_exit_values(&values[0], p_details);
+  for (i = 0; i < k_jit_entry_num_values; ++i) {
+    if ((p_entry->guards[i] != -1) && (p_entry->guards[i] != values[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int32_t
+jit_compiler_try_chain(struct jit_compiler* p_compiler,
+                       int32_t* p_check_extra,
+                       struct jit_opcode_details* p_opcodes,
+                       uint32_t num_opcodes,
+                       uint16_t start_addr_6502) {
+  int32_t i_opcodes;
+  uint16_t target;
+  uint16_t end_addr_6502;
+  int32_t target_cycles;
+  int32_t target_check_cycles;
+  struct jit_uop* p_uop;
+  struct jit_uop* p_run_uop;
+  struct jit_uop* p_check_uop;
+
+  int32_t i_last = (num_opcodes - 1);
+  struct jit_opcode_details* p_details = &p_opcodes[i_last];
+
+  assert(p_details->ends_block);
+  if (p_details->eliminated || (p_details->num_uops == 0)) {
+    return -1;
+  }
+  p_uop = &p_details->uops[p_details->num_uops - 1];
+  if ((p_uop->uopcode != 0x4C) || p_uop->eliminated) {
+    return -1;
+  }
+  target = (uint16_t) p_uop->value1;
+  if (jit_compiler_is_banked(p_compiler, start_addr_6502) !=
+      jit_compiler_is_banked(p_compiler, target)) {
+    return -1;
+  }
+  target_cycles = p_compiler->addr_chain[target].cycles;
+  target_check_cycles = p_compiler->addr_chain[target].check_cycles;
+  if (target_cycles == -1) {
+    return -1;
+  }
+  /* Don't chain into code this block is about to replace. This also rules out
+   * loops back to the block start, which must keep their countdown check.
+   */
+  end_addr_6502 = (p_details->addr_6502 + p_details->len_bytes_6502_orig);
+  if ((uint16_t) (target - start_addr_6502) <
+          (uint16_t) (end_addr_6502 - start_addr_6502)) {
+    return -1;
+  }
+
+  p_run_uop = NULL;
+  p_check_uop = NULL;
+  for (i_opcodes = i_last; i_opcodes >= 0; --i_opcodes) {
+    struct jit_uop* p_countdown_uop = &p_opcodes[i_opcodes].uops[0];
+    if (p_opcodes[i_opcodes].eliminated ||
+        (p_opcodes[i_opcodes].cycles_run_start == -1)) {
+      continue;
+    }
+    if (p_run_uop == NULL) {
+      p_run_uop = p_countdown_uop;
+    }
+    if (p_countdown_uop->uopcode == k_opcode_countdown) {
+      p_check_uop = p_countdown_uop;
+      break;
+    }
+  }
+  assert(p_run_uop != NULL);
+  assert(p_check_uop != NULL);
+  if ((p_check_uop->value2 + p_check_uop->value3 + target_check_cycles) >
+          k_max_cycles_per_check) {
+    return -1;
+  }
+
+  /* The target's first run is charged as part of this final opcode, so any
+   * bounce to the interpreter within the run refunds it. The check must also
+   * cover any further runs the target's own check would have covered.
+   */
+  p_uop->uopcode = k_opcode_JMP_CHAIN;
+  p_details->max_cycles_merged += target_cycles;
+  p_run_uop->value2 += target_cycles;
+  *p_check_extra = (target_check_cycles - target_cycles);
+
+  return i_last;
+}
+
+static void
+jit_compiler_emit_zpc_uop(struct util_buffer* p_dest_buf,
+                          struct jit_uop* p_uop) {
+  uint8_t addr = (uint8_t) p_uop->value1;
+
+  if (p_uop->value3 & k_jit_zpc_load) {
+    asm_x64_emit_jit_ZPC_LOAD(p_dest_buf, addr);
+  }
+  switch (p_uop->uopcode) {
+  case k_opcode_ZPC_ADC:
+    asm_x64_emit_jit_ZPC_ADC(p_dest_buf);
+    break;
+  case k_opcode_ZPC_ADD:
+    asm_x64_emit_jit_ZPC_ADD(p_dest_buf);
+    break;
+  case k_opcode_ZPC_AND:
+    asm_x64_emit_jit_ZPC_AND(p_dest_buf);
+    break;
+  case k_opcode_ZPC_ASL:
+    asm_x64_emit_jit_ZPC_ASL(p_dest_buf);
+    break;
+  case k_opcode_ZPC_CMP:
+    asm_x64_emit_jit_ZPC_CMP(p_dest_buf);
+    break;
+  case k_opcode_ZPC_CPX:
+    asm_x64_emit_jit_ZPC_CPX(p_dest_buf);
+    break;
+  case k_opcode_ZPC_CPY:
+    asm_x64_emit_jit_ZPC_CPY(p_dest_buf);
+    break;
+  case k_opcode_ZPC_DEC:
+    asm_x64_emit_jit_ZPC_DEC(p_dest_buf);
+    break;
+  case k_opcode_ZPC_EOR:
+    asm_x64_emit_jit_ZPC_EOR(p_dest_buf);
+    break;
+  case k_opcode_ZPC_INC:
+    asm_x64_emit_jit_ZPC_INC(p_dest_buf);
+    break;
+  case k_opcode_ZPC_LDA:
+    asm_x64_emit_jit_ZPC_LDA(p_dest_buf);
+    break;
+  case k_opcode_ZPC_LDX:
+    asm_x64_emit_jit_ZPC_LDX(p_dest_buf);
+    break;
+  case k_opcode_ZPC_LDY:
+    asm_x64_emit_jit_ZPC_LDY(p_dest_buf);
+    break;
+  case k_opcode_ZPC_LSR:
+    asm_x64_emit_jit_ZPC_LSR(p_dest_buf);
+    break;
+  case k_opcode_ZPC_ORA:
+    asm_x64_emit_jit_ZPC_ORA(p_dest_buf);
+    break;
+  case k_opcode_ZPC_SBC:
+    asm_x64_emit_jit_ZPC_SBC(p_dest_buf);
+    break;
+  case k_opcode_ZPC_STA:
+    asm_x64_emit_jit_ZPC_STA(p_dest_buf);
+    break;
+  case k_opcode_ZPC_STOA:
+    asm_x64_emit_jit_ZPC_STOA(p_dest_buf, (uint8_t) p_uop->value2);
+    break;
+  case k_opcode_ZPC_STX:
+    asm_x64_emit_jit_ZPC_STX(p_dest_buf);
+    break;
+  case k_opcode_ZPC_STY:
+    asm_x64_emit_jit_ZPC_STY(p_dest_buf);
+    break;
+  case k_opcode_ZPC_SUB:
+    asm_x64_emit_jit_ZPC_SUB(p_dest_buf);
+    break;
+  default:
+    assert(0);
+    break;
+  }
+  if (p_uop->value3 & k_jit_zpc_store) {
+    asm_x64_emit_jit_ZPC_STORE(p_dest_buf, addr);
+  }
+}
+
+static void
+jit_compiler_emit_uop(struct jit_compiler* p_compiler,
+                      struct util_buffer* p_dest_buf,
+                      struct jit_uop* p_uop) {
+  int uopcode = p_uop->uopcode;
+  int32_t value1 = p_uop->value1;
+  int32_t value2 = p_uop->value2;
+  struct memory_access* p_memory_access = p_compiler->p_memory_access;
+  void* p_memory_object = p_memory_access->p_callback_obj;
+  void* p_host_address_object = p_compiler->p_host_address_object;
+
+  uint32_t segment;
+
+  /* Resolve any addresses to real pointers. */
+  switch (uopcode) {
+  case k_opcode_countdown:
+  case k_opcode_CHECK_IND_SCRATCH:
+  case k_opcode_CHECK_IND_SCRATCH_Y:
+  case k_opcode_CHECK_PENDING_IRQ:
+  case k_opcode_ENTRY_GUARD_A:
+  case k_opcode_ENTRY_GUARD_C:
+  case k_opcode_ENTRY_GUARD_X:
+  case k_opcode_ENTRY_GUARD_Y:
+    value1 = (uint32_t) (size_t) p_compiler->get_trampoline_host_address(
+        p_host_address_object, (uint16_t) value1);
+    break;
+  case 0x4C: /* JMP abs */
+  case 0x10: /* All of the conditional branches. */
+  case 0x30:
+  case 0x50:
+  case 0x70:
+  case 0x90:
+  case 0xB0:
+  case 0xD0:
+  case 0xF0:
+    value1 = (uint32_t) (size_t) p_compiler->get_block_host_address(
+        p_host_address_object, (uint16_t) value1);
+    break;
+  case k_opcode_JMP_CHAIN:
+    /* value2 is set if the jump meets the target's entry guard. */
+    if (value2) {
+      value1 = p_compiler->addr_chain[(uint16_t) value1].unguarded_jit_ptr;
+    } else {
+      value1 = p_compiler->addr_chain[(uint16_t) value1].entry_jit_ptr;
+    }
+    break;
+  default:
+    break;
+  }
+
+  /* Resolve which segment we need to hit for memory accesses. */
+  segment = K_BBC_MEM_READ_IND_ADDR;
+  switch (uopcode) {
+  case k_opcode_MODE_IND_16:
+    /* TODO: this is not correct for hardware register hits. */
+    segment = K_BBC_MEM_READ_FULL_ADDR;
+    break;
+  default:
+    break;
+  }
+
+  /* Emit the opcode. */
+  switch (uopcode) {
+  case k_opcode_countdown:
+  case k_opcode_countdown_no_check:
+    if (uopcode == k_opcode_countdown_no_check) {
+      /* value3 is any folded in refund from a preceding not-taken branch. */
+      asm_x64_emit_jit_countdown_no_check(p_dest_buf,
+                                          (value2 - p_uop->value3));
+    } else if (p_uop->value3 == 0) {
+      asm_x64_emit_jit_check_countdown(p_dest_buf,
+                                       (uint32_t) value2,
+                                       (void*) (size_t) value1);
+    } else {
+      /* value3 is the cycles of the following runs covered by this check. */
+      asm_x64_emit_jit_check_countdown_ahead(p_dest_buf,
+                                             (uint32_t) value2,
+                                             (uint32_t) p_uop->value3,
+                                             (void*) (size_t) value1);
+    }
+    if (p_compiler->option_profile) {
+      /* Attribute the cycles to the block, and count entries on the block
+       * start countdown.
+       */
+      uint16_t block_addr_6502 = p_compiler->compile_start_addr_6502;
+      asm_x64_emit_jit_profile(p_dest_buf,
+                               block_addr_6502,
+                               (p_uop->value1 == block_addr_6502),
+                               (uint32_t) value2);
+    }
+    break;
+  case k_opcode_debug:
+    asm_x64_emit_jit_call_debug(p_dest_buf, (uint16_t) value1);
+    break;
+  case k_opcode_interp:
+    asm_x64_emit_jit_jump_interp(p_dest_buf, (uint16_t) value1);
+    break;
+  case k_opcode_hw_read:
+    asm_x64_emit_jit_jump_hw_read(p_dest_buf, (uint16_t) value1);
+    break;
+  case k_opcode_for_testing:
+    asm_x64_emit_jit_for_testing(p_dest_buf);
+    break;
+  case k_opcode_ADC_ZPG_16:
+    asm_x64_emit_jit_ADC_ZPG_16(p_dest_buf,
+                                (uint8_t) value1,
+                                (uint8_t) value2,
+                                (uint8_t) p_uop->value3);
+    break;
+  case k_opcode_ADC_ZPG_32:
+    asm_x64_emit_jit_ADC_ZPG_32(p_dest_buf,
+                                (uint8_t) value1,
+                                (uint8_t) value2,
+                                (uint8_t) p_uop->value3);
+    break;
+  case k_opcode_ADD_CYCLES:
+    asm_x64_emit_jit_ADD_CYCLES(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_ADD_ABS:
+    asm_x64_emit_jit_ADD_ABS(p_dest_buf, (uint16_t) value1);
+    break;
+  case k_opcode_ADD_ABX:
+    asm_x64_emit_jit_ADD_ABX(p_dest_buf, (uint16_t) value1);
+    break;
+  case k_opcode_ADD_ABY:
+    asm_x64_emit_jit_ADD_ABY(p_dest_buf, (uint16_t) value1);
+    break;
+  case k_opcode_ADD_IMM:
+    asm_x64_emit_jit_ADD_IMM(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_ADD_SCRATCH:
+    asm_x64_emit_jit_ADD_SCRATCH(p_dest_buf, 0);
+    break;
+  case k_opcode_ADD_SCRATCH_Y:
+    asm_x64_emit_jit_ADD_SCRATCH_Y(p_dest_buf);
+    break;
+  case k_opcode_ASL_ACC_n:
+    asm_x64_emit_jit_ASL_ACC_n(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_ASL_ZPG_16:
+    asm_x64_emit_jit_ASL_ZPG_16(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_ASL_ZPG_32:
+    asm_x64_emit_jit_ASL_ZPG_32(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_BCD_ADC:
+    asm_x64_emit_jit_BCD(p_dest_buf, 0, 0);
+    break;
+  case k_opcode_BCD_ADC_CHECK_D:
+    asm_x64_emit_jit_BCD(p_dest_buf, 0, 1);
+    break;
+  case k_opcode_BCD_SAVE_A:
+    asm_x64_emit_jit_BCD_SAVE_A(p_dest_buf);
+    break;
+  case k_opcode_BCD_SBC:
+    asm_x64_emit_jit_BCD(p_dest_buf, 1, 0);
+    break;
+  case k_opcode_BCD_SBC_CHECK_D:
+    asm_x64_emit_jit_BCD(p_dest_buf, 1, 1);
     break;
   case k_opcode_CHECK_BCD:
     asm_x64_emit_jit_CHECK_BCD(p_dest_buf);
     break;
+  case k_opcode_CHECK_OPCODE:
+    p_compiler->check_opcode_offset = util_buffer_get_pos(p_dest_buf);
+    asm_x64_emit_jit_CHECK_OPCODE(p_dest_buf,
+                                  (uint16_t) value1,
+                                  (uint8_t) value2);
+    break;
+  case k_opcode_CHECK_OPCODE_MISS:
+    asm_x64_emit_jit_CHECK_OPCODE_MISS(p_dest_buf,
+                                       p_compiler->check_opcode_offset);
+    break;
   case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_n:
     asm_x64_emit_jit_CHECK_PAGE_CROSSING_SCRATCH_n(p_dest_buf,
                                                    (uint8_t) value1);
@@ -790,12 +2298,52 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_CHECK_PAGE_CROSSING_Y_n:
     asm_x64_emit_jit_CHECK_PAGE_CROSSING_Y_n(p_dest_buf, (uint16_t) value1);
     break;
+  case k_opcode_CHECK_IND_SCRATCH:
+    asm_x64_emit_jit_CHECK_IND_SCRATCH(p_dest_buf,
+                                       (void*) (size_t) value1,
+                                       (uint32_t) value2);
+    break;
+  case k_opcode_CHECK_IND_SCRATCH_Y:
+    asm_x64_emit_jit_CHECK_IND_SCRATCH_Y(p_dest_buf,
+                                         (void*) (size_t) value1,
+                                         (uint32_t) value2);
+    break;
   case k_opcode_CHECK_PENDING_IRQ:
     asm_x64_emit_jit_CHECK_PENDING_IRQ(p_dest_buf, (void*) (size_t) value1);
     break;
   case k_opcode_CLEAR_CARRY:
     asm_x64_emit_jit_CLEAR_CARRY(p_dest_buf);
     break;
+  case k_opcode_COPY_ZPG_16:
+    asm_x64_emit_jit_COPY_ZPG_16(p_dest_buf,
+                                 (uint8_t) value1,
+                                 (uint8_t) value2);
+    break;
+  case k_opcode_COPY_ZPG_32:
+    asm_x64_emit_jit_COPY_ZPG_32(p_dest_buf,
+                                 (uint8_t) value1,
+                                 (uint8_t) value2);
+    break;
+  case k_opcode_ENTRY_GUARD_A:
+    asm_x64_emit_jit_ENTRY_GUARD_A(p_dest_buf,
+                                   (uint8_t) value2,
+                                   (void*) (size_t) value1);
+    break;
+  case k_opcode_ENTRY_GUARD_C:
+    asm_x64_emit_jit_ENTRY_GUARD_C(p_dest_buf,
+                                   (uint8_t) value2,
+                                   (void*) (size_t) value1);
+    break;
+  case k_opcode_ENTRY_GUARD_X:
+    asm_x64_emit_jit_ENTRY_GUARD_X(p_dest_buf,
+                                   (uint8_t) value2,
+                                   (void*) (size_t) value1);
+    break;
+  case k_opcode_ENTRY_GUARD_Y:
+    asm_x64_emit_jit_ENTRY_GUARD_Y(p_dest_buf,
+                                   (uint8_t) value2,
+                                   (void*) (size_t) value1);
+    break;
   case k_opcode_EOR_SCRATCH_n:
     asm_x64_emit_jit_EOR_SCRATCH(p_dest_buf, (uint8_t) value1);
     break;
@@ -811,6 +2359,13 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_FLAG_MEM:
     asm_x64_emit_jit_FLAG_MEM(p_dest_buf, (uint16_t) value1);
     break;
+  case k_opcode_IDLE_LOOP:
+    /* value3 is the opcode of the branch that goes round the loop again. */
+    asm_x64_emit_jit_IDLE_LOOP(p_dest_buf,
+                               (uint8_t) p_uop->value3,
+                               (uint32_t) value1,
+                               (uint32_t) value2);
+    break;
   case k_opcode_INC_SCRATCH:
     asm_x64_emit_jit_INC_SCRATCH(p_dest_buf);
     break;
@@ -818,7 +2373,7 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
     asm_x64_emit_jit_INVERT_CARRY(p_dest_buf);
     break;
   case k_opcode_JMP_SCRATCH:
-    asm_x64_emit_jit_JMP_SCRATCH(p_dest_buf);
+    asm_x64_emit_jit_JMP_SCRATCH(p_dest_buf, p_compiler->block_shift);
     break;
   case k_opcode_LDA_SCRATCH_n:
     asm_x64_emit_jit_LDA_SCRATCH(p_dest_buf, (uint8_t) value1);
@@ -856,6 +2411,12 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_LSR_ACC_n:
     asm_x64_emit_jit_LSR_ACC_n(p_dest_buf, (uint8_t) value1);
     break;
+  case k_opcode_LSR_ZPG_16:
+    asm_x64_emit_jit_LSR_ZPG_16(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_LSR_ZPG_32:
+    asm_x64_emit_jit_LSR_ZPG_32(p_dest_buf, (uint8_t) value1);
+    break;
   case k_opcode_MODE_ABX:
     asm_x64_emit_jit_MODE_ABX(p_dest_buf, (uint16_t) value1);
     break;
@@ -889,9 +2450,21 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_ROL_ACC_n:
     asm_x64_emit_jit_ROL_ACC_n(p_dest_buf, (uint8_t) value1);
     break;
+  case k_opcode_ROL_ZPG_16:
+    asm_x64_emit_jit_ROL_ZPG_16(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_ROL_ZPG_32:
+    asm_x64_emit_jit_ROL_ZPG_32(p_dest_buf, (uint8_t) value1);
+    break;
   case k_opcode_ROR_ACC_n:
     asm_x64_emit_jit_ROR_ACC_n(p_dest_buf, (uint8_t) value1);
     break;
+  case k_opcode_ROR_ZPG_16:
+    asm_x64_emit_jit_ROR_ZPG_16(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_ROR_ZPG_32:
+    asm_x64_emit_jit_ROR_ZPG_32(p_dest_buf, (uint8_t) value1);
+    break;
   case k_opcode_SAVE_CARRY:
     asm_x64_emit_jit_SAVE_CARRY(p_dest_buf);
     break;
@@ -928,6 +2501,38 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_WRITE_INV_SCRATCH_Y:
     asm_x64_emit_jit_WRITE_INV_SCRATCH_Y(p_dest_buf);
     break;
+  case k_opcode_WRITE_INV_STACK_n:
+    asm_x64_emit_jit_WRITE_INV_STACK_n(p_dest_buf, (uint8_t) value1);
+    break;
+  case k_opcode_WRITE_SINK:
+    asm_x64_emit_jit_WRITE_SINK(p_dest_buf);
+    break;
+  case k_opcode_ZPC_ADC:
+  case k_opcode_ZPC_ADD:
+  case k_opcode_ZPC_AND:
+  case k_opcode_ZPC_ASL:
+  case k_opcode_ZPC_CMP:
+  case k_opcode_ZPC_CPX:
+  case k_opcode_ZPC_CPY:
+  case k_opcode_ZPC_DEC:
+  case k_opcode_ZPC_EOR:
+  case k_opcode_ZPC_INC:
+  case k_opcode_ZPC_LDA:
+  case k_opcode_ZPC_LDX:
+  case k_opcode_ZPC_LDY:
+  case k_opcode_ZPC_LSR:
+  case k_opcode_ZPC_ORA:
+  case k_opcode_ZPC_SBC:
+  case k_opcode_ZPC_STA:
+  case k_opcode_ZPC_STOA:
+  case k_opcode_ZPC_STX:
+  case k_opcode_ZPC_STY:
+  case k_opcode_ZPC_SUB:
+    jit_compiler_emit_zpc_uop(p_dest_buf, p_uop);
+    break;
+  case k_opcode_ZPC_STORE:
+    asm_x64_emit_jit_ZPC_STORE(p_dest_buf, (uint8_t) value1);
+    break;
   case 0x01: /* ORA idx */
   case 0x15: /* ORA zpx */
     asm_x64_emit_jit_ORA_SCRATCH(p_dest_buf, 0);
@@ -1073,6 +2678,7 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
     asm_x64_emit_jit_ALR_IMM(p_dest_buf, (uint8_t) value1);
     break;
   case 0x4C:
+  case k_opcode_JMP_CHAIN:
     asm_x64_emit_jit_JMP(p_dest_buf, (void*) (size_t) value1);
     break;
   case 0x4E: /* LSR abs */
@@ -1405,7 +3011,7 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
                            int is_invalidation,
                            uint16_t start_addr_6502) {
   struct jit_opcode_details opcode_details[k_max_opcodes_per_compile];
-  uint8_t single_opcode_buffer[128];
+  uint8_t single_opcode_buffer[256];
 
   uint32_t i_opcodes;
   uint32_t i_uops;
@@ -1426,9 +3032,32 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
   int block_ended = 0;
   int is_block_start = 0;
   int is_next_block_continuation = 0;
+  int is_smc_block = 0;
+  int is_specializing;
+  int32_t chain_opcode_index;
+  int32_t chain_check_extra;
+  int32_t idle_branch_addr_6502;
+  int32_t idle_cycles;
 
   assert(!util_buffer_get_pos(p_buf));
 
+  p_compiler->compile_start_addr_6502 = start_addr_6502;
+  p_compiler->unguarded_pages = 0;
+  /* Opcodes decoded ahead are only of use if they were decoded with the same
+   * view of the compiler state.
+   */
+  if ((p_compiler->p_prep != NULL) &&
+      ((p_compiler->p_prep->addr_6502 != start_addr_6502) ||
+       (p_compiler->p_prep->code_pages != p_compiler->code_pages) ||
+       (p_compiler->p_prep->hw_read != p_compiler->option_hw_read))) {
+    p_compiler->p_prep = NULL;
+  }
+  p_compiler->prep_index = 0;
+  jit_compiler_touch_page(p_compiler, start_addr_6502);
+
+  /* The existing code here, if any, is being replaced. */
+  jit_compiler_unchain(p_compiler, start_addr_6502);
+
   if (p_compiler->addr_is_block_start[start_addr_6502]) {
     /* Retain any existing block start determination. */
     is_block_start = 1;
@@ -1446,6 +3075,12 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
    * The only way to clear it is compile across the continuation boundary.
    */
 
+  /* A polling loop is compiled as one block, even if an earlier bounce out
+   * of the interpreter left a block start in the middle of it.
+   */
+  idle_branch_addr_6502 = jit_compiler_get_idle_loop_branch(p_compiler,
+                                                            start_addr_6502);
+
   /* Prepend opcodes at the start of every block. */
   addr_6502 = start_addr_6502;
   /* 1) Every block starts with a countdown check. */
@@ -1456,7 +3091,17 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
                                    addr_6502);
   p_details->cycles_run_start = 0;
   total_num_opcodes++;
-  /* 2) An unused opcode for the optimizer to use if it wants. */
+  /* 2) A check on any register values the block is compiled to assume,
+   * filled in once the block's extent is known.
+   */
+  p_details = &opcode_details[total_num_opcodes];
+  jit_opcode_make_internal_opcode1(p_details,
+                                   addr_6502,
+                                   k_opcode_ENTRY_GUARD_A,
+                                   addr_6502);
+  p_details->eliminated = 1;
+  total_num_opcodes++;
+  /* 3) An unused opcode for the optimizer to use if it wants. */
   p_details = &opcode_details[total_num_opcodes];
   jit_opcode_make_internal_opcode1(p_details, addr_6502, 0xEA, 0);
   p_details->eliminated = 1;
@@ -1483,7 +3128,17 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
 
     assert(total_num_opcodes < k_max_opcodes_per_compile);
 
-    jit_compiler_get_opcode_details(p_compiler, p_details, addr_6502);
+    if ((addr_6502 == start_addr_6502) &&
+        jit_compiler_get_smc_opcode_details(p_compiler,
+                                            p_details,
+                                            addr_6502)) {
+      is_smc_block = 1;
+      p_compiler->addr_is_block_start[addr_6502] = 1;
+    } else if (!jit_compiler_get_prep_opcode_details(p_compiler,
+                                                     p_details,
+                                                     addr_6502)) {
+      jit_compiler_get_opcode_details(p_compiler, p_details, addr_6502);
+    }
 
     addr_6502 += p_details->len_bytes_6502_orig;
     total_num_opcodes++;
@@ -1499,8 +3154,12 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
       break;
     }
 
-    /* Exit loop condition: next opcode is the start of a block boundary. */
-    if (p_compiler->addr_is_block_start[addr_6502]) {
+    /* Exit loop condition: next opcode is the start of a block boundary, or
+     * is code with a rewritten opcode that needs a block of its own.
+     */
+    if ((p_compiler->addr_is_block_start[addr_6502] &&
+         (addr_6502 > idle_branch_addr_6502)) ||
+        jit_compiler_smc_needs_own_block(p_compiler, addr_6502)) {
       break;
     }
 
@@ -1534,6 +3193,8 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
   }
 
   assert(addr_6502 > start_addr_6502);
+  /* The caller may reuse the prepared opcodes once this compile is done. */
+  p_compiler->p_prep = NULL;
 
   if (!block_ended) {
     p_details = &opcode_details[total_num_opcodes];
@@ -1543,6 +3204,21 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
     p_details->ends_block = 1;
   }
 
+  /* Register values known on entry come from the optimizer's view of the
+   * blocks that jump here, and are only of use to the optimizer.
+   */
+  is_specializing = (p_compiler->option_entry_state &&
+                     !p_compiler->option_no_optimize &&
+                     !is_smc_block);
+  if (is_specializing) {
+    jit_compiler_setup_entry_guard(p_compiler,
+                                   &opcode_details[0],
+                                   total_num_opcodes,
+                                   start_addr_6502);
+  } else {
+    jit_compiler_clear_entry_guards(&p_compiler->addr_entry[start_addr_6502]);
+  }
+
   /* Second, walk the opcode list and apply any fixups or adjustments. */
   p_uop = NULL;
   p_details_fixup = NULL;
@@ -1563,21 +3239,74 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
     /* Check self-modified status for each opcode. Need to do this before we
      * start overwriting the existing host binary in the fourth step below.
      */
-    if (jit_has_invalidated_code(p_compiler, addr_6502) &&
-        (p_details->len_bytes_6502_orig > 1)) {
-      p_details->self_modify_invalidated = 1;
+    if ((p_details->len_bytes_6502_orig > 0) &&
+        jit_has_invalidated_code(p_compiler, addr_6502)) {
+      if (!p_details->opcode_write_sink) {
+        jit_compiler_smc_record_write(p_compiler, p_details);
+      }
+      if (p_details->len_bytes_6502_orig > 1) {
+        p_details->self_modify_invalidated = 1;
+      }
     }
 
     p_details_fixup->cycles_run_start += p_details->max_cycles_orig;
     p_uop->value2 = p_details_fixup->cycles_run_start;
   }
 
-  /* Third, run the optimizer across the list of opcodes. */
-  if (!p_compiler->option_no_optimize) {
+  /* The first run's cycles are those of an idle loop iteration, if any. */
+  idle_cycles = opcode_details[0].uops[0].value2;
+
+  /* Third, run the optimizer across the list of opcodes. A block for code
+   * with a rewritten opcode is just the one opcode, and isn't optimized.
+   */
+  if (!p_compiler->option_no_optimize && !is_smc_block) {
     total_num_opcodes = jit_optimizer_optimize(p_compiler,
                                                &opcode_details[0],
                                                total_num_opcodes);
   }
+  if (is_specializing) {
+    jit_compiler_record_exits(p_compiler,
+                              &opcode_details[0],
+                              total_num_opcodes);
+  }
+
+  /* Chaining: if the block ends with a jump to an existing block, that block's
+   * first countdown run can be paid for up front, and then the jump can skip
+   * the target's countdown check.
+   */
+  jit_compiler_group_countdowns(&opcode_details[0], total_num_opcodes);
+
+  chain_opcode_index = -1;
+  chain_check_extra = 0;
+  if (p_compiler->option_chain && !is_smc_block) {
+    chain_opcode_index = jit_compiler_try_chain(p_compiler,
+                                                &chain_check_extra,
+                                                &opcode_details[0],
+                                                total_num_opcodes,
+                                                start_addr_6502);
+    jit_compiler_calculate_lookahead(&opcode_details[0],
+                                     total_num_opcodes,
+                                     chain_check_extra);
+  }
+  if ((chain_opcode_index != -1) && is_specializing) {
+    p_details = &opcode_details[chain_opcode_index];
+    p_uop = &p_details->uops[p_details->num_uops - 1];
+    p_uop->value2 = jit_compiler_is_entry_guard_met(p_compiler,
+                                                    (uint16_t) p_uop->value1,
+                                                    p_details);
+  }
+
+  /* The idle loop fast forward goes in last, because it needs the final
+   * countdown check details.
+   */
+  if ((idle_branch_addr_6502 != -1) &&
+      !is_smc_block &&
+      jit_compiler_add_idle_loop(&opcode_details[0],
+                                 total_num_opcodes,
+                                 idle_branch_addr_6502,
+                                 idle_cycles)) {
+    p_compiler->num_idle_loops++;
+  }
 
   /* Fourth, emit the uop stream to the output buffer. This finalizes the number
    * of opcodes compiled, which may get smaller if we run out of space in the
@@ -1642,6 +3371,11 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
       p_fixup_opcode = &opcode_details[(i_opcodes + 1)];
       num_fixup_uops = p_fixup_opcode->num_fixup_uops;
     }
+    if ((p_fixup_opcode != NULL) &&
+        (p_fixup_opcode->uops[0].uopcode == k_opcode_countdown_no_check) &&
+        (p_fixup_opcode->uops[0].value3 != 0)) {
+      buf_needed += p_compiler->len_x64_ADD_CYCLES;
+    }
     for (i_uops = 0; i_uops < num_fixup_uops; ++i_uops) {
       p_uop = p_fixup_opcode->fixup_uops[i_uops];
       assert(p_uop->eliminated);
@@ -1682,6 +3416,9 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
       case 0x38:
         buf_needed += p_compiler->len_x64_SEC;
         break;
+      case k_opcode_ZPC_STORE:
+        buf_needed += p_compiler->len_x64_ZPC_STORE;
+        break;
       default:
         assert(0);
         break;
@@ -1692,12 +3429,22 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
      * current position, and execute a jump to the block continuation.
      */
     if (util_buffer_remaining(p_buf) < buf_needed) {
+      int32_t refund = 0;
+      if (p_details->uops[0].uopcode == k_opcode_countdown_no_check) {
+        refund = p_details->uops[0].value3;
+      }
       is_next_block_continuation = 1;
       util_buffer_set_pos(p_single_opcode_buf, 0);
       for (i_uops = 0; i_uops < p_details->num_fixup_uops; ++i_uops) {
         p_uop = p_details->fixup_uops[i_uops];
         jit_compiler_emit_uop(p_compiler, p_single_opcode_buf, p_uop);
       }
+      /* Any not-taken branch refund folded into this run's charge. */
+      if (refund != 0) {
+        struct jit_uop refund_uop;
+        jit_opcode_make_uop1(&refund_uop, k_opcode_ADD_CYCLES, refund);
+        jit_compiler_emit_uop(p_compiler, p_single_opcode_buf, &refund_uop);
+      }
       /* JMP abs */
       jit_opcode_make_internal_opcode1(p_details, addr_6502, 0x4C, addr_6502);
       p_details->ends_block = 1;
@@ -1716,6 +3463,7 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
 
   p_compiler->addr_is_block_continuation[addr_6502] =
       is_next_block_continuation;
+  jit_compiler_touch_page(p_compiler, addr_6502);
 
   /* Fifth, update any values (metadata and/or binary) that may have changed
    * now we know the full extent of the emitted binary.
@@ -1731,31 +3479,76 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
       p_details_fixup = p_details;
       assert(p_details_fixup->num_uops == 1);
       p_uop = &p_details_fixup->uops[0];
-      assert(p_uop->uopcode == k_opcode_countdown);
+      assert((p_uop->uopcode == k_opcode_countdown) ||
+             (p_uop->uopcode == k_opcode_countdown_no_check));
       p_details_fixup->cycles_run_start = 0;
       p_uop->value2 = 0;
-
-      util_buffer_setup(p_single_opcode_buf,
-                        p_details_fixup->p_host_address,
-                        p_uop->len_x64);
-      /* The replacement uop could be shorter (e.g. 4-byte length -> 1-byte) but
-       * never longer so fill with nop.
-       */
-      util_buffer_fill_to_end(p_single_opcode_buf, '\x90');
     }
 
     p_details_fixup->cycles_run_start += p_details->max_cycles_merged;
     p_uop->value2 = p_details_fixup->cycles_run_start;
+  }
+  if ((chain_opcode_index == -1) ||
+      ((uint32_t) chain_opcode_index >= total_num_opcodes)) {
+    chain_check_extra = 0;
+  }
+  jit_compiler_calculate_lookahead(&opcode_details[0],
+                                   total_num_opcodes,
+                                   chain_check_extra);
+  for (i_opcodes = 0; i_opcodes < total_num_opcodes; ++i_opcodes) {
+    p_details = &opcode_details[i_opcodes];
+    if (p_details->eliminated || (p_details->cycles_run_start == -1)) {
+      continue;
+    }
+    p_uop = &p_details->uops[0];
+    util_buffer_setup(p_single_opcode_buf,
+                      p_details->p_host_address,
+                      p_uop->len_x64);
+    /* The replacement uop could be shorter (e.g. 4-byte length -> 1-byte) but
+     * never longer so fill with nop.
+     */
+    util_buffer_fill_to_end(p_single_opcode_buf, '\x90');
     util_buffer_set_pos(p_single_opcode_buf, 0);
     jit_compiler_emit_uop(p_compiler, p_single_opcode_buf, p_uop);
   }
 
+  if (p_compiler->option_chain && !is_smc_block) {
+    struct jit_compiler_chain* p_chain =
+        &p_compiler->addr_chain[start_addr_6502];
+    p_details = &opcode_details[0];
+    assert(p_details->uops[0].uopcode == k_opcode_countdown);
+    p_chain->cycles = p_details->cycles_run_start;
+    p_chain->check_cycles = (p_details->uops[0].value2 +
+                             p_details->uops[0].value3);
+    p_chain->entry_jit_ptr = ((uint32_t) (size_t) p_details->p_host_address +
+                              p_details->uops[0].len_x64);
+    p_chain->unguarded_jit_ptr = p_chain->entry_jit_ptr;
+    p_details = &opcode_details[1];
+    if (!p_details->eliminated) {
+      for (i_uops = 0; i_uops < p_details->num_uops; ++i_uops) {
+        p_chain->unguarded_jit_ptr += p_details->uops[i_uops].len_x64;
+      }
+    }
+    /* A chained jump may have been lost if the block didn't fit. */
+    if ((chain_opcode_index != -1) &&
+        ((uint32_t) chain_opcode_index < total_num_opcodes)) {
+      p_details = &opcode_details[chain_opcode_index];
+      p_uop = &p_details->uops[p_details->num_uops - 1];
+      assert(p_uop->uopcode == k_opcode_JMP_CHAIN);
+      jit_compiler_chain_link(p_compiler,
+                              start_addr_6502,
+                              (uint16_t) p_uop->value1);
+    }
+  }
+
   /* Sixth, update compiler metadata. */
   cycles = 0;
   for (i_opcodes = 0; i_opcodes < total_num_opcodes; ++i_opcodes) {
     uint8_t num_bytes_6502;
     uint8_t i;
     uint32_t jit_ptr;
+    uint32_t operand_jit_ptr;
+    uint32_t sink_jit_ptr;
 
     p_details = &opcode_details[i_opcodes];
     if (p_details->eliminated) {
@@ -1768,81 +3561,117 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
 
     num_bytes_6502 = p_details->len_bytes_6502_merged;
     jit_ptr = (uint32_t) (size_t) p_details->p_host_address;
+    operand_jit_ptr = jit_ptr;
+    sink_jit_ptr = jit_ptr;
+    if (p_details->opcode_write_sink) {
+      /* Opcode byte writes go to the sink at the end of the code. Operand
+       * byte writes invalidate the block start, which is the only way into
+       * this code. Or, if we're just bouncing to the interpreter, operands
+       * are dynamic.
+       */
+      for (i_uops = 0; i_uops < (p_details->num_uops - 1U); ++i_uops) {
+        sink_jit_ptr += p_details->uops[i_uops].len_x64;
+      }
+      assert(p_details->uops[i_uops].uopcode == k_opcode_WRITE_SINK);
+      if (p_compiler->addr_smc[addr_6502].strategy ==
+          k_jit_smc_strategy_inline_cache) {
+        operand_jit_ptr = (uint32_t) (size_t)
+            p_compiler->get_block_host_address(
+                p_compiler->p_host_address_object, start_addr_6502);
+      } else {
+        operand_jit_ptr = p_compiler->jit_ptr_dynamic_operand;
+      }
+    }
     for (i = 0; i < num_bytes_6502; ++i) {
       p_compiler->p_jit_ptrs[addr_6502] = jit_ptr;
+      jit_compiler_touch_page(p_compiler, addr_6502);
 
       if (addr_6502 != start_addr_6502) {
         jit_invalidate_jump_target(p_compiler, addr_6502);
         p_compiler->addr_is_block_start[addr_6502] = 0;
         p_compiler->addr_is_block_continuation[addr_6502] = 0;
+        jit_compiler_clear_entry_guards(&p_compiler->addr_entry[addr_6502]);
       }
 
-      p_compiler->addr_nz_fixup[addr_6502] = 0;
-      p_compiler->addr_nz_mem_fixup[addr_6502] = -1;
-      p_compiler->addr_o_fixup[addr_6502] = 0;
-      p_compiler->addr_c_fixup[addr_6502] = 0;
-      p_compiler->addr_a_fixup[addr_6502] = -1;
-      p_compiler->addr_x_fixup[addr_6502] = -1;
-      p_compiler->addr_y_fixup[addr_6502] = -1;
-
       if (i == 0) {
+        struct jit_compiler_opcode_meta* p_meta =
+            jit_compiler_get_meta(p_compiler, addr_6502);
         uint8_t opcode_6502 = p_details->opcode_6502;
-        int32_t revalidate_count = p_compiler->addr_revalidate_count[addr_6502];
-        if (opcode_6502 != p_compiler->addr_opcode[addr_6502]) {
-          revalidate_count = 0;
-        } else if (p_details->self_modify_invalidated) {
-          revalidate_count++;
-          if (p_compiler->log_revalidate) {
-            log_do_log(k_log_jit,
-                       k_log_info,
-                       "revalidate at $%.4X, opcode %.2X count %d",
-                       addr_6502,
-                       opcode_6502,
-                       revalidate_count);
+        int32_t revalidate_count = 0;
+        if ((p_meta != NULL) && (p_meta->opcode == opcode_6502)) {
+          revalidate_count = p_meta->revalidate_count;
+          if (p_details->self_modify_invalidated) {
+            revalidate_count++;
+            if (p_compiler->log_revalidate) {
+              log_do_log(k_log_jit,
+                         k_log_info,
+                         "revalidate at $%.4X, opcode %.2X count %d",
+                         addr_6502,
+                         opcode_6502,
+                         revalidate_count);
+            }
           }
         }
-        p_compiler->addr_opcode[addr_6502] = opcode_6502;
-        p_compiler->addr_revalidate_count[addr_6502] = revalidate_count;
+        p_meta = jit_compiler_new_meta(p_compiler, addr_6502, opcode_6502);
+        p_meta->revalidate_count = revalidate_count;
 
-        p_compiler->addr_cycles_fixup[addr_6502] = cycles;
+        if (p_details->opcode_write_sink) {
+          p_compiler->p_jit_ptrs[addr_6502] = sink_jit_ptr;
+        } else if (p_details->dynamic_operand) {
+          p_compiler->addr_smc[addr_6502].strategy =
+              k_jit_smc_strategy_dynamic_operand;
+        } else {
+          p_compiler->addr_smc[addr_6502].strategy =
+              k_jit_smc_strategy_recompile;
+        }
+
+        p_meta->cycles_fixup = cycles;
         for (i_uops = 0; i_uops < p_details->num_fixup_uops; ++i_uops) {
           p_uop = p_details->fixup_uops[i_uops];
           switch (p_uop->uopcode) {
           case k_opcode_FLAGA:
-            p_compiler->addr_nz_fixup[addr_6502] = k_a;
+            p_meta->nz_fixup = k_a;
             break;
           case k_opcode_FLAGX:
-            p_compiler->addr_nz_fixup[addr_6502] = k_x;
+            p_meta->nz_fixup = k_x;
             break;
           case k_opcode_FLAGY:
-            p_compiler->addr_nz_fixup[addr_6502] = k_y;
+            p_meta->nz_fixup = k_y;
             break;
           case k_opcode_FLAG_MEM:
-            p_compiler->addr_nz_mem_fixup[addr_6502] = (uint16_t) p_uop->value1;
+            p_meta->fixups |= k_jit_compiler_fixup_nz_mem;
+            p_meta->nz_mem_fixup = (uint16_t) p_uop->value1;
             break;
           case 0xA9: /* LDA imm */
-            p_compiler->addr_a_fixup[addr_6502] = (uint8_t) p_uop->value1;
+            p_meta->fixups |= k_jit_compiler_fixup_a;
+            p_meta->a_fixup = (uint8_t) p_uop->value1;
             break;
           case 0xA2: /* LDX imm */
-            p_compiler->addr_x_fixup[addr_6502] = (uint8_t) p_uop->value1;
+            p_meta->fixups |= k_jit_compiler_fixup_x;
+            p_meta->x_fixup = (uint8_t) p_uop->value1;
             break;
           case 0xA0: /* LDY imm */
-            p_compiler->addr_y_fixup[addr_6502] = (uint8_t) p_uop->value1;
+            p_meta->fixups |= k_jit_compiler_fixup_y;
+            p_meta->y_fixup = (uint8_t) p_uop->value1;
             break;
           case k_opcode_SAVE_OVERFLOW:
-            p_compiler->addr_o_fixup[addr_6502] = 1;
+            p_meta->fixups |= k_jit_compiler_fixup_o;
             break;
           case k_opcode_SAVE_CARRY:
-            p_compiler->addr_c_fixup[addr_6502] = 1;
+            p_meta->c_fixup = 1;
             break;
           case k_opcode_SAVE_CARRY_INV:
-            p_compiler->addr_c_fixup[addr_6502] = 2;
+            p_meta->c_fixup = 2;
             break;
           case 0x18: /* CLC */
-            p_compiler->addr_c_fixup[addr_6502] = 3;
+            p_meta->c_fixup = 3;
             break;
           case 0x38: /* SEC */
-            p_compiler->addr_c_fixup[addr_6502] = 4;
+            p_meta->c_fixup = 4;
+            break;
+          case k_opcode_ZPC_STORE:
+            p_meta->fixups |= k_jit_compiler_fixup_zpc;
+            p_meta->zpc_fixup = (uint8_t) p_uop->value1;
             break;
           default:
             assert(0);
@@ -1850,15 +3679,15 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
           }
         }
       } else {
-        p_compiler->addr_opcode[addr_6502] = -1;
-        p_compiler->addr_revalidate_count[addr_6502] = -1;
-
-        p_compiler->addr_cycles_fixup[addr_6502] = -1;
+        jit_compiler_free_meta(p_compiler, addr_6502);
 
         if (p_details->dynamic_operand) {
           p_compiler->p_jit_ptrs[addr_6502] =
               p_compiler->jit_ptr_dynamic_operand;
         }
+        if (p_details->opcode_write_sink) {
+          p_compiler->p_jit_ptrs[addr_6502] = operand_jit_ptr;
+        }
       }
 
       addr_6502++;
@@ -1874,6 +3703,7 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
    * jump.
    * 3) Performance. int3 will stop the Intel instruction decoder.
    */
+  p_compiler->compile_code_len = util_buffer_get_pos(p_buf);
   util_buffer_fill_to_end(p_buf, '\xcc');
 
   return (addr_6502 - start_addr_6502);
@@ -1883,41 +3713,50 @@ int64_t
 jit_compiler_fixup_state(struct jit_compiler* p_compiler,
                          struct state_6502* p_state_6502,
                          int64_t countdown,
-                         uint64_t host_rflags) {
+                         uint64_t host_rflags,
+                         uint8_t host_zpc_value) {
   uint16_t pc_6502 = p_state_6502->reg_pc;
-  int32_t cycles_fixup = p_compiler->addr_cycles_fixup[pc_6502];
-  uint8_t nz_fixup = p_compiler->addr_nz_fixup[pc_6502];
-  int32_t nz_mem_fixup = p_compiler->addr_nz_mem_fixup[pc_6502];
-  uint8_t o_fixup = p_compiler->addr_o_fixup[pc_6502];
-  uint8_t c_fixup = p_compiler->addr_c_fixup[pc_6502];
-  int32_t a_fixup = p_compiler->addr_a_fixup[pc_6502];
-  int32_t x_fixup = p_compiler->addr_x_fixup[pc_6502];
-  int32_t y_fixup = p_compiler->addr_y_fixup[pc_6502];
+  struct jit_compiler_opcode_meta* p_meta =
+      jit_compiler_get_meta(p_compiler, pc_6502);
+  uint8_t fixups;
+  uint8_t nz_fixup;
+  uint8_t c_fixup;
+
+  assert(p_meta != NULL);
+  fixups = p_meta->fixups;
+  nz_fixup = p_meta->nz_fixup;
+  c_fixup = p_meta->c_fixup;
 
   /* cycles_fixup can be 0 in the case the opcode is bouncing to the
    * interpreter -- an invalid opcode, for example.
    */
-  assert(cycles_fixup >= 0);
-  countdown += cycles_fixup;
+  assert(p_meta->cycles_fixup >= 0);
+  countdown += p_meta->cycles_fixup;
 
-  if (a_fixup != -1) {
-    state_6502_set_a(p_state_6502, a_fixup);
+  /* Write back any cached zero page byte first, as the NZ fixup may read it
+   * from memory.
+   */
+  if (fixups & k_jit_compiler_fixup_zpc) {
+    p_compiler->p_memory_access->p_mem_write[p_meta->zpc_fixup] =
+        host_zpc_value;
+  }
+  if (fixups & k_jit_compiler_fixup_a) {
+    state_6502_set_a(p_state_6502, p_meta->a_fixup);
   }
-  if (x_fixup != -1) {
-    state_6502_set_x(p_state_6502, x_fixup);
+  if (fixups & k_jit_compiler_fixup_x) {
+    state_6502_set_x(p_state_6502, p_meta->x_fixup);
   }
-  if (y_fixup != -1) {
-    state_6502_set_y(p_state_6502, y_fixup);
+  if (fixups & k_jit_compiler_fixup_y) {
+    state_6502_set_y(p_state_6502, p_meta->y_fixup);
   }
-  if ((nz_fixup != 0) || (nz_mem_fixup != -1)) {
+  if ((nz_fixup != 0) || (fixups & k_jit_compiler_fixup_nz_mem)) {
     uint8_t nz_val = 0;
     uint8_t flag_n;
     uint8_t flag_z;
     uint8_t flags_new;
     switch (nz_fixup) {
     case 0:
-      assert(nz_mem_fixup != -1);
-      nz_val = p_compiler->p_mem_read[nz_mem_fixup];
+      nz_val = p_compiler->p_mem_read[p_meta->nz_mem_fixup];
       break;
     case k_a:
       nz_val = p_state_6502->reg_a;
@@ -1941,7 +3780,7 @@ jit_compiler_fixup_state(struct jit_compiler* p_compiler,
     p_state_6502->reg_flags &= ~((1 << k_flag_negative) | (1 << k_flag_zero));
     p_state_6502->reg_flags |= flags_new;
   }
-  if (o_fixup) {
+  if (fixups & k_jit_compiler_fixup_o) {
     int host_overflow_flag = !!(host_rflags & 0x0800);
     p_state_6502->reg_flags &= ~(1 << k_flag_overflow);
     p_state_6502->reg_flags |= (host_overflow_flag << k_flag_overflow);
@@ -1977,20 +3816,206 @@ jit_compiler_memory_range_invalidate(struct jit_compiler* p_compiler,
   assert(addr_end <= k_6502_addr_space_size);
 
   for (i = addr; i < addr_end; ++i) {
-    p_compiler->addr_opcode[i] = -1;
-    p_compiler->addr_revalidate_count[i] = -1;
+    if (!p_compiler->page_is_live[i >> 8]) {
+      i |= 0xFF;
+      continue;
+    }
+
+    jit_compiler_unchain(p_compiler, i);
+    jit_compiler_free_meta(p_compiler, i);
+
     p_compiler->addr_is_block_start[i] = 0;
     p_compiler->addr_is_block_continuation[i] = 0;
 
-    p_compiler->addr_cycles_fixup[i] = -1;
-    p_compiler->addr_nz_fixup[i] = 0;
-    p_compiler->addr_nz_mem_fixup[i] = -1;
-    p_compiler->addr_o_fixup[i] = 0;
-    p_compiler->addr_c_fixup[i] = 0;
-    p_compiler->addr_a_fixup[i] = -1;
-    p_compiler->addr_x_fixup[i] = -1;
-    p_compiler->addr_y_fixup[i] = -1;
+    (void) memset(&p_compiler->addr_smc[i],
+                  '\0',
+                  sizeof(struct jit_compiler_smc));
+    jit_compiler_reset_entry(&p_compiler->addr_entry[i]);
+
+    /* A page wiped from start to end has nothing left in it. */
+    if (((i & 0xFF) == 0xFF) && ((i - 0xFF) >= addr)) {
+      p_compiler->page_is_live[i >> 8] = 0;
+    }
+  }
+}
+
+int
+jit_compiler_is_page_live(struct jit_compiler* p_compiler, uint16_t addr) {
+  return p_compiler->page_is_live[addr >> 8];
+}
+
+void
+jit_compiler_unchain_block(struct jit_compiler* p_compiler,
+                           uint16_t addr_6502) {
+  jit_compiler_unchain(p_compiler, addr_6502);
+}
+
+static uint32_t
+jit_compiler_copy_range_array(uint8_t* p_state,
+                              void* p_array,
+                              size_t elem_size,
+                              uint16_t addr,
+                              uint32_t len,
+                              int is_save) {
+  uint8_t* p_range = ((uint8_t*) p_array + (addr * elem_size));
+  uint32_t size = (len * elem_size);
+
+  if (p_state == NULL) {
+    return size;
+  }
+  if (is_save) {
+    (void) memcpy(p_state, p_range, size);
+  } else {
+    (void) memcpy(p_range, p_state, size);
+  }
+  return size;
+}
+
+static uint32_t
+jit_compiler_copy_range_metas(struct jit_compiler* p_compiler,
+                              uint8_t* p_state,
+                              uint16_t addr,
+                              uint32_t len,
+                              int is_save) {
+  /* Saved as a presence byte per address, followed by a slot per address. */
+  uint32_t i;
+  struct jit_compiler_opcode_meta* p_saved_metas;
+
+  uint32_t meta_size = sizeof(struct jit_compiler_opcode_meta);
+
+  if (p_state == NULL) {
+    return (len * (1 + meta_size));
+  }
+
+  p_saved_metas = (struct jit_compiler_opcode_meta*) (p_state + len);
+  for (i = 0; i < len; ++i) {
+    uint16_t addr_6502 = (addr + i);
+    struct jit_compiler_opcode_meta* p_meta =
+        jit_compiler_get_meta(p_compiler, addr_6502);
+    if (is_save) {
+      p_state[i] = (p_meta != NULL);
+      if (p_meta != NULL) {
+        (void) memcpy(&p_saved_metas[i], p_meta, meta_size);
+      }
+    } else if (p_state[i]) {
+      p_meta = jit_compiler_new_meta(p_compiler, addr_6502, 0);
+      (void) memcpy(p_meta, &p_saved_metas[i], meta_size);
+    } else {
+      jit_compiler_free_meta(p_compiler, addr_6502);
+    }
+  }
+
+  return (len * (1 + meta_size));
+}
+
+static uint32_t
+jit_compiler_copy_range_state(struct jit_compiler* p_compiler,
+                              uint8_t* p_state,
+                              uint16_t addr,
+                              uint32_t len,
+                              int is_save) {
+  uint32_t i;
+  void* p_arrays[8];
+  size_t elem_sizes[8];
+  uint32_t num_arrays = 0;
+  uint32_t size = 0;
+
+  p_arrays[num_arrays] = &p_compiler->addr_is_block_start[0];
+  elem_sizes[num_arrays++] = sizeof(p_compiler->addr_is_block_start[0]);
+  p_arrays[num_arrays] = &p_compiler->addr_is_block_continuation[0];
+  elem_sizes[num_arrays++] =
+      sizeof(p_compiler->addr_is_block_continuation[0]);
+  p_arrays[num_arrays] = &p_compiler->addr_decimal[0];
+  elem_sizes[num_arrays++] = sizeof(p_compiler->addr_decimal[0]);
+  p_arrays[num_arrays] = &p_compiler->addr_defaulted[0];
+  elem_sizes[num_arrays++] = sizeof(p_compiler->addr_defaulted[0]);
+  p_arrays[num_arrays] = &p_compiler->addr_smc[0];
+  elem_sizes[num_arrays++] = sizeof(p_compiler->addr_smc[0]);
+  p_arrays[num_arrays] = &p_compiler->addr_chain[0];
+  elem_sizes[num_arrays++] = sizeof(p_compiler->addr_chain[0]);
+  p_arrays[num_arrays] = &p_compiler->addr_entry[0];
+  elem_sizes[num_arrays++] = sizeof(p_compiler->addr_entry[0]);
+  assert(num_arrays <= (sizeof(p_arrays) / sizeof(p_arrays[0])));
+
+  for (i = 0; i < num_arrays; ++i) {
+    uint32_t array_size = jit_compiler_copy_range_array(p_state,
+                                                        p_arrays[i],
+                                                        elem_sizes[i],
+                                                        addr,
+                                                        len,
+                                                        is_save);
+    if (p_state != NULL) {
+      p_state += array_size;
+    }
+    size += array_size;
   }
+
+  size += jit_compiler_copy_range_metas(p_compiler, p_state, addr, len, is_save);
+
+  return size;
+}
+
+void
+jit_compiler_set_block_shift(struct jit_compiler* p_compiler,
+                             uint8_t block_shift) {
+  p_compiler->block_shift = block_shift;
+}
+
+uint32_t
+jit_compiler_get_compile_code_len(struct jit_compiler* p_compiler) {
+  return p_compiler->compile_code_len;
+}
+
+void
+jit_compiler_set_banked_range(struct jit_compiler* p_compiler,
+                              uint16_t addr,
+                              uint32_t len) {
+  assert((addr + len) <= k_6502_addr_space_size);
+
+  p_compiler->banked_addr = addr;
+  p_compiler->banked_len = len;
+}
+
+uint32_t
+jit_compiler_get_range_state_size(struct jit_compiler* p_compiler,
+                                  uint32_t len) {
+  return jit_compiler_copy_range_state(p_compiler, NULL, 0, len, 0);
+}
+
+void
+jit_compiler_save_range_state(struct jit_compiler* p_compiler,
+                              uint8_t* p_state,
+                              uint16_t addr,
+                              uint32_t len) {
+  /* Only valid within the banked range: a chain link to outside the range
+   * would not survive being put aside.
+   */
+  assert(jit_compiler_is_banked(p_compiler, addr));
+  assert((addr + len) <= (p_compiler->banked_addr + p_compiler->banked_len));
+
+  (void) jit_compiler_copy_range_state(p_compiler, p_state, addr, len, 1);
+}
+
+void
+jit_compiler_load_range_state(struct jit_compiler* p_compiler,
+                              uint8_t* p_state,
+                              uint16_t addr,
+                              uint32_t len) {
+  uint32_t i;
+
+  assert(jit_compiler_is_banked(p_compiler, addr));
+  assert((addr + len) <= (p_compiler->banked_addr + p_compiler->banked_len));
+
+  for (i = 0; i < len; i += 256) {
+    jit_compiler_touch_page(p_compiler, (uint16_t) (addr + i));
+  }
+  (void) jit_compiler_copy_range_state(p_compiler, p_state, addr, len, 0);
+}
+
+int
+jit_compiler_get_chain_target(struct jit_compiler* p_compiler,
+                              uint16_t addr_6502) {
+  return p_compiler->addr_chain[addr_6502].target;
 }
 
 uint32_t
@@ -2003,8 +4028,35 @@ jit_compiler_get_revalidation_details(struct jit_compiler* p_compiler,
                                       int32_t* p_opcode,
                                       int32_t* p_revalidate_count,
                                       uint16_t addr_6502) {
-  *p_opcode = p_compiler->addr_opcode[addr_6502];
-  *p_revalidate_count = p_compiler->addr_revalidate_count[addr_6502];
+  struct jit_compiler_opcode_meta* p_meta =
+      jit_compiler_get_meta(p_compiler, addr_6502);
+
+  if (p_meta == NULL) {
+    *p_opcode = -1;
+    *p_revalidate_count = -1;
+    return;
+  }
+  *p_opcode = p_meta->opcode;
+  *p_revalidate_count = p_meta->revalidate_count;
+}
+
+void
+jit_compiler_set_revalidation_details(struct jit_compiler* p_compiler,
+                                      int32_t opcode,
+                                      int32_t revalidate_count,
+                                      uint16_t addr_6502) {
+  struct jit_compiler_opcode_meta* p_meta;
+
+  if (opcode == -1) {
+    jit_compiler_free_meta(p_compiler, addr_6502);
+    return;
+  }
+  p_meta = jit_compiler_get_meta(p_compiler, addr_6502);
+  if (p_meta == NULL) {
+    p_meta = jit_compiler_new_meta(p_compiler, addr_6502, (uint8_t) opcode);
+  }
+  p_meta->opcode = (uint8_t) opcode;
+  p_meta->revalidate_count = revalidate_count;
 }
 
 int
@@ -2014,15 +4066,287 @@ jit_compiler_is_block_continuation(struct jit_compiler* p_compiler,
 }
 
 int
-jit_compiler_is_compiling_for_code_in_zero_page(
-    struct jit_compiler* p_compiler) {
-  return p_compiler->compile_for_code_in_zero_page;
+jit_compiler_is_block_start(struct jit_compiler* p_compiler,
+                            uint16_t addr_6502) {
+  return p_compiler->addr_is_block_start[addr_6502];
+}
+
+void
+jit_compiler_set_block_start(struct jit_compiler* p_compiler,
+                             uint16_t addr_6502) {
+  p_compiler->addr_is_block_start[addr_6502] = 1;
+  jit_compiler_touch_page(p_compiler, addr_6502);
+}
+
+void
+jit_compiler_set_decimal_block(struct jit_compiler* p_compiler,
+                               uint16_t addr_6502) {
+  p_compiler->addr_decimal[addr_6502] = 1;
+}
+
+int
+jit_compiler_default_opcode(struct jit_compiler* p_compiler,
+                            uint16_t addr_6502) {
+  uint8_t defaulted = p_compiler->addr_defaulted[addr_6502];
+
+  if (defaulted < 2) {
+    defaulted++;
+    p_compiler->addr_defaulted[addr_6502] = defaulted;
+  }
+  return defaulted;
+}
+
+int32_t
+jit_compiler_get_entry_guard(struct jit_compiler* p_compiler,
+                             uint16_t addr_6502,
+                             int which) {
+  assert(which < k_jit_entry_num_values);
+  return p_compiler->addr_entry[addr_6502].guards[which];
+}
+
+int
+jit_compiler_check_entry_state(struct jit_compiler* p_compiler,
+                               struct state_6502* p_state_6502) {
+  int32_t values[k_jit_entry_num_values];
+  uint32_t i;
+
+  uint16_t pc_6502 = p_state_6502->reg_pc;
+  struct jit_compiler_entry* p_entry = &p_compiler->addr_entry[pc_6502];
+
+  values[k_jit_entry_a] = (uint8_t) p_state_6502->reg_a;
+  values[k_jit_entry_x] = (uint8_t) p_state_6502->reg_x;
+  values[k_jit_entry_y] = (uint8_t) p_state_6502->reg_y;
+  values[k_jit_entry_carry] = !!(p_state_6502->reg_flags &
+                                 (1 << k_flag_carry));
+  for (i = 0; i < k_jit_entry_num_values; ++i) {
+    if ((p_entry->guards[i] != -1) && (p_entry->guards[i] != values[i])) {
+      break;
+    }
+  }
+  if (i == k_jit_entry_num_values) {
+    return 0;
+  }
+
+  jit_compiler_clear_entry_guards(p_entry);
+  p_entry->is_dropped = 1;
+  return 1;
+}
+
+int
+jit_compiler_is_fusing(struct jit_compiler* p_compiler) {
+  return !p_compiler->option_no_fuse;
+}
+
+int
+jit_compiler_is_zp_caching(struct jit_compiler* p_compiler) {
+  /* Code in zero page needs every zero page write to check for invalidation,
+   * so nothing may linger in a register.
+   */
+  return (p_compiler->option_zp_cache &&
+          !p_compiler->debug &&
+          !(p_compiler->code_pages & k_jit_compiler_code_page_zero));
+}
+
+void
+jit_compiler_count_fusion(struct jit_compiler* p_compiler, int kind) {
+  assert(kind < k_jit_fusion_num_kinds);
+  p_compiler->fusion_counts[kind]++;
+}
+
+uint64_t
+jit_compiler_get_fusion_count(struct jit_compiler* p_compiler, int kind) {
+  assert(kind < k_jit_fusion_num_kinds);
+  return p_compiler->fusion_counts[kind];
+}
+
+uint64_t
+jit_compiler_get_num_idle_loops(struct jit_compiler* p_compiler) {
+  return p_compiler->num_idle_loops;
+}
+
+struct jit_compiler_prep*
+jit_compiler_prep_create() {
+  return util_mallocz(sizeof(struct jit_compiler_prep));
+}
+
+void
+jit_compiler_prep_destroy(struct jit_compiler_prep* p_prep) {
+  util_free(p_prep);
+}
+
+uint16_t
+jit_compiler_prep_get_addr(struct jit_compiler_prep* p_prep) {
+  return p_prep->addr_6502;
+}
+
+uint32_t
+jit_compiler_prepare_block(struct jit_compiler* p_compiler,
+                           struct jit_compiler_prep* p_prep,
+                           uint16_t addr_6502) {
+  /* Called on the scanner's helper thread, while the CPU thread carries on
+   * running and compiling. The 6502 bytes and per-address state read here may
+   * change at any time, so they're recorded alongside each decoded opcode and
+   * checked again when the opcode is taken.
+   */
+  uint32_t i;
+
+  volatile uint8_t* p_mem_read = p_compiler->p_mem_read;
+  volatile uint8_t* p_defaulted = p_compiler->addr_defaulted;
+  volatile uint8_t* p_decimal = p_compiler->addr_decimal;
+  uint32_t addr = addr_6502;
+
+  p_prep->addr_6502 = addr_6502;
+  p_prep->code_pages = *(volatile int*) &p_compiler->code_pages;
+  p_prep->hw_read = p_compiler->option_hw_read;
+
+  for (i = 0; i < k_jit_compiler_max_prep_opcodes; ++i) {
+    struct jit_compiler_prep_opcode* p_prep_opcode = &p_prep->opcodes[i];
+    int unguarded_pages = 0;
+    uint8_t optype;
+
+    /* Zero page, stack and hardware register code isn't looked ahead at. */
+    if ((addr < 0x200) ||
+        (addr > 0xFFFD) ||
+        ((addr >= 0xFC00) && (addr < 0xFF00))) {
+      break;
+    }
+    p_prep_opcode->bytes[0] = p_mem_read[addr];
+    p_prep_opcode->bytes[1] = p_mem_read[addr + 1];
+    p_prep_opcode->bytes[2] = p_mem_read[addr + 2];
+    p_prep_opcode->defaulted = p_defaulted[addr];
+    optype = g_optypes[p_prep_opcode->bytes[0]];
+    p_prep_opcode->bcd_check = 0;
+    if ((optype == k_adc) || (optype == k_sbc)) {
+      p_prep_opcode->bcd_check = !p_decimal[addr];
+    }
+    jit_compiler_decode_opcode(p_compiler,
+                               &p_prep_opcode->details,
+                               &unguarded_pages,
+                               addr,
+                               &p_prep_opcode->bytes[0],
+                               p_prep_opcode->defaulted,
+                               p_prep_opcode->bcd_check,
+                               p_prep->code_pages);
+    p_prep_opcode->unguarded_pages = unguarded_pages;
+
+    addr += p_prep_opcode->details.len_bytes_6502_orig;
+    if (p_prep_opcode->details.ends_block) {
+      i++;
+      break;
+    }
+  }
+
+  p_prep->num_opcodes = i;
+
+  return i;
+}
+
+void
+jit_compiler_set_prep(struct jit_compiler* p_compiler,
+                      struct jit_compiler_prep* p_prep) {
+  p_compiler->p_prep = p_prep;
+}
+
+uint64_t
+jit_compiler_get_num_prep_opcodes(struct jit_compiler* p_compiler) {
+  return p_compiler->num_prep_opcodes;
+}
+
+uint32_t
+jit_compiler_get_cache_key(struct jit_compiler* p_compiler) {
+  /* Everything that can change block boundaries or optimizer decisions. */
+  uint32_t key = 0;
+
+  key |= !!p_compiler->option_accurate_timings;
+  key |= (!!p_compiler->option_no_optimize << 1);
+  key |= (!!p_compiler->option_profile << 2);
+  key |= (!!p_compiler->option_no_fuse << 3);
+  key |= (!!p_compiler->option_idle_loops << 4);
+  key |= (!!p_compiler->option_zp_cache << 5);
+  key |= ((p_compiler->max_revalidate_count & 0xFF) << 8);
+  key |= ((p_compiler->max_6502_opcodes_per_block & 0xFFFF) << 16);
+
+  return key;
+}
+
+void
+jit_compiler_get_smc_info(struct jit_compiler* p_compiler,
+                          struct jit_smc_info* p_info,
+                          uint16_t addr_6502) {
+  uint32_t i;
+
+  struct jit_compiler_smc* p_smc = &p_compiler->addr_smc[addr_6502];
+
+  (void) memset(p_info, '\0', sizeof(struct jit_smc_info));
+  if (p_smc->num_opcode_writes > 0) {
+    if (p_smc->num_opcodes > k_jit_smc_max_variants) {
+      p_info->smc_class = k_jit_smc_opcode_chaotic;
+    } else {
+      p_info->smc_class = k_jit_smc_opcode_flip;
+    }
+  } else if (p_smc->num_operand_writes > 0) {
+    p_info->smc_class = k_jit_smc_operand;
+  } else {
+    p_info->smc_class = k_jit_smc_none;
+  }
+  p_info->strategy = p_smc->strategy;
+  p_info->num_operand_writes = p_smc->num_operand_writes;
+  p_info->num_opcode_writes = p_smc->num_opcode_writes;
+  p_info->operand_min = p_smc->operand_min;
+  p_info->operand_max = p_smc->operand_max;
+  p_info->num_opcodes = p_smc->num_opcodes;
+  for (i = 0; (i < p_smc->num_opcodes) && (i < k_jit_smc_max_variants); ++i) {
+    p_info->opcodes[i] = p_smc->opcodes[i];
+  }
+}
+
+const char*
+jit_compiler_get_smc_class_name(int smc_class) {
+  switch (smc_class) {
+  case k_jit_smc_none:
+    return "none";
+  case k_jit_smc_operand:
+    return "operand";
+  case k_jit_smc_opcode_flip:
+    return "flip";
+  case k_jit_smc_opcode_chaotic:
+    return "chaotic";
+  default:
+    assert(0);
+    return "?";
+  }
+}
+
+const char*
+jit_compiler_get_smc_strategy_name(int strategy) {
+  switch (strategy) {
+  case k_jit_smc_strategy_recompile:
+    return "recompile";
+  case k_jit_smc_strategy_dynamic_operand:
+    return "dynamic";
+  case k_jit_smc_strategy_inline_cache:
+    return "cache";
+  case k_jit_smc_strategy_interp:
+    return "interp";
+  default:
+    assert(0);
+    return "?";
+  }
+}
+
+int
+jit_compiler_get_code_pages(struct jit_compiler* p_compiler) {
+  return p_compiler->code_pages;
 }
 
 void
-jit_compiler_set_compiling_for_code_in_zero_page(
-    struct jit_compiler* p_compiler, int value) {
-  p_compiler->compile_for_code_in_zero_page = value;
+jit_compiler_add_code_pages(struct jit_compiler* p_compiler, int pages) {
+  p_compiler->code_pages |= pages;
+}
+
+int
+jit_compiler_get_unguarded_pages(struct jit_compiler* p_compiler) {
+  return p_compiler->unguarded_pages;
 }
 
 void
@@ -2037,8 +4361,43 @@ jit_compiler_testing_set_max_ops(struct jit_compiler* p_compiler,
   p_compiler->max_6502_opcodes_per_block = num_ops;
 }
 
+void
+jit_compiler_testing_set_chaining(struct jit_compiler* p_compiler,
+                                  int chaining) {
+  p_compiler->option_chain = chaining;
+}
+
 void
 jit_compiler_testing_set_max_revalidate_count(struct jit_compiler* p_compiler,
                                               uint32_t max_count) {
   p_compiler->max_revalidate_count = max_count;
 }
+
+void
+jit_compiler_testing_set_idle_loops(struct jit_compiler* p_compiler,
+                                    int idle_loops) {
+  p_compiler->option_idle_loops = idle_loops;
+}
+
+void
+jit_compiler_testing_set_hw_read(struct jit_compiler* p_compiler,
+                                 int hw_read) {
+  p_compiler->option_hw_read = hw_read;
+}
+
+void
+jit_compiler_testing_set_zp_cache(struct jit_compiler* p_compiler,
+                                  int zp_cache) {
+  p_compiler->option_zp_cache = zp_cache;
+}
+
+void
+jit_compiler_testing_set_entry_state(struct jit_compiler* p_compiler,
+                                     int entry_state) {
+  p_compiler->option_entry_state = entry_state;
+}
+
+void
+jit_compiler_testing_set_fusing(struct jit_compiler* p_compiler, int fusing) {
+  p_compiler->option_no_fuse = !fusing;
+}
@@ -5,10 +5,73 @@
 
 struct bbc_options;
 struct jit_compiler;
+struct jit_compiler_prep;
 struct memory_access;
 struct state_6502;
 struct util_buffer;
 
+/* Self-modifying code classification of a 6502 code address, from the writes
+ * seen each time the code there was invalidated and recompiled.
+ */
+enum {
+  k_jit_smc_none = 0,
+  /* Operand bytes rewritten, opcode stable. */
+  k_jit_smc_operand = 1,
+  /* Opcode flipped between a small set of opcodes, e.g. JSR <-> JMP. */
+  k_jit_smc_opcode_flip = 2,
+  /* Opcode rewritten to more opcodes than we'll keep variants for. */
+  k_jit_smc_opcode_chaotic = 3,
+};
+
+/* How the compiler handled the code address last time it was compiled. */
+enum {
+  k_jit_smc_strategy_recompile = 0,
+  k_jit_smc_strategy_dynamic_operand = 1,
+  k_jit_smc_strategy_inline_cache = 2,
+  k_jit_smc_strategy_interp = 3,
+};
+
+enum {
+  k_jit_smc_max_variants = 2,
+};
+
+enum {
+  k_jit_compiler_code_page_zero = 1,
+  k_jit_compiler_code_page_stack = 2,
+};
+
+/* Multi-byte operations that the optimizer fused into single wider host
+ * operations.
+ */
+enum {
+  k_jit_fusion_shift = 0,
+  k_jit_fusion_copy = 1,
+  k_jit_fusion_add = 2,
+  k_jit_fusion_num_kinds = 3,
+};
+
+/* Register and flag values that a block can be compiled to assume on entry,
+ * when every static jump into it so far agrees on them.
+ */
+enum {
+  k_jit_entry_a = 0,
+  k_jit_entry_x = 1,
+  k_jit_entry_y = 2,
+  k_jit_entry_carry = 3,
+  k_jit_entry_num_values = 4,
+};
+
+struct jit_smc_info {
+  int smc_class;
+  int strategy;
+  uint32_t num_operand_writes;
+  uint32_t num_opcode_writes;
+  uint16_t operand_min;
+  uint16_t operand_max;
+  uint32_t num_opcodes;
+  uint8_t opcodes[k_jit_smc_max_variants];
+};
+
 struct jit_compiler* jit_compiler_create(
     struct memory_access* p_memory_access,
     void* (*get_block_host_address)(void* p, uint16_t addr),
@@ -23,35 +86,155 @@ uint32_t jit_compiler_compile_block(struct jit_compiler* p_compiler,
                                     struct util_buffer* p_buf,
                                     int is_invalidation,
                                     uint16_t addr_6502);
+/* Host code bytes used by the last compiled block, before int3 padding. */
+uint32_t jit_compiler_get_compile_code_len(struct jit_compiler* p_compiler);
+/* log2 of the host bytes between the entry points of consecutive 6502
+ * addresses, used by computed jumps.
+ */
+void jit_compiler_set_block_shift(struct jit_compiler* p_compiler,
+                                  uint8_t block_shift);
 
 int64_t jit_compiler_fixup_state(struct jit_compiler* p_compiler,
                                  struct state_6502* p_state_6502,
                                  int64_t countdown,
-                                 uint64_t host_rflags);
+                                 uint64_t host_rflags,
+                                 uint8_t host_zpc_value);
 
 void jit_compiler_memory_range_invalidate(struct jit_compiler* p_compiler,
                                           uint16_t addr,
                                           uint32_t len);
 
+/* Whether the page holding addr may have any compiled code or metadata in it.
+ * Pages stop being live when they are invalidated in full.
+ */
+int jit_compiler_is_page_live(struct jit_compiler* p_compiler, uint16_t addr);
+
+/* Invalidates any blocks that jump directly into the block at addr_6502. Must
+ * be called whenever the block start is invalidated.
+ */
+void jit_compiler_unchain_block(struct jit_compiler* p_compiler,
+                                uint16_t addr_6502);
+/* Returns the block that addr_6502 chains into, or -1. */
+int jit_compiler_get_chain_target(struct jit_compiler* p_compiler,
+                                  uint16_t addr_6502);
+
+/* A banked range holds paged memory whose per-address state gets put aside and
+ * brought back on bank switches. Blocks never chain into or out of it.
+ */
+void jit_compiler_set_banked_range(struct jit_compiler* p_compiler,
+                                   uint16_t addr,
+                                   uint32_t len);
+uint32_t jit_compiler_get_range_state_size(struct jit_compiler* p_compiler,
+                                           uint32_t len);
+void jit_compiler_save_range_state(struct jit_compiler* p_compiler,
+                                   uint8_t* p_state,
+                                   uint16_t addr,
+                                   uint32_t len);
+void jit_compiler_load_range_state(struct jit_compiler* p_compiler,
+                                   uint8_t* p_state,
+                                   uint16_t addr,
+                                   uint32_t len);
+
 uint32_t jit_compiler_get_max_revalidate_count(struct jit_compiler* p_compiler);
 
 int jit_compiler_is_block_continuation(struct jit_compiler* p_compiler,
                                        uint16_t addr_6502);
+int jit_compiler_is_block_start(struct jit_compiler* p_compiler,
+                                uint16_t addr_6502);
+void jit_compiler_set_block_start(struct jit_compiler* p_compiler,
+                                  uint16_t addr_6502);
 void jit_compiler_get_revalidation_details(struct jit_compiler* p_compiler,
                                            int32_t* p_opcode,
                                            int32_t* p_revalidate_count,
                                            uint16_t addr_6502);
+void jit_compiler_set_revalidation_details(struct jit_compiler* p_compiler,
+                                           int32_t opcode,
+                                           int32_t revalidate_count,
+                                           uint16_t addr_6502);
+/* Notes that the block at addr_6502 ran ADC / SBC with the D flag set. When
+ * next compiled, its ADC / SBC use native BCD code instead of faulting.
+ */
+void jit_compiler_set_decimal_block(struct jit_compiler* p_compiler,
+                                    uint16_t addr_6502);
+/* Notes that the opcode at addr_6502 keeps faulting. When next compiled, it
+ * checks for the faulting case and branches to the interpreter, or if that
+ * was already tried, always uses the interpreter. Returns the new level.
+ */
+int jit_compiler_default_opcode(struct jit_compiler* p_compiler,
+                                uint16_t addr_6502);
+/* The value the block at addr_6502 was compiled to assume on entry, or -1. */
+int32_t jit_compiler_get_entry_guard(struct jit_compiler* p_compiler,
+                                     uint16_t addr_6502,
+                                     int which);
+/* Checks the state on arrival at a block start against the values the block
+ * was compiled to assume. On a mismatch, the block is compiled without
+ * assumptions from now on, and 1 is returned so the caller invalidates it.
+ */
+int jit_compiler_check_entry_state(struct jit_compiler* p_compiler,
+                                   struct state_6502* p_state_6502);
+int jit_compiler_is_fusing(struct jit_compiler* p_compiler);
+int jit_compiler_is_zp_caching(struct jit_compiler* p_compiler);
+void jit_compiler_count_fusion(struct jit_compiler* p_compiler, int kind);
+uint64_t jit_compiler_get_fusion_count(struct jit_compiler* p_compiler,
+                                       int kind);
+/* Polling loops compiled to fast forward to the next timer. */
+uint64_t jit_compiler_get_num_idle_loops(struct jit_compiler* p_compiler);
+/* For a register read at addr_6502 that is directly followed by the branch
+ * back of an idle loop, the cycles an iteration takes, not counting any 1MHz
+ * stretch of the read. Otherwise -1.
+ */
+int32_t jit_compiler_get_idle_loop_cycles(struct jit_compiler* p_compiler,
+                                          uint16_t addr_6502);
+uint32_t jit_compiler_get_cache_key(struct jit_compiler* p_compiler);
+
+/* A block's opcodes can be decoded into uops ahead of time, on another thread,
+ * by jit_compiler_prepare_block(). Passing them to jit_compiler_set_prep()
+ * before compiling the block saves decoding them again; each is checked
+ * against current memory and compiler state first. The prep may be reused
+ * once the compile is done.
+ */
+struct jit_compiler_prep* jit_compiler_prep_create();
+void jit_compiler_prep_destroy(struct jit_compiler_prep* p_prep);
+uint16_t jit_compiler_prep_get_addr(struct jit_compiler_prep* p_prep);
+uint32_t jit_compiler_prepare_block(struct jit_compiler* p_compiler,
+                                    struct jit_compiler_prep* p_prep,
+                                    uint16_t addr_6502);
+void jit_compiler_set_prep(struct jit_compiler* p_compiler,
+                           struct jit_compiler_prep* p_prep);
+/* Opcodes compiled from a prep rather than decoded on the spot. */
+uint64_t jit_compiler_get_num_prep_opcodes(struct jit_compiler* p_compiler);
+void jit_compiler_get_smc_info(struct jit_compiler* p_compiler,
+                               struct jit_smc_info* p_info,
+                               uint16_t addr_6502);
+const char* jit_compiler_get_smc_class_name(int smc_class);
+const char* jit_compiler_get_smc_strategy_name(int strategy);
 
-int jit_compiler_is_compiling_for_code_in_zero_page(
-    struct jit_compiler* p_compiler);
-void jit_compiler_set_compiling_for_code_in_zero_page(
-    struct jit_compiler* p_compiler, int value);
+/* Low 6502 pages that have had code compiled in them. Plain zero page and
+ * stack pushes only pay for self-modify invalidation once there is code in
+ * the page they write to.
+ */
+int jit_compiler_get_code_pages(struct jit_compiler* p_compiler);
+void jit_compiler_add_code_pages(struct jit_compiler* p_compiler, int pages);
+/* Code pages the last compiled block writes to without invalidation. */
+int jit_compiler_get_unguarded_pages(struct jit_compiler* p_compiler);
 
 void jit_compiler_testing_set_optimizing(struct jit_compiler* p_compiler,
                                          int optimizing);
 void jit_compiler_testing_set_max_ops(struct jit_compiler* p_compiler,
                                       uint32_t num_ops);
+void jit_compiler_testing_set_chaining(struct jit_compiler* p_compiler,
+                                       int chaining);
 void jit_compiler_testing_set_max_revalidate_count(
     struct jit_compiler* p_compiler, uint32_t max_count);
+void jit_compiler_testing_set_idle_loops(struct jit_compiler* p_compiler,
+                                         int idle_loops);
+void jit_compiler_testing_set_hw_read(struct jit_compiler* p_compiler,
+                                      int hw_read);
+void jit_compiler_testing_set_zp_cache(struct jit_compiler* p_compiler,
+                                       int zp_cache);
+void jit_compiler_testing_set_entry_state(struct jit_compiler* p_compiler,
+                                          int entry_state);
+void jit_compiler_testing_set_fusing(struct jit_compiler* p_compiler,
+                                     int fusing);
 
 #endif /* BEEJIT_JIT_COMPILER_H */
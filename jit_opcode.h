@@ -9,6 +9,7 @@ struct jit_uop {
   int32_t uoptype;
   int32_t value1;
   int32_t value2;
+  int32_t value3;
 
   /* Dynamic details that are calculated as compilation proceeds. */
   uint32_t len_x64;
@@ -48,13 +49,21 @@ struct jit_opcode_details {
   int eliminated;
   int self_modify_invalidated;
   int dynamic_operand;
+  /* Writes to the opcode byte land in a sink rather than invalidating the
+   * code, because the code checks the opcode byte itself.
+   */
+  int opcode_write_sink;
 };
 
 enum {
   k_opcode_countdown = 0x100,
+  k_opcode_countdown_no_check,
   k_opcode_debug,
   k_opcode_interp,
+  k_opcode_hw_read,
   k_opcode_for_testing,
+  k_opcode_ADC_ZPG_16,
+  k_opcode_ADC_ZPG_32,
   k_opcode_ADD_CYCLES,
   k_opcode_ADD_ABS,
   k_opcode_ADD_ABX,
@@ -63,21 +72,40 @@ enum {
   k_opcode_ADD_SCRATCH,
   k_opcode_ADD_SCRATCH_Y,
   k_opcode_ASL_ACC_n,
+  k_opcode_ASL_ZPG_16,
+  k_opcode_ASL_ZPG_32,
+  k_opcode_BCD_ADC,
+  k_opcode_BCD_ADC_CHECK_D,
+  k_opcode_BCD_SAVE_A,
+  k_opcode_BCD_SBC,
+  k_opcode_BCD_SBC_CHECK_D,
   k_opcode_CHECK_BCD,
+  k_opcode_CHECK_OPCODE,
+  k_opcode_CHECK_OPCODE_MISS,
   k_opcode_CHECK_PAGE_CROSSING_SCRATCH_n,
   k_opcode_CHECK_PAGE_CROSSING_SCRATCH_X,
   k_opcode_CHECK_PAGE_CROSSING_SCRATCH_Y,
   k_opcode_CHECK_PAGE_CROSSING_X_n,
   k_opcode_CHECK_PAGE_CROSSING_Y_n,
+  k_opcode_CHECK_IND_SCRATCH,
+  k_opcode_CHECK_IND_SCRATCH_Y,
   k_opcode_CHECK_PENDING_IRQ,
   k_opcode_CLEAR_CARRY,
+  k_opcode_COPY_ZPG_16,
+  k_opcode_COPY_ZPG_32,
+  k_opcode_ENTRY_GUARD_A,
+  k_opcode_ENTRY_GUARD_C,
+  k_opcode_ENTRY_GUARD_X,
+  k_opcode_ENTRY_GUARD_Y,
   k_opcode_EOR_SCRATCH_n,
   k_opcode_FLAGA,
   k_opcode_FLAGX,
   k_opcode_FLAGY,
   k_opcode_FLAG_MEM,
+  k_opcode_IDLE_LOOP,
   k_opcode_INC_SCRATCH,
   k_opcode_INVERT_CARRY,
+  k_opcode_JMP_CHAIN,
   k_opcode_JMP_SCRATCH,
   k_opcode_LDA_SCRATCH_n,
   k_opcode_LDA_SCRATCH_X,
@@ -91,6 +119,8 @@ enum {
   k_opcode_LOAD_SCRATCH_8,
   k_opcode_LOAD_SCRATCH_16,
   k_opcode_LSR_ACC_n,
+  k_opcode_LSR_ZPG_16,
+  k_opcode_LSR_ZPG_32,
   k_opcode_MODE_ABX,
   k_opcode_MODE_ABY,
   k_opcode_MODE_IND_8,
@@ -102,7 +132,11 @@ enum {
   k_opcode_PULL_16,
   k_opcode_PUSH_16,
   k_opcode_ROL_ACC_n,
+  k_opcode_ROL_ZPG_16,
+  k_opcode_ROL_ZPG_32,
   k_opcode_ROR_ACC_n,
+  k_opcode_ROR_ZPG_16,
+  k_opcode_ROR_ZPG_32,
   k_opcode_SAVE_CARRY,
   k_opcode_SAVE_CARRY_INV,
   k_opcode_SAVE_OVERFLOW,
@@ -115,6 +149,39 @@ enum {
   k_opcode_WRITE_INV_SCRATCH,
   k_opcode_WRITE_INV_SCRATCH_n,
   k_opcode_WRITE_INV_SCRATCH_Y,
+  k_opcode_WRITE_INV_STACK_n,
+  k_opcode_WRITE_SINK,
+  k_opcode_ZPC_ADC,
+  k_opcode_ZPC_ADD,
+  k_opcode_ZPC_AND,
+  k_opcode_ZPC_ASL,
+  k_opcode_ZPC_CMP,
+  k_opcode_ZPC_CPX,
+  k_opcode_ZPC_CPY,
+  k_opcode_ZPC_DEC,
+  k_opcode_ZPC_EOR,
+  k_opcode_ZPC_INC,
+  k_opcode_ZPC_LDA,
+  k_opcode_ZPC_LDX,
+  k_opcode_ZPC_LDY,
+  k_opcode_ZPC_LSR,
+  k_opcode_ZPC_ORA,
+  k_opcode_ZPC_SBC,
+  k_opcode_ZPC_STA,
+  k_opcode_ZPC_STOA,
+  k_opcode_ZPC_STORE,
+  k_opcode_ZPC_STX,
+  k_opcode_ZPC_STY,
+  k_opcode_ZPC_SUB,
+};
+
+/* The k_opcode_ZPC_* uops operate on a zero page byte cached in a host
+ * register, value1 being its address. value3 says whether the uop must first
+ * load the register from memory and / or store it back after.
+ */
+enum {
+  k_jit_zpc_load = 1,
+  k_jit_zpc_store = 2,
 };
 
 void jit_opcode_make_internal_opcode1(struct jit_opcode_details* p_opcode,
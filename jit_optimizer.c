@@ -100,6 +100,36 @@ jit_optimizer_uop_could_write(struct jit_uop* p_uop, uint16_t addr) {
       write_addr_start = 0;
       write_addr_end = (k_6502_addr_space_size - 1);
       break;
+    case k_opcode_ASL_ZPG_16:
+    case k_opcode_LSR_ZPG_16:
+    case k_opcode_ROL_ZPG_16:
+    case k_opcode_ROR_ZPG_16:
+      write_addr_start = p_uop->value1;
+      write_addr_end = (p_uop->value1 + 1);
+      break;
+    case k_opcode_ASL_ZPG_32:
+    case k_opcode_LSR_ZPG_32:
+    case k_opcode_ROL_ZPG_32:
+    case k_opcode_ROR_ZPG_32:
+      write_addr_start = p_uop->value1;
+      write_addr_end = (p_uop->value1 + 3);
+      break;
+    case k_opcode_COPY_ZPG_16:
+      write_addr_start = p_uop->value2;
+      write_addr_end = (p_uop->value2 + 1);
+      break;
+    case k_opcode_COPY_ZPG_32:
+      write_addr_start = p_uop->value2;
+      write_addr_end = (p_uop->value2 + 3);
+      break;
+    case k_opcode_ADC_ZPG_16:
+      write_addr_start = p_uop->value3;
+      write_addr_end = (p_uop->value3 + 1);
+      break;
+    case k_opcode_ADC_ZPG_32:
+      write_addr_start = p_uop->value3;
+      write_addr_end = (p_uop->value3 + 3);
+      break;
     default:
       break;
     }
@@ -235,6 +265,11 @@ jit_optimizer_uopcode_needs_a(int32_t uopcode) {
     case k_opcode_ADD_SCRATCH:
     case k_opcode_ADD_SCRATCH_Y:
     case k_opcode_ASL_ACC_n:
+    case k_opcode_BCD_ADC:
+    case k_opcode_BCD_ADC_CHECK_D:
+    case k_opcode_BCD_SAVE_A:
+    case k_opcode_BCD_SBC:
+    case k_opcode_BCD_SBC_CHECK_D:
     case k_opcode_FLAGA:
     case k_opcode_LSR_ACC_n:
     case k_opcode_ROL_ACC_n:
@@ -378,6 +413,7 @@ jit_optimizer_uopcode_needs_y(int32_t uopcode) {
     switch (uopcode) {
     case k_opcode_ADD_ABY:
     case k_opcode_ADD_SCRATCH_Y:
+    case k_opcode_CHECK_IND_SCRATCH_Y:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_Y:
     case k_opcode_CHECK_PAGE_CROSSING_Y_n:
     case k_opcode_FLAGY:
@@ -454,7 +490,14 @@ jit_optimizer_uop_invalidates_idy(struct jit_uop* p_uop,
     case k_opcode_ADD_IMM:
     case k_opcode_ADD_SCRATCH:
     case k_opcode_ADD_SCRATCH_Y:
+    case k_opcode_BCD_ADC:
+    case k_opcode_BCD_ADC_CHECK_D:
+    case k_opcode_BCD_SAVE_A:
+    case k_opcode_BCD_SBC:
+    case k_opcode_BCD_SBC_CHECK_D:
     case k_opcode_CHECK_BCD:
+    case k_opcode_CHECK_IND_SCRATCH:
+    case k_opcode_CHECK_IND_SCRATCH_Y:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_n:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_X:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_Y:
@@ -529,7 +572,14 @@ jit_optimizer_uopcode_needs_or_trashes_overflow(int32_t uopcode) {
     case k_opcode_ADD_IMM:
     case k_opcode_ADD_SCRATCH:
     case k_opcode_ADD_SCRATCH_Y:
+    case k_opcode_BCD_ADC:
+    case k_opcode_BCD_ADC_CHECK_D:
+    case k_opcode_BCD_SAVE_A:
+    case k_opcode_BCD_SBC:
+    case k_opcode_BCD_SBC_CHECK_D:
     case k_opcode_CHECK_BCD:
+    case k_opcode_CHECK_IND_SCRATCH:
+    case k_opcode_CHECK_IND_SCRATCH_Y:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_n:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_X:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_Y:
@@ -561,6 +611,7 @@ jit_optimizer_uopcode_needs_or_trashes_overflow(int32_t uopcode) {
     case k_opcode_WRITE_INV_SCRATCH:
     case k_opcode_WRITE_INV_SCRATCH_n:
     case k_opcode_WRITE_INV_SCRATCH_Y:
+    case k_opcode_WRITE_INV_STACK_n:
       ret = 0;
       break;
     default:
@@ -616,7 +667,10 @@ jit_optimizer_uopcode_needs_or_trashes_carry(int32_t uopcode) {
     case k_opcode_ADD_SCRATCH:
     case k_opcode_ADD_SCRATCH_Y:
     case k_opcode_ASL_ACC_n:
+    case k_opcode_BCD_SAVE_A:
     case k_opcode_CHECK_BCD:
+    case k_opcode_CHECK_IND_SCRATCH:
+    case k_opcode_CHECK_IND_SCRATCH_Y:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_n:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_X:
     case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_Y:
@@ -649,6 +703,7 @@ jit_optimizer_uopcode_needs_or_trashes_carry(int32_t uopcode) {
     case k_opcode_WRITE_INV_SCRATCH:
     case k_opcode_WRITE_INV_SCRATCH_n:
     case k_opcode_WRITE_INV_SCRATCH_Y:
+    case k_opcode_WRITE_INV_STACK_n:
       ret = 0;
       break;
     default:
@@ -674,6 +729,759 @@ jit_optimizer_append_uop(struct jit_opcode_details* p_opcode,
   p_uop->eliminated = 0;
 }
 
+static struct jit_uop*
+jit_optimizer_get_fusable_uop(struct jit_opcode_details* p_opcodes,
+                              uint32_t num_opcodes,
+                              uint32_t i_opcodes,
+                              uint8_t opcode_6502) {
+  uint32_t i_uops;
+  struct jit_opcode_details* p_opcode;
+  struct jit_uop* p_main_uop = NULL;
+
+  if (i_opcodes >= num_opcodes) {
+    return NULL;
+  }
+  p_opcode = &p_opcodes[i_opcodes];
+  if (p_opcode->eliminated ||
+      (p_opcode->opcode_6502 != opcode_6502) ||
+      p_opcode->ends_block ||
+      p_opcode->dynamic_operand ||
+      p_opcode->opcode_write_sink) {
+    return NULL;
+  }
+
+  /* Only fuse the plain forms of the opcodes. Anything extra, such as debug
+   * callbacks or code invalidation for code in zero page, rules fusion out.
+   */
+  for (i_uops = 0; i_uops < p_opcode->num_uops; ++i_uops) {
+    struct jit_uop* p_uop = &p_opcode->uops[i_uops];
+    int32_t uopcode = p_uop->uopcode;
+    if (p_uop->eliminated) {
+      continue;
+    }
+    switch (uopcode) {
+    case k_opcode_FLAGA:
+    case k_opcode_FLAG_MEM:
+    case k_opcode_LOAD_CARRY_FOR_CALC:
+    case k_opcode_SAVE_CARRY:
+    case k_opcode_SAVE_OVERFLOW:
+      break;
+    default:
+      if ((uopcode != opcode_6502) &&
+          !((uopcode == k_opcode_ADD_ABS) && (opcode_6502 == 0x65))) {
+        return NULL;
+      }
+      p_main_uop = p_uop;
+      break;
+    }
+  }
+
+  return p_main_uop;
+}
+
+static void
+jit_optimizer_fuse_opcodes(struct jit_opcode_details* p_opcode,
+                           uint32_t num_opcodes) {
+  uint32_t i;
+
+  for (i = 1; i < num_opcodes; ++i) {
+    struct jit_opcode_details* p_fused_opcode = (p_opcode + i);
+    p_fused_opcode->eliminated = 1;
+    p_opcode->len_bytes_6502_merged += p_fused_opcode->len_bytes_6502_orig;
+    p_opcode->max_cycles_merged += p_fused_opcode->max_cycles_orig;
+  }
+}
+
+static uint32_t
+jit_optimizer_fuse_shifts(struct jit_compiler* p_compiler,
+                          struct jit_opcode_details* p_opcodes,
+                          uint32_t num_opcodes,
+                          uint32_t i_opcodes) {
+  /* ASL / ROL chains run up through memory and LSR / ROR chains run down, as
+   * per multi-byte shifts. The carry chains through the bytes exactly as it
+   * does through a wider host shift.
+   */
+  struct jit_uop* p_uop;
+  int32_t step;
+  uint8_t tail_opcode_6502;
+  int32_t addr;
+  int32_t addr_low;
+  uint32_t num_bytes;
+  int32_t uopcode;
+  int needs_carry;
+
+  struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+  uint8_t opcode_6502 = p_opcode->opcode_6502;
+
+  switch (opcode_6502) {
+  case 0x06: /* ASL zpg */
+  case 0x26: /* ROL zpg */
+    step = 1;
+    tail_opcode_6502 = 0x26;
+    break;
+  case 0x46: /* LSR zpg */
+  case 0x66: /* ROR zpg */
+    step = -1;
+    tail_opcode_6502 = 0x66;
+    break;
+  default:
+    return 0;
+  }
+
+  p_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                        num_opcodes,
+                                        i_opcodes,
+                                        opcode_6502);
+  if (p_uop == NULL) {
+    return 0;
+  }
+  addr = p_uop->value1;
+  num_bytes = 1;
+  while (num_bytes < 4) {
+    p_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                          num_opcodes,
+                                          (i_opcodes + num_bytes),
+                                          tail_opcode_6502);
+    if ((p_uop == NULL) ||
+        (p_uop->value1 != (addr + (step * (int32_t) num_bytes)))) {
+      break;
+    }
+    num_bytes++;
+  }
+  if (num_bytes == 3) {
+    num_bytes = 2;
+  }
+  if (num_bytes < 2) {
+    return 0;
+  }
+
+  addr_low = addr;
+  if (step < 0) {
+    addr_low -= (num_bytes - 1);
+  }
+  needs_carry = 1;
+  switch (opcode_6502) {
+  case 0x06:
+    uopcode = ((num_bytes == 2) ? k_opcode_ASL_ZPG_16 : k_opcode_ASL_ZPG_32);
+    needs_carry = 0;
+    break;
+  case 0x26:
+    uopcode = ((num_bytes == 2) ? k_opcode_ROL_ZPG_16 : k_opcode_ROL_ZPG_32);
+    break;
+  case 0x46:
+    uopcode = ((num_bytes == 2) ? k_opcode_LSR_ZPG_16 : k_opcode_LSR_ZPG_32);
+    needs_carry = 0;
+    break;
+  default:
+    uopcode = ((num_bytes == 2) ? k_opcode_ROR_ZPG_16 : k_opcode_ROR_ZPG_32);
+    break;
+  }
+
+  /* The N and Z flags are those of the last byte shifted. */
+  p_opcode->num_uops = 0;
+  if (needs_carry) {
+    jit_optimizer_append_uop(p_opcode, k_opcode_LOAD_CARRY_FOR_CALC);
+  }
+  jit_optimizer_append_uop(p_opcode, uopcode);
+  p_opcode->uops[p_opcode->num_uops - 1].value1 = addr_low;
+  jit_optimizer_append_uop(p_opcode, k_opcode_SAVE_CARRY);
+  jit_optimizer_append_uop(p_opcode, k_opcode_FLAG_MEM);
+  p_opcode->uops[p_opcode->num_uops - 1].value1 =
+      (addr + (step * (int32_t) (num_bytes - 1)));
+
+  jit_optimizer_fuse_opcodes(p_opcode, num_bytes);
+  jit_compiler_count_fusion(p_compiler, k_jit_fusion_shift);
+
+  return num_bytes;
+}
+
+static uint32_t
+jit_optimizer_fuse_copy(struct jit_compiler* p_compiler,
+                        struct jit_opcode_details* p_opcodes,
+                        uint32_t num_opcodes,
+                        uint32_t i_opcodes) {
+  /* LDA zpg; STA zpg pairs over adjacent bytes, in either direction. */
+  int32_t src_addrs[4];
+  int32_t dest_addrs[4];
+  struct jit_uop* p_lda_uop;
+  struct jit_uop* p_sta_uop;
+  struct jit_uop lda_uop;
+  uint32_t num_bytes;
+  uint32_t i;
+  uint32_t j;
+  int32_t step;
+  int32_t src_low;
+  int32_t dest_low;
+
+  struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+
+  step = 0;
+  num_bytes = 0;
+  while (num_bytes < 4) {
+    uint32_t i_pair = (i_opcodes + (num_bytes * 2));
+    p_lda_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                              num_opcodes,
+                                              i_pair,
+                                              0xA5);
+    p_sta_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                              num_opcodes,
+                                              (i_pair + 1),
+                                              0x85);
+    if ((p_lda_uop == NULL) || (p_sta_uop == NULL)) {
+      break;
+    }
+    if (num_bytes == 1) {
+      step = (p_lda_uop->value1 - src_addrs[0]);
+      if ((step != 1) && (step != -1)) {
+        break;
+      }
+    }
+    if ((num_bytes > 0) &&
+        ((p_lda_uop->value1 != (src_addrs[0] + (step * (int32_t) num_bytes))) ||
+         (p_sta_uop->value1 !=
+             (dest_addrs[0] + (step * (int32_t) num_bytes))))) {
+      break;
+    }
+    src_addrs[num_bytes] = p_lda_uop->value1;
+    dest_addrs[num_bytes] = p_sta_uop->value1;
+    num_bytes++;
+  }
+  if (num_bytes == 3) {
+    num_bytes = 2;
+  }
+  if (num_bytes < 2) {
+    return 0;
+  }
+
+  /* The wide copy reads all the source bytes before writing any destination
+   * bytes, so a byte stored must not be a byte loaded later.
+   */
+  for (i = 0; i < num_bytes; ++i) {
+    for (j = (i + 1); j < num_bytes; ++j) {
+      if (dest_addrs[i] == src_addrs[j]) {
+        return 0;
+      }
+    }
+  }
+
+  src_low = src_addrs[0];
+  dest_low = dest_addrs[0];
+  if (step < 0) {
+    src_low = src_addrs[num_bytes - 1];
+    dest_low = dest_addrs[num_bytes - 1];
+  }
+
+  /* A and the N and Z flags are those of the last byte loaded. */
+  lda_uop = *jit_opcode_find_uop(p_opcode, 0xA5);
+  lda_uop.value1 = src_addrs[num_bytes - 1];
+  p_opcode->num_uops = 0;
+  jit_optimizer_append_uop(p_opcode,
+                           ((num_bytes == 2) ?
+                               k_opcode_COPY_ZPG_16 : k_opcode_COPY_ZPG_32));
+  p_opcode->uops[0].value1 = src_low;
+  p_opcode->uops[0].value2 = dest_low;
+  p_opcode->uops[1] = lda_uop;
+  p_opcode->num_uops = 2;
+  jit_optimizer_append_uop(p_opcode, k_opcode_FLAGA);
+
+  jit_optimizer_fuse_opcodes(p_opcode, (num_bytes * 2));
+  jit_compiler_count_fusion(p_compiler, k_jit_fusion_copy);
+
+  return (num_bytes * 2);
+}
+
+static uint32_t
+jit_optimizer_fuse_add(struct jit_compiler* p_compiler,
+                       struct jit_opcode_details* p_opcodes,
+                       uint32_t num_opcodes,
+                       uint32_t i_opcodes) {
+  /* LDA zpg; ADC zpg; STA zpg triples over ascending adjacent bytes, i.e. a
+   * multi-byte binary add.
+   */
+  int32_t addrs1[4];
+  int32_t addrs2[4];
+  int32_t dest_addrs[4];
+  struct jit_uop* p_lda_uop;
+  struct jit_uop* p_adc_uop;
+  struct jit_uop* p_sta_uop;
+  struct jit_uop lda_uop;
+  uint32_t num_bytes;
+  uint32_t i;
+  uint32_t j;
+  int first_is_add;
+
+  struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+
+  first_is_add = 0;
+  num_bytes = 0;
+  while (num_bytes < 4) {
+    uint32_t i_triple = (i_opcodes + (num_bytes * 3));
+    p_lda_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                              num_opcodes,
+                                              i_triple,
+                                              0xA5);
+    p_adc_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                              num_opcodes,
+                                              (i_triple + 1),
+                                              0x65);
+    p_sta_uop = jit_optimizer_get_fusable_uop(p_opcodes,
+                                              num_opcodes,
+                                              (i_triple + 2),
+                                              0x85);
+    if ((p_lda_uop == NULL) || (p_adc_uop == NULL) || (p_sta_uop == NULL)) {
+      break;
+    }
+    /* Decimal mode must be known to be off. */
+    if (p_opcodes[i_triple + 1].flag_decimal != 0) {
+      break;
+    }
+    if (num_bytes == 0) {
+      first_is_add = (p_adc_uop->uopcode == k_opcode_ADD_ABS);
+    } else if ((p_adc_uop->uopcode != 0x65) ||
+               (p_lda_uop->value1 != (addrs1[0] + (int32_t) num_bytes)) ||
+               (p_adc_uop->value1 != (addrs2[0] + (int32_t) num_bytes)) ||
+               (p_sta_uop->value1 !=
+                   (dest_addrs[0] + (int32_t) num_bytes))) {
+      break;
+    }
+    addrs1[num_bytes] = p_lda_uop->value1;
+    addrs2[num_bytes] = p_adc_uop->value1;
+    dest_addrs[num_bytes] = p_sta_uop->value1;
+    num_bytes++;
+  }
+  if (num_bytes == 3) {
+    num_bytes = 2;
+  }
+  if (num_bytes < 2) {
+    return 0;
+  }
+  for (i = 0; i < num_bytes; ++i) {
+    for (j = (i + 1); j < num_bytes; ++j) {
+      if ((dest_addrs[i] == addrs1[j]) || (dest_addrs[i] == addrs2[j])) {
+        return 0;
+      }
+    }
+  }
+
+  /* The wide add gets C and V right, because they come from the top byte.
+   * Z doesn't, so A and the N and Z flags come from reloading the top byte.
+   */
+  lda_uop = *jit_opcode_find_uop(p_opcode, 0xA5);
+  lda_uop.value1 = dest_addrs[num_bytes - 1];
+  p_opcode->num_uops = 0;
+  if (first_is_add) {
+    jit_optimizer_append_uop(p_opcode, k_opcode_CLEAR_CARRY);
+  } else {
+    jit_optimizer_append_uop(p_opcode, k_opcode_LOAD_CARRY_FOR_CALC);
+  }
+  jit_optimizer_append_uop(p_opcode,
+                           ((num_bytes == 2) ?
+                               k_opcode_ADC_ZPG_16 : k_opcode_ADC_ZPG_32));
+  p_opcode->uops[1].value1 = addrs1[0];
+  p_opcode->uops[1].value2 = addrs2[0];
+  p_opcode->uops[1].value3 = dest_addrs[0];
+  jit_optimizer_append_uop(p_opcode, k_opcode_SAVE_CARRY);
+  jit_optimizer_append_uop(p_opcode, k_opcode_SAVE_OVERFLOW);
+  p_opcode->uops[4] = lda_uop;
+  p_opcode->num_uops = 5;
+  jit_optimizer_append_uop(p_opcode, k_opcode_FLAGA);
+
+  jit_optimizer_fuse_opcodes(p_opcode, (num_bytes * 3));
+  jit_compiler_count_fusion(p_compiler, k_jit_fusion_add);
+
+  return (num_bytes * 3);
+}
+
+enum {
+  k_zpc_safe = 0,
+  k_zpc_access = 1,
+  k_zpc_jump = 2,
+  k_zpc_barrier = 3,
+};
+
+static int32_t
+jit_optimizer_zpc_uopcode(struct jit_uop* p_uop) {
+  int32_t ret;
+
+  switch (p_uop->uopcode) {
+  case 0x65: /* ADC zpg */
+  case 0x6D: /* ADC abs */
+    ret = k_opcode_ZPC_ADC;
+    break;
+  case k_opcode_ADD_ABS:
+    ret = k_opcode_ZPC_ADD;
+    break;
+  case 0x25: /* AND zpg */
+  case 0x2D: /* AND abs */
+    ret = k_opcode_ZPC_AND;
+    break;
+  case 0x06: /* ASL zpg */
+  case 0x0E: /* ASL abs */
+    ret = k_opcode_ZPC_ASL;
+    break;
+  case 0xC5: /* CMP zpg */
+  case 0xCD: /* CMP abs */
+    ret = k_opcode_ZPC_CMP;
+    break;
+  case 0xE4: /* CPX zpg */
+  case 0xEC: /* CPX abs */
+    ret = k_opcode_ZPC_CPX;
+    break;
+  case 0xC4: /* CPY zpg */
+  case 0xCC: /* CPY abs */
+    ret = k_opcode_ZPC_CPY;
+    break;
+  case 0xC6: /* DEC zpg */
+  case 0xCE: /* DEC abs */
+    ret = k_opcode_ZPC_DEC;
+    break;
+  case 0x45: /* EOR zpg */
+  case 0x4D: /* EOR abs */
+    ret = k_opcode_ZPC_EOR;
+    break;
+  case 0xE6: /* INC zpg */
+  case 0xEE: /* INC abs */
+    ret = k_opcode_ZPC_INC;
+    break;
+  case 0xA5: /* LDA zpg */
+  case 0xAD: /* LDA abs */
+    ret = k_opcode_ZPC_LDA;
+    break;
+  case 0xA6: /* LDX zpg */
+  case 0xAE: /* LDX abs */
+    ret = k_opcode_ZPC_LDX;
+    break;
+  case 0xA4: /* LDY zpg */
+  case 0xAC: /* LDY abs */
+    ret = k_opcode_ZPC_LDY;
+    break;
+  case 0x46: /* LSR zpg */
+  case 0x4E: /* LSR abs */
+    ret = k_opcode_ZPC_LSR;
+    break;
+  case 0x05: /* ORA zpg */
+  case 0x0D: /* ORA abs */
+    ret = k_opcode_ZPC_ORA;
+    break;
+  case 0xE5: /* SBC zpg */
+  case 0xED: /* SBC abs */
+    ret = k_opcode_ZPC_SBC;
+    break;
+  case 0x85: /* STA zpg */
+  case 0x8D: /* STA abs */
+    ret = k_opcode_ZPC_STA;
+    break;
+  case k_opcode_STOA_IMM:
+    ret = k_opcode_ZPC_STOA;
+    break;
+  case 0x86: /* STX zpg */
+  case 0x8E: /* STX abs */
+    ret = k_opcode_ZPC_STX;
+    break;
+  case 0x84: /* STY zpg */
+  case 0x8C: /* STY abs */
+    ret = k_opcode_ZPC_STY;
+    break;
+  case k_opcode_SUB_ABS:
+    ret = k_opcode_ZPC_SUB;
+    break;
+  default:
+    ret = -1;
+    break;
+  }
+  if ((p_uop->value1 < 0) || (p_uop->value1 > 0xFF)) {
+    ret = -1;
+  }
+
+  return ret;
+}
+
+static int
+jit_optimizer_zpc_uopcode_reads(int32_t zpc_uopcode) {
+  switch (zpc_uopcode) {
+  case k_opcode_ZPC_STA:
+  case k_opcode_ZPC_STOA:
+  case k_opcode_ZPC_STX:
+  case k_opcode_ZPC_STY:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+static int
+jit_optimizer_zpc_uopcode_writes(int32_t zpc_uopcode) {
+  switch (zpc_uopcode) {
+  case k_opcode_ZPC_ASL:
+  case k_opcode_ZPC_DEC:
+  case k_opcode_ZPC_INC:
+  case k_opcode_ZPC_LSR:
+  case k_opcode_ZPC_STA:
+  case k_opcode_ZPC_STOA:
+  case k_opcode_ZPC_STX:
+  case k_opcode_ZPC_STY:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int
+jit_optimizer_zpc_classify(struct jit_uop* p_uop, int32_t addr) {
+  int32_t uopcode = p_uop->uopcode;
+
+  if (jit_optimizer_zpc_uopcode(p_uop) != -1) {
+    if (p_uop->value1 == addr) {
+      return k_zpc_access;
+    }
+    return k_zpc_safe;
+  }
+  if (jit_optimizer_uopcode_can_jump(uopcode)) {
+    return k_zpc_jump;
+  }
+  if (uopcode <= 0xFF) {
+    switch (g_opmodes[uopcode]) {
+    case k_nil:
+    case k_acc:
+    case k_imm:
+      return k_zpc_safe;
+    case k_zpg:
+    case k_abs:
+      if (p_uop->value1 != addr) {
+        return k_zpc_safe;
+      }
+      break;
+    default:
+      break;
+    }
+    return k_zpc_barrier;
+  }
+  switch (uopcode) {
+  case k_opcode_countdown:
+  case k_opcode_countdown_no_check:
+  case k_opcode_ADD_ABS:
+  case k_opcode_ADD_CYCLES:
+  case k_opcode_ADD_IMM:
+  case k_opcode_ASL_ACC_n:
+  case k_opcode_CLEAR_CARRY:
+  case k_opcode_FLAGA:
+  case k_opcode_FLAGX:
+  case k_opcode_FLAGY:
+  case k_opcode_INVERT_CARRY:
+  case k_opcode_LDA_Z:
+  case k_opcode_LDX_Z:
+  case k_opcode_LDY_Z:
+  case k_opcode_LOAD_CARRY_FOR_BRANCH:
+  case k_opcode_LOAD_CARRY_FOR_CALC:
+  case k_opcode_LOAD_CARRY_INV_FOR_CALC:
+  case k_opcode_LOAD_OVERFLOW:
+  case k_opcode_LSR_ACC_n:
+  case k_opcode_PUSH_16:
+  case k_opcode_ROL_ACC_n:
+  case k_opcode_ROR_ACC_n:
+  case k_opcode_SAVE_CARRY:
+  case k_opcode_SAVE_CARRY_INV:
+  case k_opcode_SAVE_OVERFLOW:
+  case k_opcode_SET_CARRY:
+  case k_opcode_STOA_IMM:
+  case k_opcode_SUB_ABS:
+  case k_opcode_SUB_IMM:
+  case k_opcode_WRITE_INV_ABS:
+  case k_opcode_WRITE_INV_STACK_n:
+    return k_zpc_safe;
+  case k_opcode_FLAG_MEM:
+    if (p_uop->value1 != addr) {
+      return k_zpc_safe;
+    }
+    return k_zpc_barrier;
+  default:
+    return k_zpc_barrier;
+  }
+}
+
+static int
+jit_optimizer_zpc_is_barrier(struct jit_opcode_details* p_opcode,
+                             int32_t addr) {
+  uint32_t i_uops;
+
+  if (p_opcode->dynamic_operand || p_opcode->opcode_write_sink) {
+    return 1;
+  }
+  /* A barrier anywhere in an opcode covers all of it, so that e.g. the BCD
+   * helpers' use of the cache register never overlaps a cached access.
+   */
+  for (i_uops = 0; i_uops < p_opcode->num_uops; ++i_uops) {
+    struct jit_uop* p_uop = &p_opcode->uops[i_uops];
+    if (p_uop->eliminated) {
+      continue;
+    }
+    if (jit_optimizer_zpc_classify(p_uop, addr) == k_zpc_barrier) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static uint32_t
+jit_optimizer_zpc_count_region(struct jit_opcode_details* p_opcodes,
+                               uint32_t num_opcodes,
+                               uint32_t i_opcodes,
+                               int32_t addr) {
+  uint32_t count = 0;
+
+  for (; i_opcodes < num_opcodes; ++i_opcodes) {
+    uint32_t i_uops;
+    struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+    if (p_opcode->eliminated) {
+      continue;
+    }
+    if (jit_optimizer_zpc_is_barrier(p_opcode, addr)) {
+      break;
+    }
+    /* Room is needed for the write back uop and its fixups. */
+    if (p_opcode->num_fixup_uops >= (k_max_uops_per_opcode - 1)) {
+      return 0;
+    }
+    for (i_uops = 0; i_uops < p_opcode->num_uops; ++i_uops) {
+      struct jit_uop* p_uop = &p_opcode->uops[i_uops];
+      if (p_uop->eliminated) {
+        continue;
+      }
+      if (jit_optimizer_zpc_classify(p_uop, addr) == k_zpc_access) {
+        if (p_opcode->num_uops == k_max_uops_per_opcode) {
+          return 0;
+        }
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
+
+static void
+jit_optimizer_zpc_write_back(struct jit_opcode_details* p_dirty_opcode,
+                             struct jit_opcode_details* p_last_opcode,
+                             struct jit_uop* p_last_uop,
+                             int32_t addr) {
+  struct jit_uop* p_store_uop;
+
+  /* The last access stores the register. Before that, the store is a fixup
+   * for anything that leaves the block from an opcode after the one that
+   * dirtied the register.
+   */
+  p_last_uop->value3 |= k_jit_zpc_store;
+
+  jit_optimizer_append_uop(p_dirty_opcode, k_opcode_ZPC_STORE);
+  p_store_uop = &p_dirty_opcode->uops[p_dirty_opcode->num_uops - 1];
+  p_store_uop->value1 = addr;
+  jit_optimizer_eliminate(&p_dirty_opcode, p_store_uop, p_last_opcode);
+}
+
+static uint32_t
+jit_optimizer_zpc_walk(struct jit_opcode_details* p_opcodes,
+                       uint32_t num_opcodes,
+                       int32_t addr,
+                       int rewrite) {
+  uint32_t i_opcodes;
+
+  uint32_t count = 0;
+  int valid = 0;
+  int skipping = 0;
+  struct jit_opcode_details* p_dirty_opcode = NULL;
+  struct jit_opcode_details* p_last_opcode = NULL;
+  struct jit_uop* p_last_uop = NULL;
+
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    uint32_t i_uops;
+    struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+    if (p_opcode->eliminated) {
+      continue;
+    }
+    if (jit_optimizer_zpc_is_barrier(p_opcode, addr)) {
+      if (rewrite && (p_dirty_opcode != NULL)) {
+        jit_optimizer_zpc_write_back(p_dirty_opcode,
+                                     p_last_opcode,
+                                     p_last_uop,
+                                     addr);
+      }
+      p_dirty_opcode = NULL;
+      valid = 0;
+      skipping = 0;
+      continue;
+    }
+    for (i_uops = 0; i_uops < p_opcode->num_uops; ++i_uops) {
+      int32_t zpc_uopcode;
+      uint32_t region_count;
+      int load;
+      struct jit_uop* p_uop = &p_opcode->uops[i_uops];
+      if (p_uop->eliminated) {
+        continue;
+      }
+      switch (jit_optimizer_zpc_classify(p_uop, addr)) {
+      case k_zpc_jump:
+        /* The register stays valid if a branch isn't taken, but memory must
+         * be current if it is.
+         */
+        if (rewrite && (p_dirty_opcode != NULL)) {
+          jit_optimizer_zpc_write_back(p_dirty_opcode,
+                                       p_last_opcode,
+                                       p_last_uop,
+                                       addr);
+        }
+        p_dirty_opcode = NULL;
+        break;
+      case k_zpc_access:
+        if (skipping) {
+          break;
+        }
+        zpc_uopcode = jit_optimizer_zpc_uopcode(p_uop);
+        load = 0;
+        if (!valid) {
+          region_count = jit_optimizer_zpc_count_region(p_opcodes,
+                                                        num_opcodes,
+                                                        i_opcodes,
+                                                        addr);
+          /* A lone access gains nothing. */
+          if (region_count < 2) {
+            skipping = 1;
+            break;
+          }
+          count += region_count;
+          valid = 1;
+          load = jit_optimizer_zpc_uopcode_reads(zpc_uopcode);
+        }
+        if (rewrite) {
+          p_uop->uopcode = zpc_uopcode;
+          p_uop->uoptype = -1;
+          p_uop->value3 = 0;
+          if (load) {
+            p_uop->value3 = k_jit_zpc_load;
+          }
+        }
+        if (jit_optimizer_zpc_uopcode_writes(zpc_uopcode) &&
+            (p_dirty_opcode == NULL)) {
+          p_dirty_opcode = p_opcode;
+        }
+        p_last_opcode = p_opcode;
+        p_last_uop = p_uop;
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  if (rewrite && (p_dirty_opcode != NULL)) {
+    jit_optimizer_zpc_write_back(p_dirty_opcode,
+                                 p_last_opcode,
+                                 p_last_uop,
+                                 addr);
+  }
+
+  return count;
+}
+
 uint32_t
 jit_optimizer_optimize(struct jit_compiler* p_compiler,
                        struct jit_opcode_details* p_opcodes,
@@ -706,12 +1514,14 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
 
   uint32_t max_revalidate_count =
       jit_compiler_get_max_revalidate_count(p_compiler);
-  struct jit_opcode_details* p_bcd_opcode = &p_opcodes[1];
+  int is_fusing = jit_compiler_is_fusing(p_compiler);
+  struct jit_opcode_details* p_bcd_opcode = &p_opcodes[2];
+  uint16_t start_addr_6502 = p_opcodes[0].addr_6502;
 
   /* Use a compiler-provided scratch opcode to eliminate all BCD checks and do
    * it just once at the start of the block, if any ADC / SBC are present.
    */
-  assert(num_opcodes > 2);
+  assert(num_opcodes > 3);
   assert(p_bcd_opcode->eliminated);
   assert(p_bcd_opcode->num_uops == 1);
   p_bcd_opcode->uops[0].uopcode = k_opcode_CHECK_BCD;
@@ -926,10 +1736,21 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
    * One example is LDY imm -> dynamic operand conversion, which no longer
    * results in "known Y".
    */
-  reg_a = k_value_unknown;
-  reg_x = k_value_unknown;
-  reg_y = k_value_unknown;
-  flag_carry = k_value_unknown;
+  /* Anything the block was compiled to assume on entry is known from the
+   * start. The compiler checks it.
+   */
+  reg_a = jit_compiler_get_entry_guard(p_compiler,
+                                       start_addr_6502,
+                                       k_jit_entry_a);
+  reg_x = jit_compiler_get_entry_guard(p_compiler,
+                                       start_addr_6502,
+                                       k_jit_entry_x);
+  reg_y = jit_compiler_get_entry_guard(p_compiler,
+                                       start_addr_6502,
+                                       k_jit_entry_y);
+  flag_carry = jit_compiler_get_entry_guard(p_compiler,
+                                            start_addr_6502,
+                                            k_jit_entry_carry);
   flag_decimal = k_value_unknown;
   for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
     struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
@@ -1050,8 +1871,7 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
     uint32_t i_uops;
 
     struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
-    uint16_t addr_6502 = p_opcode->addr_6502;
-    int32_t interp_replace = -1;
+    int bcd_checked = 0;
 
     reg_a = p_opcode->reg_a;
     reg_x = p_opcode->reg_x;
@@ -1069,6 +1889,7 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
       int32_t uopcode = p_uop->uopcode;
       int32_t new_add_uopcode = -1;
       int32_t new_sub_uopcode = -1;
+      int bcd_possible;
 
       switch (uopcode) {
       case 0x61: /* ADC idx */
@@ -1172,22 +1993,39 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
         new_sub_uopcode = k_opcode_SUB_IMM;
         break;
       case k_opcode_CHECK_BCD:
+        /* If D is known set, the native BCD code always runs instead. */
+        p_uop->eliminated = 1;
         if (flag_decimal == k_value_unknown) {
-          p_uop->eliminated = 1;
           p_bcd_opcode->eliminated = 0;
-        } else if (flag_decimal == 0) {
+          bcd_checked = 1;
+        }
+        break;
+      case k_opcode_BCD_SAVE_A:
+      case k_opcode_BCD_ADC_CHECK_D:
+      case k_opcode_BCD_SBC_CHECK_D:
+        if ((flag_decimal == 0) || bcd_checked) {
+          /* D is known clear, or the BCD check at the block start got it. */
           p_uop->eliminated = 1;
-        } else {
-          interp_replace = k_opcode_CHECK_BCD;
+        } else if (flag_decimal == 1) {
+          if (uopcode == k_opcode_BCD_ADC_CHECK_D) {
+            uopcode = k_opcode_BCD_ADC;
+          } else if (uopcode == k_opcode_BCD_SBC_CHECK_D) {
+            uopcode = k_opcode_BCD_SBC;
+          }
         }
         break;
       default:
         break;
       }
 
+      /* Folding the carry into the immediate would defeat the decimal
+       * fixup, which needs the host nibble carry of the real operand.
+       */
+      bcd_possible = ((flag_decimal != 0) && !bcd_checked);
       if ((new_add_uopcode != -1) && (flag_carry != k_value_unknown)) {
         if ((flag_carry == 0) ||
-            ((new_add_uopcode == k_opcode_ADD_IMM) &&
+            (!bcd_possible &&
+             (new_add_uopcode == k_opcode_ADD_IMM) &&
              (p_uop->value1 != 0xFF) &&
              (p_uop->value1 != 0x7F))) {
           /* Eliminate LOAD_CARRY_FOR_CALC, flip ADC to ADD. */
@@ -1204,7 +2042,8 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
       }
       if ((new_sub_uopcode != -1) && (flag_carry != k_value_unknown)) {
         if ((flag_carry == 1) ||
-            ((new_sub_uopcode == k_opcode_SUB_IMM) &&
+            (!bcd_possible &&
+             (new_sub_uopcode == k_opcode_SUB_IMM) &&
              (p_uop->value1 != 0xFF) &&
              (p_uop->value1 != 0x7F))) {
           /* Eliminate LOAD_CARRY_INV_FOR_CALC, flip SBC to SUB. */
@@ -1260,16 +2099,6 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
 
       p_uop->uopcode = uopcode;
     }
-
-    if (interp_replace != -1) {
-      jit_opcode_find_replace1(p_opcode,
-                               interp_replace,
-                               k_opcode_interp,
-                               addr_6502);
-      p_opcode->ends_block = 1;
-      num_opcodes = (i_opcodes + 1);
-      break;
-    }
   }
 
   /* Pass 4: merge 6502 macro opcodes as we can. */
@@ -1278,6 +2107,35 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
     struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
 
     uint8_t opcode_6502 = p_opcode->opcode_6502;
+    uint32_t num_fused;
+
+    /* Fuse byte-at-a-time operations on multi-byte zero page values into
+     * wider host operations.
+     */
+    num_fused = 0;
+    if (is_fusing) {
+      num_fused = jit_optimizer_fuse_shifts(p_compiler,
+                                            p_opcodes,
+                                            num_opcodes,
+                                            i_opcodes);
+      if (num_fused == 0) {
+        num_fused = jit_optimizer_fuse_add(p_compiler,
+                                           p_opcodes,
+                                           num_opcodes,
+                                           i_opcodes);
+      }
+      if (num_fused == 0) {
+        num_fused = jit_optimizer_fuse_copy(p_compiler,
+                                            p_opcodes,
+                                            num_opcodes,
+                                            i_opcodes);
+      }
+    }
+    if (num_fused != 0) {
+      p_prev_opcode = p_opcode;
+      i_opcodes += (num_fused - 1);
+      continue;
+    }
 
     /* Merge opcode into previous if supported. */
     if ((p_prev_opcode != NULL) &&
@@ -1613,5 +2471,44 @@ jit_optimizer_optimize(struct jit_compiler* p_compiler,
     }
   }
 
+  /* Pass 7: keep the most used zero page byte in a host register, for runs
+   * of the block where nothing else could touch it.
+   */
+  if (jit_compiler_is_zp_caching(p_compiler)) {
+    uint8_t is_candidate[256];
+    uint32_t best_count = 0;
+    int32_t best_addr = -1;
+    int32_t addr;
+
+    (void) memset(is_candidate, '\0', sizeof(is_candidate));
+    for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+      uint32_t i_uops;
+      struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+      if (p_opcode->eliminated) {
+        continue;
+      }
+      for (i_uops = 0; i_uops < p_opcode->num_uops; ++i_uops) {
+        struct jit_uop* p_uop = &p_opcode->uops[i_uops];
+        if (!p_uop->eliminated && (jit_optimizer_zpc_uopcode(p_uop) != -1)) {
+          is_candidate[p_uop->value1] = 1;
+        }
+      }
+    }
+    for (addr = 0; addr < 256; ++addr) {
+      uint32_t count;
+      if (!is_candidate[addr]) {
+        continue;
+      }
+      count = jit_optimizer_zpc_walk(p_opcodes, num_opcodes, addr, 0);
+      if (count > best_count) {
+        best_count = count;
+        best_addr = addr;
+      }
+    }
+    if (best_addr != -1) {
+      (void) jit_optimizer_zpc_walk(p_opcodes, num_opcodes, best_addr, 1);
+    }
+  }
+
   return num_opcodes;
 }
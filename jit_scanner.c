@@ -0,0 +1,353 @@
+#include "jit_scanner.h"
+
+#include "defs_6502.h"
+#include "jit_compiler.h"
+#include "os_thread.h"
+#include "util.h"
+
+#include <assert.h>
+
+enum {
+  k_jit_scanner_ring_size = 1024,
+  /* Decoded blocks, either waiting for the CPU thread or held by it. */
+  k_jit_scanner_num_slots = 64,
+  /* Blocks followed per seed, including the seed itself. */
+  k_jit_scanner_max_blocks = 8,
+  k_jit_scanner_max_block_ops = 64,
+};
+
+struct jit_scanner_ring {
+  uint16_t values[k_jit_scanner_ring_size];
+  uint32_t head;
+  uint32_t tail;
+};
+
+struct jit_scanner {
+  /* The helper thread reads 6502 memory while the CPU thread writes it. */
+  volatile uint8_t* p_mem_read;
+  struct jit_compiler* p_compiler;
+  struct os_lock_struct* p_lock;
+  struct os_event_struct* p_event;
+  struct os_thread_struct* p_thread;
+  volatile int is_exiting;
+
+  /* The rings and is_waiting are only touched with the lock held. A slot is
+   * owned by whoever last took it off a ring.
+   */
+  struct jit_scanner_ring seeds;
+  struct jit_scanner_ring candidates;
+  struct jit_scanner_ring free_slots;
+  int is_waiting;
+  struct jit_compiler_prep* p_preps[k_jit_scanner_num_slots];
+  uint8_t is_provisional[k_jit_scanner_num_slots];
+  uint64_t num_seeds;
+  uint64_t num_candidates;
+};
+
+static int jit_scanner_ring_push(struct jit_scanner_ring* p_ring,
+                                 uint16_t value);
+
+struct jit_scanner*
+jit_scanner_create(uint8_t* p_mem_read, struct jit_compiler* p_compiler) {
+  uint32_t i;
+  struct jit_scanner* p_scanner = util_mallocz(sizeof(struct jit_scanner));
+
+  p_scanner->p_mem_read = p_mem_read;
+  p_scanner->p_compiler = p_compiler;
+  p_scanner->p_lock = os_lock_create();
+  p_scanner->p_event = os_event_create();
+
+  for (i = 0; i < k_jit_scanner_num_slots; ++i) {
+    p_scanner->p_preps[i] = jit_compiler_prep_create();
+    (void) jit_scanner_ring_push(&p_scanner->free_slots, i);
+  }
+
+  return p_scanner;
+}
+
+void
+jit_scanner_destroy(struct jit_scanner* p_scanner) {
+  uint32_t i;
+
+  if (p_scanner->p_thread != NULL) {
+    p_scanner->is_exiting = 1;
+    os_event_post(p_scanner->p_event);
+    (void) os_thread_destroy(p_scanner->p_thread);
+  }
+  for (i = 0; i < k_jit_scanner_num_slots; ++i) {
+    jit_compiler_prep_destroy(p_scanner->p_preps[i]);
+  }
+  os_event_destroy(p_scanner->p_event);
+  os_lock_destroy(p_scanner->p_lock);
+  util_free(p_scanner);
+}
+
+static int
+jit_scanner_ring_push(struct jit_scanner_ring* p_ring, uint16_t value) {
+  if ((p_ring->head - p_ring->tail) == k_jit_scanner_ring_size) {
+    return 0;
+  }
+  p_ring->values[p_ring->head % k_jit_scanner_ring_size] = value;
+  p_ring->head++;
+  return 1;
+}
+
+static int
+jit_scanner_ring_pop(struct jit_scanner_ring* p_ring, uint16_t* p_value) {
+  if (p_ring->head == p_ring->tail) {
+    return 0;
+  }
+  *p_value = p_ring->values[p_ring->tail % k_jit_scanner_ring_size];
+  p_ring->tail++;
+  return 1;
+}
+
+void
+jit_scanner_add_seed(struct jit_scanner* p_scanner, uint16_t addr_6502) {
+  int is_waiting;
+
+  /* A full ring just drops the seed; it is only a hint. */
+  os_lock_lock(p_scanner->p_lock);
+  p_scanner->num_seeds += jit_scanner_ring_push(&p_scanner->seeds, addr_6502);
+  is_waiting = p_scanner->is_waiting;
+  p_scanner->is_waiting = 0;
+  os_lock_unlock(p_scanner->p_lock);
+
+  if (is_waiting) {
+    os_event_post(p_scanner->p_event);
+  }
+}
+
+int
+jit_scanner_get_candidate(struct jit_scanner* p_scanner, uint32_t* p_slot) {
+  int ret;
+  uint16_t slot;
+
+  os_lock_lock(p_scanner->p_lock);
+  ret = jit_scanner_ring_pop(&p_scanner->candidates, &slot);
+  os_lock_unlock(p_scanner->p_lock);
+
+  if (ret) {
+    *p_slot = slot;
+  }
+  return ret;
+}
+
+struct jit_compiler_prep*
+jit_scanner_get_prep(struct jit_scanner* p_scanner, uint32_t slot) {
+  assert(slot < k_jit_scanner_num_slots);
+  return p_scanner->p_preps[slot];
+}
+
+int
+jit_scanner_is_provisional(struct jit_scanner* p_scanner, uint32_t slot) {
+  assert(slot < k_jit_scanner_num_slots);
+  return p_scanner->is_provisional[slot];
+}
+
+void
+jit_scanner_free_slot(struct jit_scanner* p_scanner, uint32_t slot) {
+  int ret;
+
+  assert(slot < k_jit_scanner_num_slots);
+  os_lock_lock(p_scanner->p_lock);
+  ret = jit_scanner_ring_push(&p_scanner->free_slots, slot);
+  os_lock_unlock(p_scanner->p_lock);
+  assert(ret);
+  (void) ret;
+}
+
+static int
+jit_scanner_is_scannable(uint16_t addr_6502) {
+  /* Zero page and stack code changes how those pages are compiled, so don't
+   * go looking for it. And don't wander into the hardware registers.
+   */
+  if (addr_6502 < 0x200) {
+    return 0;
+  }
+  if ((addr_6502 >= 0xFC00) && (addr_6502 < 0xFF00)) {
+    return 0;
+  }
+  return 1;
+}
+
+struct jit_scanner_blocks {
+  uint16_t addrs[k_jit_scanner_max_blocks];
+  uint8_t is_provisional[k_jit_scanner_max_blocks];
+  uint32_t num_blocks;
+};
+
+static void
+jit_scanner_add_block(struct jit_scanner_blocks* p_blocks,
+                      uint16_t addr_6502,
+                      int is_provisional) {
+  uint32_t i;
+  uint32_t num_blocks = p_blocks->num_blocks;
+
+  if (!jit_scanner_is_scannable(addr_6502)) {
+    return;
+  }
+  for (i = 0; i < num_blocks; ++i) {
+    if (p_blocks->addrs[i] == addr_6502) {
+      /* Reached by a surer route as well. */
+      p_blocks->is_provisional[i] &= is_provisional;
+      return;
+    }
+  }
+  if (num_blocks == k_jit_scanner_max_blocks) {
+    return;
+  }
+  p_blocks->addrs[num_blocks] = addr_6502;
+  p_blocks->is_provisional[num_blocks] = is_provisional;
+  p_blocks->num_blocks = (num_blocks + 1);
+}
+
+static void
+jit_scanner_scan_block(struct jit_scanner* p_scanner,
+                       struct jit_scanner_blocks* p_blocks,
+                       uint32_t index) {
+  uint32_t i;
+
+  volatile uint8_t* p_mem_read = p_scanner->p_mem_read;
+  uint32_t addr = p_blocks->addrs[index];
+  int is_provisional = p_blocks->is_provisional[index];
+
+  for (i = 0; i < k_jit_scanner_max_block_ops; ++i) {
+    uint8_t opcode;
+    uint8_t optype;
+    uint8_t opmode;
+    uint8_t opbranch;
+    uint16_t operand;
+
+    if ((addr > 0xFFFD) || !jit_scanner_is_scannable(addr)) {
+      return;
+    }
+    opcode = p_mem_read[addr];
+    optype = g_optypes[opcode];
+    opmode = g_opmodes[opcode];
+    opbranch = g_opbranch[optype];
+    operand = (p_mem_read[addr + 1] | (p_mem_read[addr + 2] << 8));
+
+    if (opbranch == k_bra_m) {
+      uint16_t target = (addr + 2 + (int8_t) p_mem_read[addr + 1]);
+      jit_scanner_add_block(p_blocks, target, is_provisional);
+    } else if (opbranch == k_bra_y) {
+      /* Anything else ending the block, such as RTS, JMP indirect or an
+       * unknown opcode, has no static successor.
+       */
+      if (optype == k_jsr) {
+        jit_scanner_add_block(p_blocks, operand, is_provisional);
+        jit_scanner_add_block(p_blocks, (uint16_t) (addr + 3), 1);
+      } else if ((optype == k_jmp) && (opmode == k_abs)) {
+        jit_scanner_add_block(p_blocks, operand, is_provisional);
+      }
+      return;
+    }
+
+    addr += g_opmodelens[opmode];
+  }
+}
+
+static int
+jit_scanner_scan_one(struct jit_scanner* p_scanner) {
+  struct jit_scanner_blocks blocks;
+  uint32_t i;
+  uint16_t addr_6502;
+  int ret;
+
+  struct jit_compiler* p_compiler = p_scanner->p_compiler;
+
+  os_lock_lock(p_scanner->p_lock);
+  ret = jit_scanner_ring_pop(&p_scanner->seeds, &addr_6502);
+  os_lock_unlock(p_scanner->p_lock);
+  if (!ret) {
+    return 0;
+  }
+
+  /* Breadth first from the seed, so the nearest successors come out first. */
+  blocks.addrs[0] = addr_6502;
+  blocks.is_provisional[0] = 0;
+  blocks.num_blocks = 1;
+  for (i = 0; i < blocks.num_blocks; ++i) {
+    jit_scanner_scan_block(p_scanner, &blocks, i);
+  }
+
+  /* Decoding is the costly part, and is done without the lock held. If the
+   * CPU thread is holding on to all the slots, the rest are dropped.
+   */
+  for (i = 1; i < blocks.num_blocks; ++i) {
+    uint16_t slot;
+
+    os_lock_lock(p_scanner->p_lock);
+    ret = jit_scanner_ring_pop(&p_scanner->free_slots, &slot);
+    os_lock_unlock(p_scanner->p_lock);
+    if (!ret) {
+      break;
+    }
+
+    p_scanner->is_provisional[slot] = blocks.is_provisional[i];
+    ret = jit_compiler_prepare_block(p_compiler,
+                                     p_scanner->p_preps[slot],
+                                     blocks.addrs[i]);
+
+    os_lock_lock(p_scanner->p_lock);
+    if (ret) {
+      (void) jit_scanner_ring_push(&p_scanner->candidates, slot);
+      p_scanner->num_candidates++;
+    } else {
+      (void) jit_scanner_ring_push(&p_scanner->free_slots, slot);
+    }
+    os_lock_unlock(p_scanner->p_lock);
+  }
+
+  return 1;
+}
+
+void
+jit_scanner_scan_pending(struct jit_scanner* p_scanner) {
+  while (jit_scanner_scan_one(p_scanner)) {
+    /* Keep going. */
+  }
+}
+
+static void*
+jit_scanner_thread(void* p) {
+  struct jit_scanner* p_scanner = (struct jit_scanner*) p;
+
+  while (!p_scanner->is_exiting) {
+    int is_waiting;
+
+    if (jit_scanner_scan_one(p_scanner)) {
+      continue;
+    }
+    /* Sleep until the next seed. A seed added between the check and the wait
+     * leaves the event posted, so isn't missed.
+     */
+    os_lock_lock(p_scanner->p_lock);
+    is_waiting = (p_scanner->seeds.head == p_scanner->seeds.tail);
+    p_scanner->is_waiting = is_waiting;
+    os_lock_unlock(p_scanner->p_lock);
+    if (is_waiting) {
+      os_event_wait(p_scanner->p_event);
+    }
+  }
+
+  return NULL;
+}
+
+void
+jit_scanner_start_thread(struct jit_scanner* p_scanner) {
+  assert(p_scanner->p_thread == NULL);
+
+  p_scanner->p_thread = os_thread_create(jit_scanner_thread, p_scanner);
+}
+
+uint64_t
+jit_scanner_get_num_seeds(struct jit_scanner* p_scanner) {
+  return p_scanner->num_seeds;
+}
+
+uint64_t
+jit_scanner_get_num_candidates(struct jit_scanner* p_scanner) {
+  return p_scanner->num_candidates;
+}
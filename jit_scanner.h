@@ -0,0 +1,45 @@
+#ifndef BEEBJIT_JIT_SCANNER_H
+#define BEEBJIT_JIT_SCANNER_H
+
+#include <stdint.h>
+
+struct jit_compiler;
+struct jit_compiler_prep;
+struct jit_scanner;
+
+/* The scanner looks ahead of the JIT. It is seeded with the start addresses of
+ * freshly compiled blocks, follows their static control flow (branches, JMP and
+ * JSR targets, and JSR return points) and decodes the blocks it finds into
+ * uops, ready for the compiler. Scanning may happen on a helper thread, which
+ * only ever reads 6502 memory and compiler state, so the results are hints:
+ * the compiler re-checks each decoded opcode before it uses it.
+ *
+ * Each decoded block is handed back in a slot, which the caller frees when it
+ * is done with it. A block found via a JSR return point, or via another block
+ * that was, is provisional: the bytes after a JSR are sometimes inline data
+ * that the subroutine skips over.
+ */
+struct jit_scanner* jit_scanner_create(uint8_t* p_mem_read,
+                                       struct jit_compiler* p_compiler);
+void jit_scanner_destroy(struct jit_scanner* p_scanner);
+
+/* Starts the helper thread, which sleeps until there are seeds. Without it,
+ * seeds are only scanned by jit_scanner_scan_pending().
+ */
+void jit_scanner_start_thread(struct jit_scanner* p_scanner);
+
+/* CPU thread side. */
+void jit_scanner_add_seed(struct jit_scanner* p_scanner, uint16_t addr_6502);
+int jit_scanner_get_candidate(struct jit_scanner* p_scanner, uint32_t* p_slot);
+struct jit_compiler_prep* jit_scanner_get_prep(struct jit_scanner* p_scanner,
+                                               uint32_t slot);
+int jit_scanner_is_provisional(struct jit_scanner* p_scanner, uint32_t slot);
+void jit_scanner_free_slot(struct jit_scanner* p_scanner, uint32_t slot);
+
+/* Scans any seeds queued so far, on the calling thread. */
+void jit_scanner_scan_pending(struct jit_scanner* p_scanner);
+
+uint64_t jit_scanner_get_num_seeds(struct jit_scanner* p_scanner);
+uint64_t jit_scanner_get_num_candidates(struct jit_scanner* p_scanner);
+
+#endif /* BEEBJIT_JIT_SCANNER_H */
@@ -57,7 +57,7 @@ log_severity_to_string(int severity) {
 void
 log_do_log(int module, int severity, const char* p_msg, ...) {
   va_list args;
-  char msg[256];
+  char msg[1024];
   int ret;
 
   const char* p_module_str = log_module_to_string(module);
@@ -59,6 +59,22 @@ main(int argc, const char* argv[]) {
     if (!strcmp(argv[arg], "-f")) {
       /* "Fast", does 2^24 iterations instead of 2^32. */
       fast = 1;
+    } else if (!strcmp(argv[arg], "-b")) {
+      /* "Branchy", a run of not-taken branches to stress the per-branch JIT
+       * timing code.
+       */
+      emit_LDA(p_buf, k_imm, 0x01);
+      bytes += 2;
+      for (i = 0; i < 8; ++i) {
+        emit_BEQ(p_buf, 0);
+        bytes += 2;
+      }
+    } else if (!strcmp(argv[arg], "-s")) {
+      /* "Switchy", a sideways ROM bank switch per iteration to measure bank
+       * switch cost.
+       */
+      emit_STX(p_buf, k_abs, 0xFE30);
+      bytes += 3;
     } else if (sscanf(argv[arg], "%x", &i) == 1) {
       util_buffer_add_1b(p_buf, i);
       bytes++;
@@ -13,6 +13,10 @@ struct memory_access {
   uint16_t (*memory_write_needs_callback_from)(void* p);
   int (*memory_read_needs_callback)(void* p, uint16_t addr);
   int (*memory_write_needs_callback)(void* p, uint16_t addr);
+  /* A register that reads without side effects and only changes when a timer
+   * fires or the CPU writes it.
+   */
+  int (*memory_read_is_timer_driven)(void* p, uint16_t addr);
 
   uint8_t (*memory_read_callback)(void* p, uint16_t addr, int do_tick_callback);
   void (*memory_write_callback)(void* p,
@@ -11,4 +11,16 @@ void os_fault_register_handler(
                              uintptr_t host_rdi));
 void os_fault_bail(void);
 
+/* Periodically samples the calling thread's host instruction pointer, every
+ * interval_us of that thread's CPU time (wall time on Windows). Other threads
+ * are never sampled. The callback runs in signal context on the sampled
+ * thread, or on Windows on a helper thread while the sampled thread is
+ * suspended. Either way, only one thread ever runs it.
+ */
+void os_fault_start_sampling(void (*p_sample_callback)(void* p,
+                                                       uintptr_t host_rip),
+                             void* p_sample_callback_object,
+                             uint32_t interval_us);
+void os_fault_stop_sampling(void);
+
 #endif /* BEEBJIT_OS_FAULT_H */
@@ -2,12 +2,24 @@
 
 #include "util.h"
 
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <ucontext.h>
 #include <unistd.h>
 
+/* Older glibc doesn't name the thread id member of struct sigevent. */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 static void (*s_p_fault_callback)(uintptr_t*, uintptr_t, int, int, uintptr_t);
+static void (*s_p_sample_callback)(void*, uintptr_t);
+static void* s_p_sample_callback_object;
+static timer_t s_sample_timer;
+static int s_is_sampling;
 
 static void
 linux_sigsegv_handler(int signum, siginfo_t* p_siginfo, void* p_void) {
@@ -72,3 +84,84 @@ os_fault_bail(void) {
   (void) raise(SIGSEGV);
   _exit(1);
 }
+
+static void
+linux_sigprof_handler(int signum, siginfo_t* p_siginfo, void* p_void) {
+  ucontext_t* p_context = (ucontext_t*) p_void;
+
+  (void) signum;
+  (void) p_siginfo;
+
+  s_p_sample_callback(s_p_sample_callback_object,
+                      p_context->uc_mcontext.gregs[REG_RIP]);
+}
+
+void
+os_fault_start_sampling(void (*p_sample_callback)(void* p, uintptr_t host_rip),
+                        void* p_sample_callback_object,
+                        uint32_t interval_us) {
+  struct sigaction sa;
+  struct sigevent event;
+  struct itimerspec timer;
+  clockid_t clock_id;
+  int ret;
+
+  if (s_is_sampling) {
+    util_bail("already sampling");
+  }
+
+  s_p_sample_callback = p_sample_callback;
+  s_p_sample_callback_object = p_sample_callback_object;
+
+  (void) memset(&sa, '\0', sizeof(sa));
+  sa.sa_sigaction = linux_sigprof_handler;
+  sa.sa_flags = (SA_SIGINFO | SA_RESTART);
+  ret = sigaction(SIGPROF, &sa, NULL);
+  if (ret != 0) {
+    util_bail("sigaction failed");
+  }
+
+  /* A timer on this thread's CPU clock, signalling only this thread. A
+   * process wide ITIMER_PROF would land samples on whichever thread happened
+   * to be running, such as the sound or render threads.
+   */
+  ret = pthread_getcpuclockid(pthread_self(), &clock_id);
+  if (ret != 0) {
+    util_bail("pthread_getcpuclockid failed");
+  }
+  (void) memset(&event, '\0', sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = syscall(SYS_gettid);
+  ret = timer_create(clock_id, &event, &s_sample_timer);
+  if (ret != 0) {
+    util_bail("timer_create failed");
+  }
+
+  (void) memset(&timer, '\0', sizeof(timer));
+  timer.it_interval.tv_sec = (interval_us / 1000000);
+  timer.it_interval.tv_nsec = ((interval_us % 1000000) * 1000);
+  timer.it_value = timer.it_interval;
+  ret = timer_settime(s_sample_timer, 0, &timer, NULL);
+  if (ret != 0) {
+    util_bail("timer_settime failed");
+  }
+
+  s_is_sampling = 1;
+}
+
+void
+os_fault_stop_sampling(void) {
+  struct sigaction sa;
+
+  if (!s_is_sampling) {
+    return;
+  }
+
+  (void) timer_delete(s_sample_timer);
+  s_is_sampling = 0;
+
+  (void) memset(&sa, '\0', sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  (void) sigaction(SIGPROF, &sa, NULL);
+}
@@ -5,8 +5,15 @@
 #include <windows.h>
 
 #include <stdio.h>
+#include <string.h>
 
 static void (*s_p_fault_callback)(uintptr_t*, uintptr_t, int, int, uintptr_t);
+static void (*s_p_sample_callback)(void*, uintptr_t);
+static void* s_p_sample_callback_object;
+static HANDLE s_sampled_thread;
+static HANDLE s_sampler_thread;
+static DWORD s_sample_interval_ms;
+static volatile int s_is_sampler_exiting;
 
 static LONG
 VectoredHandler(struct _EXCEPTION_POINTERS* p_info) {
@@ -52,3 +59,78 @@ os_fault_bail(void) {
     (void) TerminateProcess(process, 1);
   }
 }
+
+static DWORD WINAPI
+SamplerThreadProc(_In_ LPVOID lpParameter) {
+  (void) lpParameter;
+
+  while (!s_is_sampler_exiting) {
+    CONTEXT context;
+
+    Sleep(s_sample_interval_ms);
+
+    if (SuspendThread(s_sampled_thread) == (DWORD) -1) {
+      continue;
+    }
+    (void) memset(&context, '\0', sizeof(context));
+    context.ContextFlags = CONTEXT_CONTROL;
+    if (GetThreadContext(s_sampled_thread, &context)) {
+      s_p_sample_callback(s_p_sample_callback_object,
+                          (uintptr_t) context.Rip);
+    }
+    (void) ResumeThread(s_sampled_thread);
+  }
+
+  return 0;
+}
+
+void
+os_fault_start_sampling(void (*p_sample_callback)(void* p, uintptr_t host_rip),
+                        void* p_sample_callback_object,
+                        uint32_t interval_us) {
+  BOOL ret;
+
+  if (s_sampler_thread != NULL) {
+    util_bail("already sampling");
+  }
+
+  s_p_sample_callback = p_sample_callback;
+  s_p_sample_callback_object = p_sample_callback_object;
+  /* Sleep() only goes down to milliseconds. */
+  s_sample_interval_ms = (interval_us / 1000);
+  if (s_sample_interval_ms == 0) {
+    s_sample_interval_ms = 1;
+  }
+  s_is_sampler_exiting = 0;
+
+  /* GetCurrentThread() is a pseudo handle, meaningless to another thread. */
+  ret = DuplicateHandle(GetCurrentProcess(),
+                        GetCurrentThread(),
+                        GetCurrentProcess(),
+                        &s_sampled_thread,
+                        (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT),
+                        FALSE,
+                        0);
+  if (!ret) {
+    util_bail("DuplicateHandle failed");
+  }
+
+  s_sampler_thread = CreateThread(NULL, 0, SamplerThreadProc, NULL, 0, NULL);
+  if (s_sampler_thread == NULL) {
+    util_bail("CreateThread failed");
+  }
+}
+
+void
+os_fault_stop_sampling(void) {
+  if (s_sampler_thread == NULL) {
+    return;
+  }
+
+  s_is_sampler_exiting = 1;
+  (void) WaitForSingleObject(s_sampler_thread, INFINITE);
+  (void) CloseHandle(s_sampler_thread);
+  (void) CloseHandle(s_sampled_thread);
+  s_sampler_thread = NULL;
+  s_sampled_thread = NULL;
+}
@@ -1,6 +1,9 @@
 #ifndef BEEBJIT_OS_THREAD_H
 #define BEEBJIT_OS_THREAD_H
 
+#include <stdint.h>
+
+struct os_event_struct;
 struct os_lock_struct;
 struct os_thread_struct;
 
@@ -13,4 +16,13 @@ void os_lock_destroy(struct os_lock_struct* p_lock);
 void os_lock_lock(struct os_lock_struct* p_lock);
 void os_lock_unlock(struct os_lock_struct* p_lock);
 
+/* An auto reset event. A post wakes the thread waiting on it, or if there
+ * isn't one, the next wait returns straight away.
+ */
+struct os_event_struct* os_event_create();
+void os_event_destroy(struct os_event_struct* p_event);
+
+void os_event_post(struct os_event_struct* p_event);
+void os_event_wait(struct os_event_struct* p_event);
+
 #endif /* BEEBJIT_OS_THREAD_H */
@@ -2,6 +2,7 @@
 
 #include "util.h"
 
+#include <err.h>
 #include <pthread.h>
 
 struct os_thread_struct {
@@ -12,6 +13,12 @@ struct os_lock_struct {
   pthread_spinlock_t lock;
 };
 
+struct os_event_struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int is_posted;
+};
+
 struct os_thread_struct*
 os_thread_create(void* p_func, void* p_arg) {
   int ret;
@@ -75,3 +82,70 @@ os_lock_unlock(struct os_lock_struct* p_lock) {
     errx(1, "pthread_spin_unlock failed");
   }
 }
+
+struct os_event_struct*
+os_event_create() {
+  int ret;
+  struct os_event_struct* p_event =
+      util_mallocz(sizeof(struct os_event_struct));
+
+  ret = pthread_mutex_init(&p_event->mutex, NULL);
+  if (ret != 0) {
+    errx(1, "pthread_mutex_init failed");
+  }
+  ret = pthread_cond_init(&p_event->cond, NULL);
+  if (ret != 0) {
+    errx(1, "pthread_cond_init failed");
+  }
+
+  return p_event;
+}
+
+void
+os_event_destroy(struct os_event_struct* p_event) {
+  int ret = pthread_cond_destroy(&p_event->cond);
+  if (ret != 0) {
+    errx(1, "pthread_cond_destroy failed");
+  }
+  ret = pthread_mutex_destroy(&p_event->mutex);
+  if (ret != 0) {
+    errx(1, "pthread_mutex_destroy failed");
+  }
+  util_free(p_event);
+}
+
+void
+os_event_post(struct os_event_struct* p_event) {
+  int ret = pthread_mutex_lock(&p_event->mutex);
+  if (ret != 0) {
+    errx(1, "pthread_mutex_lock failed");
+  }
+  p_event->is_posted = 1;
+  ret = pthread_cond_signal(&p_event->cond);
+  if (ret != 0) {
+    errx(1, "pthread_cond_signal failed");
+  }
+  ret = pthread_mutex_unlock(&p_event->mutex);
+  if (ret != 0) {
+    errx(1, "pthread_mutex_unlock failed");
+  }
+}
+
+void
+os_event_wait(struct os_event_struct* p_event) {
+  int ret = pthread_mutex_lock(&p_event->mutex);
+  if (ret != 0) {
+    errx(1, "pthread_mutex_lock failed");
+  }
+  while (!p_event->is_posted) {
+    ret = pthread_cond_wait(&p_event->cond, &p_event->mutex);
+    if (ret != 0) {
+      errx(1, "pthread_cond_wait failed");
+    }
+  }
+  p_event->is_posted = 0;
+  ret = pthread_mutex_unlock(&p_event->mutex);
+  if (ret != 0) {
+    errx(1, "pthread_mutex_unlock failed");
+  }
+}
@@ -13,6 +13,10 @@ struct os_lock_struct {
   CRITICAL_SECTION cs;
 };
 
+struct os_event_struct {
+  HANDLE handle;
+};
+
 DWORD WINAPI
 ThreadProc(_In_ LPVOID lpParameter) {
   void* p_ret;
@@ -90,3 +94,43 @@ void
 os_lock_unlock(struct os_lock_struct* p_lock) {
   LeaveCriticalSection(&p_lock->cs);
 }
+
+struct os_event_struct*
+os_event_create() {
+  HANDLE handle;
+  struct os_event_struct* p_event =
+      util_mallocz(sizeof(struct os_event_struct));
+
+  handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (handle == NULL) {
+    util_bail("CreateEvent failed");
+  }
+  p_event->handle = handle;
+
+  return p_event;
+}
+
+void
+os_event_destroy(struct os_event_struct* p_event) {
+  BOOL ret = CloseHandle(p_event->handle);
+  if (ret == 0) {
+    util_bail("CloseHandle failed");
+  }
+  util_free(p_event);
+}
+
+void
+os_event_post(struct os_event_struct* p_event) {
+  BOOL ret = SetEvent(p_event->handle);
+  if (ret == 0) {
+    util_bail("SetEvent failed");
+  }
+}
+
+void
+os_event_wait(struct os_event_struct* p_event) {
+  DWORD ret = WaitForSingleObject(p_event->handle, INFINITE);
+  if (ret == WAIT_FAILED) {
+    util_bail("WaitForSingleObject failed");
+  }
+}
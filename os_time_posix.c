@@ -17,6 +17,18 @@ os_time_get_us() {
   return ((ts.tv_sec * (uint64_t) 1000000) + (ts.tv_nsec / 1000));
 }
 
+uint64_t
+os_time_get_ns() {
+  struct timespec ts;
+
+  int ret = clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (ret != 0) {
+    util_bail("clock_gettime failed");
+  }
+
+  return ((ts.tv_sec * (uint64_t) 1000000000) + ts.tv_nsec);
+}
+
 struct os_time_sleeper*
 os_time_create_sleeper(void) {
   return NULL;
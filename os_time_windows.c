@@ -12,11 +12,10 @@ struct os_time_sleeper {
   HANDLE handle;
 };
 
-uint64_t
-os_time_get_us() {
+static uint64_t
+os_time_get_counter(void) {
   BOOL ret;
   LARGE_INTEGER li;
-  uint64_t value;
 
   if (!s_frequency_queried) {
     ret = QueryPerformanceFrequency(&li);
@@ -36,12 +35,25 @@ os_time_get_us() {
     util_bail("QueryPerformanceCounter failed");
   }
 
-  value = li.QuadPart;
+  return li.QuadPart;
+}
+
+uint64_t
+os_time_get_us() {
+  uint64_t value = os_time_get_counter();
   value *= ((double) 1000000.0 / s_frequency);
 
   return value;
 }
 
+uint64_t
+os_time_get_ns() {
+  uint64_t value = os_time_get_counter();
+  value *= ((double) 1000000000.0 / s_frequency);
+
+  return value;
+}
+
 struct os_time_sleeper*
 os_time_create_sleeper(void) {
   HANDLE handle;
@@ -1,12 +1,43 @@
 #include "render.h"
 
 #include "bbc_options.h"
+#include "os_thread.h"
+#include "os_time.h"
 #include "teletext.h"
 #include "util.h"
 
 #include <assert.h>
+#include <immintrin.h>
 #include <string.h>
 
+enum {
+  /* Command words in the render queue: the command is in the low byte and its
+   * argument in the rest.
+   */
+  k_render_cmd_data = 0,
+  k_render_cmd_blank = 1,
+  k_render_cmd_hsync = 2,
+  k_render_cmd_vsync = 3,
+  k_render_cmd_cursor = 4,
+  k_render_cmd_set_RA = 5,
+  k_render_cmd_set_mode = 6,
+  /* Followed by a second word, the rgba value. */
+  k_render_cmd_set_palette = 7,
+  k_render_cmd_set_cursor_segments = 8,
+  k_render_cmd_frame_boundary = 9,
+  k_render_cmd_teletext_DISPMTG = 10,
+  k_render_cmd_teletext_VSYNC = 11,
+};
+
+enum {
+  /* About 3 frames of MODE 0. */
+  k_render_queue_size = 65536,
+  k_render_idle_sleep_us = 100,
+  k_render_wait_sleep_us = 10,
+  /* Longest run of queued screen bytes rendered in one go. */
+  k_render_max_span = 256,
+};
+
 struct render_struct {
   void (*p_flyback_callback)(void*);
   void* p_flyback_callback_object;
@@ -53,6 +84,36 @@ struct render_struct {
   int do_show_frame_boundaries;
   int32_t cursor_segment_index;
   int cursor_segments[4];
+
+  /* Copy runs of characters out of the render tables, with the widest vector
+   * moves the host CPU has. NULL to render one character at a time.
+   */
+  void (*p_copy_2MHz)(uint32_t* p_dst,
+                      struct render_table_2MHz* p_table,
+                      const uint8_t* p_data,
+                      uint32_t count);
+  void (*p_copy_1MHz)(uint32_t* p_dst,
+                      struct render_table_1MHz* p_table,
+                      const uint8_t* p_data,
+                      uint32_t count);
+
+  /* Render thread. While it runs, the render calls made by video on the CPU
+   * thread only queue commands, and the thread owns all the state above.
+   * The queue has a single producer and a single consumer, and relies on x64
+   * not reordering stores with other stores, or loads with other loads.
+   */
+  struct os_thread_struct* p_thread;
+  struct os_time_sleeper* p_sleeper;
+  struct os_time_sleeper* p_wait_sleeper;
+  volatile int is_thread_exiting;
+  volatile uint32_t* p_queue;
+  volatile uint32_t queue_head;
+  volatile uint32_t queue_tail;
+  /* CPU thread copy of the beam position, to spot flyback. */
+  int queue_render_mode;
+  uint32_t queue_pixels_size;
+  int32_t queue_horiz_beam_pos;
+  int32_t queue_vert_beam_pos;
 };
 
 static void
@@ -63,6 +124,68 @@ render_dirty_all_tables(struct render_struct* p_render) {
   }
 }
 
+static void
+render_copy_2MHz_sse2(uint32_t* p_dst,
+                      struct render_table_2MHz* p_table,
+                      const uint8_t* p_data,
+                      uint32_t count) {
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    __m128i* p_src = (__m128i*) &p_table->values[p_data[i]];
+    __m128i* p_out = (__m128i*) p_dst;
+    _mm_storeu_si128(&p_out[0], _mm_loadu_si128(&p_src[0]));
+    _mm_storeu_si128(&p_out[1], _mm_loadu_si128(&p_src[1]));
+    p_dst += 8;
+  }
+}
+
+static void
+render_copy_1MHz_sse2(uint32_t* p_dst,
+                      struct render_table_1MHz* p_table,
+                      const uint8_t* p_data,
+                      uint32_t count) {
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    __m128i* p_src = (__m128i*) &p_table->values[p_data[i]];
+    __m128i* p_out = (__m128i*) p_dst;
+    _mm_storeu_si128(&p_out[0], _mm_loadu_si128(&p_src[0]));
+    _mm_storeu_si128(&p_out[1], _mm_loadu_si128(&p_src[1]));
+    _mm_storeu_si128(&p_out[2], _mm_loadu_si128(&p_src[2]));
+    _mm_storeu_si128(&p_out[3], _mm_loadu_si128(&p_src[3]));
+    p_dst += 16;
+  }
+}
+
+__attribute__((target("avx2")))
+static void
+render_copy_2MHz_avx2(uint32_t* p_dst,
+                      struct render_table_2MHz* p_table,
+                      const uint8_t* p_data,
+                      uint32_t count) {
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    __m256i* p_src = (__m256i*) &p_table->values[p_data[i]];
+    _mm256_storeu_si256((__m256i*) p_dst, _mm256_loadu_si256(p_src));
+    p_dst += 8;
+  }
+}
+
+__attribute__((target("avx2")))
+static void
+render_copy_1MHz_avx2(uint32_t* p_dst,
+                      struct render_table_1MHz* p_table,
+                      const uint8_t* p_data,
+                      uint32_t count) {
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    __m256i* p_src = (__m256i*) &p_table->values[p_data[i]];
+    __m256i* p_out = (__m256i*) p_dst;
+    _mm256_storeu_si256(&p_out[0], _mm256_loadu_si256(&p_src[0]));
+    _mm256_storeu_si256(&p_out[1], _mm256_loadu_si256(&p_src[1]));
+    p_dst += 16;
+  }
+}
+
 struct render_struct*
 render_create(struct teletext_struct* p_teletext,
               struct bbc_options* p_options) {
@@ -105,6 +228,17 @@ render_create(struct teletext_struct* p_teletext,
   p_render->do_show_frame_boundaries = util_has_option(
       p_options->p_opt_flags, "video:frame-boundaries");
 
+  /* SSE2 is always there on x64. */
+  if (!util_has_option(p_options->p_opt_flags, "video:no-simd")) {
+    p_render->p_copy_2MHz = render_copy_2MHz_sse2;
+    p_render->p_copy_1MHz = render_copy_1MHz_sse2;
+    if (!util_has_option(p_options->p_opt_flags, "video:no-avx2") &&
+        __builtin_cpu_supports("avx2")) {
+      p_render->p_copy_2MHz = render_copy_2MHz_avx2;
+      p_render->p_copy_1MHz = render_copy_1MHz_avx2;
+    }
+  }
+
   width = (640 + (border_chars * 2 * 16));
   height = (512 + (border_chars * 2 * 16));
 
@@ -156,6 +290,10 @@ render_create(struct teletext_struct* p_teletext,
 
 void
 render_destroy(struct render_struct* p_render) {
+  render_stop_thread(p_render);
+  if (p_render->p_queue != NULL) {
+    util_free((uint32_t*) p_render->p_queue);
+  }
   util_free(p_render);
 }
 
@@ -228,6 +366,7 @@ void
 render_set_buffer(struct render_struct* p_render, uint32_t* p_buffer) {
   assert(p_render->p_buffer == NULL);
   assert(p_buffer != NULL);
+  assert(p_render->p_thread == NULL);
   p_render->p_buffer = p_buffer;
   p_render->p_buffer_end = p_buffer;
   p_render->p_buffer_end += (p_render->width * p_render->height);
@@ -363,8 +502,8 @@ render_function_2MHz_blank(struct render_struct* p_render, uint8_t data) {
   }
 }
 
-void
-render_set_mode(struct render_struct* p_render, int mode) {
+static void
+render_do_set_mode(struct render_struct* p_render, int mode) {
   assert((mode >= k_render_mode0) && (mode <= k_render_mode8));
 
   if (mode == p_render->render_mode) {
@@ -400,10 +539,10 @@ render_set_mode(struct render_struct* p_render, int mode) {
   render_reset_render_pos(p_render);
 }
 
-void
-render_set_palette(struct render_struct* p_render,
-                   uint8_t index,
-                   uint32_t rgba) {
+static void
+render_do_set_palette(struct render_struct* p_render,
+                      uint8_t index,
+                      uint32_t rgba) {
   if (p_render->palette[index] == rgba) {
     return;
   }
@@ -412,12 +551,12 @@ render_set_palette(struct render_struct* p_render,
   render_dirty_all_tables(p_render);
 }
 
-void
-render_set_cursor_segments(struct render_struct* p_render,
-                           int s0,
-                           int s1,
-                           int s2,
-                           int s3) {
+static void
+render_do_set_cursor_segments(struct render_struct* p_render,
+                              int s0,
+                              int s1,
+                              int s2,
+                              int s3) {
   p_render->cursor_segments[0] = s0;
   p_render->cursor_segments[1] = s1;
   p_render->cursor_segments[2] = s2;
@@ -602,7 +741,7 @@ render_check_1MHz_render_table(struct render_struct* p_render) {
   }
 }
 
-void (*render_get_render_data_function(struct render_struct* p_render))
+static void (*render_select_data_function(struct render_struct* p_render))
     (struct render_struct*, uint8_t) {
   if (p_render->render_mode == k_render_mode7) {
     return render_function_teletext;
@@ -615,7 +754,7 @@ void (*render_get_render_data_function(struct render_struct* p_render))
   }
 }
 
-void (*render_get_render_blank_function(struct render_struct* p_render))
+static void (*render_select_blank_function(struct render_struct* p_render))
     (struct render_struct*, uint8_t) {
   if (p_render->is_clock_2MHz) {
     return render_function_2MHz_blank;
@@ -624,8 +763,62 @@ void (*render_get_render_blank_function(struct render_struct* p_render))
   }
 }
 
-void
-render_set_RA(struct render_struct* p_render, uint32_t row_address) {
+static void
+render_do_data_span(struct render_struct* p_render,
+                    const uint8_t* p_data,
+                    uint32_t count) {
+  uint32_t i;
+
+  void (*p_func)(struct render_struct*, uint8_t) =
+      render_select_data_function(p_render);
+  uint32_t pixels_size = p_render->pixels_size;
+
+  /* The SAA5050 keeps state from one character to the next. */
+  if ((p_render->render_mode == k_render_mode7) ||
+      (p_render->p_copy_2MHz == NULL)) {
+    for (i = 0; i < count; ++i) {
+      p_func(p_render, p_data[i]);
+    }
+    return;
+  }
+
+  i = 0;
+  while (i < count) {
+    uint32_t num_chars;
+    uint32_t* p_render_pos = p_render->p_render_pos;
+
+    /* Window edges and the cursor are handled a character at a time. */
+    if ((p_render_pos >= p_render->p_render_pos_row_max) ||
+        (p_render->cursor_segment_index != -1)) {
+      p_func(p_render, p_data[i]);
+      i++;
+      continue;
+    }
+
+    num_chars = (p_render->p_render_pos_row_max - p_render_pos);
+    num_chars = ((num_chars + pixels_size - 1) / pixels_size);
+    if (num_chars > (count - i)) {
+      num_chars = (count - i);
+    }
+    if (p_render->is_clock_2MHz) {
+      p_render->p_copy_2MHz(p_render_pos,
+                            p_render->p_render_table_2MHz,
+                            &p_data[i],
+                            num_chars);
+    } else {
+      p_render->p_copy_1MHz(p_render_pos,
+                            p_render->p_render_table_1MHz,
+                            &p_data[i],
+                            num_chars);
+    }
+    p_render->p_render_pos += (num_chars * pixels_size);
+    p_render->horiz_beam_pos += (num_chars * pixels_size);
+    i += num_chars;
+  }
+}
+
+static void
+render_do_set_RA(struct render_struct* p_render, uint32_t row_address) {
   int is_rendering_black = 0;
   int old_is_rendering_black = p_render->is_rendering_black;
 
@@ -671,8 +864,22 @@ render_double_up_lines(struct render_struct* p_render) {
   }
 }
 
-void
-render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
+static void
+render_do_vsync(struct render_struct* p_render, int do_interlace_compensate) {
+  p_render->vert_beam_pos = 0;
+  if (do_interlace_compensate &&
+      !p_render->do_interlace_wobble &&
+      (p_render->horiz_beam_pos < 512)) {
+    /* TODO: the interlace wobble, if enabled, is wobbling too much. It wobbles
+     * 1 full vertical scanline (2 host pixels) instead of a half scanline.
+     */
+    p_render->vert_beam_pos = 2;
+  }
+  render_reset_render_pos(p_render);
+}
+
+static void
+render_do_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
   /* A real CRT appears to sync to the middle of the hsync pulse?!! This
    * permits half-character horizontal scrolling.
    * Used by tricky's RallyX demo.
@@ -685,10 +892,14 @@ render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
   p_render->vert_beam_pos += 2;
 
   /* If the CRT beam gets too low with no vsync signal in sight, it will do
-   * flyback anyway.
+   * flyback anyway. With a render thread, the CPU thread spots this and calls
+   * the flyback callback itself.
    */
   if (p_render->vert_beam_pos >= 768) {
-    render_vsync(p_render, 1);
+    if ((p_render->p_thread == NULL) && p_render->p_flyback_callback) {
+      p_render->p_flyback_callback(p_render->p_flyback_callback_object);
+    }
+    render_do_vsync(p_render, 1);
   }
 
   render_reset_render_pos(p_render);
@@ -702,42 +913,405 @@ render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
   }
 }
 
-void
-render_vsync(struct render_struct* p_render, int do_interlace_compensate) {
+static void
+render_do_frame_boundary(struct render_struct* p_render) {
+  uint32_t i;
+
+  if (!p_render->do_show_frame_boundaries) {
+    return;
+  }
+  if (p_render->p_render_pos_row == p_render->p_buffer_end) {
+    return;
+  }
+
+  /* Paint a red line to edge of canvas denote CRTC frame boundary. */
+  for (i = 0; i < p_render->width; ++i) {
+    p_render->p_render_pos_row[i] = 0xffff0000;
+  }
+}
+
+static void
+render_do_cursor(struct render_struct* p_render) {
+  p_render->cursor_segment_index = 0;
+}
+
+static void
+render_queue_wait(struct render_struct* p_render, uint32_t max_queued) {
+  while ((p_render->queue_head - p_render->queue_tail) > max_queued) {
+    os_time_sleeper_sleep_us(p_render->p_wait_sleeper,
+                             k_render_wait_sleep_us);
+  }
+}
+
+static inline void
+render_queue_push(struct render_struct* p_render, uint32_t command) {
+  uint32_t head = p_render->queue_head;
+
+  if ((head - p_render->queue_tail) == k_render_queue_size) {
+    render_queue_wait(p_render, (k_render_queue_size - 1));
+  }
+  p_render->p_queue[head % k_render_queue_size] = command;
+  p_render->queue_head = (head + 1);
+}
+
+static void
+render_queue_push_pair(struct render_struct* p_render,
+                       uint32_t command,
+                       uint32_t value) {
+  uint32_t head = p_render->queue_head;
+
+  /* Both words are published together. */
+  render_queue_wait(p_render, (k_render_queue_size - 2));
+  p_render->p_queue[head % k_render_queue_size] = command;
+  p_render->p_queue[(head + 1) % k_render_queue_size] = value;
+  p_render->queue_head = (head + 2);
+}
+
+static void
+render_queue_data(struct render_struct* p_render, uint8_t data) {
+  p_render->queue_horiz_beam_pos += p_render->queue_pixels_size;
+  render_queue_push(p_render, (k_render_cmd_data | (data << 8)));
+}
+
+static void
+render_queue_blank(struct render_struct* p_render, uint8_t data) {
+  (void) data;
+  p_render->queue_horiz_beam_pos += p_render->queue_pixels_size;
+  render_queue_push(p_render, k_render_cmd_blank);
+}
+
+static void
+render_queue_flyback(struct render_struct* p_render,
+                     int do_interlace_compensate) {
+  /* The flyback callback may hand the buffer to the UI thread, so it must hold
+   * everything up to this point.
+   */
   if (p_render->p_flyback_callback) {
+    render_queue_wait(p_render, 0);
     p_render->p_flyback_callback(p_render->p_flyback_callback_object);
   }
 
-  p_render->vert_beam_pos = 0;
+  p_render->queue_vert_beam_pos = 0;
   if (do_interlace_compensate &&
       !p_render->do_interlace_wobble &&
-      (p_render->horiz_beam_pos < 512)) {
-    /* TODO: the interlace wobble, if enabled, is wobbling too much. It wobbles
-     * 1 full vertical scanline (2 host pixels) instead of a half scanline.
-     */
-    p_render->vert_beam_pos = 2;
+      (p_render->queue_horiz_beam_pos < 512)) {
+    p_render->queue_vert_beam_pos = 2;
   }
-  render_reset_render_pos(p_render);
+}
+
+static int
+render_run_queue(struct render_struct* p_render) {
+  volatile uint32_t* p_queue = p_render->p_queue;
+  uint32_t tail = p_render->queue_tail;
+  uint32_t head = p_render->queue_head;
+
+  if (tail == head) {
+    return 0;
+  }
+
+  while (tail != head) {
+    uint32_t command = p_queue[tail % k_render_queue_size];
+    uint32_t arg = (command >> 8);
+    tail++;
+
+    switch (command & 0xFF) {
+    case k_render_cmd_data:
+      {
+        uint8_t data[k_render_max_span];
+        uint32_t num_data = 0;
+
+        data[num_data++] = arg;
+        while ((tail != head) &&
+               (num_data < k_render_max_span) &&
+               ((p_queue[tail % k_render_queue_size] & 0xFF) ==
+                    k_render_cmd_data)) {
+          data[num_data++] = (p_queue[tail % k_render_queue_size] >> 8);
+          tail++;
+        }
+        render_do_data_span(p_render, data, num_data);
+      }
+      break;
+    case k_render_cmd_blank:
+      if (p_render->is_clock_2MHz) {
+        render_function_2MHz_blank(p_render, 0);
+      } else {
+        render_function_1MHz_blank(p_render, 0);
+      }
+      break;
+    case k_render_cmd_hsync:
+      render_do_hsync(p_render, arg);
+      break;
+    case k_render_cmd_vsync:
+      render_do_vsync(p_render, arg);
+      break;
+    case k_render_cmd_cursor:
+      render_do_cursor(p_render);
+      break;
+    case k_render_cmd_set_RA:
+      render_do_set_RA(p_render, arg);
+      break;
+    case k_render_cmd_set_mode:
+      render_do_set_mode(p_render, arg);
+      break;
+    case k_render_cmd_set_palette:
+      render_do_set_palette(p_render,
+                            arg,
+                            p_queue[tail % k_render_queue_size]);
+      tail++;
+      break;
+    case k_render_cmd_set_cursor_segments:
+      render_do_set_cursor_segments(p_render,
+                                    !!(arg & 1),
+                                    !!(arg & 2),
+                                    !!(arg & 4),
+                                    !!(arg & 8));
+      break;
+    case k_render_cmd_frame_boundary:
+      render_do_frame_boundary(p_render);
+      break;
+    case k_render_cmd_teletext_DISPMTG:
+      teletext_DISPMTG_changed(p_render->p_teletext, arg);
+      break;
+    case k_render_cmd_teletext_VSYNC:
+      teletext_VSYNC_changed(p_render->p_teletext, arg);
+      break;
+    default:
+      assert(0);
+      break;
+    }
+  }
+
+  /* The pixels must be stored before the CPU thread sees the queue drained. */
+  __sync_synchronize();
+  p_render->queue_tail = tail;
+
+  return 1;
+}
+
+static void*
+render_thread(void* p) {
+  struct render_struct* p_render = (struct render_struct*) p;
+
+  while (!p_render->is_thread_exiting) {
+    if (!render_run_queue(p_render)) {
+      os_time_sleeper_sleep_us(p_render->p_sleeper, k_render_idle_sleep_us);
+    }
+  }
+
+  return NULL;
 }
 
 void
-render_frame_boundary(struct render_struct* p_render) {
+render_start_thread(struct render_struct* p_render) {
+  assert(p_render->p_thread == NULL);
+
+  if (p_render->p_queue == NULL) {
+    p_render->p_queue = util_malloc(k_render_queue_size * sizeof(uint32_t));
+  }
+  p_render->queue_head = 0;
+  p_render->queue_tail = 0;
+
+  p_render->queue_render_mode = p_render->render_mode;
+  p_render->queue_pixels_size = p_render->pixels_size;
+  p_render->queue_horiz_beam_pos = p_render->horiz_beam_pos;
+  p_render->queue_vert_beam_pos = p_render->vert_beam_pos;
+
+  p_render->is_thread_exiting = 0;
+  p_render->p_sleeper = os_time_create_sleeper();
+  p_render->p_wait_sleeper = os_time_create_sleeper();
+  p_render->p_thread = os_thread_create(render_thread, p_render);
+}
+
+void
+render_stop_thread(struct render_struct* p_render) {
+  if (p_render->p_thread == NULL) {
+    return;
+  }
+
+  render_queue_wait(p_render, 0);
+  p_render->is_thread_exiting = 1;
+  (void) os_thread_destroy(p_render->p_thread);
+  p_render->p_thread = NULL;
+  os_time_free_sleeper(p_render->p_sleeper);
+  os_time_free_sleeper(p_render->p_wait_sleeper);
+}
+
+void
+render_set_mode(struct render_struct* p_render, int mode) {
+  if (p_render->p_thread == NULL) {
+    render_do_set_mode(p_render, mode);
+    return;
+  }
+
+  assert((mode >= k_render_mode0) && (mode <= k_render_mode8));
+  p_render->queue_render_mode = mode;
+  p_render->queue_pixels_size = 16;
+  if (mode <= k_render_mode2) {
+    p_render->queue_pixels_size = 8;
+  }
+  render_queue_push(p_render, (k_render_cmd_set_mode | (mode << 8)));
+}
+
+void
+render_set_palette(struct render_struct* p_render,
+                   uint8_t index,
+                   uint32_t rgba) {
+  if (p_render->p_thread == NULL) {
+    render_do_set_palette(p_render, index, rgba);
+    return;
+  }
+
+  render_queue_push_pair(p_render,
+                         (k_render_cmd_set_palette | (index << 8)),
+                         rgba);
+}
+
+void
+render_set_cursor_segments(struct render_struct* p_render,
+                           int s0,
+                           int s1,
+                           int s2,
+                           int s3) {
+  uint32_t segments = 0;
+
+  if (p_render->p_thread == NULL) {
+    render_do_set_cursor_segments(p_render, s0, s1, s2, s3);
+    return;
+  }
+
+  if (s0) {
+    segments |= 1;
+  }
+  if (s1) {
+    segments |= 2;
+  }
+  if (s2) {
+    segments |= 4;
+  }
+  if (s3) {
+    segments |= 8;
+  }
+  render_queue_push(p_render,
+                    (k_render_cmd_set_cursor_segments | (segments << 8)));
+}
+
+void
+render_set_RA(struct render_struct* p_render, uint32_t row_address) {
+  if (p_render->p_thread == NULL) {
+    render_do_set_RA(p_render, row_address);
+    return;
+  }
+
+  render_queue_push(p_render, (k_render_cmd_set_RA | (row_address << 8)));
+}
+
+void (*render_get_render_data_function(struct render_struct* p_render))
+    (struct render_struct*, uint8_t) {
+  if (p_render->p_thread != NULL) {
+    return render_queue_data;
+  }
+  return render_select_data_function(p_render);
+}
+
+void
+render_data_span(struct render_struct* p_render,
+                 const uint8_t* p_data,
+                 uint32_t count) {
   uint32_t i;
 
-  if (!p_render->do_show_frame_boundaries) {
+  if (p_render->p_thread == NULL) {
+    render_do_data_span(p_render, p_data, count);
     return;
   }
-  if (p_render->p_render_pos_row == p_render->p_buffer_end) {
+
+  for (i = 0; i < count; ++i) {
+    render_queue_data(p_render, p_data[i]);
+  }
+}
+
+void (*render_get_render_blank_function(struct render_struct* p_render))
+    (struct render_struct*, uint8_t) {
+  if (p_render->p_thread != NULL) {
+    return render_queue_blank;
+  }
+  return render_select_blank_function(p_render);
+}
+
+void
+render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
+  if (p_render->p_thread == NULL) {
+    render_do_hsync(p_render, hsync_pulse_ticks);
     return;
   }
 
-  /* Paint a red line to edge of canvas denote CRTC frame boundary. */
-  for (i = 0; i < p_render->width; ++i) {
-    p_render->p_render_pos_row[i] = 0xffff0000;
+  /* Track the beam as render_do_hsync() will. */
+  p_render->queue_horiz_beam_pos = 0;
+  if (hsync_pulse_ticks & 1) {
+    p_render->queue_horiz_beam_pos = -4;
   }
+  p_render->queue_vert_beam_pos += 2;
+  if (p_render->queue_vert_beam_pos >= 768) {
+    render_queue_flyback(p_render, 1);
+  }
+  if (p_render->queue_render_mode == k_render_mode7) {
+    p_render->queue_horiz_beam_pos += 32;
+  }
+
+  render_queue_push(p_render, (k_render_cmd_hsync | (hsync_pulse_ticks << 8)));
+}
+
+void
+render_vsync(struct render_struct* p_render, int do_interlace_compensate) {
+  if (p_render->p_thread == NULL) {
+    if (p_render->p_flyback_callback) {
+      p_render->p_flyback_callback(p_render->p_flyback_callback_object);
+    }
+    render_do_vsync(p_render, do_interlace_compensate);
+    return;
+  }
+
+  render_queue_flyback(p_render, do_interlace_compensate);
+  render_queue_push(p_render,
+                    (k_render_cmd_vsync | (!!do_interlace_compensate << 8)));
+}
+
+void
+render_frame_boundary(struct render_struct* p_render) {
+  if (p_render->p_thread == NULL) {
+    render_do_frame_boundary(p_render);
+    return;
+  }
+
+  render_queue_push(p_render, k_render_cmd_frame_boundary);
 }
 
 void
 render_cursor(struct render_struct* p_render) {
-  p_render->cursor_segment_index = 0;
+  if (p_render->p_thread == NULL) {
+    render_do_cursor(p_render);
+    return;
+  }
+
+  render_queue_push(p_render, k_render_cmd_cursor);
+}
+
+void
+render_teletext_DISPMTG_changed(struct render_struct* p_render, int value) {
+  if (p_render->p_thread == NULL) {
+    teletext_DISPMTG_changed(p_render->p_teletext, value);
+    return;
+  }
+
+  render_queue_push(p_render,
+                    (k_render_cmd_teletext_DISPMTG | (!!value << 8)));
+}
+
+void
+render_teletext_VSYNC_changed(struct render_struct* p_render, int value) {
+  if (p_render->p_thread == NULL) {
+    teletext_VSYNC_changed(p_render->p_teletext, value);
+    return;
+  }
+
+  render_queue_push(p_render, (k_render_cmd_teletext_VSYNC | (!!value << 8)));
 }
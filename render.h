@@ -39,6 +39,13 @@ struct render_struct* render_create(struct teletext_struct* p_teletext,
                                     struct bbc_options* p_options);
 void render_destroy(struct render_struct* p_render);
 
+/* Hands the pixel work to a render thread. Until it is stopped, the calls
+ * below only queue commands for the thread, and the flyback callback is called
+ * once it has caught up.
+ */
+void render_start_thread(struct render_struct* p_render);
+void render_stop_thread(struct render_struct* p_render);
+
 void render_set_flyback_callback(struct render_struct* p_render,
                                  void (*p_flyback_callback)(void* p),
                                  void* p_callback_object);
@@ -65,6 +72,12 @@ void (*render_get_render_data_function(struct render_struct* p_render))
     (struct render_struct*, uint8_t);
 void (*render_get_render_blank_function(struct render_struct* p_render))
     (struct render_struct*, uint8_t);
+/* Renders a run of screen bytes, such as a scanline, as the data function
+ * called on each would.
+ */
+void render_data_span(struct render_struct* p_render,
+                      const uint8_t* p_data,
+                      uint32_t count);
 
 void render_clear_buffer(struct render_struct* p_render);
 void render_double_up_lines(struct render_struct* p_render);
@@ -73,4 +86,8 @@ void render_vsync(struct render_struct* p_render, int do_interlace_compensate);
 void render_frame_boundary(struct render_struct* p_render);
 void render_cursor(struct render_struct* p_render);
 
+void render_teletext_DISPMTG_changed(struct render_struct* p_render,
+                                     int value);
+void render_teletext_VSYNC_changed(struct render_struct* p_render, int value);
+
 #endif /* BEEBJIT_RENDER_H */
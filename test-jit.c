@@ -4,6 +4,7 @@
 
 #include "bbc.h"
 #include "emit_6502.h"
+#include "video.h"
 
 static struct cpu_driver* s_p_cpu_driver = NULL;
 static struct jit_struct* s_p_jit = NULL;
@@ -324,6 +325,1229 @@ jit_test_dynamic_operand() {
   jit_compiler_testing_set_optimizing(s_p_compiler, 0);
 }
 
+static void
+jit_test_smc_opcode_flip() {
+  uint8_t* p_host_address;
+  struct jit_smc_info smc_info;
+  uint64_t num_compiles;
+  uint8_t reg_s;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x1100), 0x10);
+  emit_STA(p_buf, k_abs, 0x1120);
+  emit_JMP(p_buf, k_abs, 0x1120);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1120), 0x10);
+  emit_JSR(p_buf, 0x1130);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1130), 0x10);
+  emit_EXIT(p_buf);
+
+  /* Flip the opcode at $1120 between JSR and JMP. Each flip recompiles until
+   * the flip count reaches the revalidate limit (1 in tests).
+   */
+  state_6502_set_a(s_p_state_6502, 0x20);
+  state_6502_set_pc(s_p_state_6502, 0x1100);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  state_6502_set_a(s_p_state_6502, 0x4C);
+  state_6502_set_pc(s_p_state_6502, 0x1100);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  jit_compiler_get_smc_info(s_p_compiler, &smc_info, 0x1120);
+  test_expect_u32(k_jit_smc_opcode_flip, smc_info.smc_class);
+  test_expect_u32(k_jit_smc_strategy_recompile, smc_info.strategy);
+
+  /* This flip compiles the polymorphic inline cache. */
+  state_6502_set_a(s_p_state_6502, 0x20);
+  state_6502_set_pc(s_p_state_6502, 0x1100);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  jit_compiler_get_smc_info(s_p_compiler, &smc_info, 0x1120);
+  test_expect_u32(k_jit_smc_strategy_inline_cache, smc_info.strategy);
+  test_expect_u32(2, smc_info.num_opcodes);
+
+  /* Subsequent flips run the right variant without invalidating anything. */
+  num_compiles = s_p_jit->counter_num_compiles;
+  state_6502_set_a(s_p_state_6502, 0x4C);
+  state_6502_set_pc(s_p_state_6502, 0x1100);
+  reg_s = (uint8_t) s_p_state_6502->reg_s;
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(reg_s, (uint8_t) s_p_state_6502->reg_s);
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1120);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  state_6502_set_a(s_p_state_6502, 0x20);
+  state_6502_set_pc(s_p_state_6502, 0x1100);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32((uint8_t) (reg_s - 2), (uint8_t) s_p_state_6502->reg_s);
+  test_expect_u32(num_compiles, s_p_jit->counter_num_compiles);
+
+  /* An operand write still recompiles. */
+  jit_invalidate_code_at_address(s_p_jit, 0x1121);
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1120);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_chain() {
+  uint8_t* p_host_address;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  jit_compiler_testing_set_chaining(s_p_compiler, 1);
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x1200), 0x10);
+  emit_INX(p_buf);
+  emit_JMP(p_buf, k_abs, 0x1210);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1210), 0x10);
+  emit_INX(p_buf);
+  emit_EXIT(p_buf);
+
+  /* The target must exist first. */
+  state_6502_set_x(s_p_state_6502, 0);
+  state_6502_set_pc(s_p_state_6502, 0x1210);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(-1, jit_compiler_get_chain_target(s_p_compiler, 0x1210));
+
+  state_6502_set_x(s_p_state_6502, 0);
+  state_6502_set_pc(s_p_state_6502, 0x1200);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x1210, jit_compiler_get_chain_target(s_p_compiler, 0x1200));
+  test_expect_u32(2, (uint8_t) s_p_state_6502->reg_x);
+
+  /* Replacing the target must invalidate the chained source. */
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1210, 0x10);
+  test_expect_u32(-1, jit_compiler_get_chain_target(s_p_compiler, 0x1200));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1200);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  state_6502_set_x(s_p_state_6502, 0);
+  state_6502_set_pc(s_p_state_6502, 0x1200);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(-1, jit_compiler_get_chain_target(s_p_compiler, 0x1200));
+  test_expect_u32(2, (uint8_t) s_p_state_6502->reg_x);
+
+  jit_compiler_testing_set_chaining(s_p_compiler, 0);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_cache() {
+  uint8_t* p_host_address;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  s_p_jit->p_cache = jit_cache_create(s_p_mem,
+                                      jit_compiler_get_cache_key(s_p_compiler));
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x1000), 0x100);
+  emit_NOP(p_buf);
+  emit_NOP(p_buf);
+  emit_NOP(p_buf);
+  emit_EXIT(p_buf);
+
+  /* Create a block split at $1002 the usual way. */
+  state_6502_set_pc(s_p_state_6502, 0x1000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  state_6502_set_pc(s_p_state_6502, 0x1002);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  state_6502_set_pc(s_p_state_6502, 0x1000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(2, s_p_jit->counter_cache_misses);
+  test_expect_u32(1, s_p_jit->counter_cache_hits);
+
+  /* After a wipe, as per a hard reset, the first compile should pick up the
+   * cached block split and preload the block at $1002.
+   */
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1000, 0x100);
+  state_6502_set_pc(s_p_state_6502, 0x1000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(2, s_p_jit->counter_cache_hits);
+
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1000);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1001);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1002);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  /* Changed code must not pick up the cached decisions. */
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1000, 0x100);
+  s_p_mem[0x1001] = 0xE8; /* INX */
+  state_6502_set_pc(s_p_state_6502, 0x1000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(1, s_p_jit->counter_cache_stale);
+
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1000);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1002);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  jit_cache_destroy(s_p_jit->p_cache);
+  s_p_jit->p_cache = NULL;
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_bcd_run(struct cpu_driver* p_cpu_driver,
+                 uint16_t addr,
+                 uint8_t operand,
+                 int carry) {
+  s_p_mem[0x70] = operand;
+  s_p_mem[0x72] = ((1 << k_flag_decimal) | (1 << k_flag_interrupt) | carry);
+  state_6502_set_pc(s_p_state_6502, addr);
+  /* Either the JIT, or the interpreter it bounces to, which exits the same
+   * way.
+   */
+  (void) p_cpu_driver->p_funcs->enter(p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+}
+
+static void
+jit_test_bcd_all(struct util_buffer* p_buf, int is_sbc) {
+  uint32_t operand;
+  uint32_t carry;
+  uint32_t i;
+  uint64_t num_faults;
+  uint8_t a_interp[256];
+  uint8_t flags_interp[256];
+
+  struct cpu_driver* p_interp_driver = (struct cpu_driver*) s_p_interp;
+  uint8_t flags_mask = ((1 << k_flag_negative) |
+                        (1 << k_flag_overflow) |
+                        (1 << k_flag_zero) |
+                        (1 << k_flag_carry));
+  uint16_t addr = (is_sbc ? 0x1380 : 0x1340);
+
+  /* For every A value: load the flags, then ADC / SBC the operand and store
+   * the result and flags in tables indexed by A.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + addr), 0x40);
+  emit_LDX(p_buf, k_imm, 0x00);
+  emit_LDA(p_buf, k_zpg, 0x72);
+  emit_PHA(p_buf);
+  emit_PLP(p_buf);
+  emit_TXA(p_buf);
+  if (is_sbc) {
+    emit_SBC(p_buf, k_zpg, 0x70);
+  } else {
+    emit_ADC(p_buf, k_zpg, 0x70);
+  }
+  emit_STA(p_buf, k_abx, 0x1A00);
+  emit_PHP(p_buf);
+  emit_PLA(p_buf);
+  emit_STA(p_buf, k_abx, 0x1B00);
+  emit_INX(p_buf);
+  emit_BNE(p_buf, -18);
+  emit_CLD(p_buf);
+  emit_EXIT(p_buf);
+
+  /* The interpreter is the reference, including the NMOS N / V / Z quirks
+   * for invalid BCD digits. Only the first JIT run faults, to recompile with
+   * the native BCD code.
+   */
+  num_faults = 0;
+  for (carry = 0; carry < 2; ++carry) {
+    for (operand = 0; operand < 256; ++operand) {
+      jit_test_bcd_run(p_interp_driver, addr, operand, carry);
+      (void) memcpy(a_interp, (s_p_mem + 0x1A00), 256);
+      (void) memcpy(flags_interp, (s_p_mem + 0x1B00), 256);
+      (void) memset((s_p_mem + 0x1A00), '\0', 0x200);
+
+      jit_test_bcd_run(s_p_cpu_driver, addr, operand, carry);
+      if ((carry == 0) && (operand == 0)) {
+        num_faults = s_p_jit->counter_num_faults;
+      }
+      for (i = 0; i < 256; ++i) {
+        test_expect_u32(a_interp[i], s_p_mem[0x1A00 + i]);
+        test_expect_u32((flags_interp[i] & flags_mask),
+                        (s_p_mem[0x1B00 + i] & flags_mask));
+      }
+    }
+  }
+  test_expect_u32(num_faults, s_p_jit->counter_num_faults);
+}
+
+static void
+jit_test_bcd(struct bbc_struct* p_bbc) {
+  uint64_t num_faults;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x1300), 0x10);
+  emit_SED(p_buf);
+  emit_CLC(p_buf);
+  emit_ADC(p_buf, k_imm, 0x19);
+  emit_CLD(p_buf);
+  emit_EXIT(p_buf);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1310), 0x10);
+  emit_SED(p_buf);
+  emit_SEC(p_buf);
+  emit_SBC(p_buf, k_imm, 0x09);
+  emit_CLD(p_buf);
+  emit_EXIT(p_buf);
+
+  /* The first decimal mode ADC faults, which recompiles the block with the
+   * native BCD code. That code must then run without faulting.
+   */
+  num_faults = s_p_jit->counter_num_faults;
+  state_6502_set_a(s_p_state_6502, 0x28);
+  state_6502_set_pc(s_p_state_6502, 0x1300);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x47, s_p_state_6502->reg_a);
+  test_expect_u32((num_faults + 1), s_p_jit->counter_num_faults);
+
+  state_6502_set_a(s_p_state_6502, 0x28);
+  state_6502_set_pc(s_p_state_6502, 0x1300);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x47, s_p_state_6502->reg_a);
+  test_expect_u32((num_faults + 1), s_p_jit->counter_num_faults);
+
+  /* Same for SBC. */
+  state_6502_set_a(s_p_state_6502, 0x50);
+  state_6502_set_pc(s_p_state_6502, 0x1310);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x41, s_p_state_6502->reg_a);
+  test_expect_u32((num_faults + 2), s_p_jit->counter_num_faults);
+
+  state_6502_set_a(s_p_state_6502, 0x50);
+  state_6502_set_pc(s_p_state_6502, 0x1310);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x41, s_p_state_6502->reg_a);
+  test_expect_u32((num_faults + 2), s_p_jit->counter_num_faults);
+
+  /* All A, operand and carry in values, against the interpreter. That runs
+   * for many frames, so rendering is stopped first: a paint sends a message
+   * to the UI, which doesn't exist under test.
+   */
+  video_testing_stop_rendering(bbc_get_video(p_bbc));
+  jit_test_bcd_all(p_buf, 0);
+  jit_test_bcd_all(p_buf, 1);
+
+  util_buffer_destroy(p_buf);
+}
+
+static uint32_t s_idle_timer_ids[2];
+
+static void
+jit_test_idle_loop_timer_fired(void* p) {
+  uint32_t index = (uint32_t) (size_t) p;
+
+  s_p_mem[0x70 + index] = 1;
+  (void) timing_stop_timer(s_p_cpu_driver->p_timing, s_idle_timer_ids[index]);
+}
+
+static uint8_t
+jit_test_idle_loop_run(int idle_loops) {
+  struct timing_struct* p_timing = s_p_cpu_driver->p_timing;
+  uint64_t num_idle_loops = jit_compiler_get_num_idle_loops(s_p_compiler);
+
+  jit_compiler_testing_set_idle_loops(s_p_compiler, idle_loops);
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1400, 0x10);
+  s_p_mem[0x70] = 0;
+  s_p_mem[0x71] = 0;
+  (void) timing_start_timer_with_value(p_timing, s_idle_timer_ids[0], 1000);
+  (void) timing_start_timer_with_value(p_timing, s_idle_timer_ids[1], 2001);
+
+  state_6502_set_x(s_p_state_6502, 0);
+  state_6502_set_pc(s_p_state_6502, 0x1400);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(1, s_p_state_6502->reg_a);
+  /* Only the first loop is fast forwarded. */
+  test_expect_u32((num_idle_loops + !!idle_loops),
+                  jit_compiler_get_num_idle_loops(s_p_compiler));
+
+  return s_p_state_6502->reg_x;
+}
+
+static void
+jit_test_idle_loop() {
+  uint8_t count_idle;
+  uint8_t count_no_idle;
+
+  struct timing_struct* p_timing = s_p_cpu_driver->p_timing;
+  struct util_buffer* p_buf = util_buffer_create();
+
+  s_idle_timer_ids[0] = timing_register_timer(p_timing,
+                                              jit_test_idle_loop_timer_fired,
+                                              (void*) 0);
+  s_idle_timer_ids[1] = timing_register_timer(p_timing,
+                                              jit_test_idle_loop_timer_fired,
+                                              (void*) 1);
+
+  /* A polling loop that is fast forwarded, then a counting loop that isn't.
+   * The count depends on exactly when the first loop exits, so it must match
+   * running the first loop the long way.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1400), 0x10);
+  emit_SEI(p_buf);
+  emit_LDA(p_buf, k_zpg, 0x70);
+  emit_BEQ(p_buf, -4);
+  emit_INX(p_buf);
+  emit_LDA(p_buf, k_zpg, 0x71);
+  emit_BEQ(p_buf, -5);
+  emit_EXIT(p_buf);
+
+  count_idle = jit_test_idle_loop_run(1);
+  count_no_idle = jit_test_idle_loop_run(0);
+  test_expect_u32(1, (count_idle > 0));
+  test_expect_u32(count_no_idle, count_idle);
+
+  jit_compiler_testing_set_idle_loops(s_p_compiler, 1);
+
+  util_buffer_destroy(p_buf);
+}
+
+static uint64_t
+jit_test_idle_loop_via_run(int idle_loops) {
+  uint64_t num_hw_idle_loops = s_p_jit->counter_num_hw_idle_loops;
+
+  jit_compiler_testing_set_idle_loops(s_p_compiler, idle_loops);
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1420, 0x20);
+
+  state_6502_set_pc(s_p_state_6502, 0x1420);
+  state_6502_set_cycles(s_p_state_6502, 0);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(!!idle_loops,
+                  (s_p_jit->counter_num_hw_idle_loops > num_hw_idle_loops));
+
+  return state_6502_get_cycles(s_p_state_6502);
+}
+
+static void
+jit_test_idle_loop_via() {
+  uint64_t cycles_idle;
+  uint64_t cycles_no_idle;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* A loop polling the system VIA IFR for T1, which is fast forwarded from
+   * the register read. It must exit on the same cycle as running it the long
+   * way, so the skipped iterations must be charged the 1MHz stretched cost.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1420), 0x20);
+  emit_SEI(p_buf);
+  emit_LDA(p_buf, k_imm, 0x7F);
+  emit_STA(p_buf, k_abs, 0xFE4E);
+  emit_STA(p_buf, k_abs, 0xFE4D);
+  emit_LDA(p_buf, k_imm, 0x00);
+  emit_STA(p_buf, k_abs, 0xFE4B);
+  emit_STA(p_buf, k_abs, 0xFE44);
+  emit_LDA(p_buf, k_imm, 0x08);
+  emit_STA(p_buf, k_abs, 0xFE45);
+  emit_LDA(p_buf, k_imm, 0x40);
+  emit_BIT(p_buf, k_abs, 0xFE4D);
+  emit_BEQ(p_buf, -5);
+  emit_EXIT(p_buf);
+
+  cycles_idle = jit_test_idle_loop_via_run(1);
+  cycles_no_idle = jit_test_idle_loop_via_run(0);
+  test_expect_u32(1, (cycles_idle > 0x1000));
+  test_expect_u32(cycles_no_idle, cycles_idle);
+
+  jit_compiler_testing_set_idle_loops(s_p_compiler, 1);
+
+  util_buffer_destroy(p_buf);
+}
+
+static uint8_t
+jit_test_hw_read_run(int hw_read) {
+  jit_compiler_testing_set_hw_read(s_p_compiler, hw_read);
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1500, 0x20);
+
+  s_p_mem[0x70] = 0;
+  s_p_mem[0x71] = 0;
+  state_6502_set_pc(s_p_state_6502, 0x1500);
+  state_6502_set_cycles(s_p_state_6502, 0);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  test_expect_u32(0x5A, s_p_mem[0x70]);
+  test_expect_u32(1, !!(s_p_mem[0x71] & (1 << k_flag_zero)));
+  test_expect_u32(1, !!(s_p_mem[0x71] & (1 << k_flag_carry)));
+
+  /* Timer ticks between the two T1CL reads. */
+  return (s_p_mem[0x72] - s_p_mem[0x73]);
+}
+
+static void
+jit_test_hw_read() {
+  uint64_t num_hw_reads;
+  uint8_t ticks_hw_read;
+  uint8_t ticks_interp;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* Register reads handled directly must match the interpreter, including
+   * the 1MHz cycle stretching. Results go via memory because the interpreter
+   * doesn't write back registers on EXIT.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1500), 0x20);
+  emit_LDA(p_buf, k_imm, 0x5A);
+  emit_STA(p_buf, k_abs, 0xFE43);
+  emit_LDX(p_buf, k_abs, 0xFE44);
+  emit_STX(p_buf, k_zpg, 0x72);
+  emit_LDY(p_buf, k_abs, 0xFE44);
+  emit_STY(p_buf, k_zpg, 0x73);
+  emit_LDA(p_buf, k_imm, 0x00);
+  emit_LDX(p_buf, k_abs, 0xFE43);
+  emit_CPX(p_buf, k_abs, 0xFE43);
+  emit_STX(p_buf, k_zpg, 0x70);
+  emit_PHP(p_buf);
+  emit_PLA(p_buf);
+  emit_STA(p_buf, k_zpg, 0x71);
+  emit_EXIT(p_buf);
+
+  num_hw_reads = s_p_jit->counter_num_hw_reads;
+  ticks_hw_read = jit_test_hw_read_run(1);
+  test_expect_u32(1, (s_p_jit->counter_num_hw_reads > num_hw_reads));
+
+  num_hw_reads = s_p_jit->counter_num_hw_reads;
+  ticks_interp = jit_test_hw_read_run(0);
+  test_expect_u32(num_hw_reads, s_p_jit->counter_num_hw_reads);
+  test_expect_u32(ticks_interp, ticks_hw_read);
+
+  jit_compiler_testing_set_hw_read(s_p_compiler, 1);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_zp_cache_run(int zp_cache) {
+  struct timing_struct* p_timing = s_p_cpu_driver->p_timing;
+
+  jit_compiler_testing_set_zp_cache(s_p_compiler, zp_cache);
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x1600, 0x10);
+  s_p_mem[0x1607] = 0xEA;
+
+  s_p_mem[0x70] = 0x40;
+  s_p_mem[0x71] = 0;
+  /* Start just after a timer so the block isn't bounced to the interpreter
+   * by its countdown check.
+   */
+  (void) timing_advance_time(p_timing, 0);
+  state_6502_set_pc(s_p_state_6502, 0x1600);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  test_expect_u32(0x42, s_p_mem[0x70]);
+  test_expect_u32(0x42, s_p_mem[0x71]);
+}
+
+static void
+jit_test_zp_cache() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  jit_compiler_testing_set_optimizing(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 16);
+
+  /* The block caches $70 in a register. The self-modifying store invalidates
+   * the code part way through, while the first INC is only in the register,
+   * so it must be written back before the new block reads $70.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1600), 0x10);
+  emit_INC(p_buf, k_zpg, 0x70);
+  emit_LDA(p_buf, k_imm, 0xE8);
+  emit_STA(p_buf, k_abs, 0x1607);
+  emit_NOP(p_buf);
+  emit_INC(p_buf, k_zpg, 0x70);
+  emit_LDA(p_buf, k_zpg, 0x70);
+  emit_STA(p_buf, k_zpg, 0x71);
+  emit_EXIT(p_buf);
+
+  jit_test_zp_cache_run(1);
+  jit_test_zp_cache_run(0);
+
+  jit_compiler_testing_set_zp_cache(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 4);
+  jit_compiler_testing_set_optimizing(s_p_compiler, 0);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_bank_keep_run(uint8_t expect) {
+  s_p_mem[0x70] = 0;
+  state_6502_set_pc(s_p_state_6502, 0x8000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(expect, s_p_mem[0x70]);
+}
+
+static void
+jit_test_bank_keep(struct bbc_struct* p_bbc) {
+  uint8_t* p_host_address;
+  uint64_t blocks_kept;
+  uint8_t* p_rom_1_save = util_malloc(k_bbc_rom_size);
+  uint8_t* p_rom_2_save = util_malloc(k_bbc_rom_size);
+  uint8_t* p_rom = util_mallocz(k_bbc_rom_size);
+  uint8_t romsel = bbc_get_romsel(p_bbc);
+  struct util_buffer* p_buf = util_buffer_create();
+
+  bbc_save_rom(p_bbc, 1, p_rom_1_save);
+  bbc_save_rom(p_bbc, 2, p_rom_2_save);
+
+  util_buffer_setup(p_buf, p_rom, 0x10);
+  emit_LDA(p_buf, k_imm, 0x01);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_EXIT(p_buf);
+  bbc_load_rom(p_bbc, 1, p_rom);
+  p_rom[1] = 0x02;
+  bbc_load_rom(p_bbc, 2, p_rom);
+
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x8000);
+
+  bbc_sideways_select(p_bbc, 1);
+  jit_test_bank_keep_run(0x01);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  /* Bank 2 has nothing compiled yet. */
+  bbc_sideways_select(p_bbc, 2);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  jit_test_bank_keep_run(0x02);
+
+  /* Back to bank 1: its code comes back without a compile. */
+  blocks_kept = s_p_jit->counter_bank_blocks_kept;
+  bbc_sideways_select(p_bbc, 1);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  test_expect_u32(1, (s_p_jit->counter_bank_blocks_kept - blocks_kept));
+  jit_test_bank_keep_run(0x01);
+
+  /* Bank 2 changes while paged out, so its code must not come back. */
+  p_rom[1] = 0x03;
+  bbc_load_rom(p_bbc, 2, p_rom);
+  bbc_sideways_select(p_bbc, 2);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  jit_test_bank_keep_run(0x03);
+
+  bbc_load_rom(p_bbc, 1, p_rom_1_save);
+  bbc_load_rom(p_bbc, 2, p_rom_2_save);
+  bbc_sideways_select(p_bbc, romsel);
+
+  util_buffer_destroy(p_buf);
+  util_free(p_rom);
+  util_free(p_rom_2_save);
+  util_free(p_rom_1_save);
+}
+
+static void
+jit_test_code_pages_run(uint16_t addr_6502) {
+  state_6502_set_pc(s_p_state_6502, addr_6502);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+}
+
+static void
+jit_test_code_pages() {
+  uint8_t* p_host_address_1700 = jit_get_jit_block_host_address(s_p_jit,
+                                                                0x1700);
+  uint8_t* p_host_address_1800 = jit_get_jit_block_host_address(s_p_jit,
+                                                                0x1800);
+  struct util_buffer* p_buf = util_buffer_create();
+
+  test_expect_u32(0, jit_compiler_get_code_pages(s_p_compiler));
+
+  /* A zero page writer and a stack pusher, both unguarded for now. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1700), 0x10);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_PHA(p_buf);
+  emit_PLA(p_buf);
+  emit_EXIT(p_buf);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1800), 0x10);
+  emit_LDA(p_buf, k_imm, 0x01);
+  emit_EXIT(p_buf);
+  jit_test_code_pages_run(0x1700);
+  jit_test_code_pages_run(0x1800);
+
+  /* Code in zero page only throws away the blocks that write zero page. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x90), 0x10);
+  emit_LDA(p_buf, k_imm, 0x07);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_EXIT(p_buf);
+  jit_test_code_pages_run(0x90);
+  test_expect_u32(0x07, s_p_mem[0x70]);
+  test_expect_u32(k_jit_compiler_code_page_zero,
+                  jit_compiler_get_code_pages(s_p_compiler));
+  test_expect_u32(1,
+                  jit_is_host_address_invalidated(s_p_jit,
+                                                  p_host_address_1700));
+  test_expect_u32(0,
+                  jit_is_host_address_invalidated(s_p_jit,
+                                                  p_host_address_1800));
+
+  /* Zero page writes now invalidate the zero page code. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1900), 0x10);
+  emit_LDA(p_buf, k_imm, 0x08);
+  emit_STA(p_buf, k_zpg, 0x91);
+  emit_EXIT(p_buf);
+  jit_test_code_pages_run(0x1900);
+  jit_test_code_pages_run(0x90);
+  test_expect_u32(0x08, s_p_mem[0x70]);
+
+  /* Same for the stack page, where pushes are the writes to watch. */
+  jit_test_code_pages_run(0x1700);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1C0), 0x10);
+  emit_LDA(p_buf, k_imm, 0x09);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_EXIT(p_buf);
+  jit_test_code_pages_run(0x1C0);
+  test_expect_u32(0x09, s_p_mem[0x70]);
+  test_expect_u32(1,
+                  jit_is_host_address_invalidated(s_p_jit,
+                                                  p_host_address_1700));
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x1A00), 0x20);
+  emit_TSX(p_buf);
+  emit_STX(p_buf, k_zpg, 0x72);
+  emit_LDX(p_buf, k_imm, 0xC1);
+  emit_TXS(p_buf);
+  emit_LDA(p_buf, k_imm, 0x0A);
+  emit_PHA(p_buf);
+  emit_LDX(p_buf, k_zpg, 0x72);
+  emit_TXS(p_buf);
+  emit_EXIT(p_buf);
+  jit_test_code_pages_run(0x1A00);
+  jit_test_code_pages_run(0x1C0);
+  test_expect_u32(0x0A, s_p_mem[0x70]);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_default() {
+  uint32_t i;
+  uint64_t num_faults;
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* An indirect read of &F000 faults, until it has faulted enough times to
+   * get recompiled with an explicit check.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1D00), 0x10);
+  emit_LDY(p_buf, k_imm, 0x00);
+  emit_LDA(p_buf, k_idy, 0x74);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_EXIT(p_buf);
+  s_p_mem[0x74] = 0x00;
+  s_p_mem[0x75] = 0xF0;
+  s_p_mem[0x300] = 0x5A;
+
+  for (i = 0; i < (k_jit_default_faults + 2); ++i) {
+    s_p_mem[0x70] = (s_p_mem[0xF000] + 1);
+    jit_test_code_pages_run(0x1D00);
+    test_expect_u32(s_p_mem[0xF000], s_p_mem[0x70]);
+  }
+  test_expect_u32(1, s_p_jit->counter_num_defaults);
+
+  num_faults = s_p_jit->counter_num_faults;
+  jit_test_code_pages_run(0x1D00);
+  test_expect_u32(s_p_mem[0xF000], s_p_mem[0x70]);
+  test_expect_u32(0, (s_p_jit->counter_num_faults - num_faults));
+
+  /* The check still lets RAM accesses through. */
+  s_p_mem[0x75] = 0x03;
+  jit_test_code_pages_run(0x1D00);
+  test_expect_u32(0x5A, s_p_mem[0x70]);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_spec_compile() {
+  uint8_t* p_host_address;
+  uint64_t num_prep_opcodes;
+
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* No helper thread, so the seeds are scanned synchronously. */
+  s_p_jit->p_scanner = jit_scanner_create(s_p_mem, s_p_compiler);
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x1E00), 0x10);
+  emit_JSR(p_buf, 0x1E80);
+  emit_EXIT(p_buf);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1E80), 0x10);
+  emit_RTS(p_buf);
+
+  /* The JSR target is compiled ahead, from the opcodes the scanner decoded.
+   * The return point might be inline data, so it is only held, decoded.
+   */
+  jit_scanner_add_seed(s_p_jit->p_scanner, 0x1E00);
+  jit_scanner_scan_pending(s_p_jit->p_scanner);
+  test_expect_u32(2, jit_scanner_get_num_candidates(s_p_jit->p_scanner));
+  num_prep_opcodes = jit_compiler_get_num_prep_opcodes(s_p_compiler);
+  jit_spec_compile(s_p_jit);
+  test_expect_u32(1, s_p_jit->counter_spec_compiles);
+  test_expect_u32((num_prep_opcodes + 1),
+                  jit_compiler_get_num_prep_opcodes(s_p_compiler));
+
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1E00);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1E03);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x1E80);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+
+  /* Running it compiles the seed, then the return point when it is reached,
+   * from the held opcodes. The seed scans to blocks that already have code,
+   * so there's nothing more to do.
+   */
+  state_6502_set_pc(s_p_state_6502, 0x1E00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(1, s_p_jit->counter_spec_held_hits);
+  test_expect_u32((num_prep_opcodes + 2),
+                  jit_compiler_get_num_prep_opcodes(s_p_compiler));
+  jit_scanner_scan_pending(s_p_jit->p_scanner);
+  jit_spec_compile(s_p_jit);
+  test_expect_u32(1, s_p_jit->counter_spec_compiles);
+
+  /* Code rewritten after it was decoded is decoded again. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1F00), 0x10);
+  emit_JMP(p_buf, k_abs, 0x1F80);
+  util_buffer_setup(p_buf, (s_p_mem + 0x1F80), 0x10);
+  emit_LDA(p_buf, k_imm, 0x01);
+  emit_EXIT(p_buf);
+  jit_scanner_add_seed(s_p_jit->p_scanner, 0x1F00);
+  jit_scanner_scan_pending(s_p_jit->p_scanner);
+  s_p_mem[0x1F81] = 0x02;
+  num_prep_opcodes = jit_compiler_get_num_prep_opcodes(s_p_compiler);
+  jit_spec_compile(s_p_jit);
+  test_expect_u32(2, s_p_jit->counter_spec_compiles);
+  test_expect_u32(num_prep_opcodes,
+                  jit_compiler_get_num_prep_opcodes(s_p_compiler));
+  state_6502_set_pc(s_p_state_6502, 0x1F80);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x02, s_p_state_6502->reg_a);
+
+  jit_scanner_destroy(s_p_jit->p_scanner);
+  s_p_jit->p_scanner = NULL;
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_tier() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  jit_tier_setup(s_p_jit, 2);
+
+  /* The loop body goes hot and is compiled. The code before it stays in the
+   * cold tier.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1F00), 0x10);
+  emit_LDX(p_buf, k_imm, 0x05);
+  emit_DEX(p_buf);
+  emit_BNE(p_buf, -3);
+  emit_EXIT(p_buf);
+  state_6502_set_pc(s_p_state_6502, 0x1F00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  test_expect_u32(0, (s_p_state_6502->reg_x & 0xFF));
+  test_expect_u32(1, s_p_jit->counter_tier_promotes);
+  test_expect_u32(0, jit_has_6502_code(s_p_jit, 0x1F00));
+  test_expect_u32(1, jit_has_6502_code(s_p_jit, 0x1F02));
+
+  jit_tier_destroy(s_p_jit);
+  /* Don't leave the stub behind. */
+  jit_invalidate_block_address(s_p_jit, 0x1F00);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_entry_state() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  jit_compiler_testing_set_optimizing(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 16);
+
+  /* The only jump into $2010 knows X, so that block is compiled for it. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2000), 0x10);
+  emit_LDX(p_buf, k_imm, 0x05);
+  emit_JMP(p_buf, k_abs, 0x2010);
+  util_buffer_setup(p_buf, (s_p_mem + 0x2010), 0x10);
+  emit_TXA(p_buf);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_EXIT(p_buf);
+
+  state_6502_set_pc(s_p_state_6502, 0x2000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x05, s_p_mem[0x70]);
+  test_expect_u32(0x05,
+                  jit_compiler_get_entry_guard(s_p_compiler,
+                                               0x2010,
+                                               k_jit_entry_x));
+  test_expect_u32(0, s_p_jit->counter_entry_misses);
+
+  /* Arriving with another X fails the guard, and the block goes generic. */
+  state_6502_set_x(s_p_state_6502, 0x07);
+  state_6502_set_pc(s_p_state_6502, 0x2010);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x07, s_p_mem[0x70]);
+  test_expect_u32(1, s_p_jit->counter_entry_misses);
+  test_expect_u32((uint32_t) -1,
+                  jit_compiler_get_entry_guard(s_p_compiler,
+                                               0x2010,
+                                               k_jit_entry_x));
+
+  state_6502_set_x(s_p_state_6502, 0x09);
+  state_6502_set_pc(s_p_state_6502, 0x2010);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x09, s_p_mem[0x70]);
+  test_expect_u32(1, jit_has_6502_code(s_p_jit, 0x2010));
+  test_expect_u32((uint32_t) -1,
+                  jit_compiler_get_entry_guard(s_p_compiler,
+                                               0x2010,
+                                               k_jit_entry_x));
+
+  state_6502_set_pc(s_p_state_6502, 0x2000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x05, s_p_mem[0x70]);
+  test_expect_u32(1, s_p_jit->counter_entry_misses);
+
+  jit_compiler_testing_set_max_ops(s_p_compiler, 4);
+  jit_compiler_testing_set_optimizing(s_p_compiler, 0);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_interp_loop_head() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  jit_compiler_testing_set_optimizing(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 16);
+
+  /* The loop at $2115 doesn't go round on the first run, so it is compiled
+   * into the middle of the $2110 block, which is compiled for X = 5.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2100), 0x10);
+  emit_LDX(p_buf, k_imm, 0x05);
+  emit_JMP(p_buf, k_abs, 0x2110);
+  util_buffer_setup(p_buf, (s_p_mem + 0x2110), 0x10);
+  emit_TXA(p_buf);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_LDY(p_buf, k_zpg, 0x72);
+  emit_INC(p_buf, k_zpg, 0x73);
+  emit_DEY(p_buf);
+  emit_BNE(p_buf, -5);
+  emit_EXIT(p_buf);
+
+  s_p_mem[0x72] = 1;
+  s_p_mem[0x73] = 0;
+  state_6502_set_pc(s_p_state_6502, 0x2100);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(1, s_p_mem[0x73]);
+  test_expect_u32(0x2110, jit_6502_block_addr_from_6502(s_p_jit, 0x2115));
+
+  /* The entry state miss runs the block in the interpreter. Its taken
+   * backward branch hands back to the JIT, which splits the block at the
+   * loop head, rather than interpreting the whole loop.
+   */
+  s_p_mem[0x72] = 3;
+  s_p_mem[0x73] = 0;
+  state_6502_set_x(s_p_state_6502, 0x07);
+  state_6502_set_pc(s_p_state_6502, 0x2110);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x07, s_p_mem[0x70]);
+  test_expect_u32(3, s_p_mem[0x73]);
+  test_expect_u32(0x2115, jit_6502_block_addr_from_6502(s_p_jit, 0x2115));
+
+  jit_compiler_testing_set_max_ops(s_p_compiler, 4);
+  jit_compiler_testing_set_optimizing(s_p_compiler, 0);
+
+  util_buffer_destroy(p_buf);
+}
+
+static const uint8_t s_fusion_inputs[16] = {
+  0x81, 0x40, 0x01, 0x00, 0x00, 0x00, 0xC1, 0x7F,
+  0x80, 0x3F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static void
+jit_test_fusion_run(uint16_t addr, int fusing, uint8_t* p_result) {
+  struct timing_struct* p_timing = s_p_cpu_driver->p_timing;
+
+  jit_compiler_testing_set_fusing(s_p_compiler, fusing);
+  jit_memory_range_invalidate(s_p_cpu_driver, addr, 0x20);
+  (void) memcpy((s_p_mem + 0x60), s_fusion_inputs, sizeof(s_fusion_inputs));
+  (void) memset((s_p_mem + 0x70), '\0', 0x10);
+
+  /* Start just after a timer so the block isn't bounced to the interpreter
+   * by its countdown check.
+   */
+  (void) timing_advance_time(p_timing, 0);
+  state_6502_set_a(s_p_state_6502, 0x55);
+  state_6502_set_pc(s_p_state_6502, addr);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  (void) memcpy(p_result, (s_p_mem + 0x60), 0x20);
+}
+
+static void
+jit_test_fusion_check(struct util_buffer* p_buf, uint16_t addr, int kind) {
+  uint8_t fused[0x20];
+  uint8_t unfused[0x20];
+  uint64_t count;
+  uint32_t i;
+
+  /* Stash A and the flags after the sequence. */
+  emit_STA(p_buf, k_zpg, 0x7E);
+  emit_PHP(p_buf);
+  emit_PLA(p_buf);
+  emit_STA(p_buf, k_zpg, 0x7F);
+  emit_EXIT(p_buf);
+
+  count = jit_compiler_get_fusion_count(s_p_compiler, kind);
+  jit_test_fusion_run(addr, 1, &fused[0]);
+  test_expect_u32((count + 1),
+                  jit_compiler_get_fusion_count(s_p_compiler, kind));
+
+  count = jit_compiler_get_fusion_count(s_p_compiler, kind);
+  jit_test_fusion_run(addr, 0, &unfused[0]);
+  test_expect_u32(count, jit_compiler_get_fusion_count(s_p_compiler, kind));
+
+  for (i = 0; i < 0x20; ++i) {
+    test_expect_u32(unfused[i], fused[i]);
+  }
+}
+
+static void
+jit_test_fusion() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  jit_compiler_testing_set_optimizing(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 32);
+
+  /* Each fused sequence must leave memory, A and the flags exactly as the
+   * separate opcodes do. The inputs are at $60 - $6F and results go from $70.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2300), 0x20);
+  emit_ASL(p_buf, k_zpg, 0x60);
+  emit_ROL(p_buf, k_zpg, 0x61);
+  jit_test_fusion_check(p_buf, 0x2300, k_jit_fusion_shift);
+
+  /* Shifts out to zero, so Z is from the last byte only. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2320), 0x20);
+  emit_LSR(p_buf, k_zpg, 0x65);
+  emit_ROR(p_buf, k_zpg, 0x64);
+  emit_ROR(p_buf, k_zpg, 0x63);
+  emit_ROR(p_buf, k_zpg, 0x62);
+  jit_test_fusion_check(p_buf, 0x2320, k_jit_fusion_shift);
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x2340), 0x20);
+  emit_SEC(p_buf);
+  emit_ROL(p_buf, k_zpg, 0x66);
+  emit_ROL(p_buf, k_zpg, 0x67);
+  jit_test_fusion_check(p_buf, 0x2340, k_jit_fusion_shift);
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x2360), 0x20);
+  emit_SEC(p_buf);
+  emit_ROR(p_buf, k_zpg, 0x6B);
+  emit_ROR(p_buf, k_zpg, 0x6A);
+  emit_ROR(p_buf, k_zpg, 0x69);
+  emit_ROR(p_buf, k_zpg, 0x68);
+  jit_test_fusion_check(p_buf, 0x2360, k_jit_fusion_shift);
+
+  /* Copies up and down. A and N / Z are from the last byte loaded. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2380), 0x20);
+  emit_LDA(p_buf, k_zpg, 0x60);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_LDA(p_buf, k_zpg, 0x61);
+  emit_STA(p_buf, k_zpg, 0x71);
+  jit_test_fusion_check(p_buf, 0x2380, k_jit_fusion_copy);
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x23A0), 0x20);
+  emit_LDA(p_buf, k_zpg, 0x67);
+  emit_STA(p_buf, k_zpg, 0x77);
+  emit_LDA(p_buf, k_zpg, 0x66);
+  emit_STA(p_buf, k_zpg, 0x76);
+  emit_LDA(p_buf, k_zpg, 0x65);
+  emit_STA(p_buf, k_zpg, 0x75);
+  emit_LDA(p_buf, k_zpg, 0x64);
+  emit_STA(p_buf, k_zpg, 0x74);
+  jit_test_fusion_check(p_buf, 0x23A0, k_jit_fusion_copy);
+
+  /* A 16-bit add that overflows into N and V. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x23C0), 0x20);
+  emit_CLD(p_buf);
+  emit_CLC(p_buf);
+  emit_LDA(p_buf, k_zpg, 0x60);
+  emit_ADC(p_buf, k_zpg, 0x68);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_LDA(p_buf, k_zpg, 0x61);
+  emit_ADC(p_buf, k_zpg, 0x69);
+  emit_STA(p_buf, k_zpg, 0x71);
+  jit_test_fusion_check(p_buf, 0x23C0, k_jit_fusion_add);
+
+  /* A 32-bit add with carry in, where only the top byte is zero, which the
+   * wide Z flag would get wrong.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2400), 0x40);
+  emit_CLD(p_buf);
+  emit_SEC(p_buf);
+  emit_LDA(p_buf, k_zpg, 0x62);
+  emit_ADC(p_buf, k_zpg, 0x6A);
+  emit_STA(p_buf, k_zpg, 0x72);
+  emit_LDA(p_buf, k_zpg, 0x63);
+  emit_ADC(p_buf, k_zpg, 0x6B);
+  emit_STA(p_buf, k_zpg, 0x73);
+  emit_LDA(p_buf, k_zpg, 0x64);
+  emit_ADC(p_buf, k_zpg, 0x6C);
+  emit_STA(p_buf, k_zpg, 0x74);
+  emit_LDA(p_buf, k_zpg, 0x65);
+  emit_ADC(p_buf, k_zpg, 0x6D);
+  emit_STA(p_buf, k_zpg, 0x75);
+  jit_test_fusion_check(p_buf, 0x2400, k_jit_fusion_add);
+
+  jit_compiler_testing_set_fusing(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 4);
+  jit_compiler_testing_set_optimizing(s_p_compiler, 0);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_arena_run(uint16_t addr, uint8_t expect_x) {
+  state_6502_set_x(s_p_state_6502, 0);
+  state_6502_set_pc(s_p_state_6502, addr);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(expect_x, (uint8_t) s_p_state_6502->reg_x);
+}
+
+static void
+jit_test_arena() {
+  uint8_t* p_host_address;
+  uint8_t* p_arena_end;
+  uint64_t num_flushes;
+  uint64_t num_compactions;
+  uint32_t i;
+  struct util_buffer* p_buf;
+
+  /* Only meaningful for a run with -opt jit:arena. */
+  if (s_p_jit->p_arena == NULL) {
+    return;
+  }
+
+  p_buf = util_buffer_create();
+
+  jit_compiler_testing_set_chaining(s_p_compiler, 1);
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x2500), 0x10);
+  emit_INX(p_buf);
+  emit_JMP(p_buf, k_abs, 0x2510);
+  util_buffer_setup(p_buf, (s_p_mem + 0x2510), 0x10);
+  emit_INX(p_buf);
+  emit_EXIT(p_buf);
+
+  /* Chaining goes straight between blocks packed in the arena. */
+  jit_test_arena_run(0x2510, 1);
+  jit_test_arena_run(0x2500, 2);
+  test_expect_u32(0x2510, jit_compiler_get_chain_target(s_p_compiler, 0x2500));
+  jit_test_arena_run(0x2500, 2);
+
+  /* Replacing the target must invalidate the chained source, even though the
+   * source's code lives in the arena and not in its slot.
+   */
+  s_p_mem[0x2511] = 0xE8; /* INX */
+  s_p_mem[0x2512] = 0x02; /* EXIT */
+  jit_memory_range_invalidate(s_p_cpu_driver, 0x2510, 0x10);
+  test_expect_u32(-1, jit_compiler_get_chain_target(s_p_compiler, 0x2500));
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x2500);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  jit_test_arena_run(0x2500, 3);
+
+  /* Self-modifying code hits the write invalidation of arena code. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2520), 0x10);
+  emit_LDA(p_buf, k_imm, 0xE8); /* INX */
+  emit_STA(p_buf, k_abs, 0x2530);
+  emit_JMP(p_buf, k_abs, 0x2530);
+  util_buffer_setup(p_buf, (s_p_mem + 0x2530), 0x10);
+  emit_NOP(p_buf);
+  emit_EXIT(p_buf);
+  jit_test_arena_run(0x2530, 0);
+  jit_test_arena_run(0x2520, 1);
+  jit_test_arena_run(0x2530, 1);
+
+  /* Pretend the arena is nearly full, of mostly dead code, and compile until
+   * it fills. The few live blocks are compacted and stay compiled.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x3000), 0x101);
+  for (i = 0; i < 0x100; ++i) {
+    emit_NOP(p_buf);
+  }
+  emit_EXIT(p_buf);
+  jit_memory_range_invalidate(s_p_cpu_driver, 0, k_6502_addr_space_size);
+  jit_test_arena_run(0x2500, 3);
+  jit_test_arena_run(0x2520, 1);
+  num_flushes = s_p_jit->counter_arena_flushes;
+  num_compactions = s_p_jit->counter_arena_compactions;
+  p_arena_end = s_p_jit->p_arena_end;
+  s_p_jit->p_arena_end = (s_p_jit->p_arena_pos + (k_jit_bytes_per_byte * 4));
+  jit_test_arena_run(0x3000, 0);
+  test_expect_u32(num_flushes, s_p_jit->counter_arena_flushes);
+  test_expect_u32((num_compactions + 1), s_p_jit->counter_arena_compactions);
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x2500);
+  test_expect_u32(0, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  jit_test_arena_run(0x2500, 3);
+  jit_test_arena_run(0x2520, 1);
+
+  /* Now the arena is all live code, so when it fills it is flushed instead. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x3200), 0x101);
+  for (i = 0; i < 0x100; ++i) {
+    emit_NOP(p_buf);
+  }
+  emit_EXIT(p_buf);
+  s_p_jit->p_arena_end = (s_p_jit->p_arena_pos + (k_jit_bytes_per_byte * 4));
+  jit_test_arena_run(0x3200, 0);
+  test_expect_u32((num_compactions + 1), s_p_jit->counter_arena_compactions);
+  test_expect_u32((num_flushes + 1), s_p_jit->counter_arena_flushes);
+  s_p_jit->p_arena_end = p_arena_end;
+
+  /* Everything is recompiled and rechained after the flush. */
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, 0x2500);
+  test_expect_u32(1, jit_is_host_address_invalidated(s_p_jit, p_host_address));
+  jit_test_arena_run(0x2510, 2);
+  jit_test_arena_run(0x2500, 3);
+  test_expect_u32(0x2510, jit_compiler_get_chain_target(s_p_compiler, 0x2500));
+  jit_test_arena_run(0x2520, 1);
+
+  jit_compiler_testing_set_chaining(s_p_compiler, 0);
+
+  util_buffer_destroy(p_buf);
+}
+
 void
 jit_test(struct bbc_struct* p_bbc) {
   jit_test_init(p_bbc);
@@ -332,4 +1556,22 @@ jit_test(struct bbc_struct* p_bbc) {
   jit_test_block_continuation();
   jit_test_invalidation();
   jit_test_dynamic_operand();
+  jit_test_smc_opcode_flip();
+  jit_test_chain();
+  jit_test_cache();
+  jit_test_bcd(p_bbc);
+  jit_test_idle_loop();
+  jit_test_hw_read();
+  jit_test_idle_loop_via();
+  jit_test_zp_cache();
+  /* Before any code in zero page turns fusion off. */
+  jit_test_fusion();
+  jit_test_bank_keep(p_bbc);
+  jit_test_code_pages();
+  jit_test_default();
+  jit_test_spec_compile();
+  jit_test_tier();
+  jit_test_entry_state();
+  jit_test_interp_loop_head();
+  jit_test_arena();
 }
@@ -8,6 +8,9 @@ static uint32_t s_timing_test_order_counter = 0;
 static int32_t s_timing_test_order_t1 = -1;
 static int32_t s_timing_test_order_t2 = -1;
 static int32_t s_timing_test_order_t3 = -1;
+static struct timing_struct* s_p_timing_test_many;
+static uint32_t s_timing_test_many_hits = 0;
+static int64_t s_timing_test_many_last = 0;
 
 static void
 timing_test_stop_timers(void* p) {
@@ -15,10 +18,10 @@ timing_test_stop_timers(void* p) {
 
   struct timing_struct* p_timing = (struct timing_struct*) p;
 
-  for (i = 0; i < k_timing_num_timers; ++i) {
-    struct timer_struct* p_timer = &p_timing->timers[i];
-    if (p_timer->firing && (p_timer->value == 0)) {
-      test_expect_u32(0, timing_get_timer_value(p_timing, i));
+  for (i = 0; i < p_timing->num_timers; ++i) {
+    if (timing_timer_is_running(p_timing, i) &&
+        timing_get_firing(p_timing, i) &&
+        (timing_get_timer_value(p_timing, i) == 0)) {
       (void) timing_stop_timer(p_timing, i);
     }
   }
@@ -88,14 +91,14 @@ timing_test_counting() {
    * advance that didn't update all timer baselines.
    */
   test_expect_u32(98, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
   test_expect_u32(98, timing_get_timer_value(p_timing, t1));
 
   countdown = timing_start_timer_with_value(p_timing, t2, 50);
   test_expect_u32(50, countdown);
   test_expect_u32(50, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
-  test_expect_u32(52, p_timing->timers[1].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
+  test_expect_u32(52, p_timing->p_timers[1].value);
   test_expect_u32(98, timing_get_timer_value(p_timing, t1));
   test_expect_u32(50, timing_get_timer_value(p_timing, t2));
 
@@ -110,14 +113,14 @@ timing_test_counting() {
   countdown = timing_set_timer_value(p_timing, t2, 40);
   test_expect_u32(40, countdown);
   test_expect_u32(40, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
-  test_expect_u32(42, p_timing->timers[1].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
+  test_expect_u32(42, p_timing->p_timers[1].value);
 
   countdown = timing_adjust_timer_value(p_timing, NULL, t2, -10);
   test_expect_u32(30, countdown);
   test_expect_u32(30, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
-  test_expect_u32(32, p_timing->timers[1].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
+  test_expect_u32(32, p_timing->p_timers[1].value);
 
   countdown = timing_set_firing(p_timing, t2, 0);
   test_expect_u32(98, countdown);
@@ -308,14 +311,14 @@ timing_test_scaling() {
 
   /* Peek at the internals to make sure we really have a scaled timer. */
   test_expect_u32(299, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
   test_expect_u32(99, timing_get_timer_value(p_timing, t1));
 
   countdown = timing_start_timer_with_value(p_timing, t2, 50);
   test_expect_u32(150, countdown);
   test_expect_u32(150, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
-  test_expect_u32(151, p_timing->timers[1].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
+  test_expect_u32(151, p_timing->p_timers[1].value);
   test_expect_u32(99, timing_get_timer_value(p_timing, t1));
   test_expect_u32(50, timing_get_timer_value(p_timing, t2));
 
@@ -331,14 +334,14 @@ timing_test_scaling() {
   test_expect_u32(40, timing_get_timer_value(p_timing, t2));
   test_expect_u32(120, countdown);
   test_expect_u32(120, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
-  test_expect_u32(121, p_timing->timers[1].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
+  test_expect_u32(121, p_timing->p_timers[1].value);
 
   countdown = timing_adjust_timer_value(p_timing, NULL, t2, -10);
   test_expect_u32(90, countdown);
   test_expect_u32(90, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
-  test_expect_u32(91, p_timing->timers[1].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
+  test_expect_u32(91, p_timing->p_timers[1].value);
 
   countdown = timing_set_firing(p_timing, t2, 0);
   test_expect_u32(299, countdown);
@@ -386,6 +389,45 @@ timing_test_simultaneous() {
   test_expect_u32(2, s_timing_test_order_t2);
 }
 
+static void
+timing_test_timer_fired_many(void* p) {
+  uint32_t id = (uint32_t) (uintptr_t) p;
+  int64_t now = (int64_t) timing_get_total_timer_ticks(s_p_timing_test_many);
+
+  /* Each timer expires at 1 + ((id * 37) % 101). */
+  test_expect_u32((1 + ((id * 37) % 101)), (uint32_t) now);
+  test_expect_u32(1, (now > s_timing_test_many_last));
+  s_timing_test_many_last = now;
+  s_timing_test_many_hits++;
+
+  (void) timing_stop_timer(s_p_timing_test_many, id);
+}
+
+static void
+timing_test_many() {
+  /* More timers than there used to be room for, expiring out of order. */
+  uint32_t i;
+
+  struct timing_struct* p_timing = timing_create(1);
+  s_p_timing_test_many = p_timing;
+
+  for (i = 0; i < 100; ++i) {
+    uint32_t id = timing_register_timer(p_timing,
+                                        timing_test_timer_fired_many,
+                                        (void*) (uintptr_t) i);
+    test_expect_u32(i, id);
+    (void) timing_start_timer_with_value(p_timing, id, (1 + ((i * 37) % 101)));
+  }
+  test_expect_u32(1, timing_get_countdown(p_timing));
+
+  (void) timing_advance_time_delta(p_timing, 200);
+  test_expect_u32(100, s_timing_test_many_hits);
+  test_expect_u32(0, p_timing->heap_size);
+  test_expect_u32(200, timing_get_total_timer_ticks(p_timing));
+
+  timing_destroy(p_timing);
+}
+
 void
 timing_test() {
   timing_test_counting();
@@ -393,4 +435,5 @@ timing_test() {
   timing_test_multi_expiry();
   timing_test_scaling();
   timing_test_simultaneous();
+  timing_test_many();
 }
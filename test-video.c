@@ -691,6 +691,245 @@ video_test_inactive_rendering() {
   test_expect_u32(1, g_p_video->clock_tick_multiplier);
 }
 
+static void
+video_test_write_log() {
+  /* Tests that writes which can't affect timing are logged while rendering,
+   * and applied at the right point in the raster when something catches up.
+   */
+  uint64_t num_crtc_advances;
+  int64_t countdown = timing_get_countdown(g_p_timing);
+
+  g_p_video->is_write_log_enabled = 1;
+  test_expect_u32(1, g_p_video->is_rendering_active);
+  num_crtc_advances = g_p_video->num_crtc_advances;
+
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  video_crtc_write(g_p_video, 0, k_crtc_reg_cursor_high);
+  video_crtc_write(g_p_video, 1, 0x12);
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  video_ula_write(g_p_video, 1, 0x00);
+  video_crtc_write(g_p_video, 0, k_crtc_reg_cursor_low);
+  video_crtc_write(g_p_video, 1, 0x34);
+
+  test_expect_u32(0, (g_p_video->num_crtc_advances - num_crtc_advances));
+  test_expect_u32(3, g_p_video->num_log_writes);
+  test_expect_u32(0, g_p_video->crtc_registers[k_crtc_reg_cursor_high]);
+  test_expect_u32(0, g_p_video->ula_palette[0]);
+  test_expect_u32(0, g_p_video->horiz_counter);
+
+  /* Reading a readable register catches up. */
+  test_expect_u32(0x34, video_crtc_read(g_p_video, 1));
+  test_expect_u32(1, (g_p_video->num_crtc_advances - num_crtc_advances));
+  test_expect_u32(0, g_p_video->num_log_writes);
+  test_expect_u32(0x12, g_p_video->crtc_registers[k_crtc_reg_cursor_high]);
+  test_expect_u32(7, g_p_video->ula_palette[0]);
+  test_expect_u32(10, g_p_video->horiz_counter);
+
+  /* A framing write catches up any logged writes first. */
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  video_ula_write(g_p_video, 1, 0x10);
+  test_expect_u32(1, g_p_video->num_log_writes);
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  video_crtc_write(g_p_video, 0, k_crtc_reg_vert_total);
+  video_crtc_write(g_p_video, 1, 30);
+  test_expect_u32(2, (g_p_video->num_crtc_advances - num_crtc_advances));
+  test_expect_u32(0, g_p_video->num_log_writes);
+  test_expect_u32(7, g_p_video->ula_palette[1]);
+  test_expect_u32(20, g_p_video->horiz_counter);
+
+  /* With the log off, every write catches up. */
+  g_p_video->is_write_log_enabled = 0;
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  video_ula_write(g_p_video, 1, 0x20);
+  test_expect_u32(3, (g_p_video->num_crtc_advances - num_crtc_advances));
+  test_expect_u32(0, g_p_video->num_log_writes);
+  test_expect_u32(7, g_p_video->ula_palette[2]);
+}
+
+static void
+video_test_write_log_timer() {
+  /* Tests that a logged write pulls a long video timer in to a scanline, so
+   * that the raster doesn't lag the write by more than that.
+   */
+  int64_t countdown = timing_get_countdown(g_p_timing);
+
+  g_p_video->is_write_log_enabled = 1;
+  countdown = timing_advance_time(g_p_timing,
+                                  (countdown - k_ticks_mode7_to_vsync_even));
+  video_advance_crtc_timing(g_p_video);
+  test_expect_u32(1, g_p_video->in_vsync);
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  test_expect_u32(((k_ticks_mode7_per_scanline * 2) - 10),
+                  video_test_get_timer());
+
+  video_ula_write(g_p_video, 1, 0xF0);
+  test_expect_u32(1, g_p_video->num_log_writes);
+  test_expect_u32(k_ticks_mode7_per_scanline, video_test_get_timer());
+  /* Further logged writes leave the timer alone. */
+  countdown = timing_get_countdown(g_p_timing);
+  countdown = timing_advance_time(g_p_timing, (countdown - 10));
+  video_crtc_write(g_p_video, 0, k_crtc_reg_mem_addr_low);
+  video_crtc_write(g_p_video, 1, 0xAA);
+  test_expect_u32(2, g_p_video->num_log_writes);
+  test_expect_u32((k_ticks_mode7_per_scanline - 10), video_test_get_timer());
+
+  /* When the timer fires, the log is applied. */
+  countdown = timing_advance_time(g_p_timing,
+                                  (countdown - video_test_get_timer()));
+  test_expect_u32(0, g_p_video->num_log_writes);
+  test_expect_u32(0xAA, g_p_video->crtc_registers[k_crtc_reg_mem_addr_low]);
+}
+
+static void
+video_test_render_frames(uint32_t* p_buffer, int is_threaded) {
+  uint32_t i;
+  int64_t countdown;
+
+  render_set_buffer(g_p_render, p_buffer);
+  if (is_threaded) {
+    render_start_thread(g_p_render);
+  }
+  for (i = 0; i < 0x10000; ++i) {
+    g_p_bbc_mem[i] = (i * 7);
+  }
+  g_video_test_framebuffer_ready_calls = 0;
+
+  /* A MODE7 frame, then a 2MHz one with palette changes down the screen. */
+  countdown = timing_get_countdown(g_p_timing);
+  countdown = timing_advance_time(g_p_timing,
+                                  (countdown - k_ticks_mode7_per_frame));
+  video_ula_write(g_p_video, 0, 0xF4);
+  countdown = timing_get_countdown(g_p_timing);
+  for (i = 0; i < 16; ++i) {
+    countdown = timing_advance_time(
+        g_p_timing, (countdown - (k_ticks_mode7_per_frame / 16)));
+    video_ula_write(g_p_video, 1, ((i << 4) | (i & 7)));
+    countdown = timing_get_countdown(g_p_timing);
+  }
+  countdown = timing_advance_time(g_p_timing,
+                                  (countdown - k_ticks_mode7_per_frame));
+
+  render_stop_thread(g_p_render);
+}
+
+static void
+video_test_render_thread() {
+  /* Tests that the render thread paints the same pixels, and flies back at
+   * the same points, as rendering on the CPU thread.
+   */
+  uint32_t num_paints;
+  uint32_t size = (render_get_width(g_p_render) *
+                   render_get_height(g_p_render) *
+                   4);
+  uint32_t* p_buffer = util_mallocz(size);
+  uint32_t* p_threaded_buffer = util_mallocz(size);
+
+  video_test_render_frames(p_buffer, 0);
+  num_paints = g_video_test_framebuffer_ready_calls;
+  test_expect_u32(1, (num_paints > 0));
+
+  video_test_end();
+  video_test_init();
+
+  video_test_render_frames(p_threaded_buffer, 1);
+  test_expect_u32(num_paints, g_video_test_framebuffer_ready_calls);
+  test_expect_u32(0, memcmp(p_buffer, p_threaded_buffer, size));
+
+  util_free(p_buffer);
+  util_free(p_threaded_buffer);
+}
+
+static void
+video_test_render_scanlines(struct render_struct* p_render,
+                            int mode,
+                            uint32_t num_frames) {
+  /* Renders frames of 312 scanlines straight through the renderer, a
+   * scanline of screen bytes at a time.
+   */
+  uint32_t i_frames;
+  uint32_t i_lines;
+  uint32_t i;
+  uint8_t line_data[80];
+
+  uint32_t num_cols = 80;
+  uint32_t pixels_size = 8;
+
+  if (mode >= k_render_mode4) {
+    num_cols = 40;
+    pixels_size = 16;
+  }
+
+  for (i_frames = 0; i_frames < num_frames; ++i_frames) {
+    render_vsync(p_render, 0);
+    for (i_lines = 0; i_lines < 312; ++i_lines) {
+      void (*func_render_blank)(struct render_struct*, uint8_t) =
+          render_get_render_blank_function(p_render);
+      for (i = 0; i < (176 / pixels_size); ++i) {
+        func_render_blank(p_render, 0);
+      }
+      for (i = 0; i < num_cols; ++i) {
+        line_data[i] = ((i_lines * 3) + (i * 7) + i_frames);
+      }
+      if (i_lines == 100) {
+        render_cursor(p_render);
+      }
+      render_data_span(p_render, line_data, num_cols);
+      render_hsync(p_render, 0);
+    }
+  }
+}
+
+static void
+video_test_render_span() {
+  /* Tests that the vector character copies paint the same pixels as one
+   * character at a time. bench_render times them.
+   */
+  static const char* s_p_flavors[] = { "video:no-simd", "video:no-avx2", "" };
+  static const int s_modes[] = { k_render_mode0, k_render_mode1,
+                                 k_render_mode2, k_render_mode4,
+                                 k_render_mode5, k_render_mode8,
+                                 k_render_mode7 };
+  uint32_t hashes[7];
+  uint32_t i_flavors;
+  uint32_t i_modes;
+  uint32_t i;
+
+  uint32_t size = (render_get_width(g_p_render) *
+                   render_get_height(g_p_render));
+  uint32_t* p_buffer = util_malloc(size * 4);
+
+  for (i_flavors = 0; i_flavors < 3; ++i_flavors) {
+    g_p_options.p_opt_flags = s_p_flavors[i_flavors];
+    for (i_modes = 0; i_modes < 7; ++i_modes) {
+      uint32_t hash = 2166136261u;
+      struct render_struct* p_render = render_create(g_p_teletext,
+                                                     &g_p_options);
+
+      render_set_buffer(p_render, p_buffer);
+      render_set_mode(p_render, s_modes[i_modes]);
+      render_set_cursor_segments(p_render, 0, 1, 1, 0);
+      for (i = 0; i < 16; ++i) {
+        render_set_palette(p_render, i, (0xff000000 | (i * 0x00102030)));
+      }
+
+      video_test_render_scanlines(p_render, s_modes[i_modes], 2);
+
+      for (i = 0; i < size; ++i) {
+        hash = ((hash ^ p_buffer[i]) * 16777619u);
+      }
+      if (i_flavors == 0) {
+        hashes[i_modes] = hash;
+      }
+      test_expect_u32(hashes[i_modes], hash);
+
+      render_destroy(p_render);
+    }
+  }
+
+  g_p_options.p_opt_flags = "";
+  util_free(p_buffer);
+}
+
 void
 video_test() {
   video_test_init();
@@ -724,4 +963,20 @@ video_test() {
   video_test_init();
   video_test_inactive_rendering();
   video_test_end();
+
+  video_test_init();
+  video_test_write_log();
+  video_test_end();
+
+  video_test_init();
+  video_test_write_log_timer();
+  video_test_end();
+
+  video_test_init();
+  video_test_render_thread();
+  video_test_end();
+
+  video_test_init();
+  video_test_render_span();
+  video_test_end();
 }
@@ -3,30 +3,43 @@
 #include "util.h"
 
 #include <assert.h>
+#include <string.h>
 
 enum {
-  k_timing_num_timers = 16,
+  k_timing_initial_max_timers = 16,
 };
 
 struct timer_struct {
   void (*p_callback)(void*);
   void* p_object;
+  /* While ticking, the absolute time at which the timer hits zero. Otherwise,
+   * the timer value itself.
+   */
   int64_t value;
   int ticking;
   int firing;
-  struct timer_struct* p_expiry_prev;
-  struct timer_struct* p_expiry_next;
-  struct timer_struct* p_ticking_prev;
-  struct timer_struct* p_ticking_next;
+  /* Position in the expiry heap, or -1. */
+  int32_t heap_index;
+  /* Breaks ties between timers expiring at the same time, first in first out. */
+  uint64_t expiry_seq;
 };
 
 struct timing_struct {
   uint32_t scale_factor;
-  struct timer_struct timers[k_timing_num_timers];
+  struct timer_struct* p_timers;
+  uint32_t num_timers;
+  uint32_t max_timers;
+
+  /* Binary min-heap of the ids of ticking, firing timers, soonest first. */
+  uint32_t* p_heap;
+  uint32_t heap_size;
+  uint64_t expiry_seq;
 
   uint64_t total_timer_ticks;
-  struct timer_struct* p_expiry_head;
-  struct timer_struct* p_ticking_head;
+  /* Absolute time as of the last countdown update. The current time is later
+   * by the countdown adjustment.
+   */
+  uint64_t base_time;
 
   uint64_t next_timer_expiry;
   uint64_t countdown;
@@ -38,8 +51,7 @@ timing_create(uint32_t scale_factor) {
 
   p_timing->scale_factor = scale_factor;
   p_timing->total_timer_ticks = 0;
-  p_timing->p_expiry_head = NULL;
-  p_timing->p_ticking_head = NULL;
+  p_timing->base_time = 0;
 
   p_timing->next_timer_expiry = INT64_MAX;
   p_timing->countdown = INT64_MAX;
@@ -49,6 +61,8 @@ timing_create(uint32_t scale_factor) {
 
 void
 timing_destroy(struct timing_struct* p_timing) {
+  util_free(p_timing->p_timers);
+  util_free(p_timing->p_heap);
   util_free(p_timing);
 }
 
@@ -63,18 +77,23 @@ timing_get_countdown_adjustment(struct timing_struct* p_timing) {
   return (p_timing->next_timer_expiry - p_timing->countdown);
 }
 
+static inline uint64_t
+timing_get_time(struct timing_struct* p_timing) {
+  return (p_timing->base_time + timing_get_countdown_adjustment(p_timing));
+}
+
 static uint64_t
 timing_update_counts(struct timing_struct* p_timing) {
   uint64_t countdown;
   uint64_t next_timer_expiry;
 
-  struct timer_struct* p_expiry_head = p_timing->p_expiry_head;
   uint64_t adjustment = timing_get_countdown_adjustment(p_timing);
 
-  if (p_expiry_head == NULL) {
+  if (p_timing->heap_size == 0) {
     next_timer_expiry = INT64_MAX;
   } else {
-    next_timer_expiry = p_expiry_head->value;
+    struct timer_struct* p_head = &p_timing->p_timers[p_timing->p_heap[0]];
+    next_timer_expiry = ((uint64_t) p_head->value - p_timing->base_time);
   }
 
   countdown = (next_timer_expiry - adjustment);
@@ -100,120 +119,177 @@ timing_get_scaled_total_timer_ticks(struct timing_struct* p_timing) {
   return (p_timing->total_timer_ticks / p_timing->scale_factor);
 }
 
+static void
+timing_grow_timers(struct timing_struct* p_timing) {
+  struct timer_struct* p_timers;
+  uint32_t* p_heap;
+
+  uint32_t num_timers = p_timing->num_timers;
+  uint32_t max_timers = (p_timing->max_timers * 2);
+
+  if (max_timers == 0) {
+    max_timers = k_timing_initial_max_timers;
+  }
+  if (max_timers > INT32_MAX) {
+    util_bail("out of timer ids");
+  }
+
+  p_timers = util_mallocz(max_timers * sizeof(struct timer_struct));
+  p_heap = util_mallocz(max_timers * sizeof(uint32_t));
+  if (num_timers > 0) {
+    (void) memcpy(p_timers,
+                  p_timing->p_timers,
+                  (num_timers * sizeof(struct timer_struct)));
+    (void) memcpy(p_heap,
+                  p_timing->p_heap,
+                  (p_timing->heap_size * sizeof(uint32_t)));
+  }
+  util_free(p_timing->p_timers);
+  util_free(p_timing->p_heap);
+
+  p_timing->p_timers = p_timers;
+  p_timing->p_heap = p_heap;
+  p_timing->max_timers = max_timers;
+}
+
 uint32_t
 timing_register_timer(struct timing_struct* p_timing,
                       void* p_callback,
                       void* p_object) {
-  uint32_t i;
+  uint32_t id;
   struct timer_struct* p_timer;
 
   assert(p_callback != NULL);
 
-  for (i = 0; i < k_timing_num_timers; ++i) {
-    if (p_timing->timers[i].p_callback == NULL) {
-      break;
-    }
-  }
-  if (i == k_timing_num_timers) {
-    util_bail("out of timer ids");
+  if (p_timing->num_timers == p_timing->max_timers) {
+    timing_grow_timers(p_timing);
   }
 
-  p_timer = &p_timing->timers[i];
+  id = p_timing->num_timers;
+  p_timing->num_timers++;
+  p_timer = &p_timing->p_timers[id];
 
   p_timer->p_callback = p_callback;
   p_timer->p_object = p_object;
   p_timer->value = INT64_MAX;
   p_timer->ticking = 0;
   p_timer->firing = 1;
-  p_timer->p_expiry_prev = NULL;
-  p_timer->p_expiry_next = NULL;
+  p_timer->heap_index = -1;
 
-  return i;
+  return id;
 }
 
-static void
-timing_insert_expiring_timer(struct timing_struct* p_timing,
-                             struct timer_struct* p_timer) {
-  struct timer_struct* p_iter = p_timing->p_expiry_head;
-  struct timer_struct* p_prev = NULL;
+static inline struct timer_struct*
+timing_get_timer(struct timing_struct* p_timing, uint32_t id) {
+  assert(id < p_timing->num_timers);
+  return &p_timing->p_timers[id];
+}
 
-  assert(p_timer->p_expiry_prev == NULL);
-  assert(p_timer->p_expiry_next == NULL);
-  assert(p_timer->ticking);
-  assert(p_timer->firing);
+static inline int
+timing_timer_is_before(struct timer_struct* p_timer1,
+                       struct timer_struct* p_timer2) {
+  /* Expiring timers are never behind the current time, so the deadlines
+   * compare without wrapping.
+   */
+  uint64_t value1 = (uint64_t) p_timer1->value;
+  uint64_t value2 = (uint64_t) p_timer2->value;
+  if (value1 != value2) {
+    return (value1 < value2);
+  }
+  return (p_timer1->expiry_seq < p_timer2->expiry_seq);
+}
+
+static inline void
+timing_heap_set(struct timing_struct* p_timing, uint32_t index, uint32_t id) {
+  p_timing->p_heap[index] = id;
+  p_timing->p_timers[id].heap_index = index;
+}
 
-  while ((p_iter != NULL) && (p_timer->value >= p_iter->value)) {
-    assert((p_prev == NULL) || (p_iter->value >= p_prev->value));
-    if (p_iter->p_expiry_next) {
-      assert(p_iter->p_expiry_next->p_expiry_prev == p_iter);
+static void
+timing_heap_sift_up(struct timing_struct* p_timing, uint32_t index) {
+  uint32_t* p_heap = p_timing->p_heap;
+  uint32_t id = p_heap[index];
+  struct timer_struct* p_timer = &p_timing->p_timers[id];
+
+  while (index > 0) {
+    uint32_t parent = ((index - 1) / 2);
+    uint32_t parent_id = p_heap[parent];
+    if (!timing_timer_is_before(p_timer, &p_timing->p_timers[parent_id])) {
+      break;
     }
-    p_prev = p_iter;
-    p_iter = p_iter->p_expiry_next;
+    timing_heap_set(p_timing, index, parent_id);
+    index = parent;
   }
+  timing_heap_set(p_timing, index, id);
+}
 
-  p_timer->p_expiry_prev = p_prev;
-  if (p_prev == NULL) {
-    p_timer->p_expiry_next = p_timing->p_expiry_head;
-    if (p_timing->p_expiry_head) {
-      p_timing->p_expiry_head->p_expiry_prev = p_timer;
+static void
+timing_heap_sift_down(struct timing_struct* p_timing, uint32_t index) {
+  uint32_t* p_heap = p_timing->p_heap;
+  uint32_t heap_size = p_timing->heap_size;
+  uint32_t id = p_heap[index];
+  struct timer_struct* p_timer = &p_timing->p_timers[id];
+
+  while (1) {
+    uint32_t child = ((index * 2) + 1);
+    uint32_t child_id;
+    if (child >= heap_size) {
+      break;
     }
-    p_timing->p_expiry_head = p_timer;
-  } else {
-    p_timer->p_expiry_next = p_prev->p_expiry_next;
-    if (p_prev->p_expiry_next) {
-      p_prev->p_expiry_next->p_expiry_prev = p_timer;
+    child_id = p_heap[child];
+    if ((child + 1) < heap_size) {
+      uint32_t right_id = p_heap[child + 1];
+      if (timing_timer_is_before(&p_timing->p_timers[right_id],
+                                 &p_timing->p_timers[child_id])) {
+        child++;
+        child_id = right_id;
+      }
     }
-    p_prev->p_expiry_next = p_timer;
+    if (!timing_timer_is_before(&p_timing->p_timers[child_id], p_timer)) {
+      break;
+    }
+    timing_heap_set(p_timing, index, child_id);
+    index = child;
   }
+  timing_heap_set(p_timing, index, id);
 }
 
 static void
-timing_remove_expiring_timer(struct timing_struct* p_timing,
+timing_insert_expiring_timer(struct timing_struct* p_timing,
                              struct timer_struct* p_timer) {
-  if (p_timer->p_expiry_prev) {
-    p_timer->p_expiry_prev->p_expiry_next = p_timer->p_expiry_next;
-  } else {
-    assert(p_timer == p_timing->p_expiry_head);
-    p_timing->p_expiry_head = p_timer->p_expiry_next;
-  }
-  if (p_timer->p_expiry_next) {
-    p_timer->p_expiry_next->p_expiry_prev = p_timer->p_expiry_prev;
-  }
+  uint32_t index = p_timing->heap_size;
 
-  p_timer->p_expiry_prev = NULL;
-  p_timer->p_expiry_next = NULL;
+  assert(p_timer->heap_index == -1);
+  assert(p_timer->ticking);
+  assert(p_timer->firing);
+
+  p_timer->expiry_seq = p_timing->expiry_seq++;
+  p_timing->heap_size++;
+  timing_heap_set(p_timing, index, (p_timer - p_timing->p_timers));
+  timing_heap_sift_up(p_timing, index);
 }
 
 static void
-timing_insert_ticking_timer(struct timing_struct* p_timing,
-                            struct timer_struct* p_timer) {
-  struct timer_struct* p_old_head = p_timing->p_ticking_head;
+timing_remove_expiring_timer(struct timing_struct* p_timing,
+                             struct timer_struct* p_timer) {
+  uint32_t last_id;
 
-  assert(p_timer->p_ticking_prev == NULL);
-  assert(p_timer->p_ticking_next == NULL);
+  int32_t index = p_timer->heap_index;
 
-  p_timing->p_ticking_head = p_timer;
-  p_timer->p_ticking_next = p_old_head;
-  if (p_old_head) {
-    p_old_head->p_ticking_prev = p_timer;
-  }
-}
+  assert(index >= 0);
+  assert(p_timing->p_heap[index] == (uint32_t) (p_timer - p_timing->p_timers));
 
-static void
-timing_remove_ticking_timer(struct timing_struct* p_timing,
-                            struct timer_struct* p_timer) {
-  if (p_timer->p_ticking_prev) {
-    p_timer->p_ticking_prev->p_ticking_next = p_timer->p_ticking_next;
-  } else {
-    assert(p_timer == p_timing->p_ticking_head);
-    p_timing->p_ticking_head = p_timer->p_ticking_next;
-  }
-  if (p_timer->p_ticking_next) {
-    p_timer->p_ticking_next->p_ticking_prev = p_timer->p_ticking_prev;
+  p_timer->heap_index = -1;
+  p_timing->heap_size--;
+  if ((uint32_t) index == p_timing->heap_size) {
+    return;
   }
 
-  p_timer->p_ticking_prev = NULL;
-  p_timer->p_ticking_next = NULL;
+  /* Plug the hole with the last entry, which may need to move either way. */
+  last_id = p_timing->p_heap[p_timing->heap_size];
+  timing_heap_set(p_timing, index, last_id);
+  timing_heap_sift_up(p_timing, index);
+  timing_heap_sift_down(p_timing, p_timing->p_timers[last_id].heap_index);
 }
 
 static int64_t
@@ -223,12 +299,12 @@ timing_start_timer_with_internal_value(struct timing_struct* p_timing,
   assert(p_timer->p_callback != NULL);
   assert(!p_timer->ticking);
 
-  value += timing_get_countdown_adjustment(p_timing);
-
-  p_timer->value = value;
+  /* While the timer ticks, store when it expires rather than its value, so
+   * that advancing time doesn't need to touch it.
+   */
+  p_timer->value = (int64_t) ((uint64_t) value + timing_get_time(p_timing));
   p_timer->ticking = 1;
 
-  timing_insert_ticking_timer(p_timing, p_timer);
   if (p_timer->firing) {
     timing_insert_expiring_timer(p_timing, p_timer);
   }
@@ -238,10 +314,8 @@ timing_start_timer_with_internal_value(struct timing_struct* p_timing,
 
 int64_t
 timing_start_timer(struct timing_struct* p_timing, uint32_t id) {
-  struct timer_struct* p_timer;
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
 
-  assert(id < k_timing_num_timers);
-  p_timer = &p_timing->timers[id];
   return timing_start_timer_with_internal_value(p_timing,
                                                 p_timer,
                                                 p_timer->value);
@@ -251,11 +325,7 @@ int64_t
 timing_start_timer_with_value(struct timing_struct* p_timing,
                               uint32_t id,
                               int64_t time) {
-  struct timer_struct* p_timer;
-
-  assert(id < k_timing_num_timers);
-
-  p_timer = &p_timing->timers[id];
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
 
   time *= p_timing->scale_factor;
 
@@ -264,47 +334,38 @@ timing_start_timer_with_value(struct timing_struct* p_timing,
 
 int64_t
 timing_stop_timer(struct timing_struct* p_timing, uint32_t id) {
-  struct timer_struct* p_timer;
-
-  assert(id < k_timing_num_timers);
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
 
-  p_timer = &p_timing->timers[id];
   assert(p_timer->p_callback != NULL);
   assert(p_timer->ticking);
 
   p_timer->ticking = 0;
 
-  timing_remove_ticking_timer(p_timing, p_timer);
   if (p_timer->firing) {
     timing_remove_expiring_timer(p_timing, p_timer);
   }
 
-  /* While the timer is not ticking, store the timer value directly. This
-   * avoids having to update it while the countdown ticks.
-   */
-  p_timer->value -= timing_get_countdown_adjustment(p_timing);
+  /* While the timer is not ticking, store the timer value directly. */
+  p_timer->value = (int64_t) ((uint64_t) p_timer->value -
+                              timing_get_time(p_timing));
 
   return timing_update_counts(p_timing);
 }
 
 int
 timing_timer_is_running(struct timing_struct* p_timing, uint32_t id) {
-  assert(id < k_timing_num_timers);
-
-  return p_timing->timers[id].ticking;
+  return timing_get_timer(p_timing, id)->ticking;
 }
 
 int64_t
 timing_get_timer_value(struct timing_struct* p_timing, uint32_t id) {
-  struct timer_struct* p_timer;
   int64_t ret;
 
-  assert(id < k_timing_num_timers);
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
 
-  p_timer = &p_timing->timers[id];
   ret = p_timer->value;
   if (p_timer->ticking) {
-    ret -= timing_get_countdown_adjustment(p_timing);
+    ret = (int64_t) ((uint64_t) ret - timing_get_time(p_timing));
   }
   ret /= p_timing->scale_factor;
   return ret;
@@ -314,16 +375,13 @@ int64_t
 timing_set_timer_value(struct timing_struct* p_timing,
                        uint32_t id,
                        int64_t time) {
-  struct timer_struct* p_timer;
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
 
-  assert(id < k_timing_num_timers);
-
-  p_timer = &p_timing->timers[id];
   assert(p_timer->p_callback != NULL);
 
   time *= p_timing->scale_factor;
   if (p_timer->ticking) {
-    time += timing_get_countdown_adjustment(p_timing);
+    time = (int64_t) ((uint64_t) time + timing_get_time(p_timing));
   }
 
   p_timer->value = time;
@@ -342,25 +400,24 @@ timing_adjust_timer_value(struct timing_struct* p_timing,
                           uint32_t id,
                           int64_t delta) {
   int64_t new_time;
-  struct timer_struct* p_timer;
 
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
   uint32_t scale_factor = p_timing->scale_factor;
 
-  assert(id < k_timing_num_timers);
-
-  p_timer = &p_timing->timers[id];
   assert(p_timer->p_callback != NULL);
 
   delta *= scale_factor;
 
-  new_time = (p_timer->value + delta);
+  new_time = (int64_t) ((uint64_t) p_timer->value + delta);
+  p_timer->value = new_time;
 
   if (p_new_value) {
+    if (p_timer->ticking) {
+      new_time = (int64_t) ((uint64_t) new_time - timing_get_time(p_timing));
+    }
     *p_new_value = (new_time / scale_factor);
   }
 
-  p_timer->value = new_time;
-
   if (p_timer->ticking && p_timer->firing) {
     timing_remove_expiring_timer(p_timing, p_timer);
     timing_insert_expiring_timer(p_timing, p_timer);
@@ -371,20 +428,15 @@ timing_adjust_timer_value(struct timing_struct* p_timing,
 
 int
 timing_get_firing(struct timing_struct* p_timing, uint32_t id) {
-  assert(id < k_timing_num_timers);
-
-  return p_timing->timers[id].firing;
+  return timing_get_timer(p_timing, id)->firing;
 }
 
 int64_t
 timing_set_firing(struct timing_struct* p_timing, uint32_t id, int firing) {
-  struct timer_struct* p_timer;
+  struct timer_struct* p_timer = timing_get_timer(p_timing, id);
 
   int firing_changed = 0;
 
-  assert(id < k_timing_num_timers);
-
-  p_timer = &p_timing->timers[id];
   if (firing != p_timer->firing) {
     firing_changed = 1;
     p_timer->firing = firing;
@@ -403,48 +455,47 @@ timing_set_firing(struct timing_struct* p_timing, uint32_t id, int firing) {
 
 static uint64_t
 timing_do_advance_time(struct timing_struct* p_timing, uint64_t delta) {
-  struct timer_struct* p_timer;
+  uint64_t time;
 
   delta += timing_get_countdown_adjustment(p_timing);
 
-  /* Pass 1: update all timers with their correct new value. */
-  p_timer = p_timing->p_ticking_head;
-  while (p_timer != NULL) {
-    assert(p_timer->ticking);
-    if (p_timer->p_expiry_next) {
-      assert(p_timer->p_expiry_next->p_expiry_prev == p_timer);
-    }
-    if (p_timer->p_ticking_next) {
-      assert(p_timer->p_ticking_next->p_ticking_prev == p_timer);
-    }
-
-    p_timer->value -= delta;
-
-    p_timer = p_timer->p_ticking_next;
-  }
+  /* Ticking timers hold their expiry time, so there's nothing to update
+   * per timer; just move time along.
+   */
+  time = (p_timing->base_time + delta);
+  p_timing->base_time = time;
 
   /* Clear the countdown adjustment. */
   p_timing->next_timer_expiry = 0;
   p_timing->countdown = 0;
 
-  /* Pass 2: fire any timers. */
-  p_timer = p_timing->p_expiry_head;
-  while ((p_timer != NULL) && (p_timer->value <= 0)) {
-    struct timer_struct* p_old_timer = p_timer;
+  /* Fire any timers, soonest first. */
+  while (p_timing->heap_size > 0) {
+    uint32_t id = p_timing->p_heap[0];
+    struct timer_struct* p_timer = &p_timing->p_timers[id];
+    uint64_t expiry_seq = p_timer->expiry_seq;
 
-    assert(p_old_timer->ticking);
-    assert(p_old_timer->firing);
+    if ((uint64_t) p_timer->value > time) {
+      break;
+    }
+
+    assert(p_timer->ticking);
+    assert(p_timer->firing);
 
     /* Callers of timing_do_advance_time() are required to expire active timers
      * exactly on time.
      */
-    assert(p_timer->value == 0);
-    /* Load the next timer, as calling the callback is likely to trash it. */
-    p_timer = p_timer->p_expiry_next;
-    p_old_timer->p_callback(p_old_timer->p_object);
-    assert(!p_old_timer->ticking ||
-           !p_old_timer->firing ||
-           (p_old_timer->value > 0));
+    assert((uint64_t) p_timer->value == time);
+    p_timer->p_callback(p_timer->p_object);
+    /* The callback may add timers and move the array. */
+    p_timer = &p_timing->p_timers[id];
+    assert(!p_timer->ticking ||
+           !p_timer->firing ||
+           ((uint64_t) p_timer->value > time));
+    /* A callback that left its timer alone would otherwise fire forever. */
+    if ((p_timer->heap_index == 0) && (p_timer->expiry_seq == expiry_seq)) {
+      break;
+    }
   }
 
   return timing_update_counts(p_timing);
@@ -279,6 +279,16 @@ util_file_open(const char* p_file_name, int writeable, int create) {
   return (struct util_file*) p_file;
 }
 
+int
+util_file_exists(const char* p_file_name) {
+  FILE* p_file = fopen(p_file_name, "rb");
+  if (p_file == NULL) {
+    return 0;
+  }
+  (void) fclose(p_file);
+  return 1;
+}
+
 void
 util_file_close(struct util_file* p) {
   int ret = fclose((FILE*) p);
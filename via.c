@@ -9,6 +9,13 @@
 
 #include <assert.h>
 
+enum {
+  /* Externally clocked ticks are applied at least this often, so the counter
+   * arithmetic stays well within range.
+   */
+  k_via_max_pending_ticks = (1 << 20),
+};
+
 enum {
   k_via_ORB =   0x0,
   k_via_ORA =   0x1,
@@ -64,12 +71,31 @@ struct via_struct {
   uint16_t T1L;
   uint16_t T2L;
   uint8_t t1_pb7;
+  /* T1 is in continuous mode with its interrupt already flagged, so its
+   * expiries only toggle PB7. Rather than firing a timer callback for each,
+   * they are caught up when T1 is next looked at.
+   */
+  int t1_lazy;
+  /* Externally clocked ticks not yet applied to the counters, while neither
+   * timer can raise an interrupt.
+   */
+  uint64_t pending_ticks;
   int CA1;
   int CA2;
   int CB1;
   int CB2;
 };
 
+static void
+via_t1_wake(struct via_struct* p_via) {
+  /* Callers must have caught T1 up, via via_get_t1c_raw(), first. */
+  if (!p_via->t1_lazy) {
+    return;
+  }
+  p_via->t1_lazy = 0;
+  (void) timing_set_firing(p_via->p_timing, p_via->t1_timer_id, 1);
+}
+
 static void
 via_check_interrupt(struct via_struct* p_via) {
   int level;
@@ -78,6 +104,11 @@ via_check_interrupt(struct via_struct* p_via) {
 
   assert(!(p_via->IER & 0x80));
 
+  /* Once the T1 interrupt is cleared, the next expiry needs to raise it. */
+  if (!(p_via->IFR & k_int_TIMER1)) {
+    via_t1_wake(p_via);
+  }
+
   if (p_via->IER & p_via->IFR) {
     p_via->IFR |= 0x80;
     level = 1;
@@ -129,6 +160,23 @@ via_get_t1c_raw(struct via_struct* p_via) {
 
   val -= 2;
 
+  if (p_via->t1_lazy) {
+    /* Catch up on the expiries that a firing timer would have handled, up to
+     * and including one due right now.
+     */
+    if (val <= -2) {
+      uint64_t delta = (-val - 2);
+      uint64_t relatch_cycles = ((p_via->T1L + 2) << 1);
+      uint64_t relatches = (delta / relatch_cycles);
+      relatches++;
+      val += (relatches * relatch_cycles);
+      p_via->t1_pb7 ^= (relatches & 1);
+
+      via_set_t1c_raw(p_via, val);
+    }
+    return val;
+  }
+
   /* If interrupts aren't firing, the timer will decrement indefinitely so we
    * have to fix it up with all of the re-latches.
    */
@@ -221,6 +269,11 @@ via_do_fire_t1(struct via_struct* p_via) {
   } else {
     int64_t delta = (p_via->T1L + 2);
     (void) timing_adjust_timer_value(p_timing, NULL, timer_id, (delta << 1));
+    /* The interrupt is now flagged, so until it is cleared, further expiries
+     * only toggle PB7.
+     */
+    timing_set_firing(p_timing, timer_id, 0);
+    p_via->t1_lazy = 1;
   }
 }
 
@@ -264,7 +317,7 @@ via_is_t1_firing(struct via_struct* p_via, int32_t ticks_add) {
   int32_t val;
   struct timing_struct* p_timing = p_via->p_timing;
   uint32_t timer_id = p_via->t1_timer_id;
-  if (!timing_get_firing(p_timing, timer_id)) {
+  if (!timing_get_firing(p_timing, timer_id) && !p_via->t1_lazy) {
     return 0;
   }
 
@@ -367,6 +420,8 @@ via_power_on_reset(struct via_struct* p_via) {
    */
   timing_set_firing(p_timing, t1_timer_id, 0);
   timing_set_firing(p_timing, t2_timer_id, 0);
+  p_via->t1_lazy = 0;
+  p_via->pending_ticks = 0;
 
   /* EMU: the counter values appear to be quasi-random on a real machine, but
    * we'll initialize them to 0xFFFF for deterministic behavior.
@@ -423,12 +478,35 @@ via_time_advance(struct via_struct* p_via, uint64_t ticks) {
   }
 }
 
+static void
+via_catch_up(struct via_struct* p_via) {
+  uint64_t ticks = p_via->pending_ticks;
+
+  if (ticks == 0) {
+    return;
+  }
+  p_via->pending_ticks = 0;
+  via_time_advance(p_via, ticks);
+}
+
 void
 via_apply_wall_time_delta(struct via_struct* p_via, uint64_t delta) {
+  struct timing_struct* p_timing = p_via->p_timing;
+
   if (!p_via->externally_clocked) {
     return;
   }
-  via_time_advance(p_via, delta);
+
+  /* Unless a timer could raise an interrupt, only the counter values and PB7
+   * move on, so leave that until the VIA is next accessed.
+   */
+  p_via->pending_ticks += delta;
+  if (timing_get_firing(p_timing, p_via->t1_timer_id) ||
+      (timing_get_firing(p_timing, p_via->t2_timer_id) &&
+       !(p_via->ACR & 0x20)) ||
+      (p_via->pending_ticks >= k_via_max_pending_ticks)) {
+    via_catch_up(p_via);
+  }
 }
 
 static uint8_t
@@ -538,14 +616,20 @@ via_read(struct via_struct* p_via, uint8_t reg) {
   int32_t t1_val;
   int32_t t2_val;
   uint8_t ret;
+  uint32_t ticks;
+  int t1_firing;
+  int t2_firing;
+  struct timing_struct* p_timing;
+
+  via_catch_up(p_via);
 
   /* Will T1/T2 interrupt fire at the mid cycle?
    * Work it out now because we can't tell after advancing the timing.
    */
-  uint32_t ticks = (state_6502_get_cycles(bbc_get_6502(p_via->p_bbc)) & 1);
-  int t1_firing = via_is_t1_firing(p_via, ticks);
-  int t2_firing = via_is_t2_firing(p_via, ticks);
-  struct timing_struct* p_timing = p_via->p_timing;
+  ticks = (state_6502_get_cycles(bbc_get_6502(p_via->p_bbc)) & 1);
+  t1_firing = via_is_t1_firing(p_via, ticks);
+  t2_firing = via_is_t2_firing(p_via, ticks);
+  p_timing = p_via->p_timing;
 
   /* Advance to the VIA mid-cycle.
    * EMU NOTE: do this first before processing the read. Interrupts fire at
@@ -673,14 +757,20 @@ via_write(struct via_struct* p_via, uint8_t reg, uint8_t val) {
   int32_t timer_val;
   int32_t t1_val;
   int32_t t2_val;
+  uint32_t ticks;
+  int t1_firing;
+  int t2_firing;
+  struct timing_struct* p_timing;
+
+  via_catch_up(p_via);
 
   /* Will T1/T2 interrupt fire at the mid cycle?
    * Work it out now because we can't tell after advancing the timing.
    */
-  uint32_t ticks = (state_6502_get_cycles(bbc_get_6502(p_via->p_bbc)) & 1);
-  int t1_firing = via_is_t1_firing(p_via, ticks);
-  int t2_firing = via_is_t2_firing(p_via, ticks);
-  struct timing_struct* p_timing = p_via->p_timing;
+  ticks = (state_6502_get_cycles(bbc_get_6502(p_via->p_bbc)) & 1);
+  t1_firing = via_is_t1_firing(p_via, ticks);
+  t2_firing = via_is_t2_firing(p_via, ticks);
+  p_timing = p_via->p_timing;
 
   /* TODO: the way things have worked out, it looks like we'll have less
    * complexity if we apply the write right away and then fix up. There will
@@ -743,6 +833,7 @@ via_write(struct via_struct* p_via, uint8_t reg, uint8_t val) {
     }
     p_via->T1L = ((val << 8) | (p_via->T1L & 0xFF));
     via_load_T1(p_via);
+    p_via->t1_lazy = 0;
     timing_set_firing(p_timing, p_via->t1_timer_id, 1);
     /* EMU TODO: does this behave differently if t1_firing as well? */
     p_via->t1_pb7 = 0;
@@ -799,6 +890,10 @@ via_write(struct via_struct* p_via, uint8_t reg, uint8_t val) {
      * See: tests.ssd:VIA.AC3
      * See: tests.ssd:VIA.AC2
      */
+    if (!(val & 0x40)) {
+      /* Back to one-shot, which needs the next expiry to fire. */
+      via_t1_wake(p_via);
+    }
     if (t1_firing && (!(val & 0x40))) {
       timing_set_firing(p_timing, p_via->t1_timer_id, 0);
     }
@@ -945,6 +1040,8 @@ via_get_registers(struct via_struct* p_via,
                   uint8_t* p_t1_pb7) {
   struct timing_struct* p_timing = p_via->p_timing;
 
+  via_catch_up(p_via);
+
   *p_ORA = p_via->ORA;
   *p_ORB = p_via->ORB;
   *p_DDRA = p_via->DDRA;
@@ -960,7 +1057,8 @@ via_get_registers(struct via_struct* p_via,
   *p_T1L = p_via->T1L;
   *p_T2C_raw = via_get_t2c_raw(p_via);
   *p_T2L = p_via->T2L;
-  *p_t1_oneshot_fired = !timing_get_firing(p_timing, p_via->t1_timer_id);
+  *p_t1_oneshot_fired = (!timing_get_firing(p_timing, p_via->t1_timer_id) &&
+                         !p_via->t1_lazy);
   *p_t2_oneshot_fired = !timing_get_firing(p_timing, p_via->t2_timer_id);
   *p_t1_pb7 = p_via->t1_pb7;
 }
@@ -997,6 +1095,8 @@ void via_set_registers(struct via_struct* p_via,
   p_via->IER = IER;
   p_via->peripheral_a = peripheral_a;
   p_via->peripheral_b = peripheral_b;
+  p_via->t1_lazy = 0;
+  p_via->pending_ticks = 0;
   via_set_t1c_raw(p_via, T1C_raw);
   p_via->T1L = T1L;
   via_set_t2c_raw(p_via, T2C_raw);
@@ -71,6 +71,22 @@ enum {
   k_crtc_reg_light_pen_low = 17,
 };
 
+enum {
+  k_video_write_log_size = 1024,
+};
+
+enum {
+  k_video_write_crtc = 0,
+  k_video_write_ula = 1,
+};
+
+struct video_write {
+  uint64_t ticks;
+  uint8_t type;
+  uint8_t reg;
+  uint8_t val;
+};
+
 struct video_struct {
   uint8_t* p_bbc_mem;
   int externally_clocked;
@@ -102,6 +118,16 @@ struct video_struct {
   uint64_t num_vsyncs;
   uint64_t num_crtc_advances;
 
+  /* Register write log. While rendering is active, CRTC and ULA writes that
+   * can't move the next vsync are queued here with their time, instead of
+   * each one catching up the raster. The next advance replays them in order.
+   * Writes to R0 - R9 can move vsync, so they still catch up straight away.
+   * Off by default: screen RAM is read after the write rather than at it.
+   */
+  int is_write_log_enabled;
+  uint32_t num_log_writes;
+  struct video_write write_log[k_video_write_log_size];
+
   /* Video ULA state and derivatives. */
   uint8_t video_ula_control;
   uint8_t ula_palette[16];
@@ -152,6 +178,9 @@ struct video_struct {
   int is_first_frame_scanline;
 };
 
+static void video_apply_logged_write(struct video_struct* p_video,
+                                     struct video_write* p_write);
+
 static inline uint32_t
 video_calculate_bbc_address(uint32_t* p_out_screen_address,
                             uint32_t address_counter,
@@ -311,7 +340,7 @@ video_set_vsync_lower_state(struct video_struct* p_video) {
     via_set_CA1(p_system_via, 0);
   }
 
-  teletext_VSYNC_changed(p_video->p_teletext, 0);
+  render_teletext_VSYNC_changed(p_video->p_render, 0);
 }
 
 static inline int
@@ -340,7 +369,8 @@ video_update_odd_even_frame(struct video_struct* p_video) {
 }
 
 static void
-video_advance_crtc_timing(struct video_struct* p_video) {
+video_advance_crtc_timing_to(struct video_struct* p_video,
+                             uint64_t curr_system_ticks) {
   uint32_t bbc_address;
   uint8_t data;
   uint64_t delta_crtc_ticks;
@@ -359,8 +389,6 @@ video_advance_crtc_timing(struct video_struct* p_video) {
 
   struct render_struct* p_render = p_video->p_render;
   uint8_t* p_bbc_mem = p_video->p_bbc_mem;
-  uint64_t curr_system_ticks =
-      timing_get_scaled_total_timer_ticks(p_video->p_timing);
   int clock_speed = video_get_clock_speed(p_video);
 
   uint32_t r0 = p_video->crtc_registers[k_crtc_reg_horiz_total];
@@ -380,15 +408,6 @@ video_advance_crtc_timing(struct video_struct* p_video) {
   void (*func_render_blank)(struct render_struct*, uint8_t) =
       render_get_render_blank_function(p_render);
 
-  if (p_video->externally_clocked) {
-    return;
-  }
-
-  p_video->timer_fire_force_vsync_start = 0;
-  p_video->timer_fire_force_vsync_end = 0;
-
-  p_video->num_crtc_advances++;
-
   delta_crtc_ticks = (curr_system_ticks - p_video->prev_system_ticks);
   assert(delta_crtc_ticks < INT_MAX);
 
@@ -450,7 +469,7 @@ video_advance_crtc_timing(struct video_struct* p_video) {
       func_render = func_render_blank;
       p_video->address_counter_next_row = p_video->address_counter;
       if (p_video->display_enable_vert) {
-        teletext_DISPMTG_changed(p_video->p_teletext, 0);
+        render_teletext_DISPMTG_changed(p_render, 0);
       }
     }
     if (check_vsync_at_half_r0 &&
@@ -602,6 +621,82 @@ check_r7:
   p_video->prev_system_ticks = curr_system_ticks;
 }
 
+static void
+video_advance_crtc_timing(struct video_struct* p_video) {
+  uint32_t i;
+
+  if (p_video->externally_clocked) {
+    return;
+  }
+
+  p_video->timer_fire_force_vsync_start = 0;
+  p_video->timer_fire_force_vsync_end = 0;
+
+  p_video->num_crtc_advances++;
+
+  /* Apply any logged writes at the point in the raster they were made. */
+  for (i = 0; i < p_video->num_log_writes; ++i) {
+    struct video_write* p_write = &p_video->write_log[i];
+    video_advance_crtc_timing_to(p_video, p_write->ticks);
+    video_apply_logged_write(p_video, p_write);
+  }
+  p_video->num_log_writes = 0;
+
+  video_advance_crtc_timing_to(
+      p_video,
+      timing_get_scaled_total_timer_ticks(p_video->p_timing));
+}
+
+static inline int
+video_can_log_write(struct video_struct* p_video) {
+  /* Outside of rendering, these writes don't catch up the raster anyway. */
+  if (!p_video->is_write_log_enabled || !p_video->is_rendering_active) {
+    return 0;
+  }
+  if (p_video->externally_clocked) {
+    return 0;
+  }
+  return (p_video->num_log_writes < k_video_write_log_size);
+}
+
+static void
+video_log_write(struct video_struct* p_video,
+                uint8_t type,
+                uint8_t reg,
+                uint8_t val) {
+  struct video_write* p_write;
+
+  if (p_video->num_log_writes == 0) {
+    /* Without the log, this write would have caught up the raster, and read
+     * screen RAM, up to now. The video timer may be set as far out as the next
+     * vsync, so pull it in to at most a scanline from now. That way, screen RAM
+     * is read at most a scanline later than it used to be.
+     */
+    int64_t max_timer_value =
+        ((p_video->crtc_registers[k_crtc_reg_horiz_total] + 1) *
+         p_video->clock_tick_multiplier);
+    if (timing_get_timer_value(p_video->p_timing, p_video->timer_id) >
+        max_timer_value) {
+      (void) timing_set_timer_value(p_video->p_timing,
+                                    p_video->timer_id,
+                                    max_timer_value);
+    }
+  }
+
+  p_write = &p_video->write_log[p_video->num_log_writes++];
+  p_write->ticks = timing_get_scaled_total_timer_ticks(p_video->p_timing);
+  p_write->type = type;
+  p_write->reg = reg;
+  p_write->val = val;
+}
+
+static inline void
+video_flush_write_log(struct video_struct* p_video) {
+  if (p_video->num_log_writes > 0) {
+    video_advance_crtc_timing(p_video);
+  }
+}
+
 static void
 video_init_timer(struct video_struct* p_video) {
   if (p_video->externally_clocked) {
@@ -1035,6 +1130,7 @@ video_create(uint8_t* p_bbc_mem,
   p_video->vsync_next_time = 0;
   p_video->num_vsyncs = 0;
   p_video->num_crtc_advances = 0;
+  p_video->num_log_writes = 0;
 
   p_video->timer_id = timing_register_timer(p_timing,
                                             video_timer_fired,
@@ -1051,6 +1147,8 @@ video_create(uint8_t* p_bbc_mem,
   (void) util_get_u32_option(&p_video->render_every_ticks,
                              p_options->p_opt_flags,
                              "video:render-every-ticks=");
+  p_video->is_write_log_enabled = util_has_option(p_options->p_opt_flags,
+                                                  "video:write-log");
 
   if (p_system_via) {
     via_set_CB2_changed_callback(p_system_via,
@@ -1223,6 +1321,7 @@ video_power_on_reset(struct video_struct* p_video) {
   p_video->timer_fire_force_vsync_end = 0;
   p_video->frame_skip_counter = 0;
   p_video->prev_system_ticks = 0;
+  p_video->num_log_writes = 0;
 
   /* Deliberately don't reset the counters. */
 
@@ -1240,6 +1339,16 @@ video_get_num_crtc_advances(struct video_struct* p_video) {
   return p_video->num_crtc_advances;
 }
 
+void
+video_testing_stop_rendering(struct video_struct* p_video) {
+  /* Rendering stays off, as in fast mode after a paint, but with no wall time
+   * tick to turn it back on.
+   */
+  video_advance_crtc_timing(p_video);
+  p_video->is_rendering_active = 0;
+  p_video->is_wall_time_vsync_hit = 0;
+}
+
 struct render_struct*
 video_get_render(struct video_struct* p_video) {
   return p_video->p_render;
@@ -1281,9 +1390,9 @@ video_render_full_frame(struct video_struct* p_video) {
   uint32_t i_rows;
   uint32_t crtc_line_address;
 
+  uint8_t line_data[256];
+
   struct render_struct* p_render = p_video->p_render;
-  void (*func_render_data)(struct render_struct*, uint8_t) =
-      render_get_render_data_function(p_render);
   void (*func_render_blank)(struct render_struct*, uint8_t) =
       render_get_render_blank_function(p_render);
 
@@ -1343,9 +1452,10 @@ video_render_full_frame(struct video_struct* p_video) {
                                                   crtc_line_address,
                                                   i_lines,
                                                   screen_wrap_add);
-        func_render_data(p_render, p_bbc_mem[bbc_address]);
+        line_data[i_cols] = p_bbc_mem[bbc_address];
         crtc_line_address++;
       }
+      render_data_span(p_render, line_data, num_cols);
       (void) render_hsync(p_render, hsync_pulse_ticks);
       teletext_DISPMTG_changed(p_teletext, 0);
     }
@@ -1390,8 +1500,8 @@ video_framing_changed(struct video_struct* p_video) {
   video_update_timer(p_video);
 }
 
-void
-video_ula_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
+static void
+video_ula_apply_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
   uint8_t index;
   uint8_t rgbf;
 
@@ -1400,11 +1510,7 @@ video_ula_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
   int new_clock_speed;
   int old_clock_speed;
 
-  if (p_video->is_rendering_active) {
-    video_advance_crtc_timing(p_video);
-  }
-
-  if (addr == 1) {
+  if (addr == k_ula_addr_palette) {
     /* Palette register. */
     index = (val >> 4);
     /* The xor is to map incoming color to real physical color. e.g. MOS writes
@@ -1459,6 +1565,23 @@ video_ula_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
   video_mode_updated(p_video);
 }
 
+void
+video_ula_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
+  /* Only a clock speed change affects CRTC timing. */
+  if (video_can_log_write(p_video) &&
+      ((addr == k_ula_addr_palette) ||
+       (!!(val & k_ula_clock_speed) == video_get_clock_speed(p_video)))) {
+    video_log_write(p_video, k_video_write_ula, addr, val);
+    return;
+  }
+
+  if (p_video->is_rendering_active) {
+    video_advance_crtc_timing(p_video);
+  }
+
+  video_ula_apply_write(p_video, addr, val);
+}
+
 uint8_t
 video_crtc_read(struct video_struct* p_video, uint8_t addr) {
   uint8_t reg;
@@ -1487,6 +1610,7 @@ video_crtc_read(struct video_struct* p_video, uint8_t addr) {
   case k_crtc_reg_cursor_low:
   case k_crtc_reg_light_pen_high:
   case k_crtc_reg_light_pen_low:
+    video_flush_write_log(p_video);
     return p_video->crtc_registers[reg];
   default:
     break;
@@ -1507,6 +1631,56 @@ video_update_cursor_disabled(struct video_struct* p_video) {
   p_video->cursor_disabled = cursor_disabled;
 }
 
+static void
+video_crtc_apply_write(struct video_struct* p_video, uint8_t reg, uint8_t val) {
+  p_video->crtc_registers[reg] = val;
+
+  switch (reg) {
+  case k_crtc_reg_horiz_total:
+    p_video->half_r0 = ((p_video->crtc_registers[k_crtc_reg_horiz_total] + 1) /
+                        2);
+    break;
+  case k_crtc_reg_interlace:
+    p_video->is_interlace = (val & 0x1);
+    p_video->is_interlace_sync_and_video = ((val & 0x3) == 0x3);
+    p_video->is_master_display_enable = ((val & 0x30) != 0x30);
+    if (p_video->is_interlace_sync_and_video) {
+      p_video->scanline_stride = 2;
+      p_video->scanline_mask = 0x1E;
+    } else {
+      p_video->scanline_stride = 1;
+      p_video->scanline_mask = 0x1F;
+    }
+    video_update_odd_even_frame(p_video);
+    video_update_cursor_disabled(p_video);
+    break;
+  case k_crtc_reg_cursor_start:
+    p_video->cursor_flashing = !!(val & 0x40);
+    if (val & 0x20) {
+      p_video->cursor_flash_mask = 0x10;
+    } else {
+      p_video->cursor_flash_mask = 0x08;
+    }
+    p_video->cursor_start_line = (val & 0x1F);
+    video_update_cursor_disabled(p_video);
+    break;
+  default:
+    break;
+  }
+
+  if (p_video->is_interlace_sync_and_video) {
+    /* EMU NOTE: interlace sync and video has a different behavior when
+     * programmed with an odd number in R9.
+     * The Hitachi datasheet covers it on page "92":
+     * https://www.cpcwiki.eu/imgs/c/c0/Hd6845.hitachi.pdf
+     * Since MODE7 doesn't use it, it's simplest to not emulate it, and this
+     * helps avoid headaches when CRTC registers are half-way programmed
+     * from MODE7 -> non-MODE7.
+     */
+     p_video->scanline_counter &= ~1;
+  }
+}
+
 void
 video_crtc_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
   uint8_t reg;
@@ -1621,59 +1795,21 @@ video_crtc_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
     break;
   }
 
+  val &= mask;
+
+  if (does_not_change_framing && video_can_log_write(p_video)) {
+    video_log_write(p_video, k_video_write_crtc, reg, val);
+    return;
+  }
+
   if (p_video->is_rendering_active || !does_not_change_framing) {
     video_advance_crtc_timing(p_video);
   }
 
-  p_video->crtc_registers[reg] = (val & mask);
-
-  switch (reg) {
-  case k_crtc_reg_horiz_total:
-    p_video->half_r0 = ((p_video->crtc_registers[k_crtc_reg_horiz_total] + 1) /
-                        2);
-    break;
-  case k_crtc_reg_sync_width:
+  video_crtc_apply_write(p_video, reg, val);
+  if (reg == k_crtc_reg_sync_width) {
     p_video->hsync_pulse_width = hsync_pulse_width;
     p_video->vsync_pulse_width = vsync_pulse_width;
-    break;
-  case k_crtc_reg_interlace:
-    p_video->is_interlace = (val & 0x1);
-    p_video->is_interlace_sync_and_video = ((val & 0x3) == 0x3);
-    p_video->is_master_display_enable = ((val & 0x30) != 0x30);
-    if (p_video->is_interlace_sync_and_video) {
-      p_video->scanline_stride = 2;
-      p_video->scanline_mask = 0x1E;
-    } else {
-      p_video->scanline_stride = 1;
-      p_video->scanline_mask = 0x1F;
-    }
-    video_update_odd_even_frame(p_video);
-    video_update_cursor_disabled(p_video);
-    break;
-  case k_crtc_reg_cursor_start:
-    p_video->cursor_flashing = !!(val & 0x40);
-    if (val & 0x20) {
-      p_video->cursor_flash_mask = 0x10;
-    } else {
-      p_video->cursor_flash_mask = 0x08;
-    }
-    p_video->cursor_start_line = (val & 0x1F);
-    video_update_cursor_disabled(p_video);
-    break;
-  default:
-    break;
-  }
-
-  if (p_video->is_interlace_sync_and_video) {
-    /* EMU NOTE: interlace sync and video has a different behavior when
-     * programmed with an odd number in R9.
-     * The Hitachi datasheet covers it on page "92":
-     * https://www.cpcwiki.eu/imgs/c/c0/Hd6845.hitachi.pdf
-     * Since MODE7 doesn't use it, it's simplest to not emulate it, and this
-     * helps avoid headaches when CRTC registers are half-way programmed
-     * from MODE7 -> non-MODE7.
-     */
-     p_video->scanline_counter &= ~1;
   }
 
   if (!does_not_change_framing) {
@@ -1691,8 +1827,20 @@ video_crtc_write(struct video_struct* p_video, uint8_t addr, uint8_t val) {
   }
 }
 
+static void
+video_apply_logged_write(struct video_struct* p_video,
+                         struct video_write* p_write) {
+  if (p_write->type == k_video_write_crtc) {
+    video_crtc_apply_write(p_video, p_write->reg, p_write->val);
+  } else {
+    assert(p_write->type == k_video_write_ula);
+    video_ula_apply_write(p_video, p_write->reg, p_write->val);
+  }
+}
+
 uint8_t
 video_get_ula_control(struct video_struct* p_video) {
+  video_flush_write_log(p_video);
   return p_video->video_ula_control;
 }
 
@@ -1705,6 +1853,7 @@ void
 video_get_ula_full_palette(struct video_struct* p_video,
                            uint8_t* p_values) {
   size_t i;
+  video_flush_write_log(p_video);
   for (i = 0; i < 16; ++i) {
     p_values[i] = p_video->ula_palette[i];
   }
@@ -1725,6 +1874,7 @@ void
 video_get_crtc_registers(struct video_struct* p_video,
                          uint8_t* p_values) {
   uint32_t i;
+  video_flush_write_log(p_video);
   for (i = 0; i < k_crtc_num_registers; ++i) {
     p_values[i] = p_video->crtc_registers[i];
   }
@@ -1734,6 +1884,8 @@ void
 video_set_crtc_registers(struct video_struct* p_video,
                          const uint8_t* p_values) {
   uint32_t i;
+  /* Logged writes mustn't land on top of these later. */
+  video_flush_write_log(p_video);
   for (i = 0; i < k_crtc_num_registers; ++i) {
     p_video->crtc_registers[i] = p_values[i];
   }
@@ -43,6 +43,8 @@ void video_crtc_write(struct video_struct* p_video, uint8_t addr, uint8_t val);
 
 void video_render_full_frame(struct video_struct* p_video);
 
+void video_testing_stop_rendering(struct video_struct* p_video);
+
 uint8_t video_get_ula_control(struct video_struct* p_video);
 void video_set_ula_control(struct video_struct* p_video, uint8_t val);
 void video_get_ula_full_palette(struct video_struct* p_video,